@@ -1,43 +1,180 @@
 #include "board.h"
 #include "move_generator.h"
+#include "perft.h"
 #include "utils.h"
 
-int main(int argc, char* argv[])
+namespace
 {
-  using namespace Meneldor;
+using namespace Meneldor;
+
+constexpr std::string_view c_usage{
+  "Usage: perft [depth] [fen] [--threads N] [--hash MB] [--divide]\n"
+  "       perft --epd [file] [--max-depth N] [--threads N] [--hash MB]\n"};
+
+[[noreturn]] void exit_with_usage()
+{
+  std::cerr << c_usage;
+  exit(-1);
+}
 
-  if (argc != 2 && argc != 3)
+int parse_int(char const* arg)
+{
+  try
   {
-    std::cerr << "Usage: perft [depth] [fen]\n";
-    exit(-1);
+    return std::stoi(arg);
+  }
+  catch (std::exception const& err)
+  {
+    std::cerr << err.what() << "\n";
+    exit_with_usage();
+  }
+}
+
+// Runs every position of the suite to each depth it lists, up to max_depth,
+// and returns the number of counts that didn't match
+int run_suite(std::vector<Perft_suite_position> const& positions, int max_depth, Perft& perft)
+{
+  int failures{0};
+  uint64_t total_nodes{0};
+  std::atomic_flag is_cancelled{};
+  auto const start = std::chrono::system_clock::now();
+  for (auto const& position : positions)
+  {
+    auto const board = Board::from_fen(position.fen);
+    if (!board)
+    {
+      std::cerr << "Invalid fen string: " << position.fen << "\n";
+      ++failures;
+      continue;
+    }
+
+    std::cout << position.fen << "\n";
+    auto const depths = std::min(static_cast<int>(position.expected_nodes.size()), max_depth);
+    for (int depth{1}; depth <= depths; ++depth)
+    {
+      auto const expected = position.expected_nodes[static_cast<size_t>(depth - 1)];
+      auto const position_start = std::chrono::system_clock::now();
+      auto const nodes = perft.count(depth, *board, is_cancelled);
+      std::chrono::duration<double> const elapsed = std::chrono::system_clock::now() - position_start;
+      total_nodes += nodes;
+
+      std::cout << "  D" << depth << " " << format_with_commas(nodes);
+      if (nodes == expected)
+      {
+        std::cout << " OK";
+      }
+      else
+      {
+        std::cout << " FAILED, expected " << format_with_commas(expected);
+        ++failures;
+      }
+      std::cout << " (" << std::to_string(elapsed.count()) << " seconds)\n";
+    }
   }
+  std::chrono::duration<double> const elapsed = std::chrono::system_clock::now() - start;
 
+  std::cout << "Positions: " << positions.size() << ", failures: " << failures << "\n";
+  std::cout << "Total nodes: " << format_with_commas(total_nodes) << "\n";
+  std::cout << "Elapsed time: " << std::to_string(elapsed.count()) << " seconds\n";
+  std::cout << "Nodes/sec: " << format_with_commas(static_cast<double>(total_nodes) / elapsed.count()) << "\n";
+  return failures;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
   int depth{0};
-  try
+  std::string starting_position = c_start_position_fen;
+  std::optional<std::string> epd_filename;
+  int max_depth{std::numeric_limits<int>::max()};
+  size_t thread_count{std::max(std::thread::hardware_concurrency(), 1u)};
+  size_t hash_size_mb{0};
+  bool divide{false};
+
+  std::vector<std::string_view> positional;
+  for (int i{1}; i < argc; ++i)
   {
-    depth = std::stoi(argv[1]);
+    std::string_view const arg{argv[i]};
+    if (arg == "--threads" && i + 1 < argc)
+    {
+      thread_count = static_cast<size_t>(std::max(parse_int(argv[++i]), 1));
+    }
+    else if (arg == "--hash" && i + 1 < argc)
+    {
+      hash_size_mb = static_cast<size_t>(std::max(parse_int(argv[++i]), 0));
+    }
+    else if (arg == "--max-depth" && i + 1 < argc)
+    {
+      max_depth = parse_int(argv[++i]);
+    }
+    else if (arg == "--divide")
+    {
+      divide = true;
+    }
+    else if (arg == "--epd")
+    {
+      epd_filename = (i + 1 < argc && !std::string_view{argv[i + 1]}.starts_with("--")) ? argv[++i] :
+                                                                                           "data/perftsuite.epd";
+    }
+    else if (arg.starts_with("--"))
+    {
+      exit_with_usage();
+    }
+    else
+    {
+      positional.push_back(arg);
+    }
   }
-  catch (std::invalid_argument const& err)
+
+  Perft perft{thread_count, hash_size_mb * 1024 * 1024};
+
+  if (epd_filename)
   {
-    std::cerr << err.what();
-    exit(-1);
+    if (!positional.empty())
+    {
+      exit_with_usage();
+    }
+    auto const positions = Perft::load_suite(*epd_filename);
+    if (!positions)
+    {
+      std::cerr << positions.error() << "\n";
+      exit(-1);
+    }
+    return (run_suite(*positions, max_depth, perft) == 0) ? 0 : -1;
   }
 
-  std::string starting_position = c_start_position_fen;
-  if (argc == 3)
+  if (positional.empty() || positional.size() > 2)
   {
-    starting_position = argv[2];
+    exit_with_usage();
+  }
+  depth = parse_int(positional[0].data());
+  if (positional.size() == 2)
+  {
+    starting_position = positional[1];
   }
 
   auto board = Board::from_fen(starting_position);
   if (!board)
   {
     std::cerr << "Invalid fen string\n";
+    exit(-1);
   }
 
   auto const start = std::chrono::system_clock::now();
   std::atomic_flag is_cancelled{};
-  auto result = Move_generator::perft(depth, *board, is_cancelled);
+  uint64_t result{0};
+  if (divide && depth > 0)
+  {
+    for (auto const& entry : perft.divide(depth, *board, is_cancelled))
+    {
+      std::cout << entry.move << ": " << std::to_string(entry.nodes) << "\n";
+      result += entry.nodes;
+    }
+  }
+  else
+  {
+    result = perft.count(depth, *board, is_cancelled);
+  }
   auto const end = std::chrono::system_clock::now();
   std::chrono::duration<double> const elapsed = end - start;
   auto const elapsed_seconds = elapsed.count();
@@ -45,6 +182,8 @@ int main(int argc, char* argv[])
   std::cout << "perft(" << std::to_string(depth) << ") = " << std::to_string(result) << "\n";
   std::cout << "Elapsed time: " << std::to_string(elapsed_seconds) << " seconds\n";
   std::cout << "Nodes/sec: " << format_with_commas(result / elapsed_seconds) << "\n";
+  std::cout << "Slider attacks: " << Move_generator::get_slider_backend() << "\n";
+  std::cout << "Threads: " << thread_count << ", hash: " << hash_size_mb << " MB\n";
 
   return 0;
 }
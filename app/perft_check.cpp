@@ -0,0 +1,133 @@
+#include "perft.h"
+#include "perft_checker.h"
+#include "utils.h"
+
+namespace
+{
+using namespace Meneldor;
+
+constexpr std::string_view c_usage{"Usage: perft_check [depth] [fen] [--threads N]\n"
+                                   "       perft_check --epd [file] [--max-depth N] [--threads N]\n"};
+
+[[noreturn]] void exit_with_usage()
+{
+  std::cerr << c_usage;
+  exit(-1);
+}
+
+int parse_int(char const* arg)
+{
+  try
+  {
+    return std::stoi(arg);
+  }
+  catch (std::exception const& err)
+  {
+    std::cerr << err.what() << "\n";
+    exit_with_usage();
+  }
+}
+
+// Returns false if the generators disagree or the position can't be read
+bool check_position(std::string_view fen, int depth, size_t thread_count)
+{
+  auto const start = std::chrono::system_clock::now();
+  auto const result = Perft_checker::check(fen, depth, thread_count);
+  std::chrono::duration<double> const elapsed = std::chrono::system_clock::now() - start;
+  if (!result)
+  {
+    std::cerr << result.error() << "\n";
+    return false;
+  }
+
+  if (auto const& mismatch = result->mismatch)
+  {
+    std::cout << "Mismatch after " << format_with_commas(result->nodes) << " nodes\n";
+    std::cout << "Position: " << mismatch->fen << "\n";
+    std::cout << "Moves from " << fen << ":";
+    for (auto const& move : mismatch->path)
+    {
+      std::cout << " " << move;
+    }
+    std::cout << "\nMissing moves:";
+    for (auto const& move : mismatch->missing_moves)
+    {
+      std::cout << " " << move;
+    }
+    std::cout << "\nExtra moves:";
+    for (auto const& move : mismatch->extra_moves)
+    {
+      std::cout << " " << move;
+    }
+    std::cout << "\n";
+    return false;
+  }
+
+  std::cout << "perft(" << depth << ") = " << format_with_commas(result->nodes) << ", every position matches ("
+            << std::to_string(elapsed.count()) << " seconds)\n";
+  return true;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  std::optional<std::string> epd_filename;
+  int max_depth{std::numeric_limits<int>::max()};
+  size_t thread_count{std::max(std::thread::hardware_concurrency(), 1u)};
+
+  std::vector<std::string_view> positional;
+  for (int i{1}; i < argc; ++i)
+  {
+    std::string_view const arg{argv[i]};
+    if (arg == "--threads" && i + 1 < argc)
+    {
+      thread_count = static_cast<size_t>(std::max(parse_int(argv[++i]), 1));
+    }
+    else if (arg == "--max-depth" && i + 1 < argc)
+    {
+      max_depth = parse_int(argv[++i]);
+    }
+    else if (arg == "--epd")
+    {
+      epd_filename = (i + 1 < argc && !std::string_view{argv[i + 1]}.starts_with("--")) ? argv[++i] :
+                                                                                           "data/perftsuite.epd";
+    }
+    else if (arg.starts_with("--"))
+    {
+      exit_with_usage();
+    }
+    else
+    {
+      positional.push_back(arg);
+    }
+  }
+
+  if (epd_filename)
+  {
+    auto const positions = Perft::load_suite(*epd_filename);
+    if (!positions || !positional.empty())
+    {
+      std::cerr << (positions ? std::string{c_usage} : positions.error() + "\n");
+      exit(-1);
+    }
+    for (auto const& position : *positions)
+    {
+      auto const depth = std::min(static_cast<int>(position.expected_nodes.size()), max_depth);
+      std::cout << position.fen << "\n";
+      if (!check_position(position.fen, depth, thread_count))
+      {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  if (positional.empty() || positional.size() > 2)
+  {
+    exit_with_usage();
+  }
+  auto const depth = parse_int(positional[0].data());
+  auto const fen = (positional.size() == 2) ? positional[1] : c_start_position_fen;
+
+  return check_position(fen, depth, thread_count) ? 0 : -1;
+}
@@ -0,0 +1,89 @@
+#include "tablebase.h"
+#include "tablebase_generator.h"
+#include "utils.h"
+
+int main(int argc, char* argv[])
+{
+  using namespace Meneldor;
+
+  if (argc < 2)
+  {
+    std::cerr << "Usage: tbgen [output directory] [--threads N] [table names...]\n";
+    exit(-1);
+  }
+
+  std::string const directory = argv[1];
+  size_t thread_count{std::max(std::thread::hardware_concurrency(), 1u)};
+  std::vector<std::string> names;
+  for (int i{2}; i < argc; ++i)
+  {
+    std::string_view const arg{argv[i]};
+    if (arg == "--threads" && i + 1 < argc)
+    {
+      try
+      {
+        thread_count = static_cast<size_t>(std::max(std::stoi(argv[++i]), 1));
+      }
+      catch (std::invalid_argument const& err)
+      {
+        std::cerr << err.what();
+        exit(-1);
+      }
+    }
+    else
+    {
+      names.emplace_back(arg);
+    }
+  }
+  if (names.empty())
+  {
+    names = Tablebase::get_all_table_names();
+  }
+
+  std::filesystem::create_directories(directory);
+
+  // Tables generated earlier are needed to resolve captures and promotions
+  Tablebase tablebase;
+  if (auto const loaded = tablebase.load_directory(directory); !loaded)
+  {
+    std::cerr << loaded.error() << "\n";
+    exit(-1);
+  }
+
+  for (auto const& name : names)
+  {
+    auto const start = std::chrono::system_clock::now();
+    auto table = Tablebase_generator::generate(name, tablebase, thread_count, &std::cout);
+    if (!table)
+    {
+      std::cerr << table.error() << "\n";
+      exit(-1);
+    }
+    std::chrono::duration<double> const elapsed = std::chrono::system_clock::now() - start;
+
+    std::array<size_t, 3> wdl_counts{};
+    int32_t longest_mate{0};
+    for (size_t i{0}; i < table->size(); ++i)
+    {
+      auto const result = Tablebase_table::decode(table->get_value(i));
+      ++wdl_counts[static_cast<size_t>(static_cast<int32_t>(result.wdl) + 1)];
+      longest_mate = std::max(longest_mate, result.distance_to_mate);
+    }
+
+    auto const filename = (std::filesystem::path{directory} / (name + std::string{Tablebase::c_file_extension})).string();
+    if (auto const saved = table->save(filename); !saved)
+    {
+      std::cerr << saved.error() << "\n";
+      exit(-1);
+    }
+
+    std::cout << name << ": " << format_with_commas(table->size()) << " positions in "
+              << std::to_string(elapsed.count()) << " seconds, " << format_with_commas(wdl_counts[2]) << " wins, "
+              << format_with_commas(wdl_counts[1]) << " draws or invalid, " << format_with_commas(wdl_counts[0])
+              << " losses, longest mate " << longest_mate << " plies\n";
+
+    tablebase.add_table(std::move(*table));
+  }
+
+  return 0;
+}
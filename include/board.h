@@ -4,19 +4,58 @@
 #include "bitboard.h"
 #include "castling_rights.h"
 #include "coordinates.h"
+#include "material_key.h"
 #include "move.h"
+#include "piece_square_tables.h"
 #include "zobrist_hash.h"
 
 namespace Meneldor
 {
 
+struct Piece_placement
+{
+  Color color{Color::white};
+  Piece piece{Piece::empty};
+  Coordinates location{a1};
+};
+
+// Reasons parse_fen can reject a fen string
+enum class Fen_error : uint8_t
+{
+  missing_field = 0,
+  invalid_piece,
+  bad_rank_length,
+  bad_rank_count,
+  invalid_active_color,
+  invalid_castling_rights,
+  invalid_en_passant_square,
+  invalid_move_count,
+};
+
+std::string_view get_fen_error_message(Fen_error error);
+
 class Board
 {
 public:
+  // Longest fen to_fen can write: eight full ranks of pieces, all castling
+  // rights, an en passant square and three digit move counts
+  constexpr static size_t c_max_fen_length{89};
+
+  // Final position of a single game. Pgn_reader reads files of many games.
   static tl::expected<Board, std::string> from_pgn(std::string_view pgn);
 
   static tl::expected<Board, std::string> from_fen(std::string_view fen);
 
+  // Same as from_fen without allocating, for reading large epd and training
+  // files. The move counts are optional and anything after them is ignored,
+  // so epd operations and uci move lists can follow the position.
+  static tl::expected<Board, Fen_error> parse_fen(std::string_view fen);
+
+  // Creates a position with only the given pieces, without castling rights or
+  // an en passant square. Faster than building a fen string when setting up
+  // many positions.
+  static tl::expected<Board, std::string> from_pieces(std::span<Piece_placement const> pieces, Color active_color);
+
   static void set_use_unicode_output(bool value);
 
   static bool get_use_unicode_output();
@@ -32,6 +71,10 @@ public:
 
   std::string to_fen() const;
 
+  // Writes the fen into [first, last) in the manner of std::to_chars, failing
+  // with std::errc::value_too_large if it doesn't fit
+  std::to_chars_result to_fen(char* first, char* last) const;
+
   /**
    * Checks if every square in between squares from and to are empty,
    * and if the squares are in a vertical line.
@@ -88,6 +131,14 @@ public:
    */
   bool move_no_verify(Move m, bool skip_check_detection = true);
 
+  /**
+   * Makes a legal, non null move for color, which must be the active color.
+   * Castling, double pawn pushes and promotions are taken from the move type
+   * instead of being worked out again from the squares.
+   */
+  template <Color color>
+  void make_move(Move m);
+
   /**
    * A fast try move method that will return true if the move results in check.
    * Does not perform verification on whether or not the move is legal.
@@ -159,6 +210,15 @@ public:
 
   Zobrist_hash get_hash_key() const;
 
+  // Hash of only the pawns on the board, used as the pawn hash table key
+  Zobrist_hash get_pawn_hash_key() const;
+
+  // Number of pieces of each type, used as the material table key
+  Material_key get_material_key() const;
+
+  // Incrementally updated piece-square evaluation for the current position
+  Piece_square_score get_piece_square_score() const;
+
 private:
   /**
    * Private constructor that doesn't initialize pieces
@@ -170,9 +230,8 @@ private:
    */
   bool validate_() const;
 
-  void update_castling_rights_(Color color, Piece piece, Move m);
   bool update_castling_rights_fen_(char c);
-  std::string castling_rights_to_fen_() const;
+  char* castling_rights_to_fen_(char* out) const;
 
   void perform_move_(Move m, Coordinates capture_location);
   void unperform_move_(Color color, Move m);
@@ -181,9 +240,19 @@ private:
   void add_piece_(Color color, Piece piece, Coordinates to_add);
   void remove_piece_(Color color, Piece piece, Coordinates to_remove);
 
+  // Piece on each square, kept in sync with the bitboards so that finding
+  // what stands on a square is a single load. The color is stored in the top
+  // bit, empty squares hold Piece::empty.
+  constexpr static uint8_t c_mailbox_color_shift{7};
+  constexpr static uint8_t c_mailbox_piece_mask{(1 << c_mailbox_color_shift) - 1};
+
   std::array<Bitboard, static_cast<uint8_t>(Piece::_count)> m_bitboards;
+  std::array<uint8_t, c_board_dimension_squared> m_mailbox;
   Bitboard m_en_passant_square{0};
   Zobrist_hash m_zhash;
+  Zobrist_hash m_pawn_zhash;
+  Material_key m_material_key;
+  Piece_square_score m_psq_score;
   Castling_rights m_rights{c_castling_rights_none};
   Color m_active_color{Color::white};
   uint8_t m_halfmove_clock{0};
@@ -193,6 +262,18 @@ private:
   static inline bool s_use_unicode_output{false};
 };
 
+inline Color Board::get_piece_color(Coordinates square) const
+{
+  MY_ASSERT(is_occupied(square), "This function can only be called for occupied squares");
+
+  return static_cast<Color>(m_mailbox[square.square_index()] >> c_mailbox_color_shift);
+}
+
+inline Piece Board::get_piece(Coordinates square) const
+{
+  return static_cast<Piece>(m_mailbox[square.square_index()] & c_mailbox_piece_mask);
+}
+
 std::ostream& operator<<(std::ostream& out, Board const& self);
 
 } // namespace Meneldor
@@ -36,11 +36,16 @@ enum class Piece : uint8_t
   _count,
 };
 
+// Set by the move generator so that making a move doesn't have to work out
+// again whether it castles, pushes a pawn two squares or promotes
 enum class Move_type : uint8_t
 {
   null = 0,
   normal,
   en_passant,
+  castle,
+  double_push,
+  promotion, // With or without a capture
   _count,
 };
 
@@ -0,0 +1,31 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// Code that uses x86 intrinsics or target attributes is only compiled where
+// this is defined
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MENELDOR_X86_SIMD
+#endif
+
+namespace Meneldor
+{
+// Instruction set extensions of the cpu the engine is running on. Everything
+// is false when MENELDOR_X86_SIMD isn't defined.
+struct Cpu_features
+{
+  bool sse41{false};
+  bool avx2{false};
+  bool avx512f{false};
+
+  // BMI2 is supported and pext isn't microcoded. AMD cpus before Zen 3
+  // (family 19h) take hundreds of cycles for it.
+  bool fast_pext{false};
+
+  static Cpu_features detect();
+
+  // The features of this cpu, detected once
+  static Cpu_features const& get();
+};
+} // namespace Meneldor
+
+#endif // CPU_FEATURES_H
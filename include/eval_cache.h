@@ -0,0 +1,53 @@
+#ifndef EVAL_CACHE_H
+#define EVAL_CACHE_H
+
+#include "zobrist_hash.h"
+
+namespace Meneldor
+{
+// A small, lossy, direct mapped cache of static evaluations. Each entry packs
+// 16 bits of the key (to detect collisions) with a 16 bit score, so a whole
+// cache line holds 16 entries. Newer entries always replace older ones.
+class Eval_cache
+{
+public:
+  // Checkmate scores depend on the search depth and don't fit in 16 bits, so
+  // they are stored as this value instead
+  constexpr static int16_t c_checkmate_score{std::numeric_limits<int16_t>::min()};
+
+  Eval_cache(size_t table_size_bytes);
+
+  ~Eval_cache() = default;
+
+  std::optional<int16_t> get(zhash_t key) const;
+
+  void insert(zhash_t key, int16_t evaluation);
+
+  // Discards all entries. A size of zero disables the cache.
+  void resize(size_t table_size_bytes);
+
+  size_t get_capacity() const;
+
+  void clear();
+
+private:
+  using Entry = uint32_t;
+
+  // Check bits come from the top of the key, while the index comes from the
+  // bottom. Empty entries have check bits of zero, so keys with those check
+  // bits are never cached, and every other key keeps all 16 bits.
+  constexpr static uint16_t c_empty_check_bits{0};
+
+  constexpr static uint16_t check_bits_(zhash_t key)
+  {
+    constexpr int c_check_bits_shift{48};
+    return static_cast<uint16_t>(key >> c_check_bits_shift);
+  }
+
+  size_t index_(zhash_t key) const;
+
+  std::vector<Entry> m_table;
+};
+} // namespace Meneldor
+
+#endif // EVAL_CACHE_H
@@ -0,0 +1,70 @@
+#ifndef MATERIAL_KEY_H
+#define MATERIAL_KEY_H
+
+#include "chess_types.h"
+#include "my_assert.h"
+
+namespace Meneldor
+{
+class Board;
+
+// The number of pieces of each type and color on the board, packed into an
+// integer. Kept up to date by the board, and used as the material table key.
+// Kings are not counted since there is always exactly one of each.
+class Material_key
+{
+public:
+  constexpr Material_key() = default;
+  Material_key(Board const& board);
+
+  constexpr Material_key(Material_key const& other) = default;
+  constexpr Material_key(Material_key&& other) = default;
+  constexpr Material_key& operator=(Material_key const& other) = default;
+  constexpr Material_key& operator=(Material_key&& other) = default;
+
+  constexpr auto operator<=>(Material_key const& other) const = default;
+
+  constexpr void add_piece(Color color, Piece piece)
+  {
+    if (piece != Piece::king)
+    {
+      m_key += uint64_t{1} << shift_(color, piece);
+    }
+  }
+
+  constexpr void remove_piece(Color color, Piece piece)
+  {
+    if (piece != Piece::king)
+    {
+      MY_ASSERT(count(color, piece) > 0, "Cannot remove a piece that isn't on the board");
+      m_key -= uint64_t{1} << shift_(color, piece);
+    }
+  }
+
+  constexpr int32_t count(Color color, Piece piece) const
+  {
+    return static_cast<int32_t>((m_key >> shift_(color, piece)) & c_count_mask);
+  }
+
+  constexpr uint64_t get_key() const
+  {
+    return m_key;
+  }
+
+private:
+  // Enough for 10 pieces of one type, which is the most promotions allow
+  constexpr static uint32_t c_bits_per_count{4};
+  constexpr static uint64_t c_count_mask{(uint64_t{1} << c_bits_per_count) - 1};
+  constexpr static uint32_t c_piece_types_per_color{5};
+
+  constexpr static uint32_t shift_(Color color, Piece piece)
+  {
+    auto const piece_index = static_cast<uint32_t>(piece) - static_cast<uint32_t>(Piece::pawn);
+    return c_bits_per_count * (static_cast<uint32_t>(color) * c_piece_types_per_color + piece_index);
+  }
+
+  uint64_t m_key{0};
+};
+} // namespace Meneldor
+
+#endif // MATERIAL_KEY_H
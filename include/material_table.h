@@ -0,0 +1,109 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include "material_key.h"
+
+namespace Meneldor
+{
+class Board;
+
+// Caches everything that only depends on which pieces are on the board,
+// indexed by the board's material key. This includes material and imbalance
+// scores, the game phase, and the specialized evaluation for endgames where
+// general evaluation terms don't know what matters.
+//
+// Not thread safe, each search thread should own its own table.
+class Material_table
+{
+public:
+  // Piece values, indexed by piece type starting at Piece::pawn
+  constexpr static std::array<int32_t, 5> c_piece_values{100, 300, 300, 500, 900};
+
+  // Added to positions an endgame function knows are won, so they are
+  // preferred over any position without a known result
+  constexpr static int32_t c_known_win{10'000};
+
+  // Scale factors are out of this value, which leaves the evaluation unchanged
+  constexpr static uint8_t c_scale_normal{64};
+
+  // Returns an evaluation from the point of view of strong_color
+  using Endgame_function = int32_t (*)(Board const& board, Color strong_color);
+
+  // Returns a scale factor that the evaluation should be multiplied by
+  using Scale_function = uint8_t (*)(Board const& board, Color strong_color);
+
+  struct alignas(32) Entry
+  {
+    // Kings are always on the board, so no position has an empty key
+    uint64_t key{std::numeric_limits<uint64_t>::max()};
+
+    // At most one of these is set
+    Endgame_function endgame_function{nullptr};
+    Scale_function scale_function{nullptr};
+
+    // From white's point of view
+    int16_t material{0};
+    int16_t imbalance{0};
+
+    uint8_t phase{0};
+
+    // The side the endgame or scale function is evaluated for
+    Color strong_color{Color::white};
+
+    // Neither side can force checkmate
+    bool is_draw{false};
+
+    // Material and imbalance from the point of view of the given color
+    constexpr int32_t score(Color color) const
+    {
+      auto const white_score = material + imbalance;
+      return (color == Color::white) ? white_score : -white_score;
+    }
+
+    // Specialized evaluations and scaling don't fit the bounds lazy
+    // evaluation assumes about the general evaluation
+    constexpr bool is_special() const
+    {
+      return endgame_function || scale_function || is_draw;
+    }
+
+    constexpr uint8_t scale_factor(Board const& board) const
+    {
+      return (scale_function) ? scale_function(board, strong_color) : c_scale_normal;
+    }
+  };
+
+  static_assert(sizeof(Entry) == 32);
+
+  Material_table(size_t table_size_bytes);
+
+  ~Material_table() = default;
+
+  // Returns the entry for the board's material, computing and storing it if
+  // it is not already in the table
+  Entry const& probe(Board const& board);
+
+  size_t get_capacity() const;
+
+  uint64_t get_hits() const;
+  uint64_t get_misses() const;
+  void reset_stats();
+
+  void clear();
+
+  // Computes an entry from scratch
+  static Entry evaluate(Material_key key);
+
+private:
+  std::vector<Entry> m_table;
+
+  // Material keys are packed counts rather than random numbers, so they are
+  // mixed and the top bits are used as the index
+  uint32_t m_index_shift{0};
+
+  uint64_t m_hits{0};
+  uint64_t m_misses{0};
+};
+} // namespace Meneldor
+
+#endif // MATERIAL_TABLE_H
@@ -0,0 +1,33 @@
+#ifndef MEMORY_MAPPED_FILE_H
+#define MEMORY_MAPPED_FILE_H
+
+namespace Meneldor
+{
+// A read only view of a whole file mapped into memory. Pages are loaded by
+// the OS as they are touched, so large files can be opened instantly and are
+// shared between processes that map the same file.
+class Memory_mapped_file
+{
+public:
+  static tl::expected<Memory_mapped_file, std::string> open(std::string const& filename);
+
+  Memory_mapped_file(Memory_mapped_file const& other) = delete;
+  Memory_mapped_file& operator=(Memory_mapped_file const& other) = delete;
+  Memory_mapped_file(Memory_mapped_file&& other) noexcept;
+  Memory_mapped_file& operator=(Memory_mapped_file&& other) noexcept;
+
+  ~Memory_mapped_file();
+
+  std::span<std::byte const> get_data() const;
+
+private:
+  Memory_mapped_file(void* data, size_t size);
+
+  void unmap_();
+
+  void* m_data{nullptr};
+  size_t m_size{0};
+};
+} // namespace Meneldor
+
+#endif // MEMORY_MAPPED_FILE_H
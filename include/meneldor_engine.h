@@ -5,8 +5,15 @@
 #include "board.h"
 #include "chess_types.h"
 #include "coordinates.h"
+#include "eval_cache.h"
+#include "material_table.h"
+#include "move_generator.h"
 #include "move_orderer.h"
+#include "nnue.h"
+#include "pawn_hash_table.h"
 #include "senjo/ChessEngine.h"
+#include "syzygy.h"
+#include "tablebase.h"
 #include "transposition_table.h"
 
 namespace Meneldor
@@ -72,7 +79,7 @@ public:
 
   uint64_t perft(int const depth) override;
 
-  std::pair<Move, int> search(int depth, std::vector<Move>& legal_moves);
+  std::pair<Move, int> search(int depth, Move_list& legal_moves);
 
   std::string go(senjo::GoParams const& params, std::string* ponder = nullptr) override;
 
@@ -84,6 +91,10 @@ public:
 
   int evaluate(Board const& board) const;
 
+  // Skips the expensive evaluation terms when the cheap ones already put the
+  // score outside of the alpha-beta window. Returns a bound in that case.
+  int evaluate(Board const& board, int alpha, int beta) const;
+
   std::optional<std::vector<std::string>> get_principal_variation(std::string move_str) const;
 
   void print_stats(std::pair<Move, int> best_move, std::optional<std::vector<std::string>> const& pv);
@@ -99,9 +110,21 @@ private:
 
   int quiesce_(Board const& board, int alpha, int beta) const;
 
+  // Same as the public overloads, for when the attack info is already known
+  int evaluate_(Board const& board, Attack_info const& attack_info) const;
+  int evaluate_(Board const& board, Attack_info const& attack_info, int alpha, int beta) const;
+
+  int evaluate_uncached_(Board const& board, Attack_info const& attack_info) const;
+
+  // Material and piece placement, everything that is cheap to compute
+  int evaluate_material_and_position_(Board const& board, Material_table::Entry const& material_entry) const;
+
   bool has_more_time_() const;
   void calc_time_for_move_(senjo::GoParams const& params);
 
+  // Pins the calling thread to the NUMA node option, if it is set
+  void bind_search_thread_();
+
   bool m_is_debug{false};
   bool m_search_timed_out{false};
   std::atomic_flag m_stop_requested{};
@@ -113,12 +136,66 @@ private:
   constexpr static int c_default_depth{6};
   int m_depth_for_current_search{c_default_depth};
 
-  constexpr static size_t c_transposition_table_size_bytes{128UL * 1024UL * 1024UL};
-  Transposition_table m_transpositions{c_transposition_table_size_bytes};
+  constexpr static std::string_view c_hash_option_name{"Hash"};
+  constexpr static std::string_view c_clear_hash_option_name{"Clear Hash"};
+  constexpr static int64_t c_default_hash_size_mb{128};
+  constexpr static int64_t c_max_hash_size_mb{64UL * 1024UL};
+  Transposition_table m_transpositions;
+
+  // The table can be saved to and loaded from this file between sessions
+  constexpr static std::string_view c_hash_file_option_name{"HashFile"};
+  constexpr static std::string_view c_save_hash_option_name{"Save Hash"};
+  constexpr static std::string_view c_load_hash_option_name{"Load Hash"};
+  std::string m_hash_file{"meneldor.hash"};
   std::optional<std::vector<std::string>> m_current_pv;
 
+  // Owned by the engine so each search thread has its own copy. Mutable since
+  // it only caches evaluation results.
+  constexpr static size_t c_pawn_hash_table_size_bytes{2UL * 1024UL * 1024UL};
+  mutable Pawn_hash_table m_pawn_hash_table{c_pawn_hash_table_size_bytes};
+
+  constexpr static size_t c_material_table_size_bytes{256UL * 1024UL};
+  mutable Material_table m_material_table{c_material_table_size_bytes};
+
+  constexpr static std::string_view c_eval_cache_option_name{"EvalCache"};
+  constexpr static int64_t c_default_eval_cache_size_mb{4};
+  constexpr static int64_t c_max_eval_cache_size_mb{1024};
+  int64_t m_eval_cache_size_mb{c_default_eval_cache_size_mb};
+  mutable Eval_cache m_eval_cache{c_default_eval_cache_size_mb * 1024UL * 1024UL};
+
+  // NUMA node the search thread is pinned to, or -1 to leave it unpinned.
+  // After the node changes, the per-thread tables above are reallocated by
+  // the pinned search thread so their pages are local to its node.
+  constexpr static std::string_view c_numa_node_option_name{"NumaNode"};
+  int64_t m_numa_node{-1};
+  bool m_thread_tables_need_relocation{false};
+
+  // Path to an NNUE network, the classic evaluation is used if this is empty
+  constexpr static std::string_view c_eval_file_option_name{"EvalFile"};
+  std::string m_eval_file;
+
+  // Accumulators for the boards on the search path. Mutable since the
+  // evaluation functions that fill it in are const.
+  mutable Nnue_stack m_nnue_stack;
+
+  // Directory of tables made by tbgen, no tables are probed if this is empty
+  constexpr static std::string_view c_tablebase_path_option_name{"TablebasePath"};
+  std::string m_tablebase_path;
+  Tablebase m_tablebase;
+
+  // Directories of Syzygy tables, separated like the PATH environment variable
+  constexpr static std::string_view c_syzygy_path_option_name{"SyzygyPath"};
+  std::string m_syzygy_path;
+  Syzygy_tablebase m_syzygy;
+
+  // How rook and bishop attacks are looked up, shared by every engine in the process
+  constexpr static std::string_view c_slider_attacks_option_name{"SliderAttacks"};
+
+  uint32_t m_tablebase_hits{0};
+
   mutable uint32_t m_visited_nodes{0};
   mutable uint32_t m_visited_quiesence_nodes{0};
+  mutable uint32_t m_lazy_evaluations{0};
   Search_mode m_search_mode{Search_mode::depth};
   std::chrono::time_point<std::chrono::system_clock> m_search_start_time;
   std::chrono::time_point<std::chrono::system_clock> m_search_desired_end_time;
@@ -127,6 +127,13 @@ struct Move
     MY_ASSERT(this->score() == score, "Invalid state");
   }
 
+  // From, to and promotion in 16 bits, enough to pick this move out of the
+  // moves generated for its position. A null move packs to zero.
+  constexpr uint16_t compact() const
+  {
+    return static_cast<uint16_t>((m_val & 0x00000fff) | ((m_val & 0x00f00000) >> 8));
+  }
+
   constexpr auto operator<=>(Move const& other) const = default;
 
 #if 0
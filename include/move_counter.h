@@ -0,0 +1,46 @@
+#ifndef MOVE_COUNTER_H
+#define MOVE_COUNTER_H
+
+#include "board.h"
+
+namespace Meneldor
+{
+// Counts legal moves without generating them, for the leaves of perft where
+// only the number of moves matters. Several boards are counted in lockstep,
+// one board per 64 bit lane of an AVX2 or AVX-512 register, with every attack
+// set computed set-wise like Slider_fill does. The moves of a whole group of
+// pieces are counted per direction, since two pieces can't reach the same
+// square moving the same way.
+class Move_counter
+{
+public:
+  // Boards counted per batch with AVX-512, one per lane
+  constexpr static size_t c_max_batch_size{8};
+
+  // Writes the number of legal moves of each board to the count with the
+  // same index, in the widest batches the cpu supports
+  static void count_legal_moves(std::span<Board const> boards, std::span<uint32_t> counts);
+  static uint32_t count_legal_moves(Board const& board);
+
+  // One board at a time, without SIMD
+  static void count_legal_moves_scalar(std::span<Board const> boards, std::span<uint32_t> counts);
+
+  // Four boards at a time. Must only be called if has_avx2() is true
+  static void count_legal_moves_avx2(std::span<Board const> boards, std::span<uint32_t> counts);
+
+  // Eight boards at a time. Must only be called if has_avx512() is true
+  static void count_legal_moves_avx512(std::span<Board const> boards, std::span<uint32_t> counts);
+
+  // Same result as Move_generator::perft, but the positions one ply above the
+  // leaves are gathered into batches and their moves are only counted
+  static uint64_t perft(int depth, Board& board, std::atomic_flag& is_cancelled);
+
+  // Boards count_legal_moves() processes at once: 8, 4 or 1
+  static size_t get_batch_size();
+
+  static bool has_avx2();
+  static bool has_avx512();
+};
+} // namespace Meneldor
+
+#endif // MOVE_COUNTER_H
@@ -5,31 +5,111 @@
 #include "chess_types.h"
 #include "coordinates.h"
 #include "move.h"
+#include "move_list.h"
 
 namespace Meneldor
 {
 
 class Board;
 
+// Everything about which squares are attacked in a position. Computed once
+// per node and shared by evaluation, check detection and move generation.
+struct Attack_info
+{
+  // Indexed by color, then by piece type starting at Piece::pawn
+  std::array<std::array<Bitboard, 6>, 2> attacks_by_piece{};
+
+  // Every square attacked by each color, indexed by color
+  std::array<Bitboard, 2> attacks{};
+
+  // Enemy pieces giving check to the side to move
+  Bitboard checkers;
+
+  // Pieces belonging to the side to move that are pinned to their king
+  Bitboard pinned;
+
+  // Squares the king of the side to move can't move to. Unlike the enemy's
+  // attacks, this includes squares behind the king on a slider's line.
+  Bitboard king_danger;
+
+  constexpr Bitboard get_attacks(Color color) const
+  {
+    return attacks[static_cast<uint8_t>(color)];
+  }
+
+  constexpr Bitboard get_attacks(Color color, Piece piece) const
+  {
+    auto const piece_index = static_cast<uint8_t>(piece) - static_cast<uint8_t>(Piece::pawn);
+    return attacks_by_piece[static_cast<uint8_t>(color)][piece_index];
+  }
+
+  constexpr bool is_in_check() const
+  {
+    return !checkers.is_empty();
+  }
+};
+
+// Ways of looking up the squares a rook or bishop attacks for a set of blockers
+enum class Slider_backend : uint8_t
+{
+  plain_magic = 0, // Fixed shift magics, a full 4096 (rook) or 512 (bishop) entry table per square
+  fancy_magic,     // Magics shifted by each square's blocker count, tables packed into one array
+  pext,            // The BMI2 pext instruction indexes the packed tables, no magic needed
+};
+
+std::ostream& operator<<(std::ostream& os, Slider_backend const& self);
+
 class Move_generator
 {
 public:
   static uint64_t perft(int depth, Board& board, std::atomic_flag& is_cancelled);
 
-  static std::vector<Move> generate_legal_moves(Board const& board);
-  static std::vector<Move> generate_legal_attack_moves(Board const& board);
-  static std::vector<Move> generate_pseudo_legal_attack_moves(Board const& board);
-  static std::vector<Move> generate_pseudo_legal_moves(Board const& board);
+  // These append to a list owned by the caller, so the search can keep its
+  // lists on the stack
+  static void generate_legal_moves(Board const& board, Move_list& moves);
+
+  // Only generates legal moves. Pinned pieces stay on their pin line and only
+  // evasions are generated when in check, so king moves and en passant are
+  // the only moves that need an extra test.
+  static void generate_legal_moves(Board const& board, Attack_info const& attack_info, Move_list& moves);
+  static void generate_legal_attack_moves(Board const& board, Attack_info const& attack_info, Move_list& moves);
+  static void generate_pseudo_legal_attack_moves(Board const& board, Move_list& moves);
+  static void generate_pseudo_legal_moves(Board const& board, Attack_info const& attack_info, Move_list& moves);
+
+  static Move_list generate_legal_moves(Board const& board);
+  static Move_list generate_legal_attack_moves(Board const& board);
+  static Move_list generate_pseudo_legal_attack_moves(Board const& board);
+  static Move_list generate_pseudo_legal_moves(Board const& board);
+  static Move_list generate_pseudo_legal_moves(Board const& board, Attack_info const& attack_info);
   static bool has_any_legal_moves(Board const& board);
+  static bool has_any_legal_moves(Board const& board, Attack_info const& attack_info);
   static Bitboard get_all_attacked_squares(Board const& board, Color attacking_color);
   static bool is_square_attacked(Board const& board, Color attacking_color, Bitboard attacked_square);
 
+  static Attack_info get_attack_info(Board const& board);
+
+  // Squares a knight, bishop, rook, queen or king on the given square attacks
+  static Bitboard get_piece_attacks(Piece piece, Coordinates location, Bitboard occupied);
+
+  // The fastest backend this cpu supports, pext is skipped on cpus where it is microcoded
+  static Slider_backend get_best_slider_backend();
+  static bool is_supported(Slider_backend backend);
+
+  // Used by every lookup from then on, so it shouldn't change while searching.
+  // Returns false if the cpu doesn't support the backend.
+  static bool set_slider_backend(Slider_backend backend);
+  static Slider_backend get_slider_backend();
+
+  // Checks if a pseudo legal move for the side to move leaves its king in
+  // check, without making the move
+  static bool is_legal(Board const& board, Attack_info const& attack_info, Move m);
+
 public:
-  class Tables
+  // Filled by the table_generator tool at build time and compiled in as a
+  // constant, so the tables are read only data shared by every process
+  // instead of being computed at every startup
+  struct Tables
   {
-  public:
-    Tables();
-
     // Attacked squares from each position for a knight
     std::array<Bitboard, c_board_dimension_squared> knight_attacks;
 
@@ -45,14 +125,30 @@ public:
     std::array<std::array<Bitboard, 512>, 64> bishop_attacks{};
     std::array<std::array<Bitboard, 4096>, 64> rook_attacks{};
 
-    void init_bishop_magic_tables_(int index);
-    void init_rook_magic_tables_(int index);
-
-    void initialize_knight_attacks_();
-    void initialize_king_attacks_();
+    // Each square only needs 2^(number of possible blockers) entries, so the
+    // fancy magic and pext tables are packed with the squares at these offsets
+    constexpr static size_t c_packed_bishop_size{5248};
+    constexpr static size_t c_packed_rook_size{102400};
+    std::array<uint32_t, 64> bishop_offsets{};
+    std::array<uint32_t, 64> rook_offsets{};
+    std::array<uint8_t, 64> bishop_blocker_counts{};
+    std::array<uint8_t, 64> rook_blocker_counts{};
+    std::array<Bitboard, c_packed_bishop_size> bishop_fancy_attacks{};
+    std::array<Bitboard, c_packed_rook_size> rook_fancy_attacks{};
+    std::array<Bitboard, c_packed_bishop_size> bishop_pext_attacks{};
+    std::array<Bitboard, c_packed_rook_size> rook_pext_attacks{};
+
+    // Squares strictly between two squares on the same rank, file or diagonal
+    std::array<std::array<Bitboard, c_board_dimension_squared>, c_board_dimension_squared> squares_between{};
+
+    // The whole rank, file or diagonal two squares are on, if they share one
+    std::array<std::array<Bitboard, c_board_dimension_squared>, c_board_dimension_squared> line_through{};
   };
 
   static Tables const m_tables;
+
+private:
+  static Slider_backend s_slider_backend;
 };
 
 struct Bitboard_constants
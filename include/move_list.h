@@ -0,0 +1,135 @@
+#ifndef MOVE_LIST_H
+#define MOVE_LIST_H
+
+#include "move.h"
+#include "my_assert.h"
+
+namespace Meneldor
+{
+// A list of moves stored inline, big enough for every move of any legal
+// position. Generating moves at each search node never touches the heap.
+// Works with the ranges algorithms and converts to std::span<Move>.
+class Move_list
+{
+public:
+  // The most moves any legal position has is 218
+  constexpr static size_t c_capacity{256};
+
+  using value_type = Move;
+  using iterator = Move*;
+  using const_iterator = Move const*;
+
+  // Leaves the storage uninitialized, only the size is set
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-member-init, modernize-use-equals-default)
+  Move_list()
+  {
+  }
+
+  Move_list(std::span<Move const> moves)
+  {
+    MY_ASSERT(moves.size() <= c_capacity, "Too many moves");
+    std::ranges::copy(moves, begin());
+    m_size = static_cast<uint32_t>(moves.size());
+  }
+
+  // Only copies the moves in use
+  Move_list(Move_list const& other) : Move_list{std::span<Move const>{other}}
+  {
+  }
+
+  Move_list& operator=(Move_list const& other)
+  {
+    std::ranges::copy(other, begin());
+    m_size = other.m_size;
+    return *this;
+  }
+
+  ~Move_list() = default;
+
+  void push_back(Move move)
+  {
+    MY_ASSERT(m_size < c_capacity, "Move list is full");
+    std::construct_at(data() + m_size++, move);
+  }
+
+  template <typename... Args>
+  Move& emplace_back(Args&&... args)
+  {
+    MY_ASSERT(m_size < c_capacity, "Move list is full");
+    return *std::construct_at(data() + m_size++, std::forward<Args>(args)...);
+  }
+
+  void clear()
+  {
+    m_size = 0;
+  }
+
+  size_t size() const
+  {
+    return m_size;
+  }
+
+  bool empty() const
+  {
+    return m_size == 0;
+  }
+
+  Move* data()
+  {
+    return std::launder(reinterpret_cast<Move*>(m_storage.data()));
+  }
+
+  Move const* data() const
+  {
+    return std::launder(reinterpret_cast<Move const*>(m_storage.data()));
+  }
+
+  Move* begin()
+  {
+    return data();
+  }
+
+  Move* end()
+  {
+    return data() + m_size;
+  }
+
+  Move const* begin() const
+  {
+    return data();
+  }
+
+  Move const* end() const
+  {
+    return data() + m_size;
+  }
+
+  Move& operator[](size_t index)
+  {
+    MY_ASSERT(index < m_size, "Index out of bounds");
+    return data()[index];
+  }
+
+  Move const& operator[](size_t index) const
+  {
+    MY_ASSERT(index < m_size, "Index out of bounds");
+    return data()[index];
+  }
+
+  Move& front()
+  {
+    return (*this)[0];
+  }
+
+  Move const& front() const
+  {
+    return (*this)[0];
+  }
+
+private:
+  alignas(Move) std::array<std::byte, c_capacity * sizeof(Move)> m_storage;
+  uint32_t m_size{0};
+};
+} // namespace Meneldor
+
+#endif // MOVE_LIST_H
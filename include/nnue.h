@@ -0,0 +1,166 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include "chess_types.h"
+#include "coordinates.h"
+
+// https://www.chessprogramming.org/NNUE
+
+namespace Meneldor
+{
+class Board;
+class Nnue_network;
+
+// Instruction sets the dense layers can be evaluated with
+enum class Simd_level : uint8_t
+{
+  scalar = 0,
+  sse41,
+  avx2,
+};
+
+std::ostream& operator<<(std::ostream& os, Simd_level const& self);
+
+// Output of the feature transformer for both perspectives. Boards don't hold
+// one, the engine's Nnue_stack does: the search pushes and pops positions, and
+// an accumulator is only computed when its position is evaluated, by copying
+// the parent's and adding and removing the pieces that moved. A perspective
+// becomes invalid when its king moves to a different bucket, and is then
+// refreshed from the board.
+class Nnue_accumulator
+{
+public:
+  // Number of outputs of the feature transformer, for each perspective
+  constexpr static size_t c_size{64};
+
+  void add_piece(Nnue_network const& network, Color color, Piece piece, Coordinates location);
+
+  void remove_piece(Nnue_network const& network, Color color, Piece piece, Coordinates location);
+
+  // Returns true if both perspectives are up to date for the given network
+  bool is_valid(Nnue_network const& network) const;
+
+  // Recomputes the perspectives that are out of date from scratch
+  void refresh(Nnue_network const& network, Board const& board);
+
+  std::span<int16_t const, c_size> get_values(Color perspective) const;
+
+private:
+  alignas(32) std::array<std::array<int16_t, c_size>, 2> m_values{};
+
+  // Indexed by color
+  std::array<uint8_t, 2> m_king_buckets{};
+  std::array<bool, 2> m_is_valid{};
+
+  // Which network these values were computed with
+  uint32_t m_network_id{0};
+};
+
+// Accumulators for the positions along the current search path, owned by the
+// engine so boards stay small to copy. Each position holds a pointer to its
+// board, and its accumulator is only computed when it is evaluated: it is
+// copied from the closest ancestor that has one and updated with the pieces
+// that differ between the boards.
+class Nnue_stack
+{
+public:
+  Nnue_stack();
+
+  // Starts a new path at board. The board must outlive every use of the stack
+  // until the next reset.
+  void reset(Board const& board);
+
+  // Adds a position reached from the top one. The board must not change until
+  // it is popped.
+  void push(Board const& board);
+
+  void pop();
+
+  // Accumulator of the top position, which must be board
+  Nnue_accumulator const& get(Nnue_network const& network, Board const& board);
+
+private:
+  struct Entry
+  {
+    Board const* board{nullptr};
+    bool is_computed{false};
+    Nnue_accumulator accumulator;
+  };
+
+  // Expected depth of a search including quiescence, the stack grows past this if needed
+  constexpr static size_t c_initial_capacity{128};
+
+  static void apply_difference_(Nnue_network const& network,
+                                Board const& parent,
+                                Board const& child,
+                                Nnue_accumulator& accumulator);
+
+  std::vector<Entry> m_entries;
+  size_t m_size{0};
+};
+
+// A small quantized network: a king-bucketed feature transformer, followed by
+// one hidden layer and a single output
+class Nnue_network
+{
+public:
+  // Features are (king bucket, piece color, piece type, square), relative to the perspective
+  constexpr static size_t c_king_buckets{4};
+  constexpr static size_t c_features_per_bucket{2 * 6 * c_board_dimension_squared};
+  constexpr static size_t c_feature_count{c_king_buckets * c_features_per_bucket};
+  constexpr static size_t c_hidden_input_size{2 * Nnue_accumulator::c_size};
+  constexpr static size_t c_hidden_size{32};
+
+  static tl::expected<Nnue_network, std::string> load(std::string const& filename);
+
+  // Creates a network with random weights, used to test the inference code
+  static Nnue_network create_random(uint64_t seed);
+
+  // The network used by the engine. Null when the classic evaluation should be used.
+  static Nnue_network const* get_active();
+
+  // The active network is shared by the whole process, so setting it through
+  // one engine's EvalFile option changes the evaluation of every engine
+  static void set_active(std::unique_ptr<Nnue_network const> network);
+
+  static Simd_level get_best_simd_level();
+
+  static size_t king_bucket(Color perspective, Coordinates king_location);
+
+  static size_t feature_index(Color perspective, size_t king_bucket, Color color, Piece piece, Coordinates location);
+
+  tl::expected<void, std::string> save(std::string const& filename) const;
+
+  // Returns an evaluation in centipawns from the point of view of the side to move
+  int32_t evaluate(Nnue_accumulator const& accumulator, Color side_to_move) const;
+  int32_t evaluate(Nnue_accumulator const& accumulator, Color side_to_move, Simd_level simd_level) const;
+
+  uint32_t get_id() const;
+
+  std::span<int16_t const, Nnue_accumulator::c_size> get_feature_biases() const;
+  std::span<int16_t const, Nnue_accumulator::c_size> get_feature_weights(size_t feature) const;
+
+private:
+  Nnue_network();
+
+  // Hidden layer outputs are divided by this before the activation
+  constexpr static int c_hidden_shift{6};
+  constexpr static int32_t c_output_divisor{16};
+  constexpr static int8_t c_activation_max{127};
+
+  uint32_t m_id{0};
+  std::vector<int16_t> m_feature_weights;
+  std::vector<int16_t> m_feature_biases;
+  std::vector<int8_t> m_hidden_weights;
+  std::vector<int32_t> m_hidden_biases;
+  std::vector<int8_t> m_output_weights;
+  int32_t m_output_bias{0};
+
+  // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+  static inline std::unique_ptr<Nnue_network const> s_active_network;
+  // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+  static inline uint32_t s_next_id{1};
+};
+} // namespace Meneldor
+
+#endif // NNUE_H
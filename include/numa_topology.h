@@ -0,0 +1,60 @@
+#ifndef NUMA_TOPOLOGY_H
+#define NUMA_TOPOLOGY_H
+
+namespace Meneldor
+{
+struct Numa_node
+{
+  // The number from the node's sysfs directory. Nodes without cpus are
+  // skipped, so ids can have gaps.
+  size_t id{0};
+  std::vector<int> cpus;
+};
+
+// The NUMA nodes of the machine and the cpus in each of them. Memory is
+// placed on the node of the thread that first touches it, so pinning a
+// thread to a node before it touches its tables keeps them node-local.
+class Numa_topology
+{
+public:
+  constexpr static std::string_view c_default_root{"/sys/devices/system/node"};
+
+  // Reads node<N>/cpulist for every node under a sysfs style directory.
+  // Machines without one are treated as a single node holding every cpu.
+  static Numa_topology detect(std::filesystem::path const& root = c_default_root);
+
+  // The topology of this machine, detected once
+  static Numa_topology const& get_system();
+
+  // Parses cpu lists like "0-3,8-11"
+  static tl::expected<std::vector<int>, std::string> parse_cpu_list(std::string_view list);
+
+  size_t get_node_count() const;
+
+  // Ordered by id
+  std::span<Numa_node const> get_nodes() const;
+
+  bool has_node(size_t node_id) const;
+
+  // Empty if there is no node with this id
+  std::span<int const> get_cpus(size_t node_id) const;
+
+  // Restricts the calling thread to the cpus of a node. Returns false if
+  // there is no such node or that isn't supported on this platform.
+  bool bind_current_thread(size_t node_id) const;
+
+  // Lets the calling thread run on the cpus of every node again
+  bool unbind_current_thread() const;
+
+private:
+  Numa_topology() = default;
+
+  Numa_node const* find_node_(size_t node_id) const;
+
+  static bool set_current_thread_cpus_(std::span<int const> cpus);
+
+  std::vector<Numa_node> m_nodes;
+};
+} // namespace Meneldor
+
+#endif // NUMA_TOPOLOGY_H
@@ -0,0 +1,78 @@
+#ifndef PAWN_HASH_TABLE_H
+#define PAWN_HASH_TABLE_H
+
+#include "bitboard.h"
+#include "piece_square_tables.h"
+#include "zobrist_hash.h"
+
+namespace Meneldor
+{
+class Board;
+
+// Caches pawn structure evaluation, indexed by the board's pawn-only hash key.
+// Pawn structure changes rarely between nodes, so most probes are hits.
+//
+// Not thread safe, each search thread should own its own table.
+class Pawn_hash_table
+{
+public:
+  constexpr static uint8_t c_no_square{c_board_dimension_squared};
+
+  // Two entries fit in a 64 byte cache line
+  struct alignas(32) Entry
+  {
+    zhash_t key{0};
+
+    // Indexed by color
+    std::array<Bitboard, 2> passed_pawns{};
+
+    // Passed, isolated, doubled and backward pawns, from white's point of view
+    int16_t middlegame{0};
+    int16_t endgame{0};
+
+    // The pawn shield also depends on where the king is, so it is only valid
+    // for the king square it was computed for. Indexed by color, each
+    // shield score is from that color's point of view.
+    std::array<int8_t, 2> shield{};
+    std::array<uint8_t, 2> shield_king_square{c_no_square, c_no_square};
+
+    // Total pawn structure score from the point of view of the given color
+    constexpr int32_t score(Color color, int32_t phase) const
+    {
+      auto const shield_score = shield[static_cast<uint8_t>(Color::white)] - shield[static_cast<uint8_t>(Color::black)];
+      auto const white_score = Piece_square_score::taper(middlegame + shield_score, endgame, phase);
+      return (color == Color::white) ? white_score : -white_score;
+    }
+  };
+
+  static_assert(sizeof(Entry) == 32);
+
+  Pawn_hash_table(size_t table_size_bytes);
+
+  ~Pawn_hash_table() = default;
+
+  // Returns the pawn structure evaluation for the board, computing and
+  // storing it if the pawn structure is not already in the table
+  Entry const& probe(Board const& board);
+
+  size_t get_capacity() const;
+
+  uint64_t get_hits() const;
+  uint64_t get_misses() const;
+  void reset_stats();
+
+  void clear();
+
+  // Evaluates the pawn structure from scratch, without the pawn shield
+  static Entry evaluate(Board const& board);
+
+private:
+  static int8_t evaluate_shield_(Board const& board, Color color, Coordinates king_location);
+
+  std::vector<Entry> m_table;
+  uint64_t m_hits{0};
+  uint64_t m_misses{0};
+};
+} // namespace Meneldor
+
+#endif // PAWN_HASH_TABLE_H
@@ -0,0 +1,77 @@
+#ifndef PERFT_H
+#define PERFT_H
+
+#include "board.h"
+#include "move_counter.h"
+
+namespace Meneldor
+{
+// Nodes under one of the moves from the root position
+struct Perft_divide_entry
+{
+  Move move;
+  uint64_t nodes{0};
+};
+
+// A position from an EPD perft suite, with its known node counts
+struct Perft_suite_position
+{
+  std::string fen;
+
+  // Indexed by depth - 1
+  std::vector<uint64_t> expected_nodes;
+};
+
+// Counts the leaves of the move tree to a fixed depth, to check the move
+// generator against known results and to measure its speed.
+//
+// Positions one ply above the leaves are counted in batches by Move_counter
+// instead of being made move by move. Subtree counts can be cached in a table
+// shared by every thread, since the same position is often reached through
+// different move orders. The root moves are handed out to the threads one at
+// a time, so a thread that finishes a small subtree takes the next move
+// instead of waiting for the others.
+class Perft
+{
+public:
+  // A table size of zero disables the table
+  explicit Perft(size_t thread_count = 1, size_t table_size_bytes = 0);
+
+  Perft(Perft const& other) = delete;
+  Perft& operator=(Perft const& other) = delete;
+
+  uint64_t count(int depth, Board const& board, std::atomic_flag const& is_cancelled);
+
+  // Nodes under each root move, in move generator order
+  std::vector<Perft_divide_entry> divide(int depth, Board const& board, std::atomic_flag const& is_cancelled);
+
+  // Reads lines like "<fen> ;D1 20 ;D2 400", skipping blank lines and
+  // comments starting with #
+  static tl::expected<std::vector<Perft_suite_position>, std::string> load_suite(
+    std::filesystem::path const& filename);
+
+private:
+  // The key is xored with the data, so an entry torn by two threads writing
+  // at once fails the key check instead of returning a wrong count
+  struct Table_entry
+  {
+    std::atomic<uint64_t> key{0};
+    std::atomic<uint64_t> data{0};
+  };
+
+  // Positions one ply above the leaves are made here before being counted.
+  // Each thread has its own, so they are set up once rather than per node.
+  using Leaf_parents = std::array<Board, Move_counter::c_max_batch_size>;
+
+  template <Color color>
+  uint64_t count_(int depth, Board const& board, Leaf_parents& leaf_parents, std::atomic_flag const& is_cancelled);
+
+  std::optional<uint64_t> probe_(zhash_t key, int depth) const;
+  void store_(zhash_t key, int depth, uint64_t nodes);
+
+  size_t m_thread_count;
+  std::vector<Table_entry> m_table;
+};
+} // namespace Meneldor
+
+#endif // PERFT_H
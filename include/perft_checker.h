@@ -0,0 +1,57 @@
+#ifndef PERFT_CHECKER_H
+#define PERFT_CHECKER_H
+
+#include "chess_types.h"
+
+namespace Meneldor
+{
+class Board;
+class Move_list;
+
+// Changes the moves Move_generator found in a position before they are
+// compared, so tests can plant a move generator bug at a known node. Called
+// from every checking thread at once.
+using Perft_move_filter = std::function<void(Board const& board, Move_list& moves)>;
+
+// A position where the move generator and the reference generator disagree
+struct Perft_mismatch
+{
+  std::string fen;
+
+  // Moves in uci format leading from the root position to this one
+  std::vector<std::string> path;
+
+  // Legal moves only the reference generator found
+  std::vector<std::string> missing_moves;
+
+  // Moves only the move generator found
+  std::vector<std::string> extra_moves;
+};
+
+struct Perft_check_result
+{
+  // Leaves checked before stopping, which is the perft count if there was no mismatch
+  uint64_t nodes{0};
+  std::optional<Perft_mismatch> mismatch;
+};
+
+// Walks the perft tree, comparing the legal moves Move_generator finds in
+// every position with those of a deliberately simple 0x88 generator that
+// shares no code with the engine, not even the board. Used to validate
+// changes to the move generator at depths an external script is far too
+// slow for. Root moves are split between threads the same way Perft does.
+class Perft_checker
+{
+public:
+  // Stops at the first position where the generators disagree
+  static tl::expected<Perft_check_result, std::string> check(std::string_view fen,
+                                                             int depth,
+                                                             size_t thread_count,
+                                                             Perft_move_filter const& move_filter = {});
+
+  // Leaf count found by the reference generator alone
+  static tl::expected<uint64_t, std::string> reference_perft(std::string_view fen, int depth);
+};
+} // namespace Meneldor
+
+#endif // PERFT_CHECKER_H
@@ -0,0 +1,78 @@
+#ifndef PGN_READER_H
+#define PGN_READER_H
+
+#include "board.h"
+#include "memory_mapped_file.h"
+#include "move.h"
+
+namespace Meneldor
+{
+// A tag pair from the header of a game, like [White "Fischer, Robert J."].
+// Both views point into the pgn text.
+struct Pgn_tag
+{
+  std::string_view name;
+  std::string_view value;
+};
+
+// One ply of a game, passed to the callback before the move is made
+struct Pgn_ply
+{
+  Board const& board;
+  Move move;
+  std::span<Pgn_tag const> tags;
+  size_t game_index;
+};
+
+using Pgn_ply_callback = std::function<void(Pgn_ply const&)>;
+
+struct Pgn_replay_stats
+{
+  size_t games{0};
+  size_t failed_games{0};
+  size_t plies{0};
+  double elapsed_seconds{0};
+
+  double games_per_second() const;
+};
+
+// Reads files of many games. The file is memory mapped and split into games
+// in a single pass when it is opened, then replay hands the games out to a
+// pool of threads. Each move is matched using the attack tables, and only the
+// pieces that can reach its target square are checked for legality.
+class Pgn_reader
+{
+public:
+  static tl::expected<Pgn_reader, std::string> open(std::string const& filename);
+
+  // The text must outlive the reader
+  static Pgn_reader from_text(std::string_view text);
+
+  size_t get_game_count() const;
+  std::string_view get_game(size_t index) const;
+
+  // Calls on_ply for every ply of every game. The plies of a game arrive in
+  // order on one thread, but games are replayed in parallel, so on_ply must
+  // be safe to call from several threads at once. A game with an illegal or
+  // unreadable move is counted as failed and its remaining plies skipped.
+  Pgn_replay_stats replay(size_t thread_count, Pgn_ply_callback const& on_ply) const;
+
+  // Replays a single game and returns its final position. Games start from
+  // the FEN tag if there is one.
+  static tl::expected<Board, std::string> replay_game(std::string_view game, Pgn_ply_callback const& on_ply = {});
+
+private:
+  explicit Pgn_reader(std::string_view text);
+
+  static tl::expected<Board, std::string> replay_game_(std::string_view game,
+                                                       size_t game_index,
+                                                       Pgn_ply_callback const& on_ply,
+                                                       std::vector<Pgn_tag>& tags,
+                                                       size_t& plies);
+
+  std::optional<Memory_mapped_file> m_file;
+  std::vector<std::string_view> m_games;
+};
+} // namespace Meneldor
+
+#endif // PGN_READER_H
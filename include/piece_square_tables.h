@@ -0,0 +1,203 @@
+#ifndef PIECE_SQUARE_TABLES_H
+#define PIECE_SQUARE_TABLES_H
+
+#include "chess_types.h"
+#include "coordinates.h"
+
+namespace Meneldor
+{
+class Board;
+
+// Positional part of the evaluation, kept up to date by the board every time a
+// piece is added or removed. Scores are stored from white's point of view.
+class Piece_square_score
+{
+public:
+  // Game phase contributed by each piece, indexed by piece type starting at Piece::pawn
+  constexpr static std::array<int32_t, 6> c_phase_weights{0, 1, 1, 2, 4, 0};
+
+  // Phase of a game with all pieces still on the board
+  constexpr static int32_t c_max_phase{24};
+
+  constexpr Piece_square_score() = default;
+  Piece_square_score(Board const& board);
+
+  constexpr Piece_square_score(Piece_square_score const& other) = default;
+  constexpr Piece_square_score(Piece_square_score&& other) = default;
+  constexpr Piece_square_score& operator=(Piece_square_score const& other) = default;
+  constexpr Piece_square_score& operator=(Piece_square_score&& other) = default;
+
+  constexpr auto operator<=>(Piece_square_score const& other) const = default;
+
+  constexpr void add_piece(Color color, Piece piece, Coordinates location)
+  {
+    auto const sign = (color == Color::white) ? 1 : -1;
+    auto const index = table_index_(color, location);
+    auto const piece_index = static_cast<uint8_t>(piece) - static_cast<uint8_t>(Piece::pawn);
+
+    m_middlegame += static_cast<int16_t>(sign * c_middlegame_tables[piece_index][index]);
+    m_endgame += static_cast<int16_t>(sign * c_endgame_tables[piece_index][index]);
+    m_phase += static_cast<int16_t>(c_phase_weights[piece_index]);
+  }
+
+  constexpr void remove_piece(Color color, Piece piece, Coordinates location)
+  {
+    auto const sign = (color == Color::white) ? 1 : -1;
+    auto const index = table_index_(color, location);
+    auto const piece_index = static_cast<uint8_t>(piece) - static_cast<uint8_t>(Piece::pawn);
+
+    m_middlegame -= static_cast<int16_t>(sign * c_middlegame_tables[piece_index][index]);
+    m_endgame -= static_cast<int16_t>(sign * c_endgame_tables[piece_index][index]);
+    m_phase -= static_cast<int16_t>(c_phase_weights[piece_index]);
+  }
+
+  constexpr int32_t middlegame() const
+  {
+    return m_middlegame;
+  }
+
+  constexpr int32_t endgame() const
+  {
+    return m_endgame;
+  }
+
+  // 24 with all pieces on the board, down to 0 with only kings and pawns.
+  // Promotions can push this above c_max_phase.
+  constexpr int32_t phase() const
+  {
+    return m_phase;
+  }
+
+  // Blends a middlegame and endgame score based on the game phase
+  constexpr static int32_t taper(int32_t middlegame, int32_t endgame, int32_t phase)
+  {
+    phase = std::min(phase, c_max_phase);
+    return (middlegame * phase + endgame * (c_max_phase - phase)) / c_max_phase;
+  }
+
+  // Blends the middlegame and endgame scores based on the game phase, and
+  // returns the result from the point of view of the given color
+  constexpr int32_t tapered(Color color) const
+  {
+    auto const white_score = taper(m_middlegame, m_endgame, m_phase);
+    return (color == Color::white) ? white_score : -white_score;
+  }
+
+private:
+  // Tables are written as seen from white's side of the board (a8 is the first
+  // entry, h1 is the last), so white pieces need to be flipped vertically
+  constexpr static int32_t table_index_(Color color, Coordinates location)
+  {
+    constexpr int32_t c_flip_vertical{56};
+    return (color == Color::white) ? (location.square_index() ^ c_flip_vertical) : location.square_index();
+  }
+
+  int16_t m_middlegame{0};
+  int16_t m_endgame{0};
+  int16_t m_phase{0};
+
+  // Based on the tables from: https://www.chessprogramming.org/Simplified_Evaluation_Function
+  using Table = std::array<int8_t, c_board_dimension_squared>;
+
+  // clang-format off
+  constexpr static Table c_pawn_middlegame{
+      0,   0,   0,   0,   0,   0,   0,   0,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     10,  10,  20,  30,  30,  20,  10,  10,
+      5,   5,  10,  25,  25,  10,   5,   5,
+      0,   0,   0,  20,  20,   0,   0,   0,
+      5,  -5, -10,   0,   0, -10,  -5,   5,
+      5,  10,  10, -20, -20,  10,  10,   5,
+      0,   0,   0,   0,   0,   0,   0,   0,
+  };
+
+  constexpr static Table c_pawn_endgame{
+      0,   0,   0,   0,   0,   0,   0,   0,
+     80,  80,  80,  80,  80,  80,  80,  80,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     30,  30,  30,  30,  30,  30,  30,  30,
+     20,  20,  20,  20,  20,  20,  20,  20,
+     10,  10,  10,  10,  10,  10,  10,  10,
+     10,  10,  10,  10,  10,  10,  10,  10,
+      0,   0,   0,   0,   0,   0,   0,   0,
+  };
+
+  constexpr static Table c_knight{
+    -50, -40, -30, -30, -30, -30, -40, -50,
+    -40, -20,   0,   0,   0,   0, -20, -40,
+    -30,   0,  10,  15,  15,  10,   0, -30,
+    -30,   5,  15,  20,  20,  15,   5, -30,
+    -30,   0,  15,  20,  20,  15,   0, -30,
+    -30,   5,  10,  15,  15,  10,   5, -30,
+    -40, -20,   0,   5,   5,   0, -20, -40,
+    -50, -40, -30, -30, -30, -30, -40, -50,
+  };
+
+  constexpr static Table c_bishop{
+    -20, -10, -10, -10, -10, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,  10,  10,   5,   0, -10,
+    -10,   5,   5,  10,  10,   5,   5, -10,
+    -10,   0,  10,  10,  10,  10,   0, -10,
+    -10,  10,  10,  10,  10,  10,  10, -10,
+    -10,   5,   0,   0,   0,   0,   5, -10,
+    -20, -10, -10, -10, -10, -10, -10, -20,
+  };
+
+  constexpr static Table c_rook{
+      0,   0,   0,   0,   0,   0,   0,   0,
+      5,  10,  10,  10,  10,  10,  10,   5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+      0,   0,   0,   5,   5,   0,   0,   0,
+  };
+
+  constexpr static Table c_queen{
+    -20, -10, -10,  -5,  -5, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,   5,   5,   5,   0, -10,
+     -5,   0,   5,   5,   5,   5,   0,  -5,
+      0,   0,   5,   5,   5,   5,   0,  -5,
+    -10,   5,   5,   5,   5,   5,   0, -10,
+    -10,   0,   5,   0,   0,   0,   0, -10,
+    -20, -10, -10,  -5,  -5, -10, -10, -20,
+  };
+
+  constexpr static Table c_king_middlegame{
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -20, -30, -30, -40, -40, -30, -30, -20,
+    -10, -20, -20, -20, -20, -20, -20, -10,
+     20,  20,   0,   0,   0,   0,  20,  20,
+     20,  30,  10,   0,   0,  10,  30,  20,
+  };
+
+  constexpr static Table c_king_endgame{
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10,   0,   0, -10, -20, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -30,   0,   0,   0,   0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50,
+  };
+  // clang-format on
+
+  // These arrays can be indexed by piece type starting at Piece::pawn
+  constexpr static std::array<Table, 6> c_middlegame_tables{c_pawn_middlegame, c_knight, c_bishop,
+                                                            c_rook,            c_queen,  c_king_middlegame};
+  constexpr static std::array<Table, 6> c_endgame_tables{c_pawn_endgame, c_knight, c_bishop,
+                                                         c_rook,         c_queen,  c_king_endgame};
+};
+
+static_assert(sizeof(Piece_square_score) == 6);
+
+} // namespace Meneldor
+
+#endif // PIECE_SQUARE_TABLES_H
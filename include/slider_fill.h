@@ -0,0 +1,51 @@
+#ifndef SLIDER_FILL_H
+#define SLIDER_FILL_H
+
+#include "bitboard.h"
+
+// https://www.chessprogramming.org/Kogge-Stone_Algorithm
+
+namespace Meneldor
+{
+// Squares attacked by every rook, bishop and queen of a group
+struct Slider_group_attacks
+{
+  Bitboard rooks;
+  Bitboard bishops;
+  Bitboard queens;
+};
+
+// Computes the attacks of whole groups of sliders at once with occluded
+// fills, instead of one magic lookup per piece. Each direction takes three
+// shift steps no matter how many pieces are in the group, so this pays off
+// when full attack sets are needed, like for evaluation.
+class Slider_fill
+{
+public:
+  // Uses AVX2 to fill four directions per instruction when the cpu supports it
+  static Slider_group_attacks get_group_attacks(Bitboard rooks, Bitboard bishops, Bitboard queens, Bitboard occupied);
+
+  static Slider_group_attacks get_group_attacks_scalar(Bitboard rooks,
+                                                       Bitboard bishops,
+                                                       Bitboard queens,
+                                                       Bitboard occupied);
+
+  // Must only be called if has_avx2() is true
+  static Slider_group_attacks get_group_attacks_avx2(Bitboard rooks,
+                                                     Bitboard bishops,
+                                                     Bitboard queens,
+                                                     Bitboard occupied);
+
+  // Squares attacked along ranks and files by the first set of sliders, or
+  // along diagonals by the second. Half the work of a full group when the
+  // queens are already in both sets.
+  static Bitboard get_attacks(Bitboard orthogonal_sliders, Bitboard diagonal_sliders, Bitboard occupied);
+
+  static bool has_avx2();
+
+private:
+  static Bitboard get_attacks_avx2(Bitboard orthogonal_sliders, Bitboard diagonal_sliders, Bitboard occupied);
+};
+} // namespace Meneldor
+
+#endif // SLIDER_FILL_H
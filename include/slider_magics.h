@@ -0,0 +1,89 @@
+#ifndef SLIDER_MAGICS_H
+#define SLIDER_MAGICS_H
+
+#include "my_assert.h"
+
+// Shared by the slider lookups and the build time tool that fills their tables
+
+namespace Meneldor
+{
+// Generated with code from: https://www.chessprogramming.org/Looking_for_Magics
+inline constexpr std::array<uint64_t, 64> c_rook_magics{
+  0xa8002c000108020ULL,  0x6040004109200130ULL, 0x5820000814a02040ULL, 0x400800122040c4ULL,   0xa00211004010204ULL,
+  0x24010204000080ULL,   0x120004000822600ULL,  0x100024284a20700ULL,  0x4818080004040ULL,    0x4008e4804100ULL,
+  0x20200018000400ULL,   0x22001020081a040ULL,  0x30400200102205ULL,   0x201280018c020201ULL, 0x10401000486040e0ULL,
+  0x80290000804001ULL,   0x2000241002a08410ULL, 0x8018012008a84000ULL, 0x2015081004600090ULL, 0x8006803002208200ULL,
+  0xc220101090c800ULL,   0x20800404018aa200ULL, 0x4800900102200ULL,    0x600400980002015ULL,  0x198688480024008ULL,
+  0x10201040002000ULL,   0x403420002004c021ULL, 0x411081801804004ULL,  0x61004108016600ULL,   0x12400088240004ULL,
+  0x4004280806000100ULL, 0x840a0220005484ULL,   0x140311c080c00022ULL, 0x1004082010400040ULL, 0x110002400200400ULL,
+  0x40a02240200800ULL,   0x70480080d09040ULL,   0x1083000100800204ULL, 0x40042a510020006ULL,  0x8261014280380100ULL,
+  0x24402210042000ULL,   0x808000841001810ULL,  0x2000800811420004ULL, 0x8050006140100100ULL, 0x8002040100200dULL,
+  0x40080008100ULL,      0xa004108004204002ULL, 0xaa100429009ULL,      0x104000802080ULL,     0x400922050090118ULL,
+  0x810820104c25200ULL,  0x290005902801001ULL,  0x208080100810010aULL, 0x5004400011240ULL,    0x8104032040ULL,
+  0x1002000a0426420ULL,  0x82042081041042ULL,   0x8040c2900804001ULL,  0x884401004200882ULL,  0x88040220a000402ULL,
+  0x2303800644201ULL,    0x86e000980c122ULL,    0x82220a0461048204ULL, 0x1104010024104082ULL,
+};
+
+inline constexpr std::array<uint64_t, 64> c_bishop_magics{
+  0x4010002202254010ULL, 0x4000506049214012ULL, 0xc41200304280c044ULL, 0x8a2444c808010008ULL, 0x4020484080440000ULL,
+  0x86088240010401ULL,   0x204024041988805ULL,  0x121235021204012ULL,  0x8004024c10108a00ULL, 0x4c0060220023ULL,
+  0x20105844b4000ULL,    0xa0346880041000ULL,   0x225028000009ULL,     0x44010144025ULL,      0x10048044002224ULL,
+  0xc080a01403010021ULL, 0x4005000068002041ULL, 0x810000062002511ULL,  0x4440210104804484ULL, 0x2094000820401000ULL,
+  0x4024000080214001ULL, 0x488080800820020cULL, 0x210100118410a820ULL, 0x1d02104483a600b0ULL, 0x368201006002200ULL,
+  0x120262000800430cULL, 0x1914008001000900ULL, 0x86c080014006088ULL,  0x812002202008040ULL,  0x13410020040c2ULL,
+  0x80008008010008c0ULL, 0x20a004040050090ULL,  0x40100400120480ULL,   0x8011001064029428ULL, 0x404d0c02a140100ULL,
+  0x40020080080080ULL,   0x40040120c0100ULL,    0x44620040a032ULL,     0x8204610810002c32ULL, 0x12204034a400ULL,
+  0xa24a40a000600ULL,    0x1080401a0420810ULL,  0x103041010500200ULL,  0x8000029088002070ULL, 0x80048100420400ULL,
+  0x521041000080382ULL,  0x802886021808c040ULL, 0x1002842408080084ULL, 0x80c41040414ULL,      0x516118080102000ULL,
+  0x20008040130020ULL,   0x684044040ULL,        0x29002000c5100920ULL, 0x806004944406ULL,     0x8410002140d40088ULL,
+  0x1060032c0408eULL,    0x8000023202014000ULL, 0x102001008821081ULL,  0x706418104102c08ULL,  0x1064008000034400ULL,
+  0x110018809820080ULL,  0x462824088020422ULL,  0x88600e210a00a020ULL, 0x6011008100188200ULL,
+};
+
+// Magics for the packed tables, which shift by 64 minus the number of
+// possible blockers on each square. Found the same way as the ones above.
+inline constexpr std::array<uint64_t, 64> c_rook_fancy_magics{
+  0x1080004008801020ULL, 0x840092002c03000ULL,  0x1900200010400900ULL, 0x880100008000480ULL,  0x4200100420080200ULL,
+  0x8100020100080400ULL, 0x200040110886200ULL,  0x200008040220411ULL,  0x404800084400220ULL,  0x401000402000ULL,
+  0x86001081220440ULL,   0x408800800100280ULL,  0xa001201040820ULL,    0x8848800200840080ULL, 0x4001000100040200ULL,
+  0x442000102105084ULL,  0x9080010020804100ULL, 0x40404000201009ULL,   0x808010002009ULL,     0x2200090021d00100ULL,
+  0x8008008040080ULL,    0x4004002010040ULL,    0x11040008015042ULL,   0xa0001768104ULL,      0x800080204009ULL,
+  0x2010004140002001ULL, 0x9800200280100080ULL, 0x1000100080080080ULL, 0x442000a00049020ULL,  0x2100040080020080ULL,
+  0x800120400900148ULL,  0x10040a00128541ULL,   0x2800804000800030ULL, 0x1010002000400041ULL, 0x4000200011004100ULL,
+  0x610008410800800ULL,  0x400802402800800ULL,  0xc100020080800400ULL, 0x2000802000401ULL,    0x182085882000401ULL,
+  0x220204000808000ULL,  0x2860100040024022ULL, 0x1002004110040ULL,    0x99101042000a0020ULL, 0x4080004008080ULL,
+  0x10040002008080ULL,   0x2012004881020004ULL, 0x8300842444820011ULL, 0x88403882010200ULL,   0x820400080210100ULL,
+  0x110910040a00300ULL,  0x801100280080480ULL,  0x242009008200600ULL,  0x1002000489500200ULL, 0x40800200010080ULL,
+  0x91800041000080ULL,   0x209300488001ULL,     0x4c1002414824001ULL,  0x20020000b001041ULL,  0x7000100004200901ULL,
+  0x8002002004100802ULL, 0x30010002084c0007ULL, 0x888221800813004ULL,  0x4000002840840112ULL,
+};
+
+inline constexpr std::array<uint64_t, 64> c_bishop_fancy_magics{
+  0xa010041108003100ULL, 0x6082020a002900ULL,   0x6810010619200000ULL, 0x8281a0520000408ULL,  0x1104001000400ULL,
+  0x18901008048400ULL,   0x40a0210245280ULL,    0x200210808a402ULL,    0x9140048410821200ULL, 0x800091010820041ULL,
+  0x20504804832202c0ULL, 0x100091401081000ULL,  0x8021011140000012ULL, 0x810020804450400ULL,  0x208b0542109008a2ULL,
+  0x80084a08040204ULL,   0x40e2a80811244cULL,   0x2505022008008108ULL, 0x430220100420040ULL,  0x10a040420220040ULL,
+  0x1105000290400000ULL, 0x93001200822120ULL,   0x4000a62048043004ULL, 0x280120048a015004ULL, 0x6090002a020814ULL,
+  0x44042000240800d0ULL, 0x1102800040a4400ULL,  0x1004080080220040ULL, 0x1001011004024ULL,    0x10044000805040ULL,
+  0x914041200820100ULL,  0x4821012821480ULL,    0x24040500c05021ULL,   0x88611002080200ULL,   0x116080a00040020ULL,
+  0x4000020080080080ULL, 0x2450450140840040ULL, 0x880201484100ULL,     0x222020404020092ULL,  0x8081110600002e00ULL,
+  0x2842101105000801ULL, 0x1100809008001025ULL, 0x20202221c0400ULL,    0x422014022009020ULL,  0x210046102100c00ULL,
+  0xc004008082029102ULL, 0xaa461801101200ULL,   0x404080080201108ULL,  0x20542108c205002ULL,  0x410544804100100ULL,
+  0x40910841100000ULL,   0x400200042021100ULL,  0x4204850400c0ULL,     0x200100410a42102ULL,  0x1040020801210102ULL,
+  0x805040410420000ULL,  0x2884804130100200ULL, 0x800c262201242000ULL, 0x1058000194108800ULL, 0x14221054420204ULL,
+  0x104000012a02200ULL,  0x200881003300100ULL,  0x140400202840100ULL,  0x402020801010201ULL,
+};
+
+constexpr int magic_hash_fn(uint64_t blockers, uint64_t magic, int bits)
+{
+  MY_ASSERT(bits == 9 || bits == 12, "Fixed shift");
+  return (int)((blockers * magic) >> (64 - bits));
+}
+
+constexpr uint32_t fancy_magic_hash_fn(uint64_t blockers, uint64_t magic, int bits)
+{
+  return static_cast<uint32_t>((blockers * magic) >> (64 - bits));
+}
+} // namespace Meneldor
+
+#endif // SLIDER_MAGICS_H
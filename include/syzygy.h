@@ -0,0 +1,76 @@
+#ifndef SYZYGY_H
+#define SYZYGY_H
+
+#include "move_list.h"
+
+// https://www.chessprogramming.org/Syzygy_Bases
+// https://github.com/syzygy1/tb
+
+namespace Meneldor
+{
+class Board;
+
+// Defined in syzygy.cpp
+struct Syzygy_table;
+
+enum class Syzygy_wdl : int8_t
+{
+  loss = -2,
+  blessed_loss = -1, // Lost, but drawn by the 50 move rule
+  draw = 0,
+  cursed_win = 1, // Won, but drawn by the 50 move rule
+  win = 2,
+};
+
+// Probes a set of Syzygy tablebase files. .rtbw files hold win/draw/loss for
+// both sides to move and .rtbz files hold the distance to the next capture or
+// pawn move for one side to move. Files are found when the paths are set, and
+// only mapped into memory the first time a position needs them.
+class Syzygy_tablebase
+{
+public:
+  constexpr static std::string_view c_wdl_extension{".rtbw"};
+  constexpr static std::string_view c_dtz_extension{".rtbz"};
+
+  Syzygy_tablebase();
+  ~Syzygy_tablebase();
+
+  Syzygy_tablebase(Syzygy_tablebase const& other) = delete;
+  Syzygy_tablebase& operator=(Syzygy_tablebase const& other) = delete;
+
+  // Finds the tables in every directory of a list separated by ':' (';' on
+  // Windows). Returns the number of tables found.
+  tl::expected<size_t, std::string> load_paths(std::string const& paths);
+
+  void clear();
+
+  // Number of pieces in the largest table found, zero if none were found
+  size_t get_max_pieces() const;
+
+  // Returns nothing if the position isn't covered by the tables. Positions
+  // that can still castle aren't covered.
+  std::optional<Syzygy_wdl> probe_wdl(Board const& board) const;
+
+  // Plies to the next capture or pawn move with best play, positive when
+  // winning and negative when losing. Zero for draws. Values above 100 mean
+  // the result is drawn by the 50 move rule.
+  std::optional<int32_t> probe_dtz(Board const& board) const;
+
+  // The root moves that keep the best result, preferring moves that reach
+  // a capture or pawn move sooner. Returns nothing if the position isn't
+  // covered by the tables.
+  std::optional<Move_list> filter_root_moves(Board const& board, std::span<Move const> moves) const;
+
+private:
+  bool covers_(Board const& board) const;
+
+  std::vector<std::unique_ptr<Syzygy_table>> m_tables;
+
+  // Each table is found under its material key and the key with colors swapped
+  std::unordered_map<uint64_t, Syzygy_table*> m_tables_by_key;
+
+  size_t m_max_pieces{0};
+};
+} // namespace Meneldor
+
+#endif // SYZYGY_H
@@ -0,0 +1,204 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include "board.h"
+#include "memory_mapped_file.h"
+
+// https://www.chessprogramming.org/Endgame_Tablebases
+// https://www.chessprogramming.org/Retrograde_Analysis
+
+namespace Meneldor
+{
+struct Tablebase_result
+{
+  enum class Wdl : int8_t
+  {
+    loss = -1,
+    draw = 0,
+    win = 1,
+  };
+
+  // From the point of view of the side to move
+  Wdl wdl{Wdl::draw};
+
+  // Plies until checkmate with best play, 0 for draws
+  int32_t distance_to_mate{0};
+
+  // The result for the side that made the move leading to this result
+  constexpr Tablebase_result parent() const
+  {
+    if (wdl == Wdl::draw)
+    {
+      return {};
+    }
+    return {(wdl == Wdl::win) ? Wdl::loss : Wdl::win, distance_to_mate + 1};
+  }
+
+  // Higher is better for the side to move: faster wins and slower losses
+  constexpr int32_t rank() const
+  {
+    constexpr int32_t c_decisive{1'000};
+    switch (wdl)
+    {
+      case Wdl::win:
+        return c_decisive - distance_to_mate;
+      case Wdl::loss:
+        return -c_decisive + distance_to_mate;
+      default:
+        return 0;
+    }
+  }
+};
+
+// A position in the order a table stores its pieces: white king, black king,
+// then the table's other pieces
+struct Tablebase_position
+{
+  std::array<Coordinates, 4> squares{a1, a1, a1, a1};
+  Color side_to_move{Color::white};
+};
+
+// Win, draw or loss and distance to mate for every position of one material
+// configuration, like "KRvKN". Tables are named with the stronger side as
+// white; positions where black is stronger are probed with the colors swapped.
+//
+// Each position is stored in a single byte. Zero is a draw, or a position
+// that can't happen. Any other value is one more than the distance to mate in
+// plies, and the side to move wins when that distance is odd.
+class Tablebase_table
+{
+public:
+  constexpr static size_t c_max_pieces{4};
+  constexpr static uint8_t c_draw{0};
+  constexpr static int32_t c_max_distance_to_mate{std::numeric_limits<uint8_t>::max() - 1};
+
+  // Creates a table with every position drawn, to be filled in by the generator
+  static tl::expected<Tablebase_table, std::string> create(std::string_view name);
+
+  static tl::expected<Tablebase_table, std::string> load(std::string const& filename);
+
+  tl::expected<void, std::string> save(std::string const& filename) const;
+
+  static constexpr uint8_t encode(int32_t distance_to_mate)
+  {
+    MY_ASSERT(0 <= distance_to_mate && distance_to_mate <= c_max_distance_to_mate, "Distance to mate out of range");
+    return static_cast<uint8_t>(distance_to_mate + 1);
+  }
+
+  static constexpr Tablebase_result decode(uint8_t value)
+  {
+    if (value == c_draw)
+    {
+      return {};
+    }
+    auto const distance_to_mate = static_cast<int32_t>(value) - 1;
+    return {(distance_to_mate % 2 == 1) ? Tablebase_result::Wdl::win : Tablebase_result::Wdl::loss,
+            distance_to_mate};
+  }
+
+  std::string const& get_name() const;
+
+  // Number of pieces including kings
+  size_t get_piece_count() const;
+
+  // The pieces that aren't kings, in the order their squares are stored
+  std::span<std::pair<Color, Piece> const> get_pieces() const;
+
+  bool has_pawns() const;
+
+  // Number of positions in the table
+  size_t size() const;
+
+  // Positions related by symmetry share an index, so the position may be
+  // mirrored to find it
+  size_t index_of(Tablebase_position position) const;
+
+  // Only the squares that belong to pieces in this table are set
+  Tablebase_position position_at(size_t index) const;
+
+  // The board must have this table's material, after swapping colors if
+  // swap_colors is set. Swapping colors also mirrors the board vertically.
+  Tablebase_position position_from_board(Board const& board, bool swap_colors) const;
+
+  uint8_t get_value(size_t index) const;
+
+  // Only valid for tables made with create()
+  void set_value(size_t index, uint8_t value);
+
+private:
+  Tablebase_table() = default;
+
+  static tl::expected<Tablebase_table, std::string> from_name_(std::string_view name);
+
+  std::string m_name;
+  std::vector<std::pair<Color, Piece>> m_pieces;
+  bool m_has_pawns{false};
+  size_t m_size{0};
+
+  // One of these holds the values
+  std::vector<uint8_t> m_owned_values;
+  std::optional<Memory_mapped_file> m_file;
+  std::span<uint8_t const> m_values;
+};
+
+// Every loaded table, looked up by the material on the board
+class Tablebase
+{
+public:
+  constexpr static std::string_view c_file_extension{".mtb"};
+
+  // Names of every table with three or four pieces, ordered so that every
+  // table a position can convert into by a capture or promotion comes first
+  static std::vector<std::string> get_all_table_names();
+
+  // Name of the table holding the board's material, and whether black is
+  // the stronger side so the colors need to be swapped
+  static std::pair<std::string, bool> table_name(Board const& board);
+
+  // Loads every table in the directory. Returns the number of tables loaded.
+  tl::expected<size_t, std::string> load_directory(std::string const& directory);
+
+  void add_table(Tablebase_table table);
+
+  void clear();
+
+  Tablebase_table const* find_table(std::string const& name) const;
+
+  // Returns nothing if the position isn't covered by a loaded table. Castling
+  // isn't stored, so positions where it is still possible aren't covered.
+  // Tables ignore the 50 move rule, so wins and losses whose mate may come
+  // after the halfmove clock runs out aren't covered either.
+  std::optional<Tablebase_result> probe(Board const& board) const;
+
+  // Same as probe, but gives the distance to mate even if the 50 move rule
+  // could end the game first. Used to generate tables.
+  std::optional<Tablebase_result> probe_ignoring_halfmove_clock(Board const& board) const;
+
+  // Number of pieces in the largest loaded table, zero if none are loaded
+  size_t get_max_pieces() const;
+
+private:
+  // A loaded table and whether the colors of the board need to be swapped to
+  // probe it
+  struct Table_entry
+  {
+    Tablebase_table const* table{nullptr};
+    bool swap_colors{false};
+  };
+
+  std::optional<Tablebase_result> probe_(Board const& board, bool use_halfmove_clock) const;
+
+  // Tables don't store the en passant square, so positions that have one
+  // are resolved by looking one move ahead
+  std::optional<Tablebase_result> probe_en_passant_(Board const& board, bool use_halfmove_clock) const;
+
+  std::map<std::string, Tablebase_table, std::less<>> m_tables;
+
+  // Every table by the material key of the boards it holds, with either side
+  // as the stronger one, so probing doesn't need to build the table name
+  std::unordered_map<uint64_t, Table_entry> m_tables_by_material;
+  size_t m_max_pieces{0};
+};
+} // namespace Meneldor
+
+#endif // TABLEBASE_H
@@ -0,0 +1,23 @@
+#ifndef TABLEBASE_GENERATOR_H
+#define TABLEBASE_GENERATOR_H
+
+#include "tablebase.h"
+
+namespace Meneldor
+{
+// Builds tables by retrograde analysis. Starting from checkmates, each pass
+// finds the positions that are won or lost one ply further from mate, and
+// only revisits positions that a newly solved position can be reached from.
+class Tablebase_generator
+{
+public:
+  // Tables that a position can convert into by a capture or promotion must
+  // already be in the tablebase. Progress is written to log if it isn't null.
+  static tl::expected<Tablebase_table, std::string> generate(std::string_view name,
+                                                             Tablebase const& tablebase,
+                                                             size_t thread_count,
+                                                             std::ostream* log = nullptr);
+};
+} // namespace Meneldor
+
+#endif // TABLEBASE_GENERATOR_H
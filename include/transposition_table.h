@@ -5,6 +5,18 @@
 
 namespace Meneldor
 {
+// Entries are grouped into 64 byte buckets, so a probe touches a single cache
+// line. Each entry keeps 16 bits of the key to detect collisions, the best
+// move as Move::compact(), and the evaluation packed together with the
+// depth, bound type and the generation it was written in.
+//
+// Entries from older searches are aged out by bumping the generation rather
+// than by clearing the table.
+//
+// The buckets are mapped straight from the OS, which hands out zeroed pages
+// the first time they are touched, so creating even a large table is
+// instant. Where supported the mapping is aligned for, and hinted to use,
+// transparent huge pages, saving a TLB miss on most probes.
 class Transposition_table
 {
 public:
@@ -17,41 +29,159 @@ public:
 
   struct Entry
   {
-    zhash_t key{0};
     int depth{0};
     int evaluation{0};
-    Move best_move{};
+
+    // Move::compact() of the best move, zero if there isn't one
+    uint16_t best_move{0};
     Eval_type type{Eval_type::alpha};
   };
 
-  static_assert(sizeof(Entry) == 24);
+  // Depths deeper than this are stored as this
+  constexpr static int c_max_depth{127};
+
+  // Throws std::bad_alloc if the memory can't be mapped
+  Transposition_table(size_t table_size_bytes, bool use_huge_pages = true);
+
+  Transposition_table(Transposition_table const& other) = delete;
+  Transposition_table& operator=(Transposition_table const& other) = delete;
+
+  ~Transposition_table();
 
-  Transposition_table(size_t table_size_bytes);
+  // Discards all entries. Keeps the current table if the new one can't be allocated.
+  tl::expected<void, std::string> resize(size_t table_size_bytes);
 
-  ~Transposition_table() = default;
+  // Writes the whole table to a file, so a later session can load() it
+  tl::expected<void, std::string> save(std::filesystem::path const& filename) const;
 
-  void insert(zhash_t h, Entry entry);
+  // Replaces the table, including its size, with one written by save(). The
+  // file is mapped copy-on-write, so pages are only read as the search
+  // touches them and the file itself never changes. Keeps the current table
+  // if the file can't be used.
+  tl::expected<void, std::string> load(std::filesystem::path const& filename);
 
-  Entry const* get(zhash_t key) const;
+  void insert(zhash_t key, int depth, int evaluation, Move best_move, Eval_type type);
+
+  std::optional<Entry> get(zhash_t key) const;
+
+  // Starts loading the bucket for a key into the cache. Called as soon as a
+  // child position's key is known, so the bucket is ready when it is probed.
+  void prefetch(zhash_t key) const
+  {
+    __builtin_prefetch(&m_buckets[index_(key)]);
+  }
 
+  // Entries written after this are preferred over entries written before it
+  // when choosing what to replace
+  void new_generation();
+
+  // Number of entries the table can hold
   size_t get_capacity() const;
 
   // Returns the number of non-null entries in the table
   size_t count() const;
 
+  // Zeroes the table, split across all hardware threads for large tables.
+  // On machines with several NUMA nodes the threads are spread over the
+  // nodes, so a new table's pages are interleaved between them.
   void clear();
 
+  // Whether the OS was asked to back the table with huge pages
+  bool uses_huge_pages() const;
+
 private:
-  // Store two entries per hash value, largest depth and newest
-  static constexpr size_t c_entries_per_key{2};
+  // Layout of Packed_entry::data, from the lowest bit up
+  constexpr static int c_evaluation_bits{18};
+  constexpr static int c_depth_bits{7};
+  constexpr static int c_type_bits{2};
+  constexpr static int c_generation_bits{5};
+  constexpr static int c_depth_shift{c_evaluation_bits};
+  constexpr static int c_type_shift{c_depth_shift + c_depth_bits};
+  constexpr static int c_generation_shift{c_type_shift + c_type_bits};
+  static_assert(c_generation_shift + c_generation_bits == 32);
+  static_assert(c_max_depth == (1 << c_depth_bits) - 1);
+  static_assert(positive_inf < (1 << (c_evaluation_bits - 1)), "Evaluations must fit in the evaluation bits");
+
+  struct Packed_entry
+  {
+    uint16_t key{0};
+    uint16_t best_move{0};
+    uint32_t data{0};
+
+    constexpr bool is_empty() const
+    {
+      return data == 0;
+    }
+
+    constexpr int evaluation() const
+    {
+      // Shift the sign bit up to the top, then back down to sign extend
+      constexpr int c_unused_bits{32 - c_evaluation_bits};
+      return static_cast<int32_t>(data << c_unused_bits) >> c_unused_bits;
+    }
+
+    constexpr int depth() const
+    {
+      return static_cast<int>((data >> c_depth_shift) & ((1U << c_depth_bits) - 1));
+    }
+
+    constexpr Eval_type type() const
+    {
+      return static_cast<Eval_type>((data >> c_type_shift) & ((1U << c_type_bits) - 1));
+    }
+
+    constexpr uint8_t generation() const
+    {
+      return static_cast<uint8_t>(data >> c_generation_shift);
+    }
+  };
+
+  static_assert(sizeof(Packed_entry) == 8);
+
+  constexpr static size_t c_entries_per_bucket{8};
+
+  struct alignas(64) Bucket
+  {
+    std::array<Packed_entry, c_entries_per_bucket> entries{};
+  };
+
+  static_assert(sizeof(Bucket) == 64);
+
+  // The low bits of the key are kept to detect collisions, while index_()
+  // mostly depends on the high bits
+  constexpr static uint16_t check_bits_(zhash_t key)
+  {
+    return static_cast<uint16_t>(key);
+  }
+
+  // Maps the key onto [0, bucket count) with a multiply and a shift instead of a
+  // division, so the bucket count doesn't need to be a power of two
+  size_t index_(zhash_t key) const
+  {
+    __extension__ using uint128_t = unsigned __int128;
+    return static_cast<size_t>((static_cast<uint128_t>(key) * m_buckets.size()) >> 64);
+  }
+
+  // How many generations ago the entry was written
+  uint8_t age_(Packed_entry entry) const;
+
+  // Takes ownership of a mapping holding the buckets
+  void adopt_(void* mapping, size_t mapping_size, std::span<Bucket> buckets, bool has_huge_pages);
+
+  void release_();
+
+  bool const m_use_huge_pages{true};
 
-  Entry* walk_(zhash_t key);
-  Entry const* walk_(zhash_t key) const;
+  // Tables smaller than a huge page never use them
+  bool m_has_huge_pages{false};
 
-  size_t hash_fn_(zhash_t key) const;
+  // The memory owned by the table. For a loaded table this includes the file header.
+  void* m_mapping{nullptr};
+  size_t m_mapping_size{0};
 
-  size_t const m_table_capacity{0};
-  std::vector<Entry> m_table;
+  // The part of the mapping holding buckets
+  std::span<Bucket> m_buckets;
+  uint8_t m_generation{1};
 };
 } // namespace Meneldor
 
@@ -22,6 +22,10 @@ public:
   constexpr Zobrist_hash() = default;
   Zobrist_hash(Board const& board);
 
+  // Computes a hash of only the pawns on the board. Pawn structure changes
+  // rarely, so this makes a good key for caching pawn evaluation.
+  static Zobrist_hash pawns_only(Board const& board);
+
   constexpr Zobrist_hash(Zobrist_hash const& other) = default;
   constexpr Zobrist_hash(Zobrist_hash&& other) = default;
   constexpr Zobrist_hash& operator=(Zobrist_hash const& other) = default;
@@ -36,7 +40,7 @@ public:
   {
     if (!ep_square.is_empty())
     {
-      m_hash ^= m_random_numbers[c_en_passant_file_offset + Coordinates{ep_square.bitscan_forward()}.y()];
+      m_hash ^= m_random_numbers[c_en_passant_file_offset + Coordinates{ep_square.bitscan_forward()}.x()];
     }
   }
 
@@ -74,6 +78,18 @@ public:
     return m_hash;
   }
 
+  // Identifies the random numbers, so hashes saved to a file are only
+  // reused by builds that hash positions the same way
+  constexpr static zhash_t get_checksum()
+  {
+    zhash_t checksum{0};
+    for (auto const value : m_random_numbers)
+    {
+      checksum = std::rotl(checksum, 1) ^ value;
+    }
+    return checksum;
+  }
+
 private:
   zhash_t m_hash{0};
 
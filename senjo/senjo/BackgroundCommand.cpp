@@ -138,7 +138,7 @@ void GoCommandHandle::doWork() {
 }
 
 //-----------------------------------------------------------------------------
-const std::string PerftCommandHandle::_TEST_FILE = "epd/perftsuite.epd";
+const std::string PerftCommandHandle::_TEST_FILE = "data/perftsuite.epd";
 
 //-----------------------------------------------------------------------------
 bool PerftCommandHandle::parse(Parameters& params) {
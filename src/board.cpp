@@ -1,6 +1,7 @@
 #include "board.h"
 #include "move_generator.h"
 #include "my_assert.h"
+#include "pgn_reader.h"
 #include "utils.h"
 
 namespace rs = std::ranges;
@@ -192,6 +193,44 @@ bool is_en_passant(Piece piece, Coordinates from, Coordinates to, Board const& b
   return false;
 }
 
+Move_type get_move_type(Piece piece, Coordinates from, Coordinates to, Piece promotion, bool is_en_passant)
+{
+  if (is_en_passant)
+  {
+    return Move_type::en_passant;
+  }
+  if (promotion != Piece::empty)
+  {
+    return Move_type::promotion;
+  }
+  if (piece == Piece::king && std::abs(from.x() - to.x()) == 2)
+  {
+    return Move_type::castle;
+  }
+  if (piece == Piece::pawn && std::abs(from.y() - to.y()) == 2)
+  {
+    return Move_type::double_push;
+  }
+  return Move_type::normal;
+}
+
+// Castling rights that are kept when a piece moves from or to each square, so
+// that updating them after any move is two lookups
+constexpr auto c_castling_rights_kept = []
+{
+  std::array<Castling_rights, c_board_dimension_squared> result{};
+  result.fill(c_castling_rights_all);
+  set_white_long_castle_false(result[a1.square_index()]);
+  set_white_short_castle_false(result[h1.square_index()]);
+  set_white_long_castle_false(result[e1.square_index()]);
+  set_white_short_castle_false(result[e1.square_index()]);
+  set_black_long_castle_false(result[a8.square_index()]);
+  set_black_short_castle_false(result[h8.square_index()]);
+  set_black_long_castle_false(result[e8.square_index()]);
+  set_black_short_castle_false(result[e8.square_index()]);
+  return result;
+}();
+
 Board::Board()
 {
   reset();
@@ -199,6 +238,7 @@ Board::Board()
 
 Board::Board(int) : m_rights{c_castling_rights_none}
 {
+  m_mailbox.fill(static_cast<uint8_t>(Piece::empty));
 }
 
 Bitboard Board::get_piece_set(Color color, Piece piece) const
@@ -231,48 +271,6 @@ bool Board::is_occupied(Coordinates square) const
   return get_occupied_squares().is_set(square);
 }
 
-Color Board::get_piece_color(Coordinates square) const
-{
-  MY_ASSERT(is_occupied(square), "This function can only be called for occupied squares");
-
-  return get_all(Color::white).is_set(square) ? Color::white : Color::black;
-}
-
-Piece Board::get_piece(Coordinates square) const
-{
-  if (get_all(Piece::pawn).is_set(square))
-  {
-    return Piece::pawn;
-  }
-
-  if (get_all(Piece::bishop).is_set(square))
-  {
-    return Piece::bishop;
-  }
-
-  if (get_all(Piece::knight).is_set(square))
-  {
-    return Piece::knight;
-  }
-
-  if (get_all(Piece::rook).is_set(square))
-  {
-    return Piece::rook;
-  }
-
-  if (get_all(Piece::queen).is_set(square))
-  {
-    return Piece::queen;
-  }
-
-  if (get_all(Piece::king).is_set(square))
-  {
-    return Piece::king;
-  }
-
-  return Piece::empty;
-}
-
 Castling_rights Board::get_castling_rights() const
 {
   return m_rights;
@@ -330,13 +328,13 @@ bool Board::undo_move(Move m, Bitboard en_passant_square, Castling_rights rights
 
   unperform_move_(color, m);
 
-  if (m.piece() == Piece::king && distance_between(m.to(), m.from()) == 2)
+  if (m.type() == Move_type::castle)
   {
     auto const rook_move = find_castling_rook_move_(m.to());
     unperform_move_(color, rook_move);
   }
 
-  if (m.promotion() != Piece::empty)
+  if (m.type() == Move_type::promotion)
   {
     remove_piece_(color, m.promotion(), m.from());
     add_piece_(color, Piece::pawn, m.from());
@@ -423,7 +421,23 @@ bool Board::move_no_verify(Move m, bool skip_check_detection)
 {
   auto const color = get_active_color();
 
-  if (m.type() != Move_type::null)
+  if (m.type() == Move_type::null)
+  {
+    m_zhash.update_en_passant_square(m_en_passant_square);
+    m_en_passant_square.unset_all();
+    m_zhash.update_en_passant_square(m_en_passant_square);
+
+    if (color == Color::black)
+    {
+      ++m_fullmove_count;
+    }
+
+    m_active_color = opposite_color(color);
+    m_zhash.update_player_to_move();
+    return true;
+  }
+
+  if (!skip_check_detection)
   {
     auto capture_location = m.to();
     if (m.type() == Move_type::en_passant)
@@ -432,62 +446,97 @@ bool Board::move_no_verify(Move m, bool skip_check_detection)
     }
 
     perform_move_(m, capture_location);
-    if (!skip_check_detection && is_in_check(color))
+    auto const leaves_king_in_check = is_in_check(color);
+    unperform_move_(color, m);
+    if (leaves_king_in_check)
     {
-      unperform_move_(color, m);
       return false;
     }
+  }
 
-    m_zhash.update_castling_rights(m_rights);
-    update_castling_rights_(color, m.piece(), m);
-    m_zhash.update_castling_rights(m_rights);
+  if (color == Color::white)
+  {
+    make_move<Color::white>(m);
+  }
+  else
+  {
+    make_move<Color::black>(m);
+  }
+  return true;
+}
 
-    // Move rook if the move was a castle
-    if (m.piece() == Piece::king && distance_between(m.from(), m.to()) == 2)
-    {
-      auto const rook_move = find_castling_rook_move_(m.to());
-      perform_move_(rook_move, rook_move.to());
-    }
+template <Color color>
+void Board::make_move(Move m)
+{
+  MY_ASSERT(color == get_active_color(), "Only the active color can move");
+  MY_ASSERT(m.type() != Move_type::null, "Null moves must be made with move_no_verify()");
+  MY_ASSERT(m.piece() == get_piece(m.from()), "Move has incorrect moving piece");
 
-    // Promote pawn if it reached the last rank
-    if (m.promotion() != Piece::empty)
-    {
-      remove_piece_(color, Piece::pawn, m.to());
-      add_piece_(color, m.promotion(), m.to());
-    }
+  constexpr auto enemy = opposite_color(color);
+  constexpr int32_t forward{(color == Color::white) ? c_board_dimension : -c_board_dimension};
 
-    if (m.piece() == Piece::pawn || m.victim() != Piece::empty)
-    {
-      m_halfmove_clock = 0;
-    }
-    else
+  switch (m.type())
+  {
+    case Move_type::castle:
     {
-      ++m_halfmove_clock;
+      auto const rook_move = find_castling_rook_move_(m.to());
+      remove_piece_(color, Piece::king, m.from());
+      add_piece_(color, Piece::king, m.to());
+      remove_piece_(color, Piece::rook, rook_move.from());
+      add_piece_(color, Piece::rook, rook_move.to());
+      break;
     }
+    case Move_type::en_passant:
+      remove_piece_(enemy, Piece::pawn, Coordinates{m.to().square_index() - forward});
+      remove_piece_(color, Piece::pawn, m.from());
+      add_piece_(color, Piece::pawn, m.to());
+      break;
+    case Move_type::promotion:
+      if (m.victim() != Piece::empty)
+      {
+        remove_piece_(enemy, m.victim(), m.to());
+      }
+      remove_piece_(color, Piece::pawn, m.from());
+      add_piece_(color, m.promotion(), m.to());
+      break;
+    default:
+      if (m.victim() != Piece::empty)
+      {
+        remove_piece_(enemy, m.victim(), m.to());
+      }
+      remove_piece_(color, m.piece(), m.from());
+      add_piece_(color, m.piece(), m.to());
+      break;
   }
 
-  // Set en passant square if applicable
+  m_zhash.update_castling_rights(m_rights);
+  m_rights &= c_castling_rights_kept[m.from().square_index()] & c_castling_rights_kept[m.to().square_index()];
+  m_zhash.update_castling_rights(m_rights);
+
+  m_halfmove_clock = (m.piece() == Piece::pawn || m.victim() != Piece::empty) ? 0 : m_halfmove_clock + 1;
+
   m_zhash.update_en_passant_square(m_en_passant_square);
   m_en_passant_square.unset_all();
-  if (m.piece() == Piece::pawn && distance_between(m.from(), m.to()) == 2)
+  if (m.type() == Move_type::double_push)
   {
-    int const offset = (color == Color::white) ? -1 : 1;
-    m_en_passant_square.set_square(Coordinates{m.to().x(), m.to().y() + offset});
+    m_en_passant_square.set_square(Coordinates{m.from().square_index() + forward});
   }
   m_zhash.update_en_passant_square(m_en_passant_square);
 
-  if (color == Color::black)
+  if constexpr (color == Color::black)
   {
     ++m_fullmove_count;
   }
 
-  m_active_color = opposite_color(color);
+  m_active_color = enemy;
   m_zhash.update_player_to_move();
 
   MY_ASSERT(validate_(), "Board is in an incorrect state after move");
-  return true;
 }
 
+template void Board::make_move<Color::white>(Move m);
+template void Board::make_move<Color::black>(Move m);
+
 tl::expected<void, std::string> Board::try_move_algebraic(std::string_view move_str)
 {
   return move_from_algebraic(move_str, get_active_color())
@@ -525,18 +574,13 @@ uint8_t Board::get_move_count() const
 
 bool Board::has_sufficient_material(Color color) const
 {
-  if (!get_piece_set(color, Piece::pawn).is_empty() || !get_piece_set(color, Piece::rook).is_empty() ||
-      !get_piece_set(color, Piece::queen).is_empty())
-  {
-    return true;
-  }
-
-  if ((get_piece_set(color, Piece::bishop).occupancy() + get_piece_set(color, Piece::knight).occupancy()) >= 2)
+  if (m_material_key.count(color, Piece::pawn) != 0 || m_material_key.count(color, Piece::rook) != 0 ||
+      m_material_key.count(color, Piece::queen) != 0)
   {
     return true;
   }
 
-  return false;
+  return (m_material_key.count(color, Piece::bishop) + m_material_key.count(color, Piece::knight)) >= 2;
 }
 
 Zobrist_hash Board::get_hash_key() const
@@ -544,6 +588,21 @@ Zobrist_hash Board::get_hash_key() const
   return m_zhash;
 }
 
+Zobrist_hash Board::get_pawn_hash_key() const
+{
+  return m_pawn_zhash;
+}
+
+Material_key Board::get_material_key() const
+{
+  return m_material_key;
+}
+
+Piece_square_score Board::get_piece_square_score() const
+{
+  return m_psq_score;
+}
+
 Move Board::find_castling_rook_move_(Coordinates king_destination) const
 {
   if (king_destination == c1)
@@ -592,45 +651,6 @@ bool Board::can_castle_to(Coordinates dest) const
   return false;
 }
 
-void Board::update_castling_rights_(Color color, Piece piece, Move m)
-{
-  if (piece == Piece::king)
-  {
-    if (color == Color::black)
-    {
-      set_black_short_castle_false(m_rights);
-      set_black_long_castle_false(m_rights);
-    }
-    else
-    {
-      set_white_short_castle_false(m_rights);
-      set_white_long_castle_false(m_rights);
-    }
-  }
-  else
-  {
-    // TODO: Could this be a lookup table, maybe with some sort of perfect hashing scheme?
-    auto const to = m.to();
-    auto const from = m.from();
-    if (to == a1 || from == a1)
-    {
-      set_white_long_castle_false(m_rights);
-    }
-    if (to == h1 || from == h1)
-    {
-      set_white_short_castle_false(m_rights);
-    }
-    if (to == a8 || from == a8)
-    {
-      set_black_long_castle_false(m_rights);
-    }
-    if (to == h8 || from == h8)
-    {
-      set_black_short_castle_false(m_rights);
-    }
-  }
-}
-
 /**
  * Calculates the distance between two squares on the board
  * @param from The first square
@@ -802,7 +822,15 @@ void Board::add_piece_(Color color, Piece piece, Coordinates to_add)
 
   m_bitboards[static_cast<uint8_t>(color)].set_square(to_add);
   m_bitboards[static_cast<uint8_t>(piece)].set_square(to_add);
+  m_mailbox[to_add.square_index()] =
+    static_cast<uint8_t>(static_cast<uint8_t>(piece) | (static_cast<uint8_t>(color) << c_mailbox_color_shift));
   m_zhash.update_piece_location(color, piece, to_add);
+  m_psq_score.add_piece(color, piece, to_add);
+  m_material_key.add_piece(color, piece);
+  if (piece == Piece::pawn)
+  {
+    m_pawn_zhash.update_piece_location(color, piece, to_add);
+  }
 }
 
 void Board::remove_piece_(Color color, Piece piece, Coordinates to_remove)
@@ -811,7 +839,14 @@ void Board::remove_piece_(Color color, Piece piece, Coordinates to_remove)
 
   m_bitboards[static_cast<uint8_t>(color)].unset_square(to_remove);
   m_bitboards[static_cast<uint8_t>(piece)].unset_square(to_remove);
+  m_mailbox[to_remove.square_index()] = static_cast<uint8_t>(Piece::empty);
   m_zhash.update_piece_location(color, piece, to_remove);
+  m_psq_score.remove_piece(color, piece, to_remove);
+  m_material_key.remove_piece(color, piece);
+  if (piece == Piece::pawn)
+  {
+    m_pawn_zhash.update_piece_location(color, piece, to_remove);
+  }
 }
 
 bool Board::validate_() const
@@ -847,12 +882,50 @@ bool Board::validate_() const
     }
   }
 
+  // The mailbox must hold the same piece as the bitboards on every square
+  for (int32_t i{0}; i < c_board_dimension_squared; ++i)
+  {
+    Coordinates const square{i};
+    auto expected = static_cast<uint8_t>(Piece::empty);
+    for (auto piece : piece_types)
+    {
+      if (get_all(piece).is_set(square))
+      {
+        auto const color = get_all(Color::white).is_set(square) ? Color::white : Color::black;
+        expected =
+          static_cast<uint8_t>(static_cast<uint8_t>(piece) | (static_cast<uint8_t>(color) << c_mailbox_color_shift));
+      }
+    }
+    if (m_mailbox[i] != expected)
+    {
+      return false;
+    }
+  }
+
   Zobrist_hash new_hash{*this};
   if (new_hash != m_zhash)
   {
     return false;
   }
 
+  if (Zobrist_hash::pawns_only(*this) != m_pawn_zhash)
+  {
+    return false;
+  }
+
+  if (Material_key{*this} != m_material_key)
+  {
+    return false;
+  }
+
+  // The piece-square score is only ever updated incrementally, make sure it
+  // still matches a full recomputation
+  Piece_square_score new_psq_score{*this};
+  if (new_psq_score != m_psq_score)
+  {
+    return false;
+  }
+
   return true;
 }
 
@@ -902,7 +975,7 @@ tl::expected<Move, std::string> Board::move_from_uci(std::string move_str) const
     auto const moving_piece = get_piece(*from);
     auto const is_ep = is_en_passant(moving_piece, *from, *to, *this);
     auto const victim_piece = is_ep ? Piece::pawn : get_piece(*to);
-    auto const move_type = is_ep ? Move_type::en_passant : Move_type::normal;
+    auto const move_type = get_move_type(moving_piece, *from, *to, promotion_result, is_ep);
     return Move{*from, *to, moving_piece, victim_piece, promotion_result, move_type};
   }
 
@@ -939,11 +1012,11 @@ tl::expected<Move, std::string> Board::move_from_algebraic(std::string_view move
   {
     if (color == Color::white)
     {
-      return Move{e1, g1, Piece::king, Piece::empty};
+      return Move{e1, g1, Piece::king, Piece::empty, Piece::empty, Move_type::castle};
     }
     else
     {
-      return Move{e8, g8, Piece::king, Piece::empty};
+      return Move{e8, g8, Piece::king, Piece::empty, Piece::empty, Move_type::castle};
     }
   }
 
@@ -951,11 +1024,11 @@ tl::expected<Move, std::string> Board::move_from_algebraic(std::string_view move
   {
     if (color == Color::white)
     {
-      return Move{e1, c1, Piece::king, Piece::empty};
+      return Move{e1, c1, Piece::king, Piece::empty, Piece::empty, Move_type::castle};
     }
     else
     {
-      return Move{e8, c8, Piece::king, Piece::empty};
+      return Move{e8, c8, Piece::king, Piece::empty, Piece::empty, Move_type::castle};
     }
   }
 
@@ -994,7 +1067,7 @@ tl::expected<Move, std::string> Board::move_from_algebraic(std::string_view move
     // Exactly one piece can move to the target square
     auto const is_ep = is_en_passant(piece, candidates.front(), *target_square, *this);
     auto const victim = is_ep ? Piece::pawn : get_piece(*target_square);
-    auto const move_type = is_ep ? Move_type::en_passant : Move_type::normal;
+    auto const move_type = get_move_type(piece, candidates.front(), *target_square, promotion_result, is_ep);
     return Move{candidates.front(), *target_square, piece, victim, promotion_result, move_type};
   }
 
@@ -1022,7 +1095,7 @@ tl::expected<Move, std::string> Board::move_from_algebraic(std::string_view move
 
       auto const is_ep = is_en_passant(piece, candidates.front(), *target_square, *this);
       auto const victim = is_ep ? Piece::pawn : get_piece(*target_square);
-      auto const move_type = is_ep ? Move_type::en_passant : Move_type::normal;
+      auto const move_type = get_move_type(piece, candidates.front(), *target_square, promotion_result, is_ep);
       return Move{candidates.front(), *target_square, piece, victim, promotion_result, move_type};
     }
   }
@@ -1050,7 +1123,7 @@ tl::expected<Move, std::string> Board::move_from_algebraic(std::string_view move
 
       auto const is_ep = is_en_passant(piece, candidates.front(), *target_square, *this);
       auto const victim = is_ep ? Piece::pawn : get_piece(*target_square);
-      auto const move_type = is_ep ? Move_type::en_passant : Move_type::normal;
+      auto const move_type = get_move_type(piece, candidates.front(), *target_square, promotion_result, is_ep);
       return Move{candidates.front(), *target_square, piece, victim, promotion_result, move_type};
     }
   }
@@ -1064,72 +1137,7 @@ tl::expected<Move, std::string> Board::move_from_algebraic(std::string_view move
 
 tl::expected<Board, std::string> Board::from_pgn(std::string_view pgn)
 {
-  std::vector<std::string> tag_pairs;
-  std::vector<std::string> moves;
-
-  size_t index{0};
-  std::string game_result;
-
-  while (index < pgn.size() && index != std::string::npos)
-  {
-    // Skip to the next non-space character, starting at the first character we
-    // haven't seen yet
-    if (index != 0)
-    {
-      ++index;
-    }
-    index = pgn.find_first_not_of(" \t\n", index);
-
-    if (pgn[index] == '[')
-    {
-      auto end_index = pgn.find(']', index);
-      tag_pairs.emplace_back(pgn.substr(index + 1, end_index - index - 1)); // Drop the [] in the tag pair
-      index = end_index;
-    }
-    else if (isalpha(pgn[index]) || pgn[index] == '0') // Castling uses both 'O and '0'
-    {
-      auto end_index = pgn.find_first_of(" \t\n", index);
-      moves.emplace_back(pgn.substr(index, end_index - index));
-      index = end_index;
-    }
-    else if (isdigit(pgn[index])) // Skip move number
-    {
-      auto end_index = pgn.find('.', index);
-      if (end_index == std::string::npos)
-      {
-        game_result = pgn.substr(index, end_index - index);
-      }
-      index = end_index;
-    }
-    else if (pgn[index] == ';') // Skip comments
-    {
-      index = pgn.find('\n', index);
-    }
-    else if (pgn[index] == '{') // Skip comments
-    {
-      index = pgn.find('}', index);
-    }
-    else
-    {
-      std::stringstream err_ss;
-      err_ss << "Unexpected char at index " << std::to_string(index) << " while parsing pgn file: " << pgn[index]
-             << "Ascii code: " << std::to_string(static_cast<int32_t>(pgn[index])) << std::endl;
-      return tl::unexpected(err_ss.str());
-    }
-  }
-
-  // Play out the target moves on the board, and ensure they are valid
-  Board result{};
-  for (auto const& move_str : moves)
-  {
-    auto attempt = result.try_move_algebraic(move_str);
-    if (!attempt)
-    {
-      return tl::unexpected(attempt.error());
-    }
-  }
-
-  return tl::expected<Board, std::string>{std::move(result)};
+  return Pgn_reader::replay_game(pgn);
 }
 
 bool Board::update_castling_rights_fen_(char c)
@@ -1154,215 +1162,352 @@ bool Board::update_castling_rights_fen_(char c)
   return true;
 }
 
-std::string Board::castling_rights_to_fen_() const
+char* Board::castling_rights_to_fen_(char* out) const
 {
-  std::stringstream ss;
+  if (m_rights == c_castling_rights_none)
+  {
+    *out++ = '-';
+    return out;
+  }
+
   if (white_can_short_castle(m_rights))
   {
-    ss << 'K';
+    *out++ = 'K';
   }
   if (white_can_long_castle(m_rights))
   {
-    ss << 'Q';
+    *out++ = 'Q';
   }
   if (black_can_short_castle(m_rights))
   {
-    ss << 'k';
+    *out++ = 'k';
   }
   if (black_can_long_castle(m_rights))
   {
-    ss << 'q';
+    *out++ = 'q';
   }
+  return out;
+}
+
+namespace
+{
+constexpr std::string_view c_white_fen_pieces{"  PNBRQK"};
+constexpr std::string_view c_black_fen_pieces{"  pnbrqk"};
 
-  auto result = ss.str();
-  if (result.empty())
+// Piece for each character of a fen's piece placement, Piece::empty if it
+// isn't a piece letter
+constexpr auto c_fen_char_pieces = []
+{
+  std::array<Piece, 128> result{};
+  result.fill(Piece::empty);
+  for (auto piece{static_cast<size_t>(Piece::pawn)}; piece <= static_cast<size_t>(Piece::king); ++piece)
   {
-    return "-";
+    result[static_cast<size_t>(c_white_fen_pieces[piece])] = static_cast<Piece>(piece);
+    result[static_cast<size_t>(c_black_fen_pieces[piece])] = static_cast<Piece>(piece);
   }
   return result;
+}();
+
+Piece fen_char_to_piece(char c)
+{
+  // Bytes outside of ascii would otherwise alias piece letters, 0xd0 is 'P' without its top bit
+  auto const index = static_cast<unsigned char>(c);
+  return (index < c_fen_char_pieces.size()) ? c_fen_char_pieces[index] : Piece::empty;
 }
 
-tl::expected<Board, std::string> Board::from_fen(std::string_view fen)
+bool is_fen_space(char c)
 {
-  tl::expected<Board, std::string> board{Board{0}};
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
 
-  std::string fen_str{fen.substr(fen.find_first_not_of(" \n\t"))};
+// Move counts are stored in a byte, so larger values are clamped
+std::optional<uint8_t> parse_move_count(std::string_view field)
+{
+  unsigned value{0};
+  auto const [end, error] = std::from_chars(field.data(), field.data() + field.size(), value);
+  if (error != std::errc{} || end != field.data() + field.size())
+  {
+    return std::nullopt;
+  }
+  return static_cast<uint8_t>(std::min(value, unsigned{std::numeric_limits<uint8_t>::max()}));
+}
+} // namespace
 
-  int8_t y{c_board_dimension - 1};
-  int8_t x{0};
+std::string_view get_fen_error_message(Fen_error error)
+{
+  switch (error)
+  {
+    case Fen_error::missing_field:
+      return "Badly formed fen string - missing field";
+    case Fen_error::invalid_piece:
+      return "Badly formed fen string - invalid piece";
+    case Fen_error::bad_rank_length:
+      return "Badly formed fen string - each row must have exactly eight squares";
+    case Fen_error::bad_rank_count:
+      return "Badly formed fen string - there must be exactly eight rows";
+    case Fen_error::invalid_active_color:
+      return "Badly formed fen string - expected current move color";
+    case Fen_error::invalid_castling_rights:
+      return "Badly formed fen string - invalid castling rights";
+    case Fen_error::invalid_en_passant_square:
+      return "Badly formed fen string - invalid en passant capture square";
+    case Fen_error::invalid_move_count:
+      return "Badly formed fen string - invalid move counts";
+  }
+  return "Badly formed fen string";
+}
+
+tl::expected<Board, std::string> Board::from_fen(std::string_view fen)
+{
+  return parse_fen(fen).map_error(
+    [](Fen_error error)
+    {
+      return std::string{get_fen_error_message(error)};
+    });
+}
+
+tl::expected<Board, Fen_error> Board::parse_fen(std::string_view fen)
+{
+  tl::expected<Board, Fen_error> board{Board{0}};
 
   size_t index{0};
-  while (index < fen_str.size() && (fen_str[index] != ' ') && y >= 0)
+  auto const next_field = [&]
   {
-    if (isdigit(fen_str[index]))
+    while (index < fen.size() && is_fen_space(fen[index]))
     {
-      for (uint8_t i{0}; i < (fen_str[index] - '0'); ++i)
+      ++index;
+    }
+    auto const begin = index;
+    while (index < fen.size() && !is_fen_space(fen[index]))
+    {
+      ++index;
+    }
+    return fen.substr(begin, index - begin);
+  };
+
+  auto const placement = next_field();
+  if (placement.empty())
+  {
+    return tl::unexpected(Fen_error::missing_field);
+  }
+
+  int32_t x{0};
+  int32_t y{c_board_dimension - 1};
+  for (auto const c : placement)
+  {
+    if (c == '/')
+    {
+      if (x != c_board_dimension)
+      {
+        return tl::unexpected(Fen_error::bad_rank_length);
+      }
+      if (y == 0)
       {
-        x = (x + 1) % c_board_dimension;
+        return tl::unexpected(Fen_error::bad_rank_count);
       }
+      x = 0;
+      --y;
     }
-    else if (isalpha(fen_str[index]))
+    else if (c >= '1' && c <= '8')
     {
-      auto color = islower(fen_str[index]) ? Color::black : Color::white;
-      auto piece = from_char(std::toupper(fen_str[index], std::locale()));
-      board->add_piece_(color, piece, {x, y});
-
-      x = (x + 1) % c_board_dimension;
+      x += c - '0';
+      if (x > c_board_dimension)
+      {
+        return tl::unexpected(Fen_error::bad_rank_length);
+      }
     }
-    else if (fen_str[index] == '/')
+    else
     {
-      if (x != 0)
+      auto const piece = fen_char_to_piece(c);
+      if (piece == Piece::empty)
       {
-        return tl::unexpected(std::string{"Badly formed fen string - each row must have exactly eight squares"});
+        return tl::unexpected(Fen_error::invalid_piece);
       }
-      --y;
+      if (x == c_board_dimension)
+      {
+        return tl::unexpected(Fen_error::bad_rank_length);
+      }
+      board->add_piece_((c >= 'a') ? Color::black : Color::white, piece, {x, y});
+      ++x;
     }
-
-    ++index;
   }
-
-  if (fen_str[index] != ' ')
+  if (x != c_board_dimension)
   {
-    return tl::unexpected(std::string{"Badly formed fen string - Too many piece locations"});
+    return tl::unexpected(Fen_error::bad_rank_length);
+  }
+  if (y != 0)
+  {
+    return tl::unexpected(Fen_error::bad_rank_count);
   }
-  ++index;
 
-  if (std::tolower(fen_str[index], std::locale()) == 'w')
+  auto const active_color = next_field();
+  if (active_color.empty())
+  {
+    return tl::unexpected(Fen_error::missing_field);
+  }
+  if (active_color == "w" || active_color == "W")
   {
     board->m_active_color = Color::white;
   }
-  else if (std::tolower(fen_str[index], std::locale()) == 'b')
+  else if (active_color == "b" || active_color == "B")
   {
     board->m_active_color = Color::black;
   }
   else
   {
-    return tl::unexpected(std::string{"Badly formed fen string - expected current move color"});
+    return tl::unexpected(Fen_error::invalid_active_color);
   }
 
-  ++index;
-  if (fen_str[index] != ' ')
+  auto const castling_rights = next_field();
+  if (castling_rights.empty())
   {
-    return tl::unexpected(std::string{"Badly formed fen string - expected space after current move"});
+    return tl::unexpected(Fen_error::missing_field);
   }
-
-  ++index;
-  while (fen_str[index] != ' ')
+  if (castling_rights != "-")
   {
-    board->update_castling_rights_fen_(fen_str[index]);
-    ++index;
+    for (auto const c : castling_rights)
+    {
+      if (!board->update_castling_rights_fen_(c))
+      {
+        return tl::unexpected(Fen_error::invalid_castling_rights);
+      }
+    }
   }
-  ++index;
 
-  if (fen_str[index] != '-')
+  auto const en_passant = next_field();
+  if (en_passant.empty())
   {
-    // En passant is possible, denote this by setting previous move to the pawn
-    // move that allowed en passant
-
-    auto capture_square = Coordinates::from_str(std::string_view{fen_str.c_str() + index, 2});
+    return tl::unexpected(Fen_error::missing_field);
+  }
+  if (en_passant != "-")
+  {
+    auto const capture_square = (en_passant.size() == 2) ? Coordinates::from_str(en_passant) : std::nullopt;
     if (!capture_square)
     {
-      return tl::unexpected(std::string{"Badly formed fen string - invalid en passant capture square"});
+      return tl::unexpected(Fen_error::invalid_en_passant_square);
     }
-
     board->m_en_passant_square.set_square(*capture_square);
-    ++index;
   }
 
-  ++index;
-  if (index < fen_str.size() && fen_str[index] != ' ')
+  // Move counts are optional, but if the halfmove clock is given the full
+  // move count must follow it
+  auto const halfmove_clock = next_field();
+  if (!halfmove_clock.empty() && std::isdigit(static_cast<unsigned char>(halfmove_clock.front())))
   {
-    return tl::unexpected(std::string{"Badly formed fen string - expected space after en passant square"});
+    auto const halfmoves = parse_move_count(halfmove_clock);
+    auto const fullmoves = halfmoves ? parse_move_count(next_field()) : std::nullopt;
+    if (!fullmoves)
+    {
+      return tl::unexpected(Fen_error::invalid_move_count);
+    }
+    board->m_halfmove_clock = *halfmoves;
+    board->m_fullmove_count = *fullmoves;
   }
 
-  while (index < fen_str.size() && fen_str[index] == ' ')
+  // add_piece_ has already hashed the pieces
+  if (board->m_active_color == Color::black)
   {
-    ++index;
+    board->m_zhash.update_player_to_move();
   }
+  board->m_zhash.update_en_passant_square(board->m_en_passant_square);
+  board->m_zhash.update_castling_rights(board->m_rights);
+  MY_ASSERT(board->m_zhash == Zobrist_hash{*board}, "Incrementally built hash doesn't match");
+  MY_ASSERT(board->validate_(), "Invalid board created during fen parsing");
 
-  // Full move and ply counts are optional
-  if (index < fen_str.size())
-  {
-    size_t last_char{0};
-    board->m_halfmove_clock = static_cast<uint8_t>(std::stoi(fen_str.substr(index), &last_char));
+  return board;
+}
 
-    index += last_char;
-    if (index >= fen_str.size())
+tl::expected<Board, std::string> Board::from_pieces(std::span<Piece_placement const> pieces, Color active_color)
+{
+  tl::expected<Board, std::string> board{Board{0}};
+  for (auto const& placement : pieces)
+  {
+    if (board->is_occupied(placement.location))
     {
-      return tl::unexpected(std::string{"Badly formed fen string - expected full move count"});
+      return tl::unexpected(std::string{"Two pieces can't be on the same square"});
     }
-    board->m_fullmove_count = static_cast<uint8_t>(std::stoi(fen_str.substr(index), &last_char));
+    board->add_piece_(placement.color, placement.piece, placement.location);
   }
 
+  board->m_active_color = active_color;
   board->m_zhash = {*board};
-  MY_ASSERT(board->validate_(), "Invalid board created during fen parsing");
+  MY_ASSERT(board->validate_(), "Invalid board created from pieces");
 
   return board;
 }
 
 std::string Board::to_fen() const
 {
-  std::stringstream result;
-
-  auto to_char = [](Piece piece, Color color) -> char
-  {
-    std::stringstream ss;
-    ss << piece;
+  std::array<char, c_max_fen_length> buffer;
+  auto const [end, error] = to_fen(buffer.data(), buffer.data() + buffer.size());
+  MY_ASSERT(error == std::errc{}, "c_max_fen_length is too short");
+  return std::string{buffer.data(), end};
+}
 
-    char result = ss.str().front();
-    return (color == Color::white) ? std::toupper(result, std::locale()) : std::tolower(result, std::locale());
-  };
+std::to_chars_result Board::to_fen(char* first, char* last) const
+{
+  std::array<char, c_max_fen_length> buffer;
+  auto* out = buffer.data();
 
-  for (int8_t y = c_board_dimension - 1; y >= 0; --y)
+  for (int32_t y{c_board_dimension - 1}; y >= 0; --y)
   {
-    int empty_counter{0};
-    for (int8_t x = 0; x < c_board_dimension; ++x)
+    int32_t empty_count{0};
+    for (int32_t x{0}; x < c_board_dimension; ++x)
     {
-      Coordinates sq{x, y};
-      if (is_occupied(sq))
+      auto const piece = get_piece({x, y});
+      if (piece == Piece::empty)
       {
-        if (empty_counter > 0)
-        {
-          result << std::to_string(empty_counter);
-          empty_counter = 0;
-        }
-        result << to_char(get_piece(sq), get_piece_color(sq));
+        ++empty_count;
+        continue;
       }
-      else
+
+      if (empty_count > 0)
       {
-        ++empty_counter;
+        *out++ = static_cast<char>('0' + empty_count);
+        empty_count = 0;
       }
+      auto const& pieces = (get_piece_color({x, y}) == Color::white) ? c_white_fen_pieces : c_black_fen_pieces;
+      *out++ = pieces[static_cast<size_t>(piece)];
     }
 
-    if (empty_counter > 0)
+    if (empty_count > 0)
     {
-      result << std::to_string(empty_counter);
+      *out++ = static_cast<char>('0' + empty_count);
     }
     if (y > 0)
     {
-      result << '/';
+      *out++ = '/';
     }
   }
-  result << ' ';
-  result << ((get_active_color() == Color::white) ? 'w' : 'b');
-  result << ' ';
 
-  result << castling_rights_to_fen_();
-  result << ' ';
+  *out++ = ' ';
+  *out++ = (get_active_color() == Color::white) ? 'w' : 'b';
+  *out++ = ' ';
+  out = castling_rights_to_fen_(out);
+  *out++ = ' ';
 
-  if (!get_en_passant_square().is_empty())
+  if (!m_en_passant_square.is_empty())
   {
-    Coordinates en_passant_square{get_en_passant_square().bitscan_forward()};
-    result << en_passant_square;
+    Coordinates const en_passant_square{m_en_passant_square.bitscan_forward()};
+    *out++ = static_cast<char>('a' + en_passant_square.x());
+    *out++ = static_cast<char>('1' + en_passant_square.y());
   }
   else
   {
-    result << '-';
+    *out++ = '-';
   }
 
-  result << " " << std::to_string(m_halfmove_clock) << " " << std::to_string(m_fullmove_count);
+  *out++ = ' ';
+  out = std::to_chars(out, buffer.data() + buffer.size(), m_halfmove_clock).ptr;
+  *out++ = ' ';
+  out = std::to_chars(out, buffer.data() + buffer.size(), m_fullmove_count).ptr;
 
-  return result.str();
+  auto const size = out - buffer.data();
+  if (last - first < size)
+  {
+    return {last, std::errc::value_too_large};
+  }
+  return {std::copy(buffer.data(), out, first), std::errc{}};
 }
 
 void Board::set_use_unicode_output(bool value)
@@ -0,0 +1,24 @@
+#include "cpu_features.h"
+
+namespace Meneldor
+{
+Cpu_features Cpu_features::detect()
+{
+  Cpu_features features;
+#ifdef MENELDOR_X86_SIMD
+  __builtin_cpu_init();
+  features.sse41 = __builtin_cpu_supports("sse4.1");
+  features.avx2 = __builtin_cpu_supports("avx2");
+  features.avx512f = __builtin_cpu_supports("avx512f");
+  features.fast_pext =
+    __builtin_cpu_supports("bmi2") && !__builtin_cpu_is("amdfam15h") && !__builtin_cpu_is("amdfam17h");
+#endif
+  return features;
+}
+
+Cpu_features const& Cpu_features::get()
+{
+  static Cpu_features const features = detect();
+  return features;
+}
+} // namespace Meneldor
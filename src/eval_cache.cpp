@@ -0,0 +1,64 @@
+#include "eval_cache.h"
+#include "utils.h"
+
+namespace rs = std::ranges;
+namespace Meneldor
+{
+Eval_cache::Eval_cache(size_t table_size_bytes)
+{
+  resize(table_size_bytes);
+}
+
+size_t Eval_cache::index_(zhash_t key) const
+{
+  MY_ASSERT(std::has_single_bit(m_table.size()), "Capacity must be a power of two");
+  return key & (m_table.size() - 1);
+}
+
+std::optional<int16_t> Eval_cache::get(zhash_t key) const
+{
+  auto const check_bits = check_bits_(key);
+  if (m_table.empty() || check_bits == c_empty_check_bits)
+  {
+    return {};
+  }
+
+  auto const entry = m_table[index_(key)];
+  if (static_cast<uint16_t>(entry >> 16) != check_bits)
+  {
+    return {};
+  }
+  return static_cast<int16_t>(entry & 0xffff);
+}
+
+void Eval_cache::insert(zhash_t key, int16_t evaluation)
+{
+  auto const check_bits = check_bits_(key);
+  if (m_table.empty() || check_bits == c_empty_check_bits)
+  {
+    return;
+  }
+
+  m_table[index_(key)] = (Entry{check_bits} << 16) | static_cast<uint16_t>(evaluation);
+}
+
+void Eval_cache::resize(size_t table_size_bytes)
+{
+  auto const capacity = table_size_bytes / sizeof(Entry);
+
+  // Keep the capacity a power of two so indexing is a mask instead of a modulus
+  m_table.clear();
+  m_table.shrink_to_fit();
+  m_table.resize((capacity == 0) ? 0 : std::bit_floor(capacity));
+}
+
+size_t Eval_cache::get_capacity() const
+{
+  return m_table.size();
+}
+
+void Eval_cache::clear()
+{
+  rs::fill(m_table, Entry{c_empty_check_bits} << 16);
+}
+} // namespace Meneldor
@@ -0,0 +1,19 @@
+#include "material_key.h"
+#include "board.h"
+
+namespace Meneldor
+{
+Material_key::Material_key(Board const& board)
+{
+  for (auto const color : {Color::black, Color::white})
+  {
+    for (auto const piece : Zobrist_hash::piece_types)
+    {
+      for ([[maybe_unused]] auto const sq_index : board.get_piece_set(color, piece))
+      {
+        add_piece(color, piece);
+      }
+    }
+  }
+}
+} // namespace Meneldor
@@ -0,0 +1,318 @@
+#include "material_table.h"
+#include "board.h"
+
+// https://www.chessprogramming.org/Material_Hash_Table
+// https://www.chessprogramming.org/Material#Imbalance
+
+namespace rs = std::ranges;
+namespace Meneldor
+{
+namespace
+{
+constexpr std::array c_non_king_pieces{Piece::pawn, Piece::knight, Piece::bishop, Piece::rook, Piece::queen};
+
+constexpr int16_t c_bishop_pair_bonus{30};
+
+// Knights get better and rooks get worse as more pawns are on the board,
+// relative to a position with five pawns of their own color
+constexpr int32_t c_knight_bonus_per_pawn{6};
+constexpr int32_t c_rook_bonus_per_pawn{-12};
+constexpr int32_t c_imbalance_base_pawns{5};
+
+// Multiplied by the distance from the center to drive the weak king to the edge
+constexpr int32_t c_push_to_edge_weight{20};
+constexpr int32_t c_push_to_corner_weight{30};
+constexpr int32_t c_king_proximity_weight{10};
+
+constexpr uint64_t c_fibonacci_multiplier{0x9E3779B97F4A7C15};
+
+constexpr int32_t distance(Coordinates a, Coordinates b)
+{
+  return std::max(std::abs(a.x() - b.x()), std::abs(a.y() - b.y()));
+}
+
+// From 1 for a center square to 7 for a corner
+constexpr int32_t distance_from_center(Coordinates location)
+{
+  return (std::abs(2 * location.x() - (c_board_dimension - 1)) +
+          std::abs(2 * location.y() - (c_board_dimension - 1))) /
+         2;
+}
+
+Coordinates king_location(Board const& board, Color color)
+{
+  return Coordinates{board.get_piece_set(color, Piece::king).bitscan_forward()};
+}
+
+int32_t non_king_material(Board const& board, Color color)
+{
+  int32_t result{0};
+  for (size_t i{0}; i < c_non_king_pieces.size(); ++i)
+  {
+    result += board.get_piece_set(color, c_non_king_pieces[i]).occupancy() * Material_table::c_piece_values[i];
+  }
+  return result;
+}
+
+// A queen or rook against a bare king. Mate is forced by driving the weak
+// king to the edge of the board with the help of the strong king.
+int32_t evaluate_kxk(Board const& board, Color strong_color)
+{
+  auto const strong_king = king_location(board, strong_color);
+  auto const weak_king = king_location(board, opposite_color(strong_color));
+
+  return Material_table::c_known_win + non_king_material(board, strong_color) +
+         c_push_to_edge_weight * distance_from_center(weak_king) +
+         c_king_proximity_weight * (c_board_dimension - 1 - distance(strong_king, weak_king));
+}
+
+// Bishop and knight against a bare king. Mate is only possible in a corner
+// the bishop controls, so the weak king is driven there.
+int32_t evaluate_kbnk(Board const& board, Color strong_color)
+{
+  auto const strong_king = king_location(board, strong_color);
+  auto const weak_king = king_location(board, opposite_color(strong_color));
+  Coordinates const bishop{board.get_piece_set(strong_color, Piece::bishop).bitscan_forward()};
+
+  // a1 and h8 are dark squares, a8 and h1 are light
+  bool const is_dark_bishop = (bishop.x() + bishop.y()) % 2 == 0;
+  auto const corner_distance = is_dark_bishop ? std::min(distance(weak_king, a1), distance(weak_king, h8)) :
+                                                std::min(distance(weak_king, a8), distance(weak_king, h1));
+
+  return Material_table::c_known_win + non_king_material(board, strong_color) +
+         c_push_to_corner_weight * (c_board_dimension - 1 - corner_distance) +
+         c_king_proximity_weight * (c_board_dimension - 1 - distance(strong_king, weak_king));
+}
+
+// King and pawn against a bare king. Recognizes the most common draws
+// without a bitbase: a rook pawn with the defending king in the corner, and
+// a defending king blocking the pawn that can't be pushed away.
+uint8_t scale_kpk(Board const& board, Color strong_color)
+{
+  auto const weak_color = opposite_color(strong_color);
+  auto const strong_king = king_location(board, strong_color);
+  auto const weak_king = king_location(board, weak_color);
+  Coordinates const pawn{board.get_piece_set(strong_color, Piece::pawn).bitscan_forward()};
+
+  auto const promotion_rank = (strong_color == Color::white) ? c_board_dimension - 1 : 0;
+  Coordinates const promotion_square{pawn.x(), promotion_rank};
+
+  bool const is_rook_pawn = pawn.x() == 0 || pawn.x() == c_board_dimension - 1;
+  if (is_rook_pawn && distance(weak_king, promotion_square) <= 1)
+  {
+    return 0;
+  }
+
+  // Rule of the square. A pawn on its starting rank can advance two squares
+  // on its first move, so it is as far away as a pawn one rank ahead.
+  auto const pawn_distance = std::min(std::abs(promotion_rank - pawn.y()), c_board_dimension - 3);
+  auto const weak_to_move = board.get_active_color() == weak_color;
+  if (distance(weak_king, promotion_square) - (weak_to_move ? 1 : 0) > pawn_distance)
+  {
+    return Material_table::c_scale_normal;
+  }
+
+  auto const direction = (strong_color == Color::white) ? 1 : -1;
+  bool const weak_king_blocks = weak_king.x() == pawn.x() && (weak_king.y() - pawn.y()) * direction > 0;
+  bool const strong_king_behind = (strong_king.y() - pawn.y()) * direction <= 0;
+  if (weak_king_blocks && strong_king_behind)
+  {
+    return Material_table::c_scale_normal / 8;
+  }
+
+  return Material_table::c_scale_normal;
+}
+
+// Endings with only bishops on opposite colors and pawns are very drawish,
+// since neither bishop can ever contest the squares the other one controls
+uint8_t scale_opposite_colored_bishops(Board const& board, Color /* strong_color */)
+{
+  Coordinates const black_bishop{board.get_piece_set(Color::black, Piece::bishop).bitscan_forward()};
+  Coordinates const white_bishop{board.get_piece_set(Color::white, Piece::bishop).bitscan_forward()};
+  if ((black_bishop.x() + black_bishop.y()) % 2 == (white_bishop.x() + white_bishop.y()) % 2)
+  {
+    return Material_table::c_scale_normal;
+  }
+
+  auto const pawn_difference = std::abs(board.get_piece_set(Color::black, Piece::pawn).occupancy() -
+                                        board.get_piece_set(Color::white, Piece::pawn).occupancy());
+  return (pawn_difference <= 1) ? Material_table::c_scale_normal / 4 : Material_table::c_scale_normal / 2;
+}
+
+struct Piece_counts
+{
+  int32_t pawns{0};
+  int32_t knights{0};
+  int32_t bishops{0};
+  int32_t rooks{0};
+  int32_t queens{0};
+
+  Piece_counts(Material_key key, Color color)
+      : pawns{key.count(color, Piece::pawn)},
+        knights{key.count(color, Piece::knight)},
+        bishops{key.count(color, Piece::bishop)},
+        rooks{key.count(color, Piece::rook)},
+        queens{key.count(color, Piece::queen)}
+  {
+  }
+
+  int32_t minors() const
+  {
+    return knights + bishops;
+  }
+
+  int32_t non_pawns() const
+  {
+    return minors() + rooks + queens;
+  }
+
+  bool is_bare() const
+  {
+    return pawns == 0 && non_pawns() == 0;
+  }
+};
+
+bool is_known_draw(Piece_counts const& black, Piece_counts const& white)
+{
+  if (black.pawns != 0 || white.pawns != 0 || black.rooks != 0 || white.rooks != 0 || black.queens != 0 ||
+      white.queens != 0)
+  {
+    return false;
+  }
+
+  // A single minor piece on each side can't force mate, and neither can two
+  // knights against a bare king
+  bool const two_knights = (black.knights == 2 && black.bishops == 0 && white.is_bare()) ||
+                           (white.knights == 2 && white.bishops == 0 && black.is_bare());
+  return (black.minors() <= 1 && white.minors() <= 1) || two_knights;
+}
+
+int32_t imbalance(Piece_counts const& counts)
+{
+  int32_t result{0};
+  if (counts.bishops >= 2)
+  {
+    result += c_bishop_pair_bonus;
+  }
+  result += counts.knights * (counts.pawns - c_imbalance_base_pawns) * c_knight_bonus_per_pawn;
+  result += counts.rooks * (counts.pawns - c_imbalance_base_pawns) * c_rook_bonus_per_pawn;
+  return result;
+}
+} // namespace
+
+Material_table::Material_table(size_t table_size_bytes)
+{
+  // Keep the capacity a power of two so the index is the top bits of the mixed key
+  m_table.resize(std::bit_floor(std::max(table_size_bytes / sizeof(Entry), size_t{2})));
+  m_index_shift = static_cast<uint32_t>(std::numeric_limits<uint64_t>::digits - std::countr_zero(m_table.size()));
+}
+
+Material_table::Entry const& Material_table::probe(Board const& board)
+{
+  auto const key = board.get_material_key().get_key();
+  auto& entry = m_table[(key * c_fibonacci_multiplier) >> m_index_shift];
+
+  if (entry.key == key)
+  {
+    ++m_hits;
+  }
+  else
+  {
+    ++m_misses;
+    entry = evaluate(board.get_material_key());
+  }
+
+  return entry;
+}
+
+Material_table::Entry Material_table::evaluate(Material_key key)
+{
+  Entry result;
+  result.key = key.get_key();
+
+  int32_t material{0};
+  int32_t phase{0};
+  for (auto const color : {Color::black, Color::white})
+  {
+    auto const sign = (color == Color::white) ? 1 : -1;
+    for (size_t i{0}; i < c_non_king_pieces.size(); ++i)
+    {
+      auto const count = key.count(color, c_non_king_pieces[i]);
+      material += sign * count * c_piece_values[i];
+      phase += count * Piece_square_score::c_phase_weights[i];
+    }
+  }
+
+  Piece_counts const black{key, Color::black};
+  Piece_counts const white{key, Color::white};
+
+  result.material = static_cast<int16_t>(material);
+  result.imbalance = static_cast<int16_t>(imbalance(white) - imbalance(black));
+  result.phase = static_cast<uint8_t>(phase);
+
+  if (is_known_draw(black, white))
+  {
+    result.is_draw = true;
+    return result;
+  }
+
+  for (auto const strong_color : {Color::black, Color::white})
+  {
+    Piece_counts const& strong = (strong_color == Color::white) ? white : black;
+    Piece_counts const& weak = (strong_color == Color::white) ? black : white;
+    if (!weak.is_bare())
+    {
+      continue;
+    }
+
+    result.strong_color = strong_color;
+    if (strong.queens > 0 || strong.rooks > 0)
+    {
+      result.endgame_function = &evaluate_kxk;
+    }
+    else if (strong.pawns == 0 && strong.knights == 1 && strong.bishops == 1)
+    {
+      result.endgame_function = &evaluate_kbnk;
+    }
+    else if (strong.pawns == 1 && strong.non_pawns() == 0)
+    {
+      result.scale_function = &scale_kpk;
+    }
+    return result;
+  }
+
+  if (black.bishops == 1 && white.bishops == 1 && black.non_pawns() == 1 && white.non_pawns() == 1)
+  {
+    result.scale_function = &scale_opposite_colored_bishops;
+  }
+
+  return result;
+}
+
+size_t Material_table::get_capacity() const
+{
+  return m_table.size();
+}
+
+uint64_t Material_table::get_hits() const
+{
+  return m_hits;
+}
+
+uint64_t Material_table::get_misses() const
+{
+  return m_misses;
+}
+
+void Material_table::reset_stats()
+{
+  m_hits = 0;
+  m_misses = 0;
+}
+
+void Material_table::clear()
+{
+  rs::fill(m_table, Entry{});
+  reset_stats();
+}
+} // namespace Meneldor
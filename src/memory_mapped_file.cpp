@@ -0,0 +1,87 @@
+#include "memory_mapped_file.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Meneldor
+{
+tl::expected<Memory_mapped_file, std::string> Memory_mapped_file::open(std::string const& filename)
+{
+#if defined(_WIN32)
+  return tl::unexpected("Memory mapped files are not supported on this platform: " + filename);
+#else
+  auto const fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return tl::unexpected("Failed to open " + filename);
+  }
+
+  struct stat file_stats
+  {
+  };
+  if (fstat(fd, &file_stats) != 0 || file_stats.st_size <= 0)
+  {
+    ::close(fd);
+    return tl::unexpected("Failed to read the size of " + filename);
+  }
+
+  auto const size = static_cast<size_t>(file_stats.st_size);
+  auto* const data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  // The mapping stays valid after the file is closed
+  ::close(fd);
+  if (data == MAP_FAILED)
+  {
+    return tl::unexpected("Failed to map " + filename);
+  }
+
+  return Memory_mapped_file{data, size};
+#endif
+}
+
+Memory_mapped_file::Memory_mapped_file(void* data, size_t size) : m_data{data}, m_size{size}
+{
+}
+
+Memory_mapped_file::Memory_mapped_file(Memory_mapped_file&& other) noexcept
+    : m_data{std::exchange(other.m_data, nullptr)}, m_size{std::exchange(other.m_size, 0)}
+{
+}
+
+Memory_mapped_file& Memory_mapped_file::operator=(Memory_mapped_file&& other) noexcept
+{
+  if (this != &other)
+  {
+    unmap_();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+  }
+  return *this;
+}
+
+Memory_mapped_file::~Memory_mapped_file()
+{
+  unmap_();
+}
+
+std::span<std::byte const> Memory_mapped_file::get_data() const
+{
+  return {static_cast<std::byte const*>(m_data), m_size};
+}
+
+void Memory_mapped_file::unmap_()
+{
+#if !defined(_WIN32)
+  if (m_data)
+  {
+    munmap(m_data, m_size);
+  }
+#endif
+  m_data = nullptr;
+  m_size = 0;
+}
+} // namespace Meneldor
@@ -1,6 +1,8 @@
 #include "meneldor_engine.h"
 #include "feature_toggle.h"
 #include "move_generator.h"
+#include "numa_topology.h"
+#include "perft.h"
 #include "senjo/Output.h"
 #include "utils.h"
 
@@ -12,47 +14,170 @@ int tt_hits{0};
 int tt_misses{0};
 int tt_sufficient_depth{0};
 
+namespace
+{
+// Returns the value of a UCI spin option if it is a number in the allowed range
+std::optional<int64_t> parse_spin_value(std::string_view value, int64_t min_value, int64_t max_value)
+{
+  int64_t result{0};
+  auto const [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+  if (error != std::errc{} || end != value.data() + value.size() || result < min_value || result > max_value)
+  {
+    return {};
+  }
+  return result;
+}
+
+constexpr std::array c_slider_backends{Slider_backend::plain_magic, Slider_backend::fancy_magic, Slider_backend::pext};
+
+std::string to_string(Slider_backend backend)
+{
+  std::stringstream out;
+  out << backend;
+  return out.str();
+}
+} // namespace
+
 // Returns a number that is positive if the side to move is winning, and
 // negative if losing
 int Meneldor_engine::evaluate(Board const& board) const
 {
-  // These arrays can be iterated in parallel
-  constexpr static std::array piece_values{100, 300, 300, 500, 900};
-  constexpr static std::array pieces{Piece::pawn, Piece::knight, Piece::bishop, Piece::rook, Piece::queen};
-  static_assert(piece_values.size() == pieces.size());
+  m_nnue_stack.reset(board);
+  return evaluate_(board, Move_generator::get_attack_info(board));
+}
+
+int Meneldor_engine::evaluate(Board const& board, int alpha, int beta) const
+{
+  m_nnue_stack.reset(board);
+  return evaluate_(board, Move_generator::get_attack_info(board), alpha, beta);
+}
 
-  auto const state = board.calc_game_state();
-  if (state == Game_state::white_victory || state == Game_state::black_victory)
+int Meneldor_engine::evaluate_(Board const& board, Attack_info const& attack_info) const
+{
+  // The halfmove clock isn't part of the hash key, so check it before looking
+  // in the cache
+  if (board.get_halfmove_clock() >= 100)
   {
-    // Add depth so the search function can return a slightly higher value if it
-    // finds an earlier mate
-    return negative_inf + m_depth_for_current_search;
+    return c_contempt_score;
   }
-  if (state == Game_state::draw || board.get_halfmove_clock() >= 100)
+
+  auto const key = board.get_hash_key().get_hash();
+  if (auto const cached = m_eval_cache.get(key))
   {
+    return (*cached == Eval_cache::c_checkmate_score) ? negative_inf + m_depth_for_current_search : *cached;
+  }
+
+  auto const result = evaluate_uncached_(board, attack_info);
+  m_eval_cache.insert(key,
+                      (result < c_min_non_mate_score)
+                        ? Eval_cache::c_checkmate_score
+                        : static_cast<int16_t>(std::clamp<int>(result, std::numeric_limits<int16_t>::min() + 1,
+                                                               std::numeric_limits<int16_t>::max())));
+  return result;
+}
+
+int Meneldor_engine::evaluate_(Board const& board, Attack_info const& attack_info, int alpha, int beta) const
+{
+  static bool const skip_lazy_evaluation = is_feature_enabled("skip_lazy_evaluation");
+  if (skip_lazy_evaluation || Nnue_network::get_active() || board.get_halfmove_clock() >= 100)
+  {
+    return evaluate_(board, attack_info);
+  }
+
+  // An exact score is already cached, no need to estimate it
+  if (m_eval_cache.get(board.get_hash_key().get_hash()))
+  {
+    return evaluate_(board, attack_info);
+  }
+
+  auto const& material_entry = m_material_table.probe(board);
+  if (material_entry.is_special())
+  {
+    return evaluate_(board, attack_info);
+  }
+
+  // Mobility is never negative and is at most the number of squares on the
+  // board, so these bounds are exact as long as the game isn't over. Checkmate
+  // needs a check, so positions in check always get a full evaluation.
+  // Stalemates can be missed here, which is the price of skipping move generation.
+  constexpr int c_max_mobility{c_board_dimension_squared};
+  auto const cheap_score = evaluate_material_and_position_(board, material_entry);
+  if ((cheap_score >= beta || cheap_score + c_max_mobility <= alpha) && !attack_info.is_in_check())
+  {
+    ++m_lazy_evaluations;
+    return cheap_score;
+  }
+
+  return evaluate_(board, attack_info);
+}
+
+int Meneldor_engine::evaluate_material_and_position_(Board const& board,
+                                                     Material_table::Entry const& material_entry) const
+{
+  // Material and imbalance only depend on the piece counts, so they are cached in the material table
+  auto const color = board.get_active_color();
+  auto const material_result = material_entry.score(color);
+
+  // Piece placement, blended between middlegame and endgame tables. This is
+  // kept up to date by the board so it doesn't need to be recomputed here.
+  auto const psq_score = board.get_piece_square_score();
+  auto const positional_result = psq_score.tapered(color);
+
+  // Pawn structure rarely changes between positions, so it is cached in the pawn hash table
+  auto const pawn_result = m_pawn_hash_table.probe(board).score(color, psq_score.phase());
+
+  return material_result + positional_result + pawn_result;
+}
+
+int Meneldor_engine::evaluate_uncached_(Board const& board, Attack_info const& attack_info) const
+{
+  // Same as Board::calc_game_state, but reuses the attack info
+  if (!Move_generator::has_any_legal_moves(board, attack_info))
+  {
+    if (attack_info.is_in_check())
+    {
+      // Add depth so the search function can return a slightly higher value if it
+      // finds an earlier mate
+      return negative_inf + m_depth_for_current_search;
+    }
     return c_contempt_score;
   }
 
+  // Draws by insufficient material and specialized endgames are recognized
+  // from the piece counts alone
   auto const color = board.get_active_color();
-  auto const enemy_color = opposite_color(color);
-  int material_result{0};
-  for (size_t i{0}; i < pieces.size(); ++i)
+  auto const& material_entry = m_material_table.probe(board);
+  if (material_entry.is_draw)
   {
-    material_result +=
-      (board.get_piece_set(color, pieces[i]).occupancy() - board.get_piece_set(enemy_color, pieces[i]).occupancy()) *
-      piece_values[i];
+    return c_contempt_score;
+  }
+  if (material_entry.endgame_function)
+  {
+    auto const score = material_entry.endgame_function(board, material_entry.strong_color);
+    return (color == material_entry.strong_color) ? score : -score;
   }
 
-  // Positions that can attack more squares are better
-  auto const mobility_result = Move_generator::get_all_attacked_squares(board, board.get_active_color()).occupancy();
-  auto const result = material_result + mobility_result;
-  return result;
+  int result{0};
+  if (auto const* network = Nnue_network::get_active())
+  {
+    result = network->evaluate(m_nnue_stack.get(*network, board), color);
+  }
+  else
+  {
+    // Positions that can attack more squares are better
+    auto const mobility_result = attack_info.get_attacks(color).occupancy();
+    result = evaluate_material_and_position_(board, material_entry) + mobility_result;
+  }
+
+  result = result * material_entry.scale_factor(board) / Material_table::c_scale_normal;
+  return std::clamp(result, c_min_non_mate_score + 1, c_max_non_mate_score - 1);
 }
 
 int Meneldor_engine::quiesce_(Board const& board, int alpha, int beta) const
 {
   ++m_visited_quiesence_nodes;
-  auto score = evaluate(board);
+  auto const attack_info = Move_generator::get_attack_info(board);
+  auto score = evaluate_(board, attack_info, alpha, beta);
 
   if (score >= beta)
   {
@@ -60,7 +185,8 @@ int Meneldor_engine::quiesce_(Board const& board, int alpha, int beta) const
   }
   alpha = std::max(alpha, score);
 
-  auto moves = Move_generator::generate_pseudo_legal_attack_moves(board);
+  Move_list moves;
+  Move_generator::generate_legal_attack_moves(board, attack_info, moves);
   m_orderer.sort_moves(moves, board);
 
   Board tmp_board{board};
@@ -68,11 +194,9 @@ int Meneldor_engine::quiesce_(Board const& board, int alpha, int beta) const
   {
     tmp_board = board;
     tmp_board.move_no_verify(move);
-    if (tmp_board.is_in_check(opposite_color(tmp_board.get_active_color())))
-    {
-      continue;
-    }
+    m_nnue_stack.push(tmp_board);
     score = -quiesce_(tmp_board, -beta, -alpha);
+    m_nnue_stack.pop();
 
     if (score >= beta)
     {
@@ -93,6 +217,32 @@ bool Meneldor_engine::has_more_time_() const
   return (m_search_mode != Search_mode::time) || std::chrono::system_clock::now() < m_search_desired_end_time;
 }
 
+void Meneldor_engine::bind_search_thread_()
+{
+  // Each go may run on a new thread, so this is done on every search. A
+  // thread bound by an earlier search may be reused after NumaNode is reset.
+  auto const& topology = Numa_topology::get_system();
+  if (m_numa_node < 0)
+  {
+    topology.unbind_current_thread();
+    return;
+  }
+
+  if (!topology.bind_current_thread(static_cast<size_t>(m_numa_node)))
+  {
+    return;
+  }
+
+  if (m_thread_tables_need_relocation)
+  {
+    // Pages are placed on the node of the thread that first touches them
+    m_pawn_hash_table = Pawn_hash_table{c_pawn_hash_table_size_bytes};
+    m_material_table = Material_table{c_material_table_size_bytes};
+    m_eval_cache.resize(static_cast<size_t>(m_eval_cache_size_mb) * 1024UL * 1024UL);
+    m_thread_tables_need_relocation = false;
+  }
+}
+
 void Meneldor_engine::calc_time_for_move_(senjo::GoParams const& params)
 {
   // We won't exit right away once time has expired, so include a buffer
@@ -160,7 +310,51 @@ int Meneldor_engine::negamax_(Board& board,
     return c_contempt_score; // Draw by repetition
   }
 
-  Move best_guess{};
+  if (m_material_table.probe(board).is_draw)
+  {
+    return c_contempt_score; // Draw by insufficient material
+  }
+
+  if (board.get_occupied_squares().occupancy() <= static_cast<int32_t>(m_tablebase.get_max_pieces()))
+  {
+    if (auto const result = m_tablebase.probe(board))
+    {
+      ++m_tablebase_hits;
+      auto const ply = m_depth_for_current_search - depth_remaining;
+      switch (result->wdl)
+      {
+        case Tablebase_result::Wdl::win:
+          return positive_inf - (ply + result->distance_to_mate);
+        case Tablebase_result::Wdl::loss:
+          return negative_inf + (ply + result->distance_to_mate);
+        default:
+          return c_contempt_score;
+      }
+    }
+  }
+
+  // Syzygy results count the 50 move rule from the last capture or pawn
+  // move, so they are only exact right after one
+  if (board.get_halfmove_clock() == 0 &&
+      board.get_occupied_squares().occupancy() <= static_cast<int32_t>(m_syzygy.get_max_pieces()))
+  {
+    if (auto const wdl = m_syzygy.probe_wdl(board))
+    {
+      ++m_tablebase_hits;
+      auto const ply = m_depth_for_current_search - depth_remaining;
+      switch (*wdl)
+      {
+        case Syzygy_wdl::win:
+          return c_max_non_mate_score - ply;
+        case Syzygy_wdl::loss:
+          return c_min_non_mate_score + ply;
+        default:
+          return c_contempt_score;
+      }
+    }
+  }
+
+  uint16_t best_guess{0};
   if (auto const entry = m_transpositions.get(board.get_hash_key()))
   {
     best_guess = entry->best_move;
@@ -187,8 +381,14 @@ int Meneldor_engine::negamax_(Board& board,
         case Transposition_table::Eval_type::exact:
           return entry->evaluation;
       }
+
+      // The bound alone is enough to know this position is outside the window
+      if (alpha >= beta)
+      {
+        return entry->evaluation;
+      }
     }
-    else if (entry->best_move.type() != Move_type::null)
+    else if (entry->best_move != 0)
     {
       best_guess = entry->best_move;
     }
@@ -198,6 +398,8 @@ int Meneldor_engine::negamax_(Board& board,
     ++tt_misses;
   }
 
+  auto const attack_info = Move_generator::get_attack_info(board);
+
   // Don't use null move pruning if the node is part of the principal variation
   bool const is_pv_node = (beta - alpha != 1);
 
@@ -206,18 +408,21 @@ int Meneldor_engine::negamax_(Board& board,
   static bool const skip_null_move_pruning = is_feature_enabled("skip_null_move_pruning");
 
   if (depth_remaining >= c_min_depth_for_null_move_pruning && !skip_null_move_pruning && !is_pv_node &&
-      !previous_move_was_null && !board.is_in_check(board.get_active_color()))
+      !previous_move_was_null && !attack_info.is_in_check())
   {
-    if (auto eval = evaluate(board); eval > beta)
+    if (auto eval = evaluate_(board, attack_info); eval > beta)
     {
       int const r = 2;
 
       Move null_move{};
       Board tmp_board{board};
       tmp_board.move_no_verify(null_move, true);
+      m_transpositions.prefetch(tmp_board.get_hash_key());
 
       constexpr bool previous_was_null{true};
+      m_nnue_stack.push(tmp_board);
       int const null_score = -negamax_(tmp_board, -beta, -alpha, depth_remaining - 1 - r, previous_was_null);
+      m_nnue_stack.pop();
       if (null_score >= beta)
       {
         //TODO: Perform full search to verify?
@@ -226,15 +431,24 @@ int Meneldor_engine::negamax_(Board& board,
     }
   }
 
-  auto moves = Move_generator::generate_pseudo_legal_moves(board);
+  Move_list moves;
+  Move_generator::generate_legal_moves(board, attack_info, moves);
+  if (moves.empty())
+  {
+    if (attack_info.is_in_check())
+    {
+      return negative_inf + (m_depth_for_current_search - depth_remaining);
+    }
+    return c_contempt_score;
+  }
   m_orderer.sort_moves(moves, board);
 
   static bool const skip_guess_move = is_feature_enabled("skip_guess_move");
   if (!skip_guess_move)
   {
-    if (best_guess.type() != Move_type::null)
+    if (best_guess != 0)
     {
-      auto const guess_location = rs::find(moves, best_guess);
+      auto const guess_location = rs::find(moves, best_guess, &Move::compact);
       if (guess_location != moves.end())
       {
         std::rotate(moves.begin(), guess_location, guess_location + 1);
@@ -248,25 +462,23 @@ int Meneldor_engine::negamax_(Board& board,
 
   // If we don't find a move here that's better than alpha, just save alpha as
   // the upper bound for this position
-  bool has_any_moves{false};
   bool perform_full_search{true};
   auto eval_type = Transposition_table::Eval_type::alpha;
 
-  // This list can't be empty, wouldn't have gotten this far if it was
   Move best{moves.front()};
   Board tmp_board{board};
   for (auto const move : moves)
   {
     tmp_board = board;
     tmp_board.move_no_verify(move);
-    if (tmp_board.is_in_check(opposite_color(tmp_board.get_active_color())))
+    if (depth_remaining > 1)
     {
-      continue;
+      // Children at depth zero go straight to quiescence, which doesn't use the table
+      m_transpositions.prefetch(tmp_board.get_hash_key());
     }
 
-    has_any_moves = true;
-
     int score{0};
+    m_nnue_stack.push(tmp_board);
     if (perform_full_search)
     {
       score = -negamax_(tmp_board, -beta, -alpha, depth_remaining - 1);
@@ -280,6 +492,7 @@ int Meneldor_engine::negamax_(Board& board,
         score = -negamax_(tmp_board, -beta, -score, depth_remaining - 1); // -score instead of -alpha?
       }
     }
+    m_nnue_stack.pop();
 
     perform_full_search = false;
 
@@ -289,7 +502,7 @@ int Meneldor_engine::negamax_(Board& board,
       // Our evaluation here is a lower bound
 
       eval_type = Transposition_table::Eval_type::beta;
-      m_transpositions.insert(board.get_hash_key(), {board.get_hash_key(), depth_remaining, score, move, eval_type});
+      m_transpositions.insert(board.get_hash_key(), depth_remaining, score, move, eval_type);
 
       return beta;
     }
@@ -305,20 +518,12 @@ int Meneldor_engine::negamax_(Board& board,
     }
   }
 
-  if (!has_any_moves)
-  {
-    if (board.is_in_check(board.get_active_color()))
-    {
-      return negative_inf + (m_depth_for_current_search - depth_remaining);
-    }
-    return c_contempt_score;
-  }
-
-  m_transpositions.insert(board.get_hash_key(), {board.get_hash_key(), depth_remaining, alpha, best, eval_type});
+  m_transpositions.insert(board.get_hash_key(), depth_remaining, alpha, best, eval_type);
   return alpha;
 }
 
 Meneldor_engine::Meneldor_engine()
+    : m_transpositions{c_default_hash_size_mb * 1024UL * 1024UL, !is_feature_enabled("skip_huge_pages")}
 {
   m_previous_positions.reserve(256);
 }
@@ -350,12 +555,179 @@ std::string Meneldor_engine::getCountryName() const
 
 std::list<senjo::EngineOption> Meneldor_engine::getOptions() const
 {
-  // This engine does not currently advertise any options / settings
-  return {};
+  std::set<std::string> slider_backends;
+  for (auto const backend : c_slider_backends)
+  {
+    if (Move_generator::is_supported(backend))
+    {
+      slider_backends.insert(to_string(backend));
+    }
+  }
+
+  return {
+    {std::string{c_hash_option_name}, std::to_string(c_default_hash_size_mb), senjo::EngineOption::Spin, 1,
+     c_max_hash_size_mb},
+    {std::string{c_clear_hash_option_name}, "", senjo::EngineOption::Button},
+    {std::string{c_hash_file_option_name}, m_hash_file, senjo::EngineOption::String},
+    {std::string{c_save_hash_option_name}, "", senjo::EngineOption::Button},
+    {std::string{c_load_hash_option_name}, "", senjo::EngineOption::Button},
+    {std::string{c_eval_cache_option_name}, std::to_string(c_default_eval_cache_size_mb), senjo::EngineOption::Spin, 0,
+     c_max_eval_cache_size_mb},
+    {std::string{c_numa_node_option_name}, std::to_string(m_numa_node), senjo::EngineOption::Spin, -1,
+     static_cast<int64_t>(Numa_topology::get_system().get_nodes().back().id)},
+    {std::string{c_eval_file_option_name}, m_eval_file, senjo::EngineOption::String},
+    {std::string{c_tablebase_path_option_name}, m_tablebase_path, senjo::EngineOption::String},
+    {std::string{c_syzygy_path_option_name}, m_syzygy_path, senjo::EngineOption::String},
+    {std::string{c_slider_attacks_option_name}, to_string(Move_generator::get_slider_backend()),
+     senjo::EngineOption::ComboBox, INT64_MIN, INT64_MAX, slider_backends},
+  };
 }
 
-bool Meneldor_engine::setEngineOption(std::string const& /* optionName */, std::string const& /* optionValue */)
+bool Meneldor_engine::setEngineOption(std::string const& optionName, std::string const& optionValue)
 {
+  if (optionName == c_hash_option_name)
+  {
+    auto const size_mb = parse_spin_value(optionValue, 1, c_max_hash_size_mb);
+    if (!size_mb)
+    {
+      return false;
+    }
+    if (auto const resized = m_transpositions.resize(static_cast<size_t>(*size_mb) * 1024UL * 1024UL); !resized)
+    {
+      senjo::Output() << resized.error();
+      return false;
+    }
+    return true;
+  }
+
+  if (optionName == c_clear_hash_option_name)
+  {
+    m_transpositions.clear();
+    return true;
+  }
+
+  if (optionName == c_hash_file_option_name)
+  {
+    m_hash_file = optionValue;
+    return true;
+  }
+
+  if (optionName == c_save_hash_option_name || optionName == c_load_hash_option_name)
+  {
+    auto const is_save = (optionName == c_save_hash_option_name);
+    auto const result = is_save ? m_transpositions.save(m_hash_file) : m_transpositions.load(m_hash_file);
+    if (!result)
+    {
+      senjo::Output() << result.error();
+      return false;
+    }
+    senjo::Output() << (is_save ? "Saved " : "Loaded ") << m_transpositions.get_capacity()
+                    << " transposition table entries " << (is_save ? "to " : "from ") << m_hash_file;
+    return true;
+  }
+
+  if (optionName == c_eval_cache_option_name)
+  {
+    auto const size_mb = parse_spin_value(optionValue, 0, c_max_eval_cache_size_mb);
+    if (!size_mb)
+    {
+      return false;
+    }
+    m_eval_cache_size_mb = *size_mb;
+    m_eval_cache.resize(static_cast<size_t>(*size_mb) * 1024UL * 1024UL);
+    return true;
+  }
+
+  if (optionName == c_numa_node_option_name)
+  {
+    // Node ids come from sysfs and can have gaps
+    auto const& topology = Numa_topology::get_system();
+    auto const node = parse_spin_value(optionValue, -1, static_cast<int64_t>(topology.get_nodes().back().id));
+    if (!node || (*node >= 0 && !topology.has_node(static_cast<size_t>(*node))))
+    {
+      return false;
+    }
+    m_thread_tables_need_relocation = (*node >= 0 && *node != m_numa_node);
+    m_numa_node = *node;
+    return true;
+  }
+
+  if (optionName == c_eval_file_option_name)
+  {
+    if (optionValue.empty() || optionValue == "<empty>")
+    {
+      Nnue_network::set_active(nullptr);
+    }
+    else
+    {
+      auto network = Nnue_network::load(optionValue);
+      if (!network)
+      {
+        senjo::Output() << network.error();
+        return false;
+      }
+      Nnue_network::set_active(std::make_unique<Nnue_network const>(std::move(*network)));
+      senjo::Output() << "Loaded network " << optionValue << " using " << Nnue_network::get_best_simd_level();
+    }
+
+    // Cached scores came from the previous evaluation function
+    m_eval_file = optionValue;
+    m_eval_cache.clear();
+    return true;
+  }
+
+  if (optionName == c_tablebase_path_option_name)
+  {
+    m_tablebase.clear();
+    m_tablebase_path.clear();
+    if (optionValue.empty() || optionValue == "<empty>")
+    {
+      return true;
+    }
+
+    auto const table_count = m_tablebase.load_directory(optionValue);
+    if (!table_count)
+    {
+      senjo::Output() << table_count.error();
+      return false;
+    }
+    m_tablebase_path = optionValue;
+    senjo::Output() << "Loaded " << *table_count << " tablebase tables from " << optionValue;
+    return true;
+  }
+
+  if (optionName == c_syzygy_path_option_name)
+  {
+    m_syzygy.clear();
+    m_syzygy_path.clear();
+    if (optionValue.empty() || optionValue == "<empty>")
+    {
+      return true;
+    }
+
+    auto const table_count = m_syzygy.load_paths(optionValue);
+    if (!table_count)
+    {
+      senjo::Output() << table_count.error();
+      return false;
+    }
+    m_syzygy_path = optionValue;
+    senjo::Output() << "Found " << *table_count << " Syzygy tables with up to " << m_syzygy.get_max_pieces()
+                    << " pieces";
+    return true;
+  }
+
+  if (optionName == c_slider_attacks_option_name)
+  {
+    auto const backend = rs::find(c_slider_backends, optionValue, &to_string);
+    if (backend == c_slider_backends.end() || !Move_generator::set_slider_backend(*backend))
+    {
+      return false;
+    }
+    senjo::Output() << "Using " << *backend << " slider attacks";
+    return true;
+  }
+
   return false;
 }
 
@@ -381,10 +753,16 @@ bool Meneldor_engine::setPosition(std::string const& fen, std::string* remain /*
     if (remain)
     {
       auto const move_index = fen.find("moves");
+      // EPD operations after the fen, like the node counts of a perft suite
+      auto const operations_index = fen.find(';');
       if (move_index < std::string::npos)
       {
         *remain = fen.substr(move_index);
       }
+      else if (operations_index < std::string::npos)
+      {
+        *remain = fen.substr(operations_index);
+      }
     }
 
     return true;
@@ -431,8 +809,12 @@ bool Meneldor_engine::whiteToMove() const
 
 void Meneldor_engine::clearSearchData()
 {
-  // No data persists between searches currently
-  m_transpositions.clear();
+  // Old entries are still correct for their positions, aging them lets the
+  // new game's entries replace them first without wiping the whole table
+  m_transpositions.new_generation();
+  m_pawn_hash_table.clear();
+  m_material_table.clear();
+  m_eval_cache.clear();
 }
 
 void Meneldor_engine::ponderHit()
@@ -506,7 +888,8 @@ uint64_t Meneldor_engine::perft(int const depth)
 
   auto const start = std::chrono::system_clock::now();
   std::atomic_flag is_cancelled{};
-  auto const result = Move_generator::perft(depth, m_board, is_cancelled);
+  Perft perft{std::max(std::thread::hardware_concurrency(), 1u)};
+  auto const result = perft.count(depth, m_board, is_cancelled);
   auto const end = std::chrono::system_clock::now();
   std::chrono::duration<double> const elapsed = end - start;
   auto const elapsed_seconds = elapsed.count();
@@ -519,7 +902,7 @@ uint64_t Meneldor_engine::perft(int const depth)
   return result;
 }
 
-std::pair<Move, int> Meneldor_engine::search(int depth, std::vector<Move>& legal_moves)
+std::pair<Move, int> Meneldor_engine::search(int depth, Move_list& legal_moves)
 {
   MY_ASSERT(!legal_moves.empty(), "Already in checkmate or stalemate");
   constexpr static int c_depth_to_use_id_score{3};
@@ -544,6 +927,7 @@ std::pair<Move, int> Meneldor_engine::search(int depth, std::vector<Move>& legal
   std::string move_string{""};
   bool perform_full_search{true};
   std::pair<Move, int> best{legal_moves.front(), negative_inf};
+  m_nnue_stack.reset(m_board);
   for (auto& move : legal_moves)
   {
     auto tmp_board = m_board;
@@ -551,6 +935,7 @@ std::pair<Move, int> Meneldor_engine::search(int depth, std::vector<Move>& legal
     move_string = move_to_string(move);
 
     int score{0};
+    m_nnue_stack.push(tmp_board);
     if (perform_full_search)
     {
       score = -negamax_(tmp_board, negative_inf, positive_inf, depth - 1);
@@ -563,6 +948,7 @@ std::pair<Move, int> Meneldor_engine::search(int depth, std::vector<Move>& legal
         score = -negamax_(tmp_board, negative_inf, -score, depth - 1);
       }
     }
+    m_nnue_stack.pop();
     perform_full_search = false;
 
     auto score_four_bits = static_cast<uint8_t>(std::clamp((score / 200) + 7, 0, 15));
@@ -608,7 +994,8 @@ void Meneldor_engine::print_stats(std::pair<Move, int> best_move, std::optional<
     (stats.msecs == 0) ? 0 : static_cast<int32_t>(1000.0 * static_cast<double>(stats.nodes) / stats.msecs);
   std::stringstream out;
   out << "info depth " << stats.depth << " seldepth " << stats.seldepth << " score " << format_score(best_move.second)
-      << " nodes " << stats.nodes << " nps " << nodes_per_second << " time " << stats.msecs;
+      << " nodes " << stats.nodes << " nps " << nodes_per_second << " tbhits " << m_tablebase_hits << " time "
+      << stats.msecs;
 
   if (pv)
   {
@@ -628,8 +1015,12 @@ std::string Meneldor_engine::go(senjo::GoParams const& params, std::string* pond
 
   m_visited_nodes = 0;
   m_visited_quiesence_nodes = 0;
+  m_lazy_evaluations = 0;
+  m_tablebase_hits = 0;
   m_stop_requested.clear();
   m_is_searching.test_and_set();
+  m_transpositions.new_generation();
+  bind_search_thread_();
 
   if (m_is_debug)
   {
@@ -644,6 +1035,13 @@ std::string Meneldor_engine::go(senjo::GoParams const& params, std::string* pond
     return {};
   }
 
+  // Only search the moves that keep the tablebase result
+  if (auto root_moves = m_syzygy.filter_root_moves(m_board, legal_moves))
+  {
+    ++m_tablebase_hits;
+    legal_moves = std::move(*root_moves);
+  }
+
   int max_depth = (params.depth > 0) ? params.depth : c_default_depth;
   m_search_mode = Search_mode::depth;
   if (params.wtime > 0 || params.btime > 0 || params.movetime > 0 || params.infinite)
@@ -675,7 +1073,17 @@ std::string Meneldor_engine::go(senjo::GoParams const& params, std::string* pond
   if (m_is_debug)
   {
     std::cout << "Search depth: " << m_depth_for_current_search << "\n";
-    std::cout << "TT occupancy: " << m_transpositions.count() << "\n";
+    if (Nnue_network::get_active())
+    {
+      std::cout << "Evaluation: nnue (" << Nnue_network::get_best_simd_level() << ")\n";
+    }
+    else
+    {
+      std::cout << "Evaluation: classic\n";
+    }
+    std::cout << "Slider attacks: " << Move_generator::get_slider_backend() << "\n";
+    std::cout << "TT occupancy: " << m_transpositions.count()
+              << (m_transpositions.uses_huge_pages() ? " (huge pages)" : "") << "\n";
     std::cout << "TT percent full: " << (static_cast<float>(m_transpositions.count()) / m_transpositions.get_capacity())
               << "\n";
 
@@ -683,9 +1091,25 @@ std::string Meneldor_engine::go(senjo::GoParams const& params, std::string* pond
               << ", sufficient_depth: " << tt_sufficient_depth
               << ", hit%: " << (static_cast<float>(100.0 * tt_hits) / (tt_hits + tt_misses)) << "\n";
 
+    auto const pawn_hits = m_pawn_hash_table.get_hits();
+    auto const pawn_probes = pawn_hits + m_pawn_hash_table.get_misses();
+    std::cout << "Pawn hash hits: " << pawn_hits << ", total: " << pawn_probes
+              << ", hit%: " << ((pawn_probes == 0) ? 0.0F : static_cast<float>(100.0 * pawn_hits) / pawn_probes)
+              << "\n";
+
+    auto const material_hits = m_material_table.get_hits();
+    auto const material_probes = material_hits + m_material_table.get_misses();
+    std::cout << "Material hash hits: " << material_hits << ", total: " << material_probes << ", hit%: "
+              << ((material_probes == 0) ? 0.0F : static_cast<float>(100.0 * material_hits) / material_probes)
+              << "\n";
+
+    std::cout << "Lazy evaluations: " << m_lazy_evaluations << ", qnodes: " << m_visited_quiesence_nodes << "\n";
+
     tt_hits = 0;
     tt_misses = 0;
     tt_sufficient_depth = 0;
+    m_pawn_hash_table.reset_stats();
+    m_material_table.reset_stats();
   }
 
   if (ponder && m_current_pv && m_current_pv->size() > 1)
@@ -754,7 +1178,13 @@ std::optional<std::vector<std::string>> Meneldor_engine::get_principal_variation
     }
 
     depth -= 1;
-    next_move = entry->best_move;
+    auto const legal_moves = Move_generator::generate_legal_moves(tmp_board);
+    auto const found = rs::find(legal_moves, entry->best_move, &Move::compact);
+    if (found == legal_moves.end())
+    {
+      return result;
+    }
+    next_move = *found;
     result.push_back(move_to_string(*next_move));
     if (std::abs(entry->evaluation) >= positive_inf - m_depth_for_current_search)
     {
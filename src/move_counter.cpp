@@ -0,0 +1,133 @@
+#include "move_counter.h"
+#include "cpu_features.h"
+#include "move_generator.h"
+#include "my_assert.h"
+
+namespace Meneldor
+{
+namespace
+{
+// Positions one ply above the leaves, counted once there are enough to fill every lane
+class Leaf_batch
+{
+public:
+  void add(Board const& parent, Move m)
+  {
+    auto& board = m_boards[m_size];
+    board = parent;
+    [[maybe_unused]] auto succeeded = board.move_no_verify(m);
+    MY_ASSERT(succeeded, "Invalid move");
+
+    if (++m_size == m_batch_size)
+    {
+      flush();
+    }
+  }
+
+  void flush()
+  {
+    Move_counter::count_legal_moves(std::span{m_boards}.first(m_size), m_counts);
+    m_nodes = std::accumulate(m_counts.begin(), m_counts.begin() + m_size, m_nodes);
+    m_size = 0;
+  }
+
+  uint64_t get_nodes() const
+  {
+    return m_nodes;
+  }
+
+private:
+  std::array<Board, Move_counter::c_max_batch_size> m_boards;
+  std::array<uint32_t, Move_counter::c_max_batch_size> m_counts{};
+  size_t m_size{0};
+  size_t m_batch_size{Move_counter::get_batch_size()};
+  uint64_t m_nodes{0};
+};
+
+void perft_(int depth, Board const& board, Leaf_batch& leaves, std::atomic_flag& is_cancelled)
+{
+  Move_list moves;
+  Move_generator::generate_legal_moves(board, moves);
+  for (auto m : moves)
+  {
+    if (depth == 2)
+    {
+      leaves.add(board, m);
+    }
+    else
+    {
+      auto tmp_board = Board{board};
+      [[maybe_unused]] auto succeeded = tmp_board.move_no_verify(m);
+      MY_ASSERT(succeeded, "Invalid move");
+      perft_(depth - 1, tmp_board, leaves, is_cancelled);
+    }
+
+    if (is_cancelled.test())
+    {
+      return;
+    }
+  }
+}
+} // namespace
+
+void Move_counter::count_legal_moves(std::span<Board const> boards, std::span<uint32_t> counts)
+{
+  static auto const batch_size = get_batch_size();
+  switch (batch_size)
+  {
+    case 8:
+      count_legal_moves_avx512(boards, counts);
+      break;
+    case 4:
+      count_legal_moves_avx2(boards, counts);
+      break;
+    default:
+      count_legal_moves_scalar(boards, counts);
+      break;
+  }
+}
+
+uint32_t Move_counter::count_legal_moves(Board const& board)
+{
+  // The other lanes would be wasted on a single board
+  uint32_t count{0};
+  count_legal_moves_scalar(std::span{&board, 1}, std::span{&count, 1});
+  return count;
+}
+
+uint64_t Move_counter::perft(int depth, Board& board, std::atomic_flag& is_cancelled)
+{
+  if (depth == 0)
+  {
+    return uint64_t{1};
+  }
+  if (depth == 1)
+  {
+    return count_legal_moves(board);
+  }
+
+  Leaf_batch leaves;
+  perft_(depth, board, leaves, is_cancelled);
+  leaves.flush();
+  return leaves.get_nodes();
+}
+
+size_t Move_counter::get_batch_size()
+{
+  if (has_avx512())
+  {
+    return 8;
+  }
+  return has_avx2() ? 4 : 1;
+}
+
+bool Move_counter::has_avx2()
+{
+  return Cpu_features::get().avx2;
+}
+
+bool Move_counter::has_avx512()
+{
+  return Cpu_features::get().avx512f;
+}
+} // namespace Meneldor
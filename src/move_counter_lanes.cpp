@@ -0,0 +1,422 @@
+#include "move_counter.h"
+#include "cpu_features.h"
+#include "move_generator.h"
+#include "my_assert.h"
+
+// The batched counting code of Move_counter. It is kept in its own file
+// because of the pragma below.
+
+#if defined(MENELDOR_X86_SIMD) && !defined(__clang__)
+// The vector helpers only ever run inlined into the AVX2 and AVX-512
+// functions, so the ABI for passing vectors between them never comes into
+// play. GCC reports -Wpsabi at the end of the translation unit rather than at
+// the helpers, so a push and pop around them wouldn't silence it. Instead the
+// helpers are the only code in this file.
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace Meneldor
+{
+namespace
+{
+// One bitboard per lane. GCC vector extensions compile to the instruction set
+// of the function they are inlined into, so the counting code below is shared
+// by every batch width and a single lane is a plain integer.
+template <size_t lanes>
+struct Lanes_type;
+
+template <>
+struct Lanes_type<1>
+{
+  using type = uint64_t;
+};
+
+#ifdef MENELDOR_X86_SIMD
+template <>
+struct Lanes_type<4>
+{
+  using type [[gnu::vector_size(32)]] = uint64_t;
+};
+
+template <>
+struct Lanes_type<8>
+{
+  using type [[gnu::vector_size(64)]] = uint64_t;
+};
+#endif
+
+template <size_t lanes>
+using Lanes = typename Lanes_type<lanes>::type;
+
+constexpr uint64_t c_a_file{Bitboard_constants::a_file.val};
+constexpr uint64_t c_h_file{Bitboard_constants::h_file.val};
+
+// Squares that didn't wrap around the board's edge after moving the given
+// number of files east (positive) or west
+constexpr uint64_t unwrapped_squares(int files)
+{
+  switch (files)
+  {
+    case 1:
+      return ~c_a_file;
+    case 2:
+      return ~(c_a_file | (c_a_file << 1));
+    case -1:
+      return ~c_h_file;
+    case -2:
+      return ~(c_h_file | (c_h_file >> 1));
+    default:
+      return Bitboard_constants::all.val;
+  }
+}
+
+template <int distance, typename V>
+[[gnu::always_inline]] inline V shift(V bb)
+{
+  if constexpr (distance > 0)
+  {
+    return bb << distance;
+  }
+  else
+  {
+    return bb >> -distance;
+  }
+}
+
+// Moves every square of the set by the given number of files and ranks
+template <int files, int ranks, typename V>
+[[gnu::always_inline]] inline V step(V bb)
+{
+  constexpr uint64_t unwrapped{unwrapped_squares(files)};
+  return shift<ranks * 8 + files>(bb) & unwrapped;
+}
+
+// Squares the sliders attack in one direction, like occluded_fill in slider_fill.cpp
+template <int files, int ranks, typename V>
+[[gnu::always_inline]] inline V slide(V sliders, V empty)
+{
+  constexpr int distance{ranks * 8 + files};
+  constexpr uint64_t unwrapped{unwrapped_squares(files)};
+  auto propagators = empty & unwrapped;
+  sliders |= propagators & shift<distance>(sliders);
+  propagators &= shift<distance>(propagators);
+  sliders |= propagators & shift<2 * distance>(sliders);
+  propagators &= shift<2 * distance>(propagators);
+  sliders |= propagators & shift<4 * distance>(sliders);
+  return step<files, ranks>(sliders);
+}
+
+template <typename V>
+[[gnu::always_inline]] inline V king_attacks(V kings)
+{
+  return step<1, 0>(kings) | step<-1, 0>(kings) | step<0, 1>(kings) | step<0, -1>(kings) | step<1, 1>(kings) |
+         step<-1, 1>(kings) | step<1, -1>(kings) | step<-1, -1>(kings);
+}
+
+template <typename V>
+[[gnu::always_inline]] inline V knight_attacks(V knights)
+{
+  return step<1, 2>(knights) | step<-1, 2>(knights) | step<2, 1>(knights) | step<-2, 1>(knights) |
+         step<1, -2>(knights) | step<-1, -2>(knights) | step<2, -1>(knights) | step<-2, -1>(knights);
+}
+
+// Every bit set in the lanes that have any bit set
+template <typename V>
+[[gnu::always_inline]] inline V nonzero(V bb)
+{
+  return V{} - ((bb | (V{} - bb)) >> 63);
+}
+
+// Set bits of each byte. Counts of up to 31 sets can be added up before a
+// byte overflows, the bytes are only summed once all moves are counted.
+template <typename V>
+[[gnu::always_inline]] inline V byte_counts(V bb)
+{
+  bb = bb - ((bb >> 1) & 0x5555555555555555ULL);
+  bb = (bb & 0x3333333333333333ULL) + ((bb >> 2) & 0x3333333333333333ULL);
+  return (bb + (bb >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+}
+
+template <typename V>
+[[gnu::always_inline]] inline V sum_bytes(V counts)
+{
+  counts = (counts & 0x00ff00ff00ff00ffULL) + ((counts >> 8) & 0x00ff00ff00ff00ffULL);
+  return (counts * 0x0001000100010001ULL) >> 48;
+}
+
+// Moves of a group of sliders in one direction. Each square is reached by at
+// most one of them, the ray of a piece behind another stops at the first one.
+template <int files, int ranks, typename V>
+[[gnu::always_inline]] inline V count_slides(V sliders, V empty, V targets)
+{
+  return byte_counts(slide<files, ranks>(sliders, empty) & targets);
+}
+
+template <typename V>
+[[gnu::always_inline]] inline V count_knight_moves(V knights, V targets)
+{
+  return byte_counts(step<1, 2>(knights) & targets) + byte_counts(step<-1, 2>(knights) & targets) +
+         byte_counts(step<2, 1>(knights) & targets) + byte_counts(step<-2, 1>(knights) & targets) +
+         byte_counts(step<1, -2>(knights) & targets) + byte_counts(step<-1, -2>(knights) & targets) +
+         byte_counts(step<2, -1>(knights) & targets) + byte_counts(step<-2, -1>(knights) & targets);
+}
+
+// Follows one line out of the king. An enemy slider seen first gives check,
+// seen behind exactly one of our pieces it pins that piece.
+template <int files, int ranks, typename V>
+[[gnu::always_inline]] inline void scan_king_line(
+  V king, V own, V empty, V snipers, V& checkers, V& evasions, V& pinned)
+{
+  auto const ray = slide<files, ranks>(king, empty);
+  auto const checker = ray & snipers;
+  checkers |= checker;
+  evasions |= ray & nonzero(checker);
+
+  auto const blocker = ray & own;
+  pinned |= blocker & nonzero(slide<files, ranks>(blocker, empty) & snipers);
+}
+
+template <size_t lanes>
+[[gnu::always_inline]] inline Lanes<lanes> load(std::array<uint64_t, lanes> const& values)
+{
+  Lanes<lanes> result;
+  std::memcpy(&result, values.data(), sizeof(result));
+  return result;
+}
+
+template <size_t lanes>
+[[gnu::always_inline]] inline void store(Lanes<lanes> value, std::array<uint64_t, lanes>& values)
+{
+  std::memcpy(values.data(), &value, sizeof(value));
+}
+
+constexpr size_t piece_index(Piece piece)
+{
+  return static_cast<size_t>(piece) - static_cast<size_t>(Piece::pawn);
+}
+
+// Boards are flipped for black to move, so the side to move always moves up the board
+constexpr uint64_t relative(Bitboard bb, Color color)
+{
+  return (color == Color::white) ? bb.val : std::byteswap(bb.val);
+}
+
+// The pieces of one board per lane
+template <size_t lanes>
+struct Lane_positions
+{
+  // Indexed by piece type starting at Piece::pawn, then by lane
+  std::array<std::array<uint64_t, lanes>, 6> own{};
+  std::array<std::array<uint64_t, lanes>, 6> enemy{};
+};
+
+template <size_t lanes>
+struct Lane_counts
+{
+  // Every legal move except castling and en passant
+  std::array<uint64_t, lanes> moves{};
+
+  // Squares the king can't move to, flipped like the positions
+  std::array<uint64_t, lanes> king_danger{};
+};
+
+template <size_t lanes>
+[[gnu::always_inline]] inline void count_lanes(Lane_positions<lanes> const& positions, Lane_counts<lanes>& counts)
+{
+  using V = Lanes<lanes>;
+
+  V const pawns = load(positions.own[piece_index(Piece::pawn)]);
+  V const knights = load(positions.own[piece_index(Piece::knight)]);
+  V const queens = load(positions.own[piece_index(Piece::queen)]);
+  V const orthogonal = load(positions.own[piece_index(Piece::rook)]) | queens;
+  V const diagonal = load(positions.own[piece_index(Piece::bishop)]) | queens;
+  V const king = load(positions.own[piece_index(Piece::king)]);
+
+  V const enemy_pawns = load(positions.enemy[piece_index(Piece::pawn)]);
+  V const enemy_knights = load(positions.enemy[piece_index(Piece::knight)]);
+  V const enemy_queens = load(positions.enemy[piece_index(Piece::queen)]);
+  V const enemy_orthogonal = load(positions.enemy[piece_index(Piece::rook)]) | enemy_queens;
+  V const enemy_diagonal = load(positions.enemy[piece_index(Piece::bishop)]) | enemy_queens;
+  V const enemy_king = load(positions.enemy[piece_index(Piece::king)]);
+
+  auto const own = pawns | knights | orthogonal | diagonal | king;
+  auto const enemy = enemy_pawns | enemy_knights | enemy_orthogonal | enemy_diagonal | enemy_king;
+  auto const empty = ~(own | enemy);
+
+  // Sliders see through the king, so it can't step away from them along their line
+  auto const seen_through_king = empty | king;
+  auto const king_danger =
+    step<1, -1>(enemy_pawns) | step<-1, -1>(enemy_pawns) | knight_attacks(enemy_knights) | king_attacks(enemy_king) |
+    slide<0, 1>(enemy_orthogonal, seen_through_king) | slide<0, -1>(enemy_orthogonal, seen_through_king) |
+    slide<1, 0>(enemy_orthogonal, seen_through_king) | slide<-1, 0>(enemy_orthogonal, seen_through_king) |
+    slide<1, 1>(enemy_diagonal, seen_through_king) | slide<-1, -1>(enemy_diagonal, seen_through_king) |
+    slide<-1, 1>(enemy_diagonal, seen_through_king) | slide<1, -1>(enemy_diagonal, seen_through_king);
+
+  // Pawns and knights give check from the squares they would attack from the king's square
+  auto checkers = ((step<1, 1>(king) | step<-1, 1>(king)) & enemy_pawns) | (knight_attacks(king) & enemy_knights);
+  auto evasions = checkers;
+
+  // Pinned pieces by the line of their pin: files, ranks, rising and falling diagonals
+  std::array<V, 4> pinned_along{};
+  scan_king_line<0, 1>(king, own, empty, enemy_orthogonal, checkers, evasions, pinned_along[0]);
+  scan_king_line<0, -1>(king, own, empty, enemy_orthogonal, checkers, evasions, pinned_along[0]);
+  scan_king_line<1, 0>(king, own, empty, enemy_orthogonal, checkers, evasions, pinned_along[1]);
+  scan_king_line<-1, 0>(king, own, empty, enemy_orthogonal, checkers, evasions, pinned_along[1]);
+  scan_king_line<1, 1>(king, own, empty, enemy_diagonal, checkers, evasions, pinned_along[2]);
+  scan_king_line<-1, -1>(king, own, empty, enemy_diagonal, checkers, evasions, pinned_along[2]);
+  scan_king_line<-1, 1>(king, own, empty, enemy_diagonal, checkers, evasions, pinned_along[3]);
+  scan_king_line<1, -1>(king, own, empty, enemy_diagonal, checkers, evasions, pinned_along[3]);
+  auto const unpinned = ~(pinned_along[0] | pinned_along[1] | pinned_along[2] | pinned_along[3]);
+
+  // In check, the other pieces can only capture the checker or block it, and
+  // only the king can move out of a double check
+  auto const double_check = nonzero(checkers & (checkers - 1));
+  auto const targets = (evasions | ~nonzero(checkers)) & ~double_check & ~own;
+
+  auto moves = byte_counts(king_attacks(king) & ~own & ~king_danger);
+  moves += count_knight_moves(knights & unpinned, targets);
+
+  // Pinned sliders can still move along the line of their pin
+  auto const file_sliders = orthogonal & (unpinned | pinned_along[0]);
+  auto const rank_sliders = orthogonal & (unpinned | pinned_along[1]);
+  auto const rising_sliders = diagonal & (unpinned | pinned_along[2]);
+  auto const falling_sliders = diagonal & (unpinned | pinned_along[3]);
+  moves += count_slides<0, 1>(file_sliders, empty, targets) + count_slides<0, -1>(file_sliders, empty, targets) +
+           count_slides<1, 0>(rank_sliders, empty, targets) + count_slides<-1, 0>(rank_sliders, empty, targets) +
+           count_slides<1, 1>(rising_sliders, empty, targets) + count_slides<-1, -1>(rising_sliders, empty, targets) +
+           count_slides<-1, 1>(falling_sliders, empty, targets) + count_slides<1, -1>(falling_sliders, empty, targets);
+
+  // The square in front of a double push must be empty, but doesn't need to block a check
+  auto const single_pushes = step<0, 1>(pawns & (unpinned | pinned_along[0])) & empty;
+  auto const double_pushes = step<0, 1>(single_pushes & Bitboard_constants::third_rank.val) & empty & targets;
+  auto const pushes = single_pushes & targets;
+  auto const east_captures = step<1, 1>(pawns & (unpinned | pinned_along[2])) & enemy & targets;
+  auto const west_captures = step<-1, 1>(pawns & (unpinned | pinned_along[3])) & enemy & targets;
+  moves += byte_counts(pushes) + byte_counts(double_pushes) + byte_counts(east_captures) + byte_counts(west_captures);
+
+  // Every promotion is four moves, one was counted above
+  constexpr uint64_t last_rank{Bitboard_constants::eighth_rank.val};
+  auto const promotions = byte_counts(pushes & last_rank) + byte_counts(east_captures & last_rank) +
+                          byte_counts(west_captures & last_rank);
+
+  store<lanes>(sum_bytes(moves) + 3 * sum_bytes(promotions), counts.moves);
+  store<lanes>(king_danger, counts.king_danger);
+}
+
+// Castling and en passant are rare enough to be counted one board at a time
+uint32_t count_special_moves(Board const& board, uint64_t king_danger)
+{
+  uint32_t result{0};
+  auto const color = board.get_active_color();
+  auto const rights = board.get_castling_rights();
+  auto const occupied = relative(board.get_occupied_squares(), color);
+
+  // The king's square is in danger when in check
+  constexpr uint64_t king_start{uint64_t{1} << 4};
+  constexpr uint64_t short_castling_path{Bitboard_constants::short_castling_empty_squares_white.val};
+  constexpr uint64_t long_castling_path{Bitboard_constants::long_castling_empty_squares_white.val};
+  constexpr uint64_t long_castling_empty{long_castling_path | (uint64_t{1} << 1)};
+
+  auto const can_short_castle =
+    (color == Color::white) ? white_can_short_castle(rights) : black_can_short_castle(rights);
+  if (can_short_castle && !(occupied & short_castling_path) && !(king_danger & (short_castling_path | king_start)))
+  {
+    ++result;
+  }
+
+  auto const can_long_castle = (color == Color::white) ? white_can_long_castle(rights) : black_can_long_castle(rights);
+  if (can_long_castle && !(occupied & long_castling_empty) && !(king_danger & (long_castling_path | king_start)))
+  {
+    ++result;
+  }
+
+  auto const en_passant = board.get_en_passant_square();
+  if (en_passant.is_empty())
+  {
+    return result;
+  }
+
+  // Pawns next to the one that just moved two squares
+  Bitboard const capturers{relative(board.get_piece_set(color, Piece::pawn), color) &
+                           (step<1, -1>(relative(en_passant, color)) | step<-1, -1>(relative(en_passant, color)))};
+  if (capturers.is_empty())
+  {
+    return result;
+  }
+
+  auto const attack_info = Move_generator::get_attack_info(board);
+  Coordinates const to{en_passant.bitscan_forward()};
+  for (auto const location : capturers)
+  {
+    // Flipping a board back swaps its ranks
+    Coordinates const from{static_cast<int32_t>((color == Color::white) ? location : location ^ 56)};
+    if (Move_generator::is_legal(board, attack_info,
+                                 Move{from, to, Piece::pawn, Piece::pawn, Piece::empty, Move_type::en_passant}))
+    {
+      ++result;
+    }
+  }
+  return result;
+}
+
+template <size_t lanes>
+[[gnu::always_inline]] inline void count_batches(std::span<Board const> boards, std::span<uint32_t> counts)
+{
+  MY_ASSERT(counts.size() >= boards.size(), "Every board needs a count");
+
+  for (size_t first{0}; first < boards.size(); first += lanes)
+  {
+    // Lanes past the last board hold empty boards, which have no moves
+    auto const batch = boards.subspan(first, std::min(lanes, boards.size() - first));
+    Lane_positions<lanes> positions;
+    for (size_t lane{0}; lane < batch.size(); ++lane)
+    {
+      auto const color = batch[lane].get_active_color();
+      for (auto const piece : {Piece::pawn, Piece::knight, Piece::bishop, Piece::rook, Piece::queen, Piece::king})
+      {
+        positions.own[piece_index(piece)][lane] = relative(batch[lane].get_piece_set(color, piece), color);
+        positions.enemy[piece_index(piece)][lane] =
+          relative(batch[lane].get_piece_set(opposite_color(color), piece), color);
+      }
+    }
+
+    Lane_counts<lanes> lane_counts;
+    count_lanes<lanes>(positions, lane_counts);
+    for (size_t lane{0}; lane < batch.size(); ++lane)
+    {
+      counts[first + lane] = static_cast<uint32_t>(lane_counts.moves[lane]) +
+                             count_special_moves(batch[lane], lane_counts.king_danger[lane]);
+    }
+  }
+}
+} // namespace
+
+void Move_counter::count_legal_moves_scalar(std::span<Board const> boards, std::span<uint32_t> counts)
+{
+  count_batches<1>(boards, counts);
+}
+
+#ifdef MENELDOR_X86_SIMD
+__attribute__((target("avx2"))) void Move_counter::count_legal_moves_avx2(std::span<Board const> boards,
+                                                                          std::span<uint32_t> counts)
+{
+  count_batches<4>(boards, counts);
+}
+
+__attribute__((target("avx512f"))) void Move_counter::count_legal_moves_avx512(std::span<Board const> boards,
+                                                                               std::span<uint32_t> counts)
+{
+  count_batches<8>(boards, counts);
+}
+#else
+void Move_counter::count_legal_moves_avx2(std::span<Board const> boards, std::span<uint32_t> counts)
+{
+  count_batches<1>(boards, counts);
+}
+
+void Move_counter::count_legal_moves_avx512(std::span<Board const> boards, std::span<uint32_t> counts)
+{
+  count_batches<1>(boards, counts);
+}
+#endif
+} // namespace Meneldor
@@ -1,53 +1,19 @@
 #include "move_generator.h"
 #include "board.h"
+#include "cpu_features.h"
 #include "feature_toggle.h"
 #include "my_assert.h"
+#include "slider_fill.h"
+#include "slider_magics.h"
+
+#ifdef MENELDOR_X86_SIMD
+#include <immintrin.h>
+#endif
 
 namespace rs = std::ranges;
 namespace Meneldor
 {
 
-// Generated with code from: https://www.chessprogramming.org/Looking_for_Magics
-std::array<uint64_t, 64> const c_rook_magics{
-  0xa8002c000108020ULL,  0x6040004109200130ULL, 0x5820000814a02040ULL, 0x400800122040c4ULL,   0xa00211004010204ULL,
-  0x24010204000080ULL,   0x120004000822600ULL,  0x100024284a20700ULL,  0x4818080004040ULL,    0x4008e4804100ULL,
-  0x20200018000400ULL,   0x22001020081a040ULL,  0x30400200102205ULL,   0x201280018c020201ULL, 0x10401000486040e0ULL,
-  0x80290000804001ULL,   0x2000241002a08410ULL, 0x8018012008a84000ULL, 0x2015081004600090ULL, 0x8006803002208200ULL,
-  0xc220101090c800ULL,   0x20800404018aa200ULL, 0x4800900102200ULL,    0x600400980002015ULL,  0x198688480024008ULL,
-  0x10201040002000ULL,   0x403420002004c021ULL, 0x411081801804004ULL,  0x61004108016600ULL,   0x12400088240004ULL,
-  0x4004280806000100ULL, 0x840a0220005484ULL,   0x140311c080c00022ULL, 0x1004082010400040ULL, 0x110002400200400ULL,
-  0x40a02240200800ULL,   0x70480080d09040ULL,   0x1083000100800204ULL, 0x40042a510020006ULL,  0x8261014280380100ULL,
-  0x24402210042000ULL,   0x808000841001810ULL,  0x2000800811420004ULL, 0x8050006140100100ULL, 0x8002040100200dULL,
-  0x40080008100ULL,      0xa004108004204002ULL, 0xaa100429009ULL,      0x104000802080ULL,     0x400922050090118ULL,
-  0x810820104c25200ULL,  0x290005902801001ULL,  0x208080100810010aULL, 0x5004400011240ULL,    0x8104032040ULL,
-  0x1002000a0426420ULL,  0x82042081041042ULL,   0x8040c2900804001ULL,  0x884401004200882ULL,  0x88040220a000402ULL,
-  0x2303800644201ULL,    0x86e000980c122ULL,    0x82220a0461048204ULL, 0x1104010024104082ULL,
-};
-
-std::array<uint64_t, 64> const c_bishop_magics{
-  0x4010002202254010ULL, 0x4000506049214012ULL, 0xc41200304280c044ULL, 0x8a2444c808010008ULL, 0x4020484080440000ULL,
-  0x86088240010401ULL,   0x204024041988805ULL,  0x121235021204012ULL,  0x8004024c10108a00ULL, 0x4c0060220023ULL,
-  0x20105844b4000ULL,    0xa0346880041000ULL,   0x225028000009ULL,     0x44010144025ULL,      0x10048044002224ULL,
-  0xc080a01403010021ULL, 0x4005000068002041ULL, 0x810000062002511ULL,  0x4440210104804484ULL, 0x2094000820401000ULL,
-  0x4024000080214001ULL, 0x488080800820020cULL, 0x210100118410a820ULL, 0x1d02104483a600b0ULL, 0x368201006002200ULL,
-  0x120262000800430cULL, 0x1914008001000900ULL, 0x86c080014006088ULL,  0x812002202008040ULL,  0x13410020040c2ULL,
-  0x80008008010008c0ULL, 0x20a004040050090ULL,  0x40100400120480ULL,   0x8011001064029428ULL, 0x404d0c02a140100ULL,
-  0x40020080080080ULL,   0x40040120c0100ULL,    0x44620040a032ULL,     0x8204610810002c32ULL, 0x12204034a400ULL,
-  0xa24a40a000600ULL,    0x1080401a0420810ULL,  0x103041010500200ULL,  0x8000029088002070ULL, 0x80048100420400ULL,
-  0x521041000080382ULL,  0x802886021808c040ULL, 0x1002842408080084ULL, 0x80c41040414ULL,      0x516118080102000ULL,
-  0x20008040130020ULL,   0x684044040ULL,        0x29002000c5100920ULL, 0x806004944406ULL,     0x8410002140d40088ULL,
-  0x1060032c0408eULL,    0x8000023202014000ULL, 0x102001008821081ULL,  0x706418104102c08ULL,  0x1064008000034400ULL,
-  0x110018809820080ULL,  0x462824088020422ULL,  0x88600e210a00a020ULL, 0x6011008100188200ULL,
-};
-
-constexpr void update_if_in_bounds_(Bitboard& bb, int x, int y)
-{
-  if (0 <= x && x < c_board_dimension && 0 <= y && y < c_board_dimension)
-  {
-    bb.set_square(Coordinates{x, y}.square_index());
-  }
-}
-
 // The following functions rely on colors casting to these values
 static_assert(static_cast<uint8_t>(Color::black) == 0);
 static_assert(static_cast<uint8_t>(Color::white) == 1);
@@ -100,294 +66,60 @@ constexpr int32_t get_west_capture_offset(Color color)
   return c_west_offsets[static_cast<int32_t>(color)];
 }
 
-int pop_1st_bit(uint64_t* bb)
-{
-  constexpr static std::array<int, 64> BitTable{63, 30, 3,  32, 25, 41, 22, 33, 15, 50, 42, 13, 11, 53, 19, 34,
-                                                61, 29, 2,  51, 21, 43, 45, 10, 18, 47, 1,  54, 9,  57, 0,  35,
-                                                62, 31, 40, 4,  49, 5,  52, 26, 60, 6,  23, 44, 46, 27, 56, 16,
-                                                7,  39, 48, 24, 59, 14, 12, 55, 38, 28, 58, 20, 37, 17, 36, 8};
-
-  uint64_t b = *bb ^ (*bb - 1);
-  auto fold = static_cast<uint32_t>((b & 0xffffffff) ^ (b >> 32));
-  *bb &= (*bb - 1);
-  return BitTable[(fold * 0x783a9b23) >> 26];
-}
-
-// Given a bitboard with n permutations (x one bits -> 2^x permutations),
-// returns the index'th permutation for the bitboard. Must be called n times to
-// generate every permutation.
-uint64_t blocker_permutation_from_index(int index, int bits, uint64_t m)
-{
-  uint64_t result = 0ULL;
-  for (int i = 0; i < bits; i++)
-  {
-    int j = pop_1st_bit(&m);
-    if (index & (1 << i))
-    {
-      result |= (1ULL << j);
-    }
-  }
-  return result;
-}
-
-// Returns the possible blockers mask for a rook on the given square
-// Outer squares are not possible blockers, unless the rook is on an outer
-// square. In that case, other pieces on the same row or column are potential
-// blockers.
-constexpr Bitboard rook_potential_blockers(int sq)
-{
-  Bitboard result{0ULL};
-  int rank = sq / 8;
-  int file = sq % 8;
-  for (int r = rank + 1; r <= 6; r++)
-  {
-    result |= (Bitboard{1ULL} << (file + r * 8));
-  }
-  for (int r = rank - 1; r >= 1; r--)
-  {
-    result |= (Bitboard{1ULL} << (file + r * 8));
-  }
-  for (int f = file + 1; f <= 6; f++)
-  {
-    result |= (Bitboard{1ULL} << (f + rank * 8));
-  }
-  for (int f = file - 1; f >= 1; f--)
-  {
-    result |= (Bitboard{1ULL} << (f + rank * 8));
-  }
-  return result;
-}
-
-// Returns the possible blockers mask for a bishop on the given square
-// Outer squares are not possible blockers for a bishop
-constexpr Bitboard bishop_potential_blockers(int sq)
-{
-  Bitboard result{0ULL};
-  int rank = sq / 8;
-  int file = sq % 8;
-  for (int r = rank + 1, f = file + 1; r <= 6 && f <= 6; r++, f++)
-  {
-    result |= (Bitboard{1ULL} << (f + r * 8));
-  }
-  for (int r = rank + 1, f = file - 1; r <= 6 && f >= 1; r++, f--)
-  {
-    result |= (Bitboard{1ULL} << (f + r * 8));
-  }
-  for (int r = rank - 1, f = file + 1; r >= 1 && f <= 6; r--, f++)
-  {
-    result |= (Bitboard{1ULL} << (f + r * 8));
-  }
-  for (int r = rank - 1, f = file - 1; r >= 1 && f >= 1; r--, f--)
-  {
-    result |= (Bitboard{1ULL} << (f + r * 8));
-  }
-  return result;
-}
-
-constexpr Bitboard rook_attacked_squares(int sq, uint64_t block)
-{
-  Bitboard result{0ULL};
-  int rk = sq / 8, fl = sq % 8;
-  for (int r = rk + 1; r <= 7; r++)
-  {
-    result |= (Bitboard{1ULL} << (fl + r * 8));
-    if (block & (1ULL << (fl + r * 8)))
-    {
-      break;
-    }
-  }
-  for (int r = rk - 1; r >= 0; r--)
-  {
-    result |= (Bitboard{1ULL} << (fl + r * 8));
-    if (block & (1ULL << (fl + r * 8)))
-    {
-      break;
-    }
-  }
-  for (int f = fl + 1; f <= 7; f++)
-  {
-    result |= (Bitboard{1ULL} << (f + rk * 8));
-    if (block & (1ULL << (f + rk * 8)))
-    {
-      break;
-    }
-  }
-  for (int f = fl - 1; f >= 0; f--)
-  {
-    result |= (Bitboard{1ULL} << (f + rk * 8));
-    if (block & (1ULL << (f + rk * 8)))
-    {
-      break;
-    }
-  }
-  return result;
-}
-
-constexpr Bitboard bishop_attacked_squares(int sq, uint64_t block)
-{
-  Bitboard result{0ULL};
-  int rk = sq / 8, fl = sq % 8;
-  for (int r = rk + 1, f = fl + 1; r <= 7 && f <= 7; r++, f++)
-  {
-    result |= (Bitboard{1ULL} << (f + r * 8));
-    if (block & (1ULL << (f + r * 8)))
-    {
-      break;
-    }
-  }
-  for (int r = rk + 1, f = fl - 1; r <= 7 && f >= 0; r++, f--)
-  {
-    result |= (Bitboard{1ULL} << (f + r * 8));
-    if (block & (1ULL << (f + r * 8)))
-    {
-      break;
-    }
-  }
-  for (int r = rk - 1, f = fl + 1; r >= 0 && f <= 7; r--, f++)
-  {
-    result |= (Bitboard{1ULL} << (f + r * 8));
-    if (block & (1ULL << (f + r * 8)))
-    {
-      break;
-    }
-  }
-  for (int r = rk - 1, f = fl - 1; r >= 0 && f >= 0; r--, f--)
-  {
-    result |= (Bitboard{1ULL} << (f + r * 8));
-    if (block & (1ULL << (f + r * 8)))
-    {
-      break;
-    }
-  }
-  return result;
-}
-
-constexpr int magic_hash_fn(uint64_t blockers, uint64_t magic, int bits)
-{
-  MY_ASSERT(bits == 9 || bits == 12, "Fixed shift");
-  return (int)((blockers * magic) >> (64 - bits));
-}
+Slider_backend Move_generator::s_slider_backend{Move_generator::get_best_slider_backend()};
 
-Move_generator::Tables const Move_generator::m_tables{};
-
-Move_generator::Tables::Tables()
+#ifdef MENELDOR_X86_SIMD
+__attribute__((target("bmi2"))) uint64_t pext(uint64_t value, uint64_t mask)
 {
-  initialize_knight_attacks_();
-  initialize_king_attacks_();
-  for (int sq{0}; sq < c_board_dimension_squared; ++sq)
-  {
-    init_bishop_magic_tables_(sq);
-    init_rook_magic_tables_(sq);
-  }
+  return _pext_u64(value, mask);
 }
+#endif
 
-void Move_generator::Tables::init_bishop_magic_tables_(int index)
+Bitboard rook_attacks(Coordinates square, Bitboard occupied)
 {
-  // Based on code from: https://www.chessprogramming.org/Looking_for_Magics
-  // (The plain implementation)
-
-  Bitboard possible_blockers = bishop_potential_blockers(index);
-  bishop_possible_blockers[index] = possible_blockers;
-
-  // Populate blockers table
-  int n = possible_blockers.occupancy();
-  auto blocker_permutations = (1 << n);
-
-  for (int i = 0; i < blocker_permutations; ++i)
-  {
-    auto blockers = blocker_permutation_from_index(i, n, possible_blockers.val);
-
-    int shift = 9;
-    auto key = magic_hash_fn(blockers, c_bishop_magics[index], shift);
-    auto attacked_squares = bishop_attacked_squares(index, blockers);
-    bishop_attacks[index][key] = attacked_squares;
-  }
-}
-
-void Move_generator::Tables::init_rook_magic_tables_(int index)
-{
-  // Based on code from: https://www.chessprogramming.org/Looking_for_Magics
-  // (The plain implementation)
-
-  Bitboard possible_blockers = rook_potential_blockers(index);
-  rook_possible_blockers[index] = possible_blockers;
-
-  // Populate blockers table
-  int n = possible_blockers.occupancy();
-  auto blocker_permutations = (1 << n);
-
-  for (int i = 0; i < blocker_permutations; ++i)
-  {
-    auto blockers = blocker_permutation_from_index(i, n, possible_blockers.val);
-
-    int shift = 12;
-    auto key = magic_hash_fn(blockers, c_rook_magics[index], shift);
-    auto attacked_squares = rook_attacked_squares(index, blockers);
-    rook_attacks[index][key] = attacked_squares;
-  }
-}
-
-void Move_generator::Tables::initialize_knight_attacks_()
-{
-  for (int8_t x{0}; x < c_board_dimension; ++x)
-  {
-    for (int8_t y{0}; y < c_board_dimension; ++y)
+  auto const& tables = Move_generator::m_tables;
+  int const index = square.square_index();
+  auto const mask = tables.rook_possible_blockers[index];
+  switch (Move_generator::get_slider_backend())
+  {
+#ifdef MENELDOR_X86_SIMD
+    case Slider_backend::pext:
+      return tables.rook_pext_attacks[tables.rook_offsets[index] + pext(occupied.val, mask.val)];
+#endif
+    case Slider_backend::fancy_magic:
     {
-      auto square_index = Coordinates{x, y}.square_index();
-      auto& bb = knight_attacks[square_index];
-
-      update_if_in_bounds_(bb, x + 1, y + 2);
-      update_if_in_bounds_(bb, x - 1, y + 2);
-      update_if_in_bounds_(bb, x + 1, y - 2);
-      update_if_in_bounds_(bb, x - 1, y - 2);
-      update_if_in_bounds_(bb, x + 2, y + 1);
-      update_if_in_bounds_(bb, x - 2, y + 1);
-      update_if_in_bounds_(bb, x + 2, y - 1);
-      update_if_in_bounds_(bb, x - 2, y - 1);
+      auto const key = fancy_magic_hash_fn((occupied & mask).val, c_rook_fancy_magics[index],
+                                           tables.rook_blocker_counts[index]);
+      return tables.rook_fancy_attacks[tables.rook_offsets[index] + key];
     }
+    default:
+      return tables.rook_attacks[index][magic_hash_fn((occupied & mask).val, c_rook_magics[index], 12)];
   }
 }
 
-void Move_generator::Tables::initialize_king_attacks_()
+Bitboard bishop_attacks(Coordinates square, Bitboard occupied)
 {
-  for (int8_t x{0}; x < c_board_dimension; ++x)
-  {
-    for (int8_t y{0}; y < c_board_dimension; ++y)
+  auto const& tables = Move_generator::m_tables;
+  int const index = square.square_index();
+  auto const mask = tables.bishop_possible_blockers[index];
+  switch (Move_generator::get_slider_backend())
+  {
+#ifdef MENELDOR_X86_SIMD
+    case Slider_backend::pext:
+      return tables.bishop_pext_attacks[tables.bishop_offsets[index] + pext(occupied.val, mask.val)];
+#endif
+    case Slider_backend::fancy_magic:
     {
-      auto square_index = Coordinates{x, y}.square_index();
-      auto& bb = king_attacks[square_index];
-
-      for (int i = -1; i <= 1; ++i)
-      {
-        for (int j = -1; j <= 1; ++j)
-        {
-          if (i != 0 || j != 0)
-          {
-            update_if_in_bounds_(bb, x + i, y + j);
-          }
-        }
-      }
+      auto const key = fancy_magic_hash_fn((occupied & mask).val, c_bishop_fancy_magics[index],
+                                           tables.bishop_blocker_counts[index]);
+      return tables.bishop_fancy_attacks[tables.bishop_offsets[index] + key];
     }
+    default:
+      return tables.bishop_attacks[index][magic_hash_fn((occupied & mask).val, c_bishop_magics[index], 9)];
   }
 }
 
-constexpr Bitboard rook_attacks(Coordinates square, Bitboard occupied)
-{
-  int const index = square.square_index();
-  occupied &= Move_generator::m_tables.rook_possible_blockers[index];
-  auto key = magic_hash_fn(occupied.val, c_rook_magics[index], 12);
-  return Move_generator::m_tables.rook_attacks[index][key];
-}
-
-constexpr Bitboard bishop_attacks(Coordinates square, Bitboard occupied)
-{
-  int index = square.square_index();
-  occupied &= Move_generator::m_tables.bishop_possible_blockers[index];
-  auto key = magic_hash_fn(occupied.val, c_bishop_magics[index], 9);
-  return Move_generator::m_tables.bishop_attacks[index][key];
-}
-
-constexpr Bitboard queen_attacks(Coordinates square, Bitboard occupied)
+Bitboard queen_attacks(Coordinates square, Bitboard occupied)
 {
   return bishop_attacks(square, occupied) | rook_attacks(square, occupied);
 }
@@ -451,26 +183,106 @@ constexpr Bitboard pawn_west_attacks(Bitboard pawns, Bitboard enemies)
   return west_attacks;
 }
 
+// Restricts where pieces can move so only legal moves are generated. A
+// default constructed filter lets every pseudo legal move through.
+struct Move_filter
+{
+  // Squares pieces other than the king can move to. When in check, that is
+  // only the checking piece and the squares between it and the king.
+  Bitboard targets{Bitboard_constants::all};
+
+  // Squares the king can't move to
+  Bitboard king_danger;
+
+  // Pinned pieces can only move along the line through their king
+  Bitboard pinned;
+  int king_square{0};
+
+  // Set when generating legal moves, en passant needs its own check
+  Attack_info const* attack_info{nullptr};
+
+  static Move_filter legal(Board const& board, Attack_info const& attack_info)
+  {
+    Move_filter filter;
+    filter.king_square = board.get_piece_set(board.get_active_color(), Piece::king).bitscan_forward();
+    filter.king_danger = attack_info.king_danger;
+    filter.pinned = attack_info.pinned;
+    filter.attack_info = &attack_info;
+
+    auto const checker_count = attack_info.checkers.occupancy();
+    if (checker_count == 1)
+    {
+      auto const checker_square = attack_info.checkers.bitscan_forward();
+      filter.targets = Move_generator::m_tables.squares_between[filter.king_square][checker_square] |
+                       attack_info.checkers;
+    }
+    else if (checker_count > 1)
+    {
+      // Only the king can move out of a double check
+      filter.targets = Bitboard_constants::none;
+    }
+    return filter;
+  }
+
+  constexpr bool allows(Coordinates from, Coordinates to) const
+  {
+    return !pinned.is_set(from) || Move_generator::m_tables.line_through[king_square][from.square_index()].is_set(to);
+  }
+};
+
+// En passant removes two pieces from the same rank, which can expose the king
+// in ways pins don't cover, so the sliders are checked again with both pawns gone
+bool en_passant_is_legal(Board const& board, Attack_info const& attack_info, Coordinates from, Coordinates to)
+{
+  auto const color = board.get_active_color();
+  auto const enemy_color = opposite_color(color);
+  Coordinates const king_location{board.get_piece_set(color, Piece::king).bitscan_forward()};
+
+  Bitboard captured;
+  captured.set_square(Coordinates{to.x(), from.y()});
+  auto occupied = board.get_occupied_squares() & ~captured;
+  occupied.unset_square(from);
+  occupied.set_square(to);
+
+  auto const enemy_queens = board.get_piece_set(enemy_color, Piece::queen);
+  auto const enemy_rooks = board.get_piece_set(enemy_color, Piece::rook) | enemy_queens;
+  auto const enemy_bishops = board.get_piece_set(enemy_color, Piece::bishop) | enemy_queens;
+
+  // A knight giving check can't be dealt with by en passant, a pawn only if it is the one captured
+  if (!(attack_info.checkers & ~captured & ~enemy_rooks & ~enemy_bishops).is_empty())
+  {
+    return false;
+  }
+  return (rook_attacks(king_location, occupied) & enemy_rooks).is_empty() &&
+         (bishop_attacks(king_location, occupied) & enemy_bishops).is_empty();
+}
+
+// If attack_info is null, attacked squares are only calculated if castling is possible
 template <Color color>
-constexpr void generate_castling_moves(Board const& board, std::vector<Move>& moves)
+constexpr void generate_castling_moves(Board const& board, Move_list& moves, Attack_info const* attack_info)
 {
-  constexpr Move short_castle_white{{4, 0}, {6, 0}, Piece::king, Piece::empty};
-  constexpr Move long_castle_white{{4, 0}, {2, 0}, Piece::king, Piece::empty};
-  constexpr Move short_castle_black{{4, 7}, {6, 7}, Piece::king, Piece::empty};
-  constexpr Move long_castle_black{{4, 7}, {2, 7}, Piece::king, Piece::empty};
+  constexpr Move short_castle_white{{4, 0}, {6, 0}, Piece::king, Piece::empty, Piece::empty, Move_type::castle};
+  constexpr Move long_castle_white{{4, 0}, {2, 0}, Piece::king, Piece::empty, Piece::empty, Move_type::castle};
+  constexpr Move short_castle_black{{4, 7}, {6, 7}, Piece::king, Piece::empty, Piece::empty, Move_type::castle};
+  constexpr Move long_castle_black{{4, 7}, {2, 7}, Piece::king, Piece::empty, Piece::empty, Move_type::castle};
 
   constexpr Coordinates white_king_start_location{4, 0};
   constexpr Coordinates black_king_start_location{4, 7};
 
   auto const castling_rights = board.get_castling_rights();
   auto const occupied = board.get_occupied_squares();
+  auto const enemy_attacks = [&]()
+  {
+    return (attack_info) ? attack_info->get_attacks(opposite_color(color)) :
+                           Move_generator::get_all_attacked_squares(board, opposite_color(color));
+  };
 
   if constexpr (color == Color::white)
   {
     if (white_can_short_castle(castling_rights) &&
         (occupied & Bitboard_constants::short_castling_empty_squares_white).is_empty())
     {
-      auto const attacks = Move_generator::get_all_attacked_squares(board, Color::black);
+      auto const attacks = enemy_attacks();
       if ((attacks & Bitboard_constants::short_castling_empty_squares_white).is_empty() &&
           !attacks.is_set(white_king_start_location))
       {
@@ -481,7 +293,7 @@ constexpr void generate_castling_moves(Board const& board, std::vector<Move>& mo
     if (white_can_long_castle(castling_rights) &&
         (occupied & Bitboard_constants::long_castling_empty_squares_white).is_empty() && !occupied.is_set(b1))
     {
-      auto const attacks = Move_generator::get_all_attacked_squares(board, Color::black);
+      auto const attacks = enemy_attacks();
       if ((attacks & Bitboard_constants::long_castling_empty_squares_white).is_empty() &&
           !attacks.is_set(white_king_start_location))
       {
@@ -494,7 +306,7 @@ constexpr void generate_castling_moves(Board const& board, std::vector<Move>& mo
     if (black_can_short_castle(castling_rights) &&
         (occupied & Bitboard_constants::short_castling_empty_squares_black).is_empty())
     {
-      auto const attacks = Move_generator::get_all_attacked_squares(board, Color::white);
+      auto const attacks = enemy_attacks();
       if ((attacks & Bitboard_constants::short_castling_empty_squares_black).is_empty() &&
           !attacks.is_set(black_king_start_location))
       {
@@ -505,7 +317,7 @@ constexpr void generate_castling_moves(Board const& board, std::vector<Move>& mo
     if (black_can_long_castle(castling_rights) &&
         (occupied & Bitboard_constants::long_castling_empty_squares_black).is_empty() && !occupied.is_set(b8))
     {
-      auto const attacks = Move_generator::get_all_attacked_squares(board, Color::white);
+      auto const attacks = enemy_attacks();
       if ((attacks & Bitboard_constants::long_castling_empty_squares_black).is_empty() &&
           !attacks.is_set(black_king_start_location))
       {
@@ -516,7 +328,7 @@ constexpr void generate_castling_moves(Board const& board, std::vector<Move>& mo
 }
 
 template <Color color>
-constexpr void generate_piece_moves(Board const& board, std::vector<Move>& moves)
+constexpr void generate_piece_moves(Board const& board, Move_list& moves, Move_filter const& filter)
 {
   // Parallel arrays that can be iterated together to get the piece type and the
   // function that matches it
@@ -537,6 +349,11 @@ constexpr void generate_piece_moves(Board const& board, std::vector<Move>& moves
       auto possible_moves = piece_move_functions[i](Coordinates{piece_location}, occupied);
       possible_moves &= friends; // Throw out any moves to a square that is
         // already occupied by our color
+      possible_moves &= (piece_types[i] == Piece::king) ? ~filter.king_danger : filter.targets;
+      if (filter.pinned.is_set(Coordinates{piece_location}))
+      {
+        possible_moves &= Move_generator::m_tables.line_through[filter.king_square][piece_location];
+      }
       auto possible_attacks = possible_moves & enemies;
       possible_moves &= ~possible_attacks; // Handle attacks separately
 
@@ -557,7 +374,7 @@ constexpr void generate_piece_moves(Board const& board, std::vector<Move>& moves
 }
 
 template <Color color>
-constexpr void generate_piece_attacks(Board const& board, std::vector<Move>& moves)
+constexpr void generate_piece_attacks(Board const& board, Move_list& moves, Move_filter const& filter)
 {
   // Parallel arrays that can be iterated together to get the piece type and the
   // function that matches it
@@ -578,6 +395,11 @@ constexpr void generate_piece_attacks(Board const& board, std::vector<Move>& mov
       attacks &= not_friends; // Throw out any moves to a square that is already
         // occupied by our color
       attacks &= enemies; // Throw out any moves that are not captures
+      attacks &= (piece_types[i] == Piece::king) ? ~filter.king_danger : filter.targets;
+      if (filter.pinned.is_set(Coordinates{piece_location}))
+      {
+        attacks &= Move_generator::m_tables.line_through[filter.king_square][piece_location];
+      }
       while (!attacks.is_empty())
       {
         auto const end_location = attacks.pop_first_bit();
@@ -589,24 +411,29 @@ constexpr void generate_piece_attacks(Board const& board, std::vector<Move>& mov
 }
 
 template <Color color>
-constexpr void generate_pawn_attacks(Board const& board, std::vector<Move>& moves)
+constexpr void generate_pawn_attacks(Board const& board, Move_list& moves, Move_filter const& filter)
 {
   // Handle east captures
   auto const east_offset = get_east_capture_offset(color);
   auto east_attacks =
-    pawn_east_attacks<color>(board.get_piece_set(color, Piece::pawn), board.get_all(opposite_color(color)));
+    pawn_east_attacks<color>(board.get_piece_set(color, Piece::pawn), board.get_all(opposite_color(color))) &
+    filter.targets;
   while (!east_attacks.is_empty())
   {
     auto const location = east_attacks.pop_first_bit();
     Coordinates const from{location + east_offset};
     Coordinates const to{location};
+    if (!filter.allows(from, to))
+    {
+      continue;
+    }
     auto const victim = board.get_piece(to);
     if (to.y() == 0 || to.y() == 7)
     {
-      moves.emplace_back(from, to, Piece::pawn, victim, Piece::bishop);
-      moves.emplace_back(from, to, Piece::pawn, victim, Piece::knight);
-      moves.emplace_back(from, to, Piece::pawn, victim, Piece::rook);
-      moves.emplace_back(from, to, Piece::pawn, victim, Piece::queen);
+      moves.emplace_back(from, to, Piece::pawn, victim, Piece::bishop, Move_type::promotion);
+      moves.emplace_back(from, to, Piece::pawn, victim, Piece::knight, Move_type::promotion);
+      moves.emplace_back(from, to, Piece::pawn, victim, Piece::rook, Move_type::promotion);
+      moves.emplace_back(from, to, Piece::pawn, victim, Piece::queen, Move_type::promotion);
     }
     else
     {
@@ -617,19 +444,24 @@ constexpr void generate_pawn_attacks(Board const& board, std::vector<Move>& move
   // Handle west captures
   auto const west_offset = get_west_capture_offset(color);
   auto west_attacks =
-    pawn_west_attacks<color>(board.get_piece_set(color, Piece::pawn), board.get_all(opposite_color(color)));
+    pawn_west_attacks<color>(board.get_piece_set(color, Piece::pawn), board.get_all(opposite_color(color))) &
+    filter.targets;
   while (!west_attacks.is_empty())
   {
     auto const location = west_attacks.pop_first_bit();
     Coordinates const from{location + west_offset};
     Coordinates const to{location};
+    if (!filter.allows(from, to))
+    {
+      continue;
+    }
     auto const victim = board.get_piece(to);
     if (to.y() == 0 || to.y() == 7)
     {
-      moves.emplace_back(from, to, Piece::pawn, victim, Piece::bishop);
-      moves.emplace_back(from, to, Piece::pawn, victim, Piece::knight);
-      moves.emplace_back(from, to, Piece::pawn, victim, Piece::rook);
-      moves.emplace_back(from, to, Piece::pawn, victim, Piece::queen);
+      moves.emplace_back(from, to, Piece::pawn, victim, Piece::bishop, Move_type::promotion);
+      moves.emplace_back(from, to, Piece::pawn, victim, Piece::knight, Move_type::promotion);
+      moves.emplace_back(from, to, Piece::pawn, victim, Piece::rook, Move_type::promotion);
+      moves.emplace_back(from, to, Piece::pawn, victim, Piece::queen, Move_type::promotion);
     }
     else
     {
@@ -639,25 +471,29 @@ constexpr void generate_pawn_attacks(Board const& board, std::vector<Move>& move
 }
 
 template <Color color>
-constexpr void generate_pawn_moves(Board const& board, std::vector<Move>& moves)
+constexpr void generate_pawn_moves(Board const& board, Move_list& moves, Move_filter const& filter)
 {
   // For a one square pawn push, the starting square will be either 8 squares
   // higher or lower than the ending square
   auto const offset_from_end_square = get_start_square_offset(color);
 
   auto short_advances =
-    pawn_short_advances<color>(board.get_piece_set(color, Piece::pawn), board.get_occupied_squares());
+    pawn_short_advances<color>(board.get_piece_set(color, Piece::pawn), board.get_occupied_squares()) & filter.targets;
   while (!short_advances.is_empty())
   {
     auto const location = short_advances.pop_first_bit();
     Coordinates from{location + offset_from_end_square};
     Coordinates to{location};
+    if (!filter.allows(from, to))
+    {
+      continue;
+    }
     if (to.y() == 0 || to.y() == 7)
     {
-      moves.emplace_back(from, to, Piece::pawn, Piece::empty, Piece::bishop);
-      moves.emplace_back(from, to, Piece::pawn, Piece::empty, Piece::knight);
-      moves.emplace_back(from, to, Piece::pawn, Piece::empty, Piece::rook);
-      moves.emplace_back(from, to, Piece::pawn, Piece::empty, Piece::queen);
+      moves.emplace_back(from, to, Piece::pawn, Piece::empty, Piece::bishop, Move_type::promotion);
+      moves.emplace_back(from, to, Piece::pawn, Piece::empty, Piece::knight, Move_type::promotion);
+      moves.emplace_back(from, to, Piece::pawn, Piece::empty, Piece::rook, Move_type::promotion);
+      moves.emplace_back(from, to, Piece::pawn, Piece::empty, Piece::queen, Move_type::promotion);
     }
     else
     {
@@ -665,12 +501,17 @@ constexpr void generate_pawn_moves(Board const& board, std::vector<Move>& moves)
     }
   }
 
-  auto long_advances = pawn_long_advances<color>(board.get_piece_set(color, Piece::pawn), board.get_occupied_squares());
+  auto long_advances =
+    pawn_long_advances<color>(board.get_piece_set(color, Piece::pawn), board.get_occupied_squares()) & filter.targets;
   while (!long_advances.is_empty())
   {
     auto const location = long_advances.pop_first_bit();
-    moves.emplace_back(Coordinates{location + 2 * offset_from_end_square}, Coordinates{location}, Piece::pawn,
-                       Piece::empty);
+    Coordinates const from{location + 2 * offset_from_end_square};
+    Coordinates const to{location};
+    if (filter.allows(from, to))
+    {
+      moves.emplace_back(from, to, Piece::pawn, Piece::empty, Piece::empty, Move_type::double_push);
+    }
   }
 
   // Handle en passant
@@ -679,8 +520,12 @@ constexpr void generate_pawn_moves(Board const& board, std::vector<Move>& moves)
   while (!east_captures.is_empty())
   {
     auto const location = east_captures.pop_first_bit();
-    moves.emplace_back(Coordinates{location + east_offset}, Coordinates{location}, Piece::pawn, Piece::pawn,
-                       Piece::empty, Move_type::en_passant);
+    Coordinates const from{location + east_offset};
+    Coordinates const to{location};
+    if (!filter.attack_info || en_passant_is_legal(board, *filter.attack_info, from, to))
+    {
+      moves.emplace_back(from, to, Piece::pawn, Piece::pawn, Piece::empty, Move_type::en_passant);
+    }
   }
 
   auto const west_offset = get_west_capture_offset(color);
@@ -688,138 +533,123 @@ constexpr void generate_pawn_moves(Board const& board, std::vector<Move>& moves)
   while (!west_captures.is_empty())
   {
     auto const location = west_captures.pop_first_bit();
-    moves.emplace_back(Coordinates{location + west_offset}, Coordinates{location}, Piece::pawn, Piece::pawn,
-                       Piece::empty, Move_type::en_passant);
+    Coordinates const from{location + west_offset};
+    Coordinates const to{location};
+    if (!filter.attack_info || en_passant_is_legal(board, *filter.attack_info, from, to))
+    {
+      moves.emplace_back(from, to, Piece::pawn, Piece::pawn, Piece::empty, Move_type::en_passant);
+    }
   }
 
-  generate_pawn_attacks<color>(board, moves);
+  generate_pawn_attacks<color>(board, moves, filter);
 }
 
-std::vector<Move> Move_generator::generate_pseudo_legal_moves(Board const& board)
+void generate_moves_(Board const& board, Attack_info const* attack_info, Move_filter const& filter, Move_list& moves)
 {
-  auto const color = board.get_active_color();
-  std::vector<Move> pseudo_legal_moves;
-  pseudo_legal_moves.reserve(218); // Max possible number of chess moves in a position
-
-  if (color == Color::black)
+  if (board.get_active_color() == Color::black)
   {
-    generate_pawn_moves<Color::black>(board, pseudo_legal_moves);
-    generate_castling_moves<Color::black>(board, pseudo_legal_moves);
-    generate_piece_moves<Color::black>(board, pseudo_legal_moves);
+    generate_pawn_moves<Color::black>(board, moves, filter);
+    generate_castling_moves<Color::black>(board, moves, attack_info);
+    generate_piece_moves<Color::black>(board, moves, filter);
   }
   else
   {
-    generate_pawn_moves<Color::white>(board, pseudo_legal_moves);
-    generate_castling_moves<Color::white>(board, pseudo_legal_moves);
-    generate_piece_moves<Color::white>(board, pseudo_legal_moves);
+    generate_pawn_moves<Color::white>(board, moves, filter);
+    generate_castling_moves<Color::white>(board, moves, attack_info);
+    generate_piece_moves<Color::white>(board, moves, filter);
   }
-
-  return pseudo_legal_moves;
 }
 
-std::vector<Move> Move_generator::generate_legal_moves(Board const& board)
+void generate_attack_moves_(Board const& board, Move_filter const& filter, Move_list& moves)
 {
-  auto const color = board.get_active_color();
-  std::vector<Move> pseudo_legal_moves;
-  pseudo_legal_moves.reserve(218); // Max possible number of chess moves in a position
-
-  if (color == Color::black)
+  if (board.get_active_color() == Color::black)
   {
-    generate_pawn_moves<Color::black>(board, pseudo_legal_moves);
-    generate_castling_moves<Color::black>(board, pseudo_legal_moves);
-    generate_piece_moves<Color::black>(board, pseudo_legal_moves);
+    generate_piece_attacks<Color::black>(board, moves, filter);
+    generate_pawn_attacks<Color::black>(board, moves, filter);
   }
   else
   {
-    generate_pawn_moves<Color::white>(board, pseudo_legal_moves);
-    generate_castling_moves<Color::white>(board, pseudo_legal_moves);
-    generate_piece_moves<Color::white>(board, pseudo_legal_moves);
+    generate_piece_attacks<Color::white>(board, moves, filter);
+    generate_pawn_attacks<Color::white>(board, moves, filter);
   }
+}
 
-  std::vector<Move> legal_moves;
-  legal_moves.reserve(pseudo_legal_moves.size());
-  Board tmp_board(board);
+void Move_generator::generate_pseudo_legal_moves(Board const& board, Attack_info const& attack_info, Move_list& moves)
+{
+  generate_moves_(board, &attack_info, Move_filter{}, moves);
+}
 
-  rs::copy_if(pseudo_legal_moves, std::back_inserter(legal_moves),
-              [&](auto m)
-              {
-                tmp_board = board;
-                return !tmp_board.move_results_in_check_destructive(m);
-              });
+Move_list Move_generator::generate_pseudo_legal_moves(Board const& board)
+{
+  Move_list moves;
+  generate_moves_(board, nullptr, Move_filter{}, moves);
+  return moves;
+}
 
-  return legal_moves;
+Move_list Move_generator::generate_pseudo_legal_moves(Board const& board, Attack_info const& attack_info)
+{
+  Move_list moves;
+  generate_moves_(board, &attack_info, Move_filter{}, moves);
+  return moves;
 }
 
-std::vector<Move> Move_generator::generate_pseudo_legal_attack_moves(Board const& board)
+void Move_generator::generate_legal_moves(Board const& board, Move_list& moves)
 {
-  auto const color = board.get_active_color();
-  std::vector<Move> pseudo_legal_attacks;
-  pseudo_legal_attacks.reserve(64);
+  generate_legal_moves(board, get_attack_info(board), moves);
+}
 
-  if (color == Color::black)
-  {
-    generate_piece_attacks<Color::black>(board, pseudo_legal_attacks);
-    generate_pawn_attacks<Color::black>(board, pseudo_legal_attacks);
-  }
-  else
-  {
-    generate_piece_attacks<Color::white>(board, pseudo_legal_attacks);
-    generate_pawn_attacks<Color::white>(board, pseudo_legal_attacks);
-  }
+void Move_generator::generate_legal_moves(Board const& board, Attack_info const& attack_info, Move_list& moves)
+{
+  // Castling already checks every square the king crosses, including the one it starts on
+  generate_moves_(board, &attack_info, Move_filter::legal(board, attack_info), moves);
+}
+
+Move_list Move_generator::generate_legal_moves(Board const& board)
+{
+  Move_list moves;
+  generate_legal_moves(board, moves);
+  return moves;
+}
 
-  return pseudo_legal_attacks;
+void Move_generator::generate_pseudo_legal_attack_moves(Board const& board, Move_list& moves)
+{
+  generate_attack_moves_(board, Move_filter{}, moves);
 }
 
-std::vector<Move> Move_generator::generate_legal_attack_moves(Board const& board)
+Move_list Move_generator::generate_pseudo_legal_attack_moves(Board const& board)
 {
-  auto pseudo_legal_attacks = generate_pseudo_legal_attack_moves(board);
+  Move_list moves;
+  generate_pseudo_legal_attack_moves(board, moves);
+  return moves;
+}
 
-  std::vector<Move> legal_attacks;
-  legal_attacks.reserve(64);
-  Board tmp_board(board);
-  rs::copy_if(pseudo_legal_attacks, std::back_inserter(legal_attacks),
-              [&](auto m)
-              {
-                tmp_board = board;
-                return !tmp_board.move_results_in_check_destructive(m);
-              });
+void Move_generator::generate_legal_attack_moves(Board const& board, Attack_info const& attack_info, Move_list& moves)
+{
+  generate_attack_moves_(board, Move_filter::legal(board, attack_info), moves);
+}
 
-  return legal_attacks;
+Move_list Move_generator::generate_legal_attack_moves(Board const& board)
+{
+  Move_list moves;
+  generate_legal_attack_moves(board, get_attack_info(board), moves);
+  return moves;
 }
 
 Bitboard Move_generator::get_all_attacked_squares(Board const& board, Color attacking_color)
 {
   auto const occupied = board.get_occupied_squares();
-  Bitboard attacked_squares;
-
-  auto pieces = board.get_piece_set(attacking_color, Piece::rook);
-  while (!pieces.is_empty())
-  {
-    auto const piece_location = pieces.pop_first_bit();
-    attacked_squares |= rook_attacks(Coordinates{piece_location}, occupied);
-  }
+  auto const queens = board.get_piece_set(attacking_color, Piece::queen);
+  auto attacked_squares = Slider_fill::get_attacks(board.get_piece_set(attacking_color, Piece::rook) | queens,
+                                                   board.get_piece_set(attacking_color, Piece::bishop) | queens,
+                                                   occupied);
 
-  pieces = board.get_piece_set(attacking_color, Piece::knight);
+  auto pieces = board.get_piece_set(attacking_color, Piece::knight);
   while (!pieces.is_empty())
   {
     auto const piece_location = pieces.pop_first_bit();
     attacked_squares |= knight_attacks(Coordinates{piece_location}, occupied);
   }
 
-  pieces = board.get_piece_set(attacking_color, Piece::bishop);
-  while (!pieces.is_empty())
-  {
-    auto const piece_location = pieces.pop_first_bit();
-    attacked_squares |= bishop_attacks(Coordinates{piece_location}, occupied);
-  }
-
-  pieces = board.get_piece_set(attacking_color, Piece::queen);
-  while (!pieces.is_empty())
-  {
-    auto const piece_location = pieces.pop_first_bit();
-    attacked_squares |= queen_attacks(Coordinates{piece_location}, occupied);
-  }
-
   MY_ASSERT(board.get_piece_set(attacking_color, Piece::king).occupancy() == 1,
             "Board should never have two kings of the same color");
   attacked_squares |=
@@ -876,8 +706,196 @@ bool Move_generator::is_square_attacked(Board const& board, Color attacking_colo
             .is_empty();
 }
 
+Attack_info Move_generator::get_attack_info(Board const& board)
+{
+  constexpr auto piece_index = [](Piece piece)
+  {
+    return static_cast<uint8_t>(piece) - static_cast<uint8_t>(Piece::pawn);
+  };
+
+  auto const attacks_from = [](Bitboard pieces, Bitboard occupied, auto attack_fn)
+  {
+    Bitboard result;
+    for (auto const location : pieces)
+    {
+      result |= attack_fn(Coordinates{location}, occupied);
+    }
+    return result;
+  };
+
+  Attack_info info;
+  auto const color = board.get_active_color();
+  auto const enemy_color = opposite_color(color);
+  auto const occupied = board.get_occupied_squares();
+
+  for (auto const attacking_color : {Color::black, Color::white})
+  {
+    auto& by_piece = info.attacks_by_piece[static_cast<uint8_t>(attacking_color)];
+    auto const pawns = board.get_piece_set(attacking_color, Piece::pawn);
+    by_piece[0] = (attacking_color == Color::black) ? pawn_potential_attacks<Color::black>(pawns) :
+                                                      pawn_potential_attacks<Color::white>(pawns);
+    by_piece[piece_index(Piece::knight)] =
+      attacks_from(board.get_piece_set(attacking_color, Piece::knight), occupied, &knight_attacks);
+    by_piece[piece_index(Piece::king)] =
+      attacks_from(board.get_piece_set(attacking_color, Piece::king), occupied, &king_attacks);
+
+    // Every slider of a type at once, faster than a lookup per piece when all of them are needed
+    auto const sliders =
+      Slider_fill::get_group_attacks(board.get_piece_set(attacking_color, Piece::rook),
+                                     board.get_piece_set(attacking_color, Piece::bishop),
+                                     board.get_piece_set(attacking_color, Piece::queen), occupied);
+    by_piece[piece_index(Piece::rook)] = sliders.rooks;
+    by_piece[piece_index(Piece::bishop)] = sliders.bishops;
+    by_piece[piece_index(Piece::queen)] = sliders.queens;
+
+    info.attacks[static_cast<uint8_t>(attacking_color)] =
+      std::accumulate(by_piece.begin(), by_piece.end(), Bitboard{}, std::bit_or{});
+  }
+
+  auto const king = board.get_piece_set(color, Piece::king);
+  MY_ASSERT(king.occupancy() == 1, "Board should have exactly one king for each color");
+  Coordinates const king_location{king.bitscan_forward()};
+
+  auto const enemy_queens = board.get_piece_set(enemy_color, Piece::queen);
+  auto const enemy_rooks = board.get_piece_set(enemy_color, Piece::rook) | enemy_queens;
+  auto const enemy_bishops = board.get_piece_set(enemy_color, Piece::bishop) | enemy_queens;
+
+  // Sliders can see through the king, so it can't step away from them along their line
+  info.king_danger = info.get_attacks(enemy_color, Piece::pawn) | info.get_attacks(enemy_color, Piece::knight) |
+                     info.get_attacks(enemy_color, Piece::king) |
+                     Slider_fill::get_attacks(enemy_rooks, enemy_bishops, occupied & ~king);
+
+  auto const own_pawn_attacks = (color == Color::black) ? pawn_potential_attacks<Color::black>(king) :
+                                                          pawn_potential_attacks<Color::white>(king);
+  info.checkers = (rook_attacks(king_location, occupied) & enemy_rooks) |
+                  (bishop_attacks(king_location, occupied) & enemy_bishops) |
+                  (knight_attacks(king_location, occupied) & board.get_piece_set(enemy_color, Piece::knight)) |
+                  (own_pawn_attacks & board.get_piece_set(enemy_color, Piece::pawn));
+
+  // A piece is pinned if it is the only piece between the king and an enemy slider
+  auto const snipers = (rook_attacks(king_location, Bitboard{}) & enemy_rooks) |
+                       (bishop_attacks(king_location, Bitboard{}) & enemy_bishops);
+  for (auto const sniper_location : snipers)
+  {
+    auto const blockers = m_tables.squares_between[king_location.square_index()][sniper_location] & occupied;
+    if (blockers.occupancy() == 1)
+    {
+      info.pinned |= blockers & board.get_all(color);
+    }
+  }
+
+  return info;
+}
+
+Bitboard Move_generator::get_piece_attacks(Piece piece, Coordinates location, Bitboard occupied)
+{
+  switch (piece)
+  {
+    case Piece::knight:
+      return knight_attacks(location, occupied);
+    case Piece::bishop:
+      return bishop_attacks(location, occupied);
+    case Piece::rook:
+      return rook_attacks(location, occupied);
+    case Piece::queen:
+      return queen_attacks(location, occupied);
+    case Piece::king:
+      return king_attacks(location, occupied);
+    default:
+      MY_ASSERT(false, "Pawn attacks depend on color");
+      return {};
+  }
+}
+
+bool Move_generator::is_legal(Board const& board, Attack_info const& attack_info, Move m)
+{
+  if (m.piece() == Piece::king)
+  {
+    // Castling moves are only generated if the king doesn't cross an attacked square
+    return !attack_info.king_danger.is_set(m.to());
+  }
+
+  if (m.type() == Move_type::en_passant)
+  {
+    return en_passant_is_legal(board, attack_info, m.from(), m.to());
+  }
+
+  auto const king_square = board.get_piece_set(board.get_active_color(), Piece::king).bitscan_forward();
+  auto const checker_count = attack_info.checkers.occupancy();
+  if (checker_count > 1)
+  {
+    // Only the king can move out of a double check
+    return false;
+  }
+  if (checker_count == 1)
+  {
+    // Must capture the checking piece or block the check
+    auto const checker_square = attack_info.checkers.bitscan_forward();
+    if (!(m_tables.squares_between[king_square][checker_square] | attack_info.checkers).is_set(m.to()))
+    {
+      return false;
+    }
+  }
+
+  // Pinned pieces can only move along the line between the king and the pinning piece
+  return !attack_info.pinned.is_set(m.from()) ||
+         m_tables.line_through[king_square][m.from().square_index()].is_set(m.to());
+}
+
+std::ostream& operator<<(std::ostream& os, Slider_backend const& self)
+{
+  switch (self)
+  {
+    case Slider_backend::plain_magic:
+      return os << "plain magic";
+    case Slider_backend::fancy_magic:
+      return os << "fancy magic";
+    case Slider_backend::pext:
+      return os << "pext";
+  }
+  return os;
+}
+
+Slider_backend Move_generator::get_best_slider_backend()
+{
+  if (is_supported(Slider_backend::pext))
+  {
+    return Slider_backend::pext;
+  }
+  return Slider_backend::fancy_magic;
+}
+
+bool Move_generator::is_supported(Slider_backend backend)
+{
+  if (backend != Slider_backend::pext)
+  {
+    return true;
+  }
+  return Cpu_features::get().fast_pext;
+}
+
+bool Move_generator::set_slider_backend(Slider_backend backend)
+{
+  if (!is_supported(backend))
+  {
+    return false;
+  }
+  s_slider_backend = backend;
+  return true;
+}
+
+Slider_backend Move_generator::get_slider_backend()
+{
+  return s_slider_backend;
+}
+
 // Faster than generating all moves and checking if the list is empty
 bool Move_generator::has_any_legal_moves(Board const& board)
+{
+  return has_any_legal_moves(board, get_attack_info(board));
+}
+
+bool Move_generator::has_any_legal_moves(Board const& board, Attack_info const& attack_info)
 {
   // Parallel arrays that can be iterated together to get the piece type and the
   // function that matches it
@@ -885,7 +903,6 @@ bool Move_generator::has_any_legal_moves(Board const& board)
   constexpr static std::array piece_move_functions{&king_attacks, &queen_attacks, &knight_attacks, &bishop_attacks,
                                                    &rook_attacks};
 
-  Board tmp_board{board};
   auto const color = board.get_active_color();
   for (size_t i{0}; i < piece_types.size(); ++i)
   {
@@ -900,9 +917,9 @@ bool Move_generator::has_any_legal_moves(Board const& board)
       while (!possible_moves.is_empty())
       {
         auto const end_location = possible_moves.pop_first_bit();
-        tmp_board = board;
-        if (!tmp_board.move_results_in_check_destructive({Coordinates{piece_location}, Coordinates{end_location},
-                                                          piece_types[i], board.get_piece(Coordinates{end_location})}))
+        if (is_legal(board, attack_info,
+                     {Coordinates{piece_location}, Coordinates{end_location}, piece_types[i],
+                      board.get_piece(Coordinates{end_location})}))
         {
           return true;
         }
@@ -910,26 +927,23 @@ bool Move_generator::has_any_legal_moves(Board const& board)
     }
   }
 
-  std::vector<Move> pseudo_legal_moves;
-  pseudo_legal_moves.reserve(32);
+  Move_list pawn_moves;
 
   if (color == Color::black)
   {
-    generate_pawn_moves<Color::black>(board, pseudo_legal_moves);
+    generate_pawn_moves<Color::black>(board, pawn_moves, Move_filter::legal(board, attack_info));
   }
   else
   {
-    generate_pawn_moves<Color::white>(board, pseudo_legal_moves);
+    generate_pawn_moves<Color::white>(board, pawn_moves, Move_filter::legal(board, attack_info));
   }
-  return rs::any_of(pseudo_legal_moves,
-                    [&](auto m)
-                    {
-                      tmp_board = board;
-                      return !tmp_board.move_results_in_check_destructive(m);
-                    });
+  return !pawn_moves.empty();
 }
 
-uint64_t Move_generator::perft(int depth, Board& board, std::atomic_flag& is_cancelled)
+// The color to move alternates every ply, so each level knows it at compile
+// time and makes its moves without checking it
+template <Color color>
+uint64_t perft_(int depth, Board const& board, std::atomic_flag& is_cancelled)
 {
   uint64_t nodes{0};
 
@@ -938,18 +952,22 @@ uint64_t Move_generator::perft(int depth, Board& board, std::atomic_flag& is_can
     return uint64_t{1};
   }
 
-  auto color = board.get_active_color();
-  auto moves = Move_generator::generate_pseudo_legal_moves(board);
+  Move_list moves;
+  Move_generator::generate_legal_moves(board, moves);
+
+  // Every legal move is a leaf, so there is no need to make them
+  if (depth == 1)
+  {
+    return moves.size();
+  }
+
   for (auto m : moves)
   {
     auto tmp_board = Board{board};
-    [[maybe_unused]] auto succeeded = tmp_board.move_no_verify(m);
-    MY_ASSERT(succeeded, "Invalid move");
+    tmp_board.make_move<color>(m);
+    MY_ASSERT(!tmp_board.is_in_check(color), "Move should be legal");
 
-    if (!tmp_board.is_in_check(color))
-    {
-      nodes += perft(depth - 1, tmp_board, is_cancelled);
-    }
+    nodes += perft_<opposite_color(color)>(depth - 1, tmp_board, is_cancelled);
     if (is_cancelled.test())
     {
       return nodes;
@@ -958,4 +976,13 @@ uint64_t Move_generator::perft(int depth, Board& board, std::atomic_flag& is_can
 
   return nodes;
 }
+
+uint64_t Move_generator::perft(int depth, Board& board, std::atomic_flag& is_cancelled)
+{
+  if (board.get_active_color() == Color::white)
+  {
+    return perft_<Color::white>(depth, board, is_cancelled);
+  }
+  return perft_<Color::black>(depth, board, is_cancelled);
+}
 } // namespace Meneldor
@@ -0,0 +1,528 @@
+#include "nnue.h"
+#include "board.h"
+#include "cpu_features.h"
+#include "zobrist_hash.h"
+
+#ifdef MENELDOR_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace rs = std::ranges;
+namespace Meneldor
+{
+namespace
+{
+constexpr uint32_t c_file_magic{0x554e4e4d}; // "MNNU"
+constexpr uint32_t c_file_version{1};
+
+using Hidden_input = std::array<uint8_t, Nnue_network::c_hidden_input_size>;
+using Hidden_output = std::array<int32_t, Nnue_network::c_hidden_size>;
+
+// Computes output = biases + weights * input, with weights stored row major
+void hidden_layer_scalar(Hidden_input const& input,
+                         int8_t const* weights,
+                         int32_t const* biases,
+                         Hidden_output& output)
+{
+  for (size_t i{0}; i < output.size(); ++i)
+  {
+    auto const* row = weights + (i * input.size());
+    int32_t sum{biases[i]};
+    for (size_t j{0}; j < input.size(); ++j)
+    {
+      sum += static_cast<int32_t>(input[j]) * row[j];
+    }
+    output[i] = sum;
+  }
+}
+
+#ifdef MENELDOR_X86_SIMD
+__attribute__((target("sse4.1"))) int32_t horizontal_sum(__m128i value)
+{
+  value = _mm_add_epi32(value, _mm_shuffle_epi32(value, 0x4e));
+  value = _mm_add_epi32(value, _mm_shuffle_epi32(value, 0xb1));
+  return _mm_cvtsi128_si32(value);
+}
+
+__attribute__((target("sse4.1"))) void hidden_layer_sse41(Hidden_input const& input,
+                                                          int8_t const* weights,
+                                                          int32_t const* biases,
+                                                          Hidden_output& output)
+{
+  constexpr size_t c_lanes{sizeof(__m128i)};
+  static_assert(std::tuple_size_v<Hidden_input> % c_lanes == 0);
+
+  auto const ones = _mm_set1_epi16(1);
+  for (size_t i{0}; i < output.size(); ++i)
+  {
+    auto const* row = weights + (i * input.size());
+    auto sum = _mm_setzero_si128();
+    for (size_t j{0}; j < input.size(); j += c_lanes)
+    {
+      // Activations are unsigned and weights are signed, which is exactly what maddubs expects.
+      // The activations are at most 127, so the pairwise sums can't saturate.
+      auto const in = _mm_loadu_si128(reinterpret_cast<__m128i const*>(input.data() + j));
+      auto const w = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row + j));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(in, w), ones));
+    }
+    output[i] = biases[i] + horizontal_sum(sum);
+  }
+}
+
+__attribute__((target("avx2"))) void hidden_layer_avx2(Hidden_input const& input,
+                                                       int8_t const* weights,
+                                                       int32_t const* biases,
+                                                       Hidden_output& output)
+{
+  constexpr size_t c_lanes{sizeof(__m256i)};
+  static_assert(std::tuple_size_v<Hidden_input> % c_lanes == 0);
+
+  auto const ones = _mm256_set1_epi16(1);
+  for (size_t i{0}; i < output.size(); ++i)
+  {
+    auto const* row = weights + (i * input.size());
+    auto sum = _mm256_setzero_si256();
+    for (size_t j{0}; j < input.size(); j += c_lanes)
+    {
+      auto const in = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input.data() + j));
+      auto const w = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(row + j));
+      sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(in, w), ones));
+    }
+    auto const sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    output[i] = biases[i] + horizontal_sum(sum128);
+  }
+}
+#endif
+
+Simd_level detect_simd_level()
+{
+  auto const& features = Cpu_features::get();
+  if (features.avx2)
+  {
+    return Simd_level::avx2;
+  }
+  if (features.sse41)
+  {
+    return Simd_level::sse41;
+  }
+  return Simd_level::scalar;
+}
+
+template <typename T>
+bool read_values(std::istream& in, std::vector<T>& values)
+{
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  in.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+  return static_cast<bool>(in);
+}
+
+template <typename T>
+void write_values(std::ostream& out, std::vector<T> const& values)
+{
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  out.write(reinterpret_cast<char const*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+} // namespace
+
+std::ostream& operator<<(std::ostream& os, Simd_level const& self)
+{
+  switch (self)
+  {
+    case Simd_level::scalar:
+      return os << "scalar";
+    case Simd_level::sse41:
+      return os << "sse4.1";
+    case Simd_level::avx2:
+      return os << "avx2";
+  }
+  return os;
+}
+
+void Nnue_accumulator::add_piece(Nnue_network const& network, Color color, Piece piece, Coordinates location)
+{
+  if (m_network_id != network.get_id())
+  {
+    return;
+  }
+
+  for (auto const perspective : {Color::black, Color::white})
+  {
+    auto const index = static_cast<uint8_t>(perspective);
+    if (piece == Piece::king && color == perspective &&
+        Nnue_network::king_bucket(perspective, location) != m_king_buckets[index])
+    {
+      // Every feature for this perspective changes, cheaper to rebuild when it's next needed
+      m_is_valid[index] = false;
+    }
+    if (!m_is_valid[index])
+    {
+      continue;
+    }
+
+    auto const weights = network.get_feature_weights(
+      Nnue_network::feature_index(perspective, m_king_buckets[index], color, piece, location));
+    for (size_t i{0}; i < c_size; ++i)
+    {
+      m_values[index][i] = static_cast<int16_t>(m_values[index][i] + weights[i]);
+    }
+  }
+}
+
+void Nnue_accumulator::remove_piece(Nnue_network const& network, Color color, Piece piece, Coordinates location)
+{
+  if (m_network_id != network.get_id())
+  {
+    return;
+  }
+
+  for (auto const perspective : {Color::black, Color::white})
+  {
+    auto const index = static_cast<uint8_t>(perspective);
+    if (!m_is_valid[index])
+    {
+      continue;
+    }
+
+    auto const weights = network.get_feature_weights(
+      Nnue_network::feature_index(perspective, m_king_buckets[index], color, piece, location));
+    for (size_t i{0}; i < c_size; ++i)
+    {
+      m_values[index][i] = static_cast<int16_t>(m_values[index][i] - weights[i]);
+    }
+  }
+}
+
+bool Nnue_accumulator::is_valid(Nnue_network const& network) const
+{
+  return m_network_id == network.get_id() && m_is_valid[0] && m_is_valid[1];
+}
+
+void Nnue_accumulator::refresh(Nnue_network const& network, Board const& board)
+{
+  if (m_network_id != network.get_id())
+  {
+    m_network_id = network.get_id();
+    m_is_valid = {false, false};
+  }
+
+  for (auto const perspective : {Color::black, Color::white})
+  {
+    auto const index = static_cast<uint8_t>(perspective);
+    if (m_is_valid[index])
+    {
+      continue;
+    }
+
+    auto const king_square = board.get_piece_set(perspective, Piece::king).bitscan_forward();
+    m_king_buckets[index] =
+      (king_square < 0) ? 0 : static_cast<uint8_t>(Nnue_network::king_bucket(perspective, Coordinates{king_square}));
+
+    rs::copy(network.get_feature_biases(), m_values[index].begin());
+    for (auto const color : {Color::black, Color::white})
+    {
+      for (auto const piece : Zobrist_hash::piece_types)
+      {
+        for (auto const sq_index : board.get_piece_set(color, piece))
+        {
+          auto const weights = network.get_feature_weights(
+            Nnue_network::feature_index(perspective, m_king_buckets[index], color, piece, Coordinates{sq_index}));
+          for (size_t i{0}; i < c_size; ++i)
+          {
+            m_values[index][i] = static_cast<int16_t>(m_values[index][i] + weights[i]);
+          }
+        }
+      }
+    }
+    m_is_valid[index] = true;
+  }
+}
+
+std::span<int16_t const, Nnue_accumulator::c_size> Nnue_accumulator::get_values(Color perspective) const
+{
+  return m_values[static_cast<uint8_t>(perspective)];
+}
+
+Nnue_stack::Nnue_stack() : m_entries(c_initial_capacity) {}
+
+void Nnue_stack::reset(Board const& board)
+{
+  m_size = 1;
+  m_entries[0].board = &board;
+  m_entries[0].is_computed = false;
+}
+
+void Nnue_stack::push(Board const& board)
+{
+  MY_ASSERT(m_size > 0, "The stack needs a root position");
+  if (m_size == m_entries.size())
+  {
+    m_entries.resize(2 * m_entries.size());
+  }
+  m_entries[m_size].board = &board;
+  m_entries[m_size].is_computed = false;
+  ++m_size;
+}
+
+void Nnue_stack::pop()
+{
+  MY_ASSERT(m_size > 1, "Cannot pop the root position");
+  --m_size;
+}
+
+Nnue_accumulator const& Nnue_stack::get(Nnue_network const& network, Board const& board)
+{
+  MY_ASSERT(m_size > 0 && m_entries[m_size - 1].board == &board, "The board must be the top of the stack");
+
+  auto first = m_size - 1;
+  while (first > 0 && !m_entries[first].is_computed)
+  {
+    --first;
+  }
+
+  for (auto i = first; i < m_size; ++i)
+  {
+    auto& entry = m_entries[i];
+    if (!entry.is_computed)
+    {
+      if (i > 0)
+      {
+        entry.accumulator = m_entries[i - 1].accumulator;
+        apply_difference_(network, *m_entries[i - 1].board, *entry.board, entry.accumulator);
+      }
+      else
+      {
+        // The root has nothing to be updated from, its values belong to the previous root
+        entry.accumulator = Nnue_accumulator{};
+      }
+    }
+    if (!entry.accumulator.is_valid(network))
+    {
+      entry.accumulator.refresh(network, *entry.board);
+    }
+    entry.is_computed = true;
+  }
+
+  return m_entries[m_size - 1].accumulator;
+}
+
+void Nnue_stack::apply_difference_(Nnue_network const& network,
+                                   Board const& parent,
+                                   Board const& child,
+                                   Nnue_accumulator& accumulator)
+{
+  // Removals go first, so a king leaving its bucket is subtracted with the old bucket
+  for (auto const color : {Color::black, Color::white})
+  {
+    for (auto const piece : Zobrist_hash::piece_types)
+    {
+      auto const removed = parent.get_piece_set(color, piece) & ~child.get_piece_set(color, piece);
+      for (auto const sq_index : removed)
+      {
+        accumulator.remove_piece(network, color, piece, Coordinates{sq_index});
+      }
+    }
+  }
+
+  for (auto const color : {Color::black, Color::white})
+  {
+    for (auto const piece : Zobrist_hash::piece_types)
+    {
+      auto const added = child.get_piece_set(color, piece) & ~parent.get_piece_set(color, piece);
+      for (auto const sq_index : added)
+      {
+        accumulator.add_piece(network, color, piece, Coordinates{sq_index});
+      }
+    }
+  }
+}
+
+Nnue_network::Nnue_network()
+  : m_id(s_next_id++),
+    m_feature_weights(c_feature_count * Nnue_accumulator::c_size),
+    m_feature_biases(Nnue_accumulator::c_size),
+    m_hidden_weights(c_hidden_size * c_hidden_input_size),
+    m_hidden_biases(c_hidden_size),
+    m_output_weights(c_hidden_size)
+{
+}
+
+tl::expected<Nnue_network, std::string> Nnue_network::load(std::string const& filename)
+{
+  std::ifstream infile{filename, std::ios::binary};
+  if (!infile)
+  {
+    return tl::unexpected(std::string{"Could not open network file: "} + filename);
+  }
+
+  // Values are stored little endian, in the same order as they are declared
+  std::vector<uint32_t> header(5);
+  if (!read_values(infile, header) || header[0] != c_file_magic || header[1] != c_file_version)
+  {
+    return tl::unexpected(std::string{"Not a supported network file: "} + filename);
+  }
+  if (header[2] != c_feature_count || header[3] != Nnue_accumulator::c_size || header[4] != c_hidden_size)
+  {
+    return tl::unexpected(std::string{"Network has unsupported layer sizes: "} + filename);
+  }
+
+  Nnue_network result;
+  std::vector<int32_t> output_bias(1);
+  if (!read_values(infile, result.m_feature_weights) || !read_values(infile, result.m_feature_biases) ||
+      !read_values(infile, result.m_hidden_weights) || !read_values(infile, result.m_hidden_biases) ||
+      !read_values(infile, result.m_output_weights) || !read_values(infile, output_bias))
+  {
+    return tl::unexpected(std::string{"Network file is truncated: "} + filename);
+  }
+  result.m_output_bias = output_bias.front();
+
+  return result;
+}
+
+tl::expected<void, std::string> Nnue_network::save(std::string const& filename) const
+{
+  std::ofstream outfile{filename, std::ios::binary};
+  if (!outfile)
+  {
+    return tl::unexpected(std::string{"Could not open network file for writing: "} + filename);
+  }
+
+  write_values(outfile, std::vector<uint32_t>{c_file_magic, c_file_version, static_cast<uint32_t>(c_feature_count),
+                                              static_cast<uint32_t>(Nnue_accumulator::c_size),
+                                              static_cast<uint32_t>(c_hidden_size)});
+  write_values(outfile, m_feature_weights);
+  write_values(outfile, m_feature_biases);
+  write_values(outfile, m_hidden_weights);
+  write_values(outfile, m_hidden_biases);
+  write_values(outfile, m_output_weights);
+  write_values(outfile, std::vector<int32_t>{m_output_bias});
+
+  if (!outfile)
+  {
+    return tl::unexpected(std::string{"Failed to write network file: "} + filename);
+  }
+  return {};
+}
+
+Nnue_network Nnue_network::create_random(uint64_t seed)
+{
+  std::mt19937_64 generator{seed};
+  auto fill = [&generator](auto& values, int min_value, int max_value)
+  {
+    std::uniform_int_distribution<int> distribution{min_value, max_value};
+    rs::generate(values,
+                 [&]
+                 {
+                   return static_cast<std::ranges::range_value_t<decltype(values)>>(distribution(generator));
+                 });
+  };
+
+  Nnue_network result;
+  fill(result.m_feature_weights, -32, 32);
+  fill(result.m_feature_biases, 0, 64);
+  fill(result.m_hidden_weights, -64, 64);
+  fill(result.m_hidden_biases, -1024, 1024);
+  fill(result.m_output_weights, -64, 64);
+  result.m_output_bias = 0;
+  return result;
+}
+
+Nnue_network const* Nnue_network::get_active()
+{
+  return s_active_network.get();
+}
+
+void Nnue_network::set_active(std::unique_ptr<Nnue_network const> network)
+{
+  s_active_network = std::move(network);
+}
+
+Simd_level Nnue_network::get_best_simd_level()
+{
+  static Simd_level const level = detect_simd_level();
+  return level;
+}
+
+size_t Nnue_network::king_bucket(Color perspective, Coordinates king_location)
+{
+  // Buckets split the board into the back two ranks and the rest, and the queen and king side
+  constexpr int32_t c_flip_vertical{56};
+  Coordinates const relative{(perspective == Color::white) ? king_location.square_index()
+                                                           : (king_location.square_index() ^ c_flip_vertical)};
+  return ((relative.y() >= 2) ? 2 : 0) + ((relative.x() >= c_board_dimension / 2) ? 1 : 0);
+}
+
+size_t Nnue_network::feature_index(
+  Color perspective, size_t king_bucket, Color color, Piece piece, Coordinates location)
+{
+  // Both perspectives see the board as if they were white
+  constexpr int32_t c_flip_vertical{56};
+  auto const relative_square =
+    (perspective == Color::white) ? location.square_index() : (location.square_index() ^ c_flip_vertical);
+  auto const relative_color = (color == perspective) ? 0 : 1;
+  auto const piece_index = static_cast<size_t>(piece) - static_cast<size_t>(Piece::pawn);
+
+  return (king_bucket * c_features_per_bucket) + ((relative_color * 6 + piece_index) * c_board_dimension_squared) +
+         static_cast<size_t>(relative_square);
+}
+
+int32_t Nnue_network::evaluate(Nnue_accumulator const& accumulator, Color side_to_move) const
+{
+  return evaluate(accumulator, side_to_move, get_best_simd_level());
+}
+
+int32_t Nnue_network::evaluate(Nnue_accumulator const& accumulator, Color side_to_move, Simd_level simd_level) const
+{
+  MY_ASSERT(accumulator.is_valid(*this), "Accumulator must be refreshed before evaluating");
+
+  // Side to move goes first, so the network doesn't need to know whose turn it is
+  Hidden_input input;
+  auto clipped_relu = [](int32_t value)
+  {
+    return static_cast<uint8_t>(std::clamp<int32_t>(value, 0, c_activation_max));
+  };
+  rs::transform(accumulator.get_values(side_to_move), input.begin(), clipped_relu);
+  rs::transform(accumulator.get_values(opposite_color(side_to_move)), input.begin() + Nnue_accumulator::c_size,
+                clipped_relu);
+
+  Hidden_output hidden;
+  switch (simd_level)
+  {
+#ifdef MENELDOR_X86_SIMD
+    case Simd_level::avx2:
+      hidden_layer_avx2(input, m_hidden_weights.data(), m_hidden_biases.data(), hidden);
+      break;
+    case Simd_level::sse41:
+      hidden_layer_sse41(input, m_hidden_weights.data(), m_hidden_biases.data(), hidden);
+      break;
+#endif
+    default:
+      hidden_layer_scalar(input, m_hidden_weights.data(), m_hidden_biases.data(), hidden);
+      break;
+  }
+
+  int32_t output{m_output_bias};
+  for (size_t i{0}; i < hidden.size(); ++i)
+  {
+    output += clipped_relu(hidden[i] >> c_hidden_shift) * m_output_weights[i];
+  }
+
+  return output / c_output_divisor;
+}
+
+uint32_t Nnue_network::get_id() const
+{
+  return m_id;
+}
+
+std::span<int16_t const, Nnue_accumulator::c_size> Nnue_network::get_feature_biases() const
+{
+  return std::span<int16_t const, Nnue_accumulator::c_size>{m_feature_biases.data(), Nnue_accumulator::c_size};
+}
+
+std::span<int16_t const, Nnue_accumulator::c_size> Nnue_network::get_feature_weights(size_t feature) const
+{
+  MY_ASSERT(feature < c_feature_count, "Feature index out of range");
+  return std::span<int16_t const, Nnue_accumulator::c_size>{
+    m_feature_weights.data() + (feature * Nnue_accumulator::c_size), Nnue_accumulator::c_size};
+}
+} // namespace Meneldor
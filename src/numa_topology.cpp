@@ -0,0 +1,182 @@
+#include "numa_topology.h"
+#include "utils.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace rs = std::ranges;
+namespace
+{
+std::optional<int> parse_int(std::string_view str)
+{
+  int value{0};
+  auto const [end, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (error != std::errc{} || end != str.data() + str.size() || value < 0)
+  {
+    return {};
+  }
+  return value;
+}
+
+// Returns the node number of a directory named like "node3"
+std::optional<size_t> parse_node_directory(std::string_view name)
+{
+  constexpr std::string_view c_node_prefix{"node"};
+  if (!name.starts_with(c_node_prefix))
+  {
+    return {};
+  }
+  auto const node = parse_int(name.substr(c_node_prefix.size()));
+  if (!node)
+  {
+    return {};
+  }
+  return static_cast<size_t>(*node);
+}
+} // namespace
+
+namespace Meneldor
+{
+Numa_topology Numa_topology::detect(std::filesystem::path const& root)
+{
+  Numa_topology topology;
+
+  std::error_code error;
+  for (auto const& entry : std::filesystem::directory_iterator{root, error})
+  {
+    auto const node = parse_node_directory(entry.path().filename().string());
+    if (!node || !entry.is_directory())
+    {
+      continue;
+    }
+
+    std::ifstream file{entry.path() / "cpulist"};
+    std::string line;
+    std::getline(file, line);
+    auto cpus = parse_cpu_list(line);
+
+    // Nodes with memory but no cpus can't run threads, so there is nothing to pin to them
+    if (!cpus || cpus->empty())
+    {
+      continue;
+    }
+
+    topology.m_nodes.push_back({*node, std::move(*cpus)});
+  }
+
+  // Directories aren't listed in any particular order
+  rs::sort(topology.m_nodes, {}, &Numa_node::id);
+
+  if (topology.m_nodes.empty())
+  {
+    auto& cpus = topology.m_nodes.emplace_back().cpus;
+    cpus.resize(std::max(std::thread::hardware_concurrency(), 1U));
+    std::iota(cpus.begin(), cpus.end(), 0);
+  }
+  return topology;
+}
+
+Numa_topology const& Numa_topology::get_system()
+{
+  static Numa_topology const topology = detect();
+  return topology;
+}
+
+tl::expected<std::vector<int>, std::string> Numa_topology::parse_cpu_list(std::string_view list)
+{
+  std::vector<int> cpus;
+  while (!list.empty() && std::isspace(static_cast<unsigned char>(list.back())))
+  {
+    list.remove_suffix(1);
+  }
+  if (list.empty())
+  {
+    return cpus;
+  }
+
+  for (auto const range : std::views::split(list, ','))
+  {
+    std::string_view const range_str{range.begin(), range.end()};
+    auto const dash = range_str.find('-');
+    auto const first = parse_int(range_str.substr(0, dash));
+    auto const last = (dash == std::string_view::npos) ? first : parse_int(range_str.substr(dash + 1));
+    if (!first || !last || *last < *first)
+    {
+      return tl::unexpected("Invalid cpu list: " + std::string{list});
+    }
+    for (int cpu{*first}; cpu <= *last; ++cpu)
+    {
+      cpus.push_back(cpu);
+    }
+  }
+
+  rs::sort(cpus);
+  auto const duplicates = rs::unique(cpus);
+  cpus.erase(duplicates.begin(), duplicates.end());
+  return cpus;
+}
+
+size_t Numa_topology::get_node_count() const
+{
+  return m_nodes.size();
+}
+
+std::span<Numa_node const> Numa_topology::get_nodes() const
+{
+  return m_nodes;
+}
+
+bool Numa_topology::has_node(size_t node_id) const
+{
+  return find_node_(node_id) != nullptr;
+}
+
+std::span<int const> Numa_topology::get_cpus(size_t node_id) const
+{
+  auto const* node = find_node_(node_id);
+  return node ? std::span<int const>{node->cpus} : std::span<int const>{};
+}
+
+bool Numa_topology::bind_current_thread(size_t node_id) const
+{
+  auto const* node = find_node_(node_id);
+  return node && set_current_thread_cpus_(node->cpus);
+}
+
+bool Numa_topology::unbind_current_thread() const
+{
+  std::vector<int> cpus;
+  for (auto const& node : m_nodes)
+  {
+    cpus.insert(cpus.end(), node.cpus.begin(), node.cpus.end());
+  }
+  return set_current_thread_cpus_(cpus);
+}
+
+Numa_node const* Numa_topology::find_node_(size_t node_id) const
+{
+  auto const it = rs::lower_bound(m_nodes, node_id, {}, &Numa_node::id);
+  return (it != m_nodes.end() && it->id == node_id) ? &*it : nullptr;
+}
+
+bool Numa_topology::set_current_thread_cpus_(std::span<int const> cpus)
+{
+#if defined(_WIN32)
+  unused(cpus);
+  return false;
+#else
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (auto const cpu : cpus)
+  {
+    if (cpu < CPU_SETSIZE)
+    {
+      CPU_SET(cpu, &cpu_set);
+    }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#endif
+}
+} // namespace Meneldor
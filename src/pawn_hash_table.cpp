@@ -0,0 +1,218 @@
+#include "pawn_hash_table.h"
+#include "board.h"
+#include "move_generator.h"
+
+// https://www.chessprogramming.org/Pawn_Hash_Table
+// https://www.chessprogramming.org/Pawn_Structure
+
+namespace rs = std::ranges;
+namespace Meneldor
+{
+namespace
+{
+// These arrays can be indexed by the rank of the pawn, from the point of view of its own color
+constexpr std::array<int16_t, c_board_dimension> c_passed_pawn_middlegame{0, 5, 10, 15, 25, 40, 60, 0};
+constexpr std::array<int16_t, c_board_dimension> c_passed_pawn_endgame{0, 10, 15, 25, 45, 75, 120, 0};
+
+constexpr int16_t c_isolated_pawn_middlegame{-10};
+constexpr int16_t c_isolated_pawn_endgame{-15};
+constexpr int16_t c_doubled_pawn_middlegame{-10};
+constexpr int16_t c_doubled_pawn_endgame{-20};
+constexpr int16_t c_backward_pawn_middlegame{-8};
+constexpr int16_t c_backward_pawn_endgame{-10};
+
+// Bonus for each friendly pawn on the king's file or an adjacent file,
+// one and two ranks in front of the king
+constexpr int8_t c_shield_one_rank_bonus{10};
+constexpr int8_t c_shield_two_ranks_bonus{5};
+
+constexpr Bitboard file_mask(int32_t file)
+{
+  return Bitboard_constants::a_file << file;
+}
+
+constexpr Bitboard adjacent_files_mask(int32_t file)
+{
+  Bitboard result;
+  if (file > 0)
+  {
+    result |= file_mask(file - 1);
+  }
+  if (file < c_board_dimension - 1)
+  {
+    result |= file_mask(file + 1);
+  }
+  return result;
+}
+
+// Squares on every rank in front of the given rank, from color's point of view
+constexpr Bitboard ranks_in_front(Color color, int32_t rank)
+{
+  constexpr uint64_t c_all_squares{std::numeric_limits<uint64_t>::max()};
+  if (color == Color::white)
+  {
+    return (rank >= c_board_dimension - 1) ? Bitboard{} : Bitboard{c_all_squares << (c_board_dimension * (rank + 1))};
+  }
+  return (rank <= 0) ? Bitboard{} : Bitboard{c_all_squares >> (c_board_dimension * (c_board_dimension - rank))};
+}
+
+constexpr Bitboard pawn_attacks(Color color, Bitboard pawns)
+{
+  if (color == Color::white)
+  {
+    return ((pawns << 7) & ~Bitboard_constants::h_file) | ((pawns << 9) & ~Bitboard_constants::a_file);
+  }
+  return ((pawns >> 9) & ~Bitboard_constants::h_file) | ((pawns >> 7) & ~Bitboard_constants::a_file);
+}
+
+constexpr int32_t relative_rank(Color color, int32_t rank)
+{
+  return (color == Color::white) ? rank : (c_board_dimension - 1 - rank);
+}
+} // namespace
+
+Pawn_hash_table::Pawn_hash_table(size_t table_size_bytes)
+{
+  // Keep the capacity a power of two so indexing is a mask instead of a modulus
+  m_table.resize(std::bit_floor(std::max(table_size_bytes / sizeof(Entry), size_t{1})));
+}
+
+Pawn_hash_table::Entry const& Pawn_hash_table::probe(Board const& board)
+{
+  auto const key = board.get_pawn_hash_key().get_hash();
+  auto& entry = m_table[key & (m_table.size() - 1)];
+
+  if (entry.key == key)
+  {
+    ++m_hits;
+  }
+  else
+  {
+    ++m_misses;
+    entry = evaluate(board);
+    entry.key = key;
+  }
+
+  for (auto const color : {Color::black, Color::white})
+  {
+    auto const color_index = static_cast<uint8_t>(color);
+    auto const king_square = board.get_piece_set(color, Piece::king).bitscan_forward();
+    if (king_square >= 0 && entry.shield_king_square[color_index] != king_square)
+    {
+      entry.shield[color_index] = evaluate_shield_(board, color, Coordinates{king_square});
+      entry.shield_king_square[color_index] = static_cast<uint8_t>(king_square);
+    }
+  }
+
+  return entry;
+}
+
+Pawn_hash_table::Entry Pawn_hash_table::evaluate(Board const& board)
+{
+  Entry result;
+  result.key = board.get_pawn_hash_key().get_hash();
+
+  int32_t middlegame{0};
+  int32_t endgame{0};
+  for (auto const color : {Color::black, Color::white})
+  {
+    auto const sign = (color == Color::white) ? 1 : -1;
+    auto const own_pawns = board.get_piece_set(color, Piece::pawn);
+    auto const enemy_pawns = board.get_piece_set(opposite_color(color), Piece::pawn);
+    auto const enemy_pawn_attacks = pawn_attacks(opposite_color(color), enemy_pawns);
+
+    for (auto const sq_index : own_pawns)
+    {
+      Coordinates const location{sq_index};
+      auto const file = location.x();
+      auto const rank = location.y();
+      auto const in_front = ranks_in_front(color, rank);
+      auto const neighbor_files = adjacent_files_mask(file);
+
+      bool const is_doubled = !(own_pawns & in_front & file_mask(file)).is_empty();
+      bool const is_isolated = (own_pawns & neighbor_files).is_empty();
+
+      if (!is_doubled && (enemy_pawns & in_front & (file_mask(file) | neighbor_files)).is_empty())
+      {
+        result.passed_pawns[static_cast<uint8_t>(color)].set_square(location);
+        middlegame += sign * c_passed_pawn_middlegame[relative_rank(color, rank)];
+        endgame += sign * c_passed_pawn_endgame[relative_rank(color, rank)];
+      }
+
+      if (is_doubled)
+      {
+        middlegame += sign * c_doubled_pawn_middlegame;
+        endgame += sign * c_doubled_pawn_endgame;
+      }
+
+      if (is_isolated)
+      {
+        middlegame += sign * c_isolated_pawn_middlegame;
+        endgame += sign * c_isolated_pawn_endgame;
+      }
+      else
+      {
+        // A pawn is backward if no friendly pawn can ever defend it, and it
+        // can't safely advance because an enemy pawn controls the square in front of it
+        auto const supporting_pawns = own_pawns & neighbor_files & ~in_front;
+        auto const stop_square = Coordinates{file, rank + ((color == Color::white) ? 1 : -1)};
+        if (supporting_pawns.is_empty() && enemy_pawn_attacks.is_set(stop_square))
+        {
+          middlegame += sign * c_backward_pawn_middlegame;
+          endgame += sign * c_backward_pawn_endgame;
+        }
+      }
+    }
+  }
+
+  result.middlegame = static_cast<int16_t>(middlegame);
+  result.endgame = static_cast<int16_t>(endgame);
+  return result;
+}
+
+int8_t Pawn_hash_table::evaluate_shield_(Board const& board, Color color, Coordinates king_location)
+{
+  // Only a king that is still tucked away on its back ranks has a shield
+  auto const rank = king_location.y();
+  if (relative_rank(color, rank) > 1)
+  {
+    return 0;
+  }
+
+  auto const direction = (color == Color::white) ? 1 : -1;
+  auto const files = file_mask(king_location.x()) | adjacent_files_mask(king_location.x());
+  auto const own_pawns = board.get_piece_set(color, Piece::pawn) & files;
+  auto const one_rank_ahead = Bitboard_constants::first_rank << (c_board_dimension * (rank + direction));
+  auto const two_ranks_ahead = Bitboard_constants::first_rank << (c_board_dimension * (rank + 2 * direction));
+
+  return static_cast<int8_t>(c_shield_one_rank_bonus * (own_pawns & one_rank_ahead).occupancy() +
+                             c_shield_two_ranks_bonus * (own_pawns & two_ranks_ahead).occupancy());
+}
+
+size_t Pawn_hash_table::get_capacity() const
+{
+  return m_table.size();
+}
+
+uint64_t Pawn_hash_table::get_hits() const
+{
+  return m_hits;
+}
+
+uint64_t Pawn_hash_table::get_misses() const
+{
+  return m_misses;
+}
+
+void Pawn_hash_table::reset_stats()
+{
+  m_hits = 0;
+  m_misses = 0;
+}
+
+void Pawn_hash_table::clear()
+{
+  rs::fill(m_table, Entry{});
+  reset_stats();
+}
+} // namespace Meneldor
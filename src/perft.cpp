@@ -0,0 +1,226 @@
+#include "perft.h"
+#include "move_generator.h"
+
+namespace Meneldor
+{
+namespace
+{
+constexpr size_t c_depth_bits{8};
+constexpr uint64_t c_depth_mask{(uint64_t{1} << c_depth_bits) - 1};
+
+size_t get_entry_count(size_t table_size_bytes, size_t entry_size)
+{
+  if (table_size_bytes < entry_size)
+  {
+    return 0;
+  }
+  // Round down to a power of two so the index is a mask of the key
+  return std::bit_floor(table_size_bytes / entry_size);
+}
+} // namespace
+
+Perft::Perft(size_t thread_count, size_t table_size_bytes)
+    : m_thread_count{std::max(thread_count, size_t{1})},
+      m_table(get_entry_count(table_size_bytes, sizeof(Table_entry)))
+{
+}
+
+uint64_t Perft::count(int depth, Board const& board, std::atomic_flag const& is_cancelled)
+{
+  if (depth <= 1 || m_thread_count == 1)
+  {
+    Leaf_parents leaf_parents;
+    return (board.get_active_color() == Color::white) ?
+             count_<Color::white>(depth, board, leaf_parents, is_cancelled) :
+             count_<Color::black>(depth, board, leaf_parents, is_cancelled);
+  }
+
+  auto const entries = divide(depth, board, is_cancelled);
+  return std::accumulate(entries.begin(), entries.end(), uint64_t{0},
+                         [](uint64_t sum, Perft_divide_entry const& entry)
+                         {
+                           return sum + entry.nodes;
+                         });
+}
+
+std::vector<Perft_divide_entry> Perft::divide(int depth, Board const& board, std::atomic_flag const& is_cancelled)
+{
+  MY_ASSERT(depth >= 1, "Divide needs at least one move to split on");
+
+  Move_list moves;
+  Move_generator::generate_legal_moves(board, moves);
+  std::vector<Perft_divide_entry> entries;
+  entries.reserve(moves.size());
+  for (auto const m : moves)
+  {
+    entries.push_back({m, 0});
+  }
+
+  // Each thread takes the next root move that no other thread has started
+  std::atomic<size_t> next_entry{0};
+  auto const count_root_moves = [&]
+  {
+    Leaf_parents leaf_parents;
+    for (auto i = next_entry.fetch_add(1); i < entries.size() && !is_cancelled.test(); i = next_entry.fetch_add(1))
+    {
+      auto child = board;
+      child.move_no_verify(entries[i].move);
+      entries[i].nodes = (child.get_active_color() == Color::white) ?
+                           count_<Color::white>(depth - 1, child, leaf_parents, is_cancelled) :
+                           count_<Color::black>(depth - 1, child, leaf_parents, is_cancelled);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t thread_index{1}; thread_index < std::min(m_thread_count, entries.size()); ++thread_index)
+  {
+    threads.emplace_back(count_root_moves);
+  }
+  count_root_moves();
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  return entries;
+}
+
+template <Color color>
+uint64_t Perft::count_(int depth, Board const& board, Leaf_parents& leaf_parents, std::atomic_flag const& is_cancelled)
+{
+  if (depth == 0)
+  {
+    return 1;
+  }
+
+  Move_list moves;
+  if (depth == 1)
+  {
+    Move_generator::generate_legal_moves(board, moves);
+    return moves.size();
+  }
+
+  auto const key = board.get_hash_key();
+  if (auto const nodes = probe_(key, depth))
+  {
+    return *nodes;
+  }
+
+  Move_generator::generate_legal_moves(board, moves);
+  uint64_t nodes{0};
+  if (depth == 2)
+  {
+    // Only the number of replies to each move is needed
+    std::array<uint32_t, Move_counter::c_max_batch_size> counts{};
+    auto const batch_size = Move_counter::get_batch_size();
+    for (size_t begin{0}; begin < moves.size(); begin += batch_size)
+    {
+      auto const size = std::min(batch_size, moves.size() - begin);
+      for (size_t i{0}; i < size; ++i)
+      {
+        leaf_parents[i] = board;
+        leaf_parents[i].make_move<color>(moves[begin + i]);
+      }
+      Move_counter::count_legal_moves(std::span{leaf_parents}.first(size), std::span{counts}.first(size));
+      nodes = std::accumulate(counts.begin(), counts.begin() + static_cast<std::ptrdiff_t>(size), nodes);
+    }
+  }
+  else
+  {
+    for (auto const m : moves)
+    {
+      auto child = board;
+      child.make_move<color>(m);
+      nodes += count_<opposite_color(color)>(depth - 1, child, leaf_parents, is_cancelled);
+      if (is_cancelled.test())
+      {
+        // Don't cache a partial count
+        return nodes;
+      }
+    }
+  }
+
+  store_(key, depth, nodes);
+  return nodes;
+}
+
+std::optional<uint64_t> Perft::probe_(zhash_t key, int depth) const
+{
+  if (m_table.empty())
+  {
+    return std::nullopt;
+  }
+
+  auto const& entry = m_table[key & (m_table.size() - 1)];
+  auto const data = entry.data.load(std::memory_order_relaxed);
+  if ((entry.key.load(std::memory_order_relaxed) ^ data) != key ||
+      (data & c_depth_mask) != static_cast<uint64_t>(depth))
+  {
+    return std::nullopt;
+  }
+  return data >> c_depth_bits;
+}
+
+void Perft::store_(zhash_t key, int depth, uint64_t nodes)
+{
+  if (m_table.empty())
+  {
+    return;
+  }
+
+  auto& entry = m_table[key & (m_table.size() - 1)];
+  auto const data = (nodes << c_depth_bits) | static_cast<uint64_t>(depth);
+  entry.key.store(key ^ data, std::memory_order_relaxed);
+  entry.data.store(data, std::memory_order_relaxed);
+}
+
+tl::expected<std::vector<Perft_suite_position>, std::string> Perft::load_suite(std::filesystem::path const& filename)
+{
+  std::ifstream file{filename};
+  if (!file)
+  {
+    return tl::unexpected(std::string{"Could not open "} + filename.string());
+  }
+
+  std::vector<Perft_suite_position> positions;
+  std::string line;
+  for (size_t line_number{1}; std::getline(file, line); ++line_number)
+  {
+    auto const first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#')
+    {
+      continue;
+    }
+
+    auto const fen_end = line.find(';');
+    Perft_suite_position position;
+    position.fen = line.substr(first, fen_end - first);
+    position.fen.erase(position.fen.find_last_not_of(" \t\r") + 1);
+
+    // Each field after the fen is "D<depth> <nodes>", in increasing depth
+    std::stringstream fields{(fen_end == std::string::npos) ? std::string{} : line.substr(fen_end)};
+    std::string field;
+    while (std::getline(fields, field, ';'))
+    {
+      if (field.find_first_not_of(" \t\r") == std::string::npos)
+      {
+        continue;
+      }
+
+      std::stringstream ss{field};
+      std::string depth_str;
+      uint64_t nodes{0};
+      if (!(ss >> depth_str >> nodes) || depth_str.size() < 2 || depth_str[0] != 'D' ||
+          depth_str.substr(1) != std::to_string(position.expected_nodes.size() + 1))
+      {
+        return tl::unexpected("Invalid depth on line " + std::to_string(line_number) + ": " + field);
+      }
+      position.expected_nodes.push_back(nodes);
+    }
+
+    positions.push_back(std::move(position));
+  }
+
+  return positions;
+}
+} // namespace Meneldor
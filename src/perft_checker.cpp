@@ -0,0 +1,616 @@
+#include "perft_checker.h"
+#include "board.h"
+#include "move_generator.h"
+
+namespace rs = std::ranges;
+namespace Meneldor
+{
+namespace
+{
+// Moves are compared as from | to << 6 | promotion << 12, with squares
+// numbered from a1 = 0 to h8 = 63 and promotions from knight = 1 to queen = 4
+using Move_code = uint16_t;
+
+constexpr std::string_view c_promotion_chars{" nbrq"};
+
+std::string code_to_uci(Move_code code)
+{
+  std::string result;
+  for (auto const square : {code & 0x3f, (code >> 6) & 0x3f})
+  {
+    result += static_cast<char>('a' + square % 8);
+    result += static_cast<char>('1' + square / 8);
+  }
+  if (auto const promotion = code >> 12; promotion != 0)
+  {
+    result += c_promotion_chars[static_cast<size_t>(promotion)];
+  }
+  return result;
+}
+
+Move_code engine_move_code(Move m)
+{
+  auto const promotion =
+    (m.promotion() == Piece::empty) ? 0 : static_cast<uint8_t>(m.promotion()) - static_cast<uint8_t>(Piece::pawn);
+  return static_cast<Move_code>(m.from().square_index() | (m.to().square_index() << 6) | (promotion << 12));
+}
+
+// The reference generator, written for obviousness rather than speed. Squares
+// are numbered rank * 16 + file, so a square is off the board exactly when
+// it has a bit of 0x88 set. Pieces are positive for white and negative for
+// black, and moves are made on a copy of the board.
+class Reference_board
+{
+public:
+  struct Reference_move
+  {
+    int from;
+    int to;
+    int promotion; // Piece type, or zero
+    bool is_en_passant;
+    bool is_castle;
+    bool is_double_push;
+  };
+
+  static std::optional<Reference_board> from_fen(std::string_view fen)
+  {
+    Reference_board board;
+    std::stringstream ss{std::string{fen}};
+    std::string placement;
+    std::string side;
+    std::string castling;
+    std::string en_passant;
+    if (!(ss >> placement >> side >> castling >> en_passant))
+    {
+      return std::nullopt;
+    }
+
+    int rank{7};
+    int file{0};
+    for (auto const c : placement)
+    {
+      if (c == '/')
+      {
+        --rank;
+        file = 0;
+      }
+      else if (c >= '1' && c <= '8')
+      {
+        file += c - '0';
+      }
+      else
+      {
+        auto const type = c_piece_chars.find(static_cast<char>(std::tolower(c)));
+        if (type == std::string_view::npos || rank < 0 || file > 7)
+        {
+          return std::nullopt;
+        }
+        auto const square = rank * 16 + file;
+        board.m_squares[static_cast<size_t>(square)] = static_cast<int8_t>(std::isupper(c) ? type : -type);
+        if (type == c_king)
+        {
+          board.m_king_squares[std::isupper(c) ? 0 : 1] = square;
+        }
+        ++file;
+      }
+    }
+
+    board.m_side = (side == "b") ? -1 : 1;
+    for (auto const c : castling)
+    {
+      if (auto const right = std::string_view{"KQkq"}.find(c); right != std::string_view::npos)
+      {
+        board.m_castling |= 1 << right;
+      }
+    }
+    if (en_passant.size() == 2)
+    {
+      board.m_en_passant = (en_passant[1] - '1') * 16 + (en_passant[0] - 'a');
+    }
+    return board;
+  }
+
+  void generate_legal_moves(std::vector<Reference_move>& moves) const
+  {
+    std::vector<Reference_move> candidates;
+    generate_pseudo_legal_moves_(candidates);
+    for (auto const& m : candidates)
+    {
+      auto child = *this;
+      child.make_move(m);
+      if (!child.is_attacked_(child.m_king_squares[(m_side == 1) ? 0 : 1], -m_side))
+      {
+        moves.push_back(m);
+      }
+    }
+  }
+
+  void make_move(Reference_move const& m)
+  {
+    auto const piece = m_squares[static_cast<size_t>(m.from)];
+    m_squares[static_cast<size_t>(m.to)] = static_cast<int8_t>((m.promotion != 0) ? m.promotion * m_side : piece);
+    m_squares[static_cast<size_t>(m.from)] = 0;
+    if (m.is_en_passant)
+    {
+      m_squares[static_cast<size_t>(m.to - 16 * m_side)] = 0;
+    }
+    if (m.is_castle)
+    {
+      auto const rank_start = m.from - 4;
+      auto const [rook_from, rook_to] = (m.to > m.from) ? std::pair{rank_start + 7, rank_start + 5} :
+                                                          std::pair{rank_start, rank_start + 3};
+      m_squares[static_cast<size_t>(rook_to)] = m_squares[static_cast<size_t>(rook_from)];
+      m_squares[static_cast<size_t>(rook_from)] = 0;
+    }
+    if (std::abs(piece) == c_king)
+    {
+      m_king_squares[(m_side == 1) ? 0 : 1] = m.to;
+    }
+
+    // Moving from or to a king or rook's starting square loses the rights it gives
+    for (auto const square : {m.from, m.to})
+    {
+      for (size_t right{0}; right < c_castling_squares.size(); ++right)
+      {
+        if (square == c_castling_squares[right].first || square == c_castling_squares[right].second)
+        {
+          m_castling &= ~(1 << right);
+        }
+      }
+    }
+
+    m_en_passant = m.is_double_push ? m.from + 16 * m_side : -1;
+    m_side = -m_side;
+  }
+
+  static Move_code code(Reference_move const& m)
+  {
+    auto const to_index = [](int square)
+    {
+      return (square >> 4) * 8 + (square & 7);
+    };
+    auto const promotion = (m.promotion == 0) ? 0 : m.promotion - 1;
+    return static_cast<Move_code>(to_index(m.from) | (to_index(m.to) << 6) | (promotion << 12));
+  }
+
+private:
+  constexpr static std::string_view c_piece_chars{" pnbrqk"};
+  constexpr static int c_pawn{1};
+  constexpr static int c_knight{2};
+  constexpr static int c_bishop{3};
+  constexpr static int c_rook{4};
+  constexpr static int c_queen{5};
+  constexpr static int c_king{6};
+
+  constexpr static std::array c_knight_steps{33, 31, 18, 14, -33, -31, -18, -14};
+  constexpr static std::array c_king_steps{1, -1, 16, -16, 15, 17, -15, -17};
+  constexpr static std::array c_rook_steps{1, -1, 16, -16};
+  constexpr static std::array c_bishop_steps{15, 17, -15, -17};
+
+  // King and rook starting squares for each of K, Q, k and q
+  constexpr static std::array<std::pair<int, int>, 4> c_castling_squares{
+    {{0x04, 0x07}, {0x04, 0x00}, {0x74, 0x77}, {0x74, 0x70}}};
+
+  static bool is_on_board_(int square)
+  {
+    return (square & 0x88) == 0;
+  }
+
+  int at_(int square) const
+  {
+    return m_squares[static_cast<size_t>(square)];
+  }
+
+  bool is_attacked_(int square, int by_side) const
+  {
+    // A pawn attacks diagonally forward, so look diagonally backward from the square
+    for (auto const step : {15, 17})
+    {
+      auto const from = square - step * by_side;
+      if (is_on_board_(from) && at_(from) == c_pawn * by_side)
+      {
+        return true;
+      }
+    }
+    for (auto const step : c_knight_steps)
+    {
+      if (is_on_board_(square + step) && at_(square + step) == c_knight * by_side)
+      {
+        return true;
+      }
+    }
+    for (auto const step : c_king_steps)
+    {
+      if (is_on_board_(square + step) && at_(square + step) == c_king * by_side)
+      {
+        return true;
+      }
+    }
+    auto const slides_to = [&](auto const& steps, int slider)
+    {
+      for (auto const step : steps)
+      {
+        for (auto to = square + step; is_on_board_(to); to += step)
+        {
+          if (at_(to) == slider * by_side || at_(to) == c_queen * by_side)
+          {
+            return true;
+          }
+          if (at_(to) != 0)
+          {
+            break;
+          }
+        }
+      }
+      return false;
+    };
+    return slides_to(c_rook_steps, c_rook) || slides_to(c_bishop_steps, c_bishop);
+  }
+
+  void generate_pseudo_legal_moves_(std::vector<Reference_move>& moves) const
+  {
+    auto const is_enemy = [&](int square)
+    {
+      return at_(square) * m_side < 0;
+    };
+    auto const add = [&](int from, int to)
+    {
+      moves.push_back({from, to, 0, false, false, false});
+    };
+
+    for (int from{0}; from < 128; ++from)
+    {
+      if (!is_on_board_(from) || at_(from) * m_side <= 0)
+      {
+        continue;
+      }
+
+      auto const type = std::abs(at_(from));
+      if (type == c_pawn)
+      {
+        auto const forward = 16 * m_side;
+        auto const last_rank = (m_side == 1) ? 7 : 0;
+        auto const start_rank = (m_side == 1) ? 1 : 6;
+        auto const add_pawn_move = [&](int to, bool is_en_passant)
+        {
+          if ((to >> 4) == last_rank)
+          {
+            for (auto const promotion : {c_knight, c_bishop, c_rook, c_queen})
+            {
+              moves.push_back({from, to, promotion, false, false, false});
+            }
+          }
+          else
+          {
+            moves.push_back({from, to, 0, is_en_passant, false, false});
+          }
+        };
+
+        if (at_(from + forward) == 0)
+        {
+          add_pawn_move(from + forward, false);
+          if ((from >> 4) == start_rank && at_(from + 2 * forward) == 0)
+          {
+            moves.push_back({from, from + 2 * forward, 0, false, false, true});
+          }
+        }
+        for (auto const side_step : {-1, 1})
+        {
+          auto const to = from + forward + side_step;
+          if (!is_on_board_(to))
+          {
+            continue;
+          }
+          if (is_enemy(to))
+          {
+            add_pawn_move(to, false);
+          }
+          else if (to == m_en_passant)
+          {
+            add_pawn_move(to, true);
+          }
+        }
+      }
+      else if (type == c_knight || type == c_king)
+      {
+        for (auto const step : (type == c_knight) ? c_knight_steps : c_king_steps)
+        {
+          auto const to = from + step;
+          if (is_on_board_(to) && (at_(to) == 0 || is_enemy(to)))
+          {
+            add(from, to);
+          }
+        }
+      }
+      else
+      {
+        auto const slide = [&](auto const& steps)
+        {
+          for (auto const step : steps)
+          {
+            for (auto to = from + step; is_on_board_(to); to += step)
+            {
+              if (at_(to) == 0 || is_enemy(to))
+              {
+                add(from, to);
+              }
+              if (at_(to) != 0)
+              {
+                break;
+              }
+            }
+          }
+        };
+        if (type != c_bishop)
+        {
+          slide(c_rook_steps);
+        }
+        if (type != c_rook)
+        {
+          slide(c_bishop_steps);
+        }
+      }
+    }
+
+    // The king may not castle out of, through or into check
+    auto const first_right = (m_side == 1) ? 0 : 2;
+    for (auto right = first_right; right < first_right + 2; ++right)
+    {
+      auto const [king, rook] = c_castling_squares[static_cast<size_t>(right)];
+      if (!(m_castling & (1 << right)) || at_(king) != c_king * m_side || at_(rook) != c_rook * m_side)
+      {
+        continue;
+      }
+      auto const direction = (rook > king) ? 1 : -1;
+      bool is_allowed{true};
+      for (auto square = king + direction; square != rook; square += direction)
+      {
+        is_allowed &= at_(square) == 0;
+      }
+      for (auto square = king; square != king + 3 * direction; square += direction)
+      {
+        is_allowed &= !is_attacked_(square, -m_side);
+      }
+      if (is_allowed)
+      {
+        moves.push_back({king, king + 2 * direction, 0, false, true, false});
+      }
+    }
+  }
+
+  std::array<int8_t, 128> m_squares{};
+  std::array<int, 2> m_king_squares{};
+  int m_side{1};
+  int m_castling{0};
+  int m_en_passant{-1};
+};
+
+uint64_t reference_perft_(Reference_board const& board, int depth)
+{
+  if (depth == 0)
+  {
+    return 1;
+  }
+  std::vector<Reference_board::Reference_move> moves;
+  board.generate_legal_moves(moves);
+  uint64_t nodes{0};
+  for (auto const& m : moves)
+  {
+    auto child = board;
+    child.make_move(m);
+    nodes += reference_perft_(child, depth - 1);
+  }
+  return nodes;
+}
+
+// Walks one subtree with both generators. Returns false once a mismatch has
+// been found, by this or any other thread.
+class Tree_walker
+{
+public:
+  Tree_walker(std::atomic_flag& is_done,
+              std::mutex& mismatch_mutex,
+              std::optional<Perft_mismatch>& mismatch,
+              Perft_move_filter const& move_filter)
+      : m_is_done{is_done}, m_mismatch_mutex{mismatch_mutex}, m_mismatch{mismatch}, m_move_filter{move_filter}
+  {
+  }
+
+  bool walk(Board const& board, Reference_board const& reference, int depth)
+  {
+    if (depth == 0)
+    {
+      ++m_nodes;
+      return true;
+    }
+    if (m_is_done.test())
+    {
+      return false;
+    }
+
+    Move_list engine_moves;
+    Move_generator::generate_legal_moves(board, engine_moves);
+    if (m_move_filter)
+    {
+      m_move_filter(board, engine_moves);
+    }
+    std::vector<std::pair<Move_code, Move>> engine_codes;
+    for (auto const m : engine_moves)
+    {
+      engine_codes.emplace_back(engine_move_code(m), m);
+    }
+    std::vector<Reference_board::Reference_move> reference_moves;
+    reference.generate_legal_moves(reference_moves);
+    std::vector<std::pair<Move_code, size_t>> reference_codes;
+    for (size_t i{0}; i < reference_moves.size(); ++i)
+    {
+      reference_codes.emplace_back(Reference_board::code(reference_moves[i]), i);
+    }
+
+    // Equal move lists pair up move by move once sorted
+    rs::sort(engine_codes, {}, &std::pair<Move_code, Move>::first);
+    rs::sort(reference_codes);
+    if (!rs::equal(engine_codes, reference_codes, {}, &std::pair<Move_code, Move>::first,
+                   &std::pair<Move_code, size_t>::first))
+    {
+      report_(board, engine_codes, reference_codes);
+      return false;
+    }
+
+    for (size_t i{0}; i < engine_codes.size(); ++i)
+    {
+      auto child = board;
+      child.move_no_verify(engine_codes[i].second);
+      auto child_reference = reference;
+      child_reference.make_move(reference_moves[reference_codes[i].second]);
+
+      m_path.push_back(engine_codes[i].first);
+      if (!walk(child, child_reference, depth - 1))
+      {
+        return false;
+      }
+      m_path.pop_back();
+    }
+    return true;
+  }
+
+  void push_path(Move_code code)
+  {
+    m_path.push_back(code);
+  }
+
+  void pop_path()
+  {
+    m_path.pop_back();
+  }
+
+  uint64_t get_nodes() const
+  {
+    return m_nodes;
+  }
+
+private:
+  void report_(Board const& board,
+               std::vector<std::pair<Move_code, Move>> const& engine_codes,
+               std::vector<std::pair<Move_code, size_t>> const& reference_codes)
+  {
+    Perft_mismatch mismatch{board.to_fen(), {}, {}, {}};
+    for (auto const code : m_path)
+    {
+      mismatch.path.push_back(code_to_uci(code));
+    }
+
+    // Both lists are sorted, and a move generated twice shows up as extra
+    std::vector<Move_code> engine_list;
+    std::vector<Move_code> reference_list;
+    rs::transform(engine_codes, std::back_inserter(engine_list), &std::pair<Move_code, Move>::first);
+    rs::transform(reference_codes, std::back_inserter(reference_list), &std::pair<Move_code, size_t>::first);
+    std::vector<Move_code> difference;
+    rs::set_difference(reference_list, engine_list, std::back_inserter(difference));
+    rs::transform(difference, std::back_inserter(mismatch.missing_moves), &code_to_uci);
+    difference.clear();
+    rs::set_difference(engine_list, reference_list, std::back_inserter(difference));
+    rs::transform(difference, std::back_inserter(mismatch.extra_moves), &code_to_uci);
+
+    std::lock_guard lock{m_mismatch_mutex};
+    if (!m_mismatch)
+    {
+      m_mismatch = std::move(mismatch);
+    }
+    m_is_done.test_and_set();
+  }
+
+  std::atomic_flag& m_is_done;
+  std::mutex& m_mismatch_mutex;
+  std::optional<Perft_mismatch>& m_mismatch;
+  Perft_move_filter const& m_move_filter;
+  std::vector<Move_code> m_path;
+  uint64_t m_nodes{0};
+};
+} // namespace
+
+tl::expected<Perft_check_result, std::string> Perft_checker::check(std::string_view fen,
+                                                                   int depth,
+                                                                   size_t thread_count,
+                                                                   Perft_move_filter const& move_filter)
+{
+  auto const board = Board::from_fen(fen);
+  if (!board)
+  {
+    return tl::unexpected(board.error());
+  }
+  auto const reference = Reference_board::from_fen(fen);
+  if (!reference)
+  {
+    return tl::unexpected(std::string{"Reference generator can't read fen"});
+  }
+
+  std::atomic_flag is_done{};
+  std::mutex mismatch_mutex;
+  Perft_check_result result;
+  if (depth <= 1)
+  {
+    Tree_walker walker{is_done, mismatch_mutex, result.mismatch, move_filter};
+    walker.walk(*board, *reference, depth);
+    result.nodes = walker.get_nodes();
+    return result;
+  }
+
+  // The root position is checked on its own, then its moves are handed out
+  // to the threads one at a time
+  Tree_walker root_walker{is_done, mismatch_mutex, result.mismatch, move_filter};
+  if (!root_walker.walk(*board, *reference, 1))
+  {
+    return result;
+  }
+
+  std::vector<Reference_board::Reference_move> root_moves;
+  reference->generate_legal_moves(root_moves);
+  std::atomic<size_t> next_move{0};
+  std::atomic<uint64_t> nodes{0};
+  auto const check_root_moves = [&]
+  {
+    Tree_walker walker{is_done, mismatch_mutex, result.mismatch, move_filter};
+    for (auto i = next_move.fetch_add(1); i < root_moves.size() && !is_done.test(); i = next_move.fetch_add(1))
+    {
+      auto const code = Reference_board::code(root_moves[i]);
+      auto const engine_moves = Move_generator::generate_legal_moves(*board);
+      auto const engine_move = rs::find(engine_moves, code, &engine_move_code);
+
+      auto child = *board;
+      child.move_no_verify(*engine_move);
+      auto child_reference = *reference;
+      child_reference.make_move(root_moves[i]);
+
+      walker.push_path(code);
+      walker.walk(child, child_reference, depth - 1);
+      walker.pop_path();
+    }
+    nodes += walker.get_nodes();
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t thread_index{1}; thread_index < std::min(thread_count, root_moves.size()); ++thread_index)
+  {
+    threads.emplace_back(check_root_moves);
+  }
+  check_root_moves();
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  result.nodes = nodes;
+  return result;
+}
+
+tl::expected<uint64_t, std::string> Perft_checker::reference_perft(std::string_view fen, int depth)
+{
+  auto const reference = Reference_board::from_fen(fen);
+  if (!reference)
+  {
+    return tl::unexpected(std::string{"Reference generator can't read fen"});
+  }
+  return reference_perft_(*reference, depth);
+}
+} // namespace Meneldor
@@ -0,0 +1,490 @@
+#include "pgn_reader.h"
+#include "move_generator.h"
+
+namespace Meneldor
+{
+namespace
+{
+constexpr std::string_view c_whitespace{" \t\r\n"};
+
+// Characters that end a move without whitespace, like "e4{good}"
+constexpr std::string_view c_token_end{" \t\r\n{(;"};
+
+bool is_game_result(std::string_view token)
+{
+  return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+}
+
+// Finds where each game starts. A game is its tag pairs followed by its
+// movetext, so a tag after movetext starts the next one. Comments are skipped
+// since they can contain brackets.
+std::vector<std::string_view> split_games(std::string_view text)
+{
+  std::vector<std::string_view> games;
+  auto game_start = std::string_view::npos;
+  bool has_movetext{false};
+
+  size_t index{0};
+  while (index < text.size())
+  {
+    index = text.find_first_not_of(c_whitespace, index);
+    if (index == std::string_view::npos)
+    {
+      break;
+    }
+
+    if (text[index] == '[' && has_movetext)
+    {
+      games.push_back(text.substr(game_start, index - game_start));
+      game_start = std::string_view::npos;
+      has_movetext = false;
+    }
+    if (game_start == std::string_view::npos)
+    {
+      game_start = index;
+    }
+
+    switch (text[index])
+    {
+      case '[':
+        index = text.find(']', index);
+        break;
+      case '{':
+        index = text.find('}', index);
+        has_movetext = true;
+        break;
+      case ';':
+        index = text.find('\n', index);
+        break;
+      default:
+        index = text.find_first_of(c_whitespace, index);
+        has_movetext = true;
+        break;
+    }
+    if (index != std::string_view::npos)
+    {
+      ++index;
+    }
+  }
+
+  if (game_start != std::string_view::npos)
+  {
+    games.push_back(text.substr(game_start));
+  }
+  return games;
+}
+
+// Reads a tag pair starting at the '['. Returns the index after the ']'.
+std::optional<size_t> read_tag(std::string_view game, size_t index, std::vector<Pgn_tag>& tags)
+{
+  auto const name_begin = game.find_first_not_of(c_whitespace, index + 1);
+  auto const name_end = game.find_first_of(" \t\"]", name_begin);
+  auto const value_begin = game.find('"', name_end);
+  if (name_end == std::string_view::npos || value_begin == std::string_view::npos)
+  {
+    return std::nullopt;
+  }
+
+  // Quotes inside the value are escaped with a backslash
+  auto value_end = value_begin + 1;
+  while (value_end < game.size() && game[value_end] != '"')
+  {
+    value_end += (game[value_end] == '\\') ? 2 : 1;
+  }
+  auto const tag_end = game.find(']', value_end);
+  if (tag_end == std::string_view::npos)
+  {
+    return std::nullopt;
+  }
+
+  tags.push_back({game.substr(name_begin, name_end - name_begin),
+                  game.substr(value_begin + 1, value_end - value_begin - 1)});
+  return tag_end + 1;
+}
+
+// Returns the index after the ')' that closes the variation starting at index
+size_t skip_variation(std::string_view game, size_t index)
+{
+  int depth{0};
+  for (; index < game.size(); ++index)
+  {
+    switch (game[index])
+    {
+      case '(':
+        ++depth;
+        break;
+      case ')':
+        if (--depth == 0)
+        {
+          return index + 1;
+        }
+        break;
+      case '{':
+        index = std::min(game.find('}', index), game.size());
+        break;
+      default:
+        break;
+    }
+  }
+  return game.size();
+}
+
+// Matches a move in standard algebraic notation against the position.
+// Accepts check and annotation suffixes, promotions with or without '=',
+// castling with zeros, and fully disambiguated moves like e2e4. Only the
+// pieces that could reach the target square are tried, by making the move
+// into next and checking that the king is safe, which is much cheaper than
+// generating every legal move. On success next holds the position after it.
+std::optional<Move> find_san_move(Board const& board, std::string_view san, Move_list& moves, Board& next)
+{
+  while (!san.empty() && std::string_view{"+#!?"}.find(san.back()) != std::string_view::npos)
+  {
+    san.remove_suffix(1);
+  }
+
+  if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0")
+  {
+    moves.clear();
+    Move_generator::generate_legal_moves(board, moves);
+    auto const king_file = (san.size() == 3) ? 6 : 2;
+    auto const it = std::ranges::find_if(moves,
+                                         [&](Move m)
+                                         {
+                                           return m.type() == Move_type::castle && m.to().x() == king_file;
+                                         });
+    if (it == moves.end())
+    {
+      return std::nullopt;
+    }
+    next = board;
+    next.move_no_verify(*it, true);
+    return *it;
+  }
+
+  auto promotion = Piece::empty;
+  if (san.size() > 2 && from_char(san.back()) != Piece::empty)
+  {
+    promotion = from_char(san.back());
+    if (promotion == Piece::pawn || promotion == Piece::king)
+    {
+      return std::nullopt;
+    }
+    san.remove_suffix((san[san.size() - 2] == '=') ? 2 : 1);
+  }
+
+  auto piece = Piece::pawn;
+  if (!san.empty() && from_char(san.front()) != Piece::empty)
+  {
+    piece = from_char(san.front());
+    san.remove_prefix(1);
+  }
+
+  auto const to = (san.size() >= 2) ? Coordinates::from_str(san.substr(san.size() - 2)) : std::nullopt;
+  if (!to)
+  {
+    return std::nullopt;
+  }
+  san.remove_suffix(2);
+
+  std::optional<int32_t> from_file;
+  std::optional<int32_t> from_rank;
+  for (auto const c : san)
+  {
+    if (c >= 'a' && c <= 'h')
+    {
+      from_file = c - 'a';
+    }
+    else if (c >= '1' && c <= '8')
+    {
+      from_rank = c - '1';
+    }
+    else if (c != 'x' && c != '-')
+    {
+      return std::nullopt;
+    }
+  }
+
+  auto const color = board.get_active_color();
+  auto const own_pieces = board.get_piece_set(color, piece);
+  if (board.get_all(color).is_set(*to))
+  {
+    return std::nullopt;
+  }
+
+  auto const is_en_passant = piece == Piece::pawn && board.get_en_passant_square().is_set(*to);
+  auto const victim = is_en_passant ? Piece::pawn : board.get_piece(*to);
+  auto const last_rank = (color == Color::white) ? c_board_dimension - 1 : 0;
+  if ((piece == Piece::pawn && to->y() == last_rank) != (promotion != Piece::empty))
+  {
+    return std::nullopt;
+  }
+
+  Bitboard candidates;
+  auto const forward = (color == Color::white) ? 1 : -1;
+  if (piece == Piece::pawn && to->y() - forward >= 0 && to->y() - forward < c_board_dimension)
+  {
+    if (from_file && *from_file != to->x())
+    {
+      // Captures name the file the pawn comes from
+      if (std::abs(*from_file - to->x()) == 1 && (victim != Piece::empty))
+      {
+        candidates.set_square(Coordinates{*from_file, to->y() - forward});
+      }
+    }
+    else if (victim == Piece::empty)
+    {
+      Coordinates const one_back{to->x(), to->y() - forward};
+      auto const double_push_rank = (color == Color::white) ? 3 : 4;
+      if (own_pieces.is_set(one_back))
+      {
+        candidates.set_square(one_back);
+      }
+      else if (to->y() == double_push_rank && !board.is_occupied(one_back))
+      {
+        candidates.set_square(Coordinates{to->x(), to->y() - 2 * forward});
+      }
+    }
+  }
+  else if (piece != Piece::pawn)
+  {
+    candidates = Move_generator::get_piece_attacks(piece, *to, board.get_occupied_squares());
+  }
+  candidates &= own_pieces;
+  if (from_file)
+  {
+    candidates &= Bitboard{Bitboard_constants::a_file.val << *from_file};
+  }
+  if (from_rank)
+  {
+    candidates &= Bitboard{Bitboard_constants::first_rank.val << (*from_rank * c_board_dimension)};
+  }
+  if (candidates.is_empty())
+  {
+    return std::nullopt;
+  }
+
+  std::optional<Move> result;
+  for (auto const from_index : candidates)
+  {
+    Coordinates const from{from_index};
+    auto type = Move_type::normal;
+    if (is_en_passant)
+    {
+      type = Move_type::en_passant;
+    }
+    else if (promotion != Piece::empty)
+    {
+      type = Move_type::promotion;
+    }
+    else if (piece == Piece::pawn && std::abs(from.y() - to->y()) == 2)
+    {
+      type = Move_type::double_push;
+    }
+
+    Move const m{from, *to, piece, victim, promotion, type};
+    next = board;
+    next.move_no_verify(m, true);
+    if (next.is_in_check(color))
+    {
+      continue;
+    }
+    if (result)
+    {
+      // Ambiguous
+      return std::nullopt;
+    }
+    result = m;
+  }
+
+  if (result && candidates.occupancy() > 1)
+  {
+    // A later candidate that was illegal may have been tried after it
+    next = board;
+    next.move_no_verify(*result, true);
+  }
+  return result;
+}
+} // namespace
+
+double Pgn_replay_stats::games_per_second() const
+{
+  return (elapsed_seconds > 0) ? static_cast<double>(games) / elapsed_seconds : 0;
+}
+
+tl::expected<Pgn_reader, std::string> Pgn_reader::open(std::string const& filename)
+{
+  auto file = Memory_mapped_file::open(filename);
+  if (!file)
+  {
+    return tl::unexpected(file.error());
+  }
+
+  auto const data = file->get_data();
+  Pgn_reader result{std::string_view{reinterpret_cast<char const*>(data.data()), data.size()}};
+
+  // Moving the file doesn't move the mapping, so the games stay valid
+  result.m_file = std::move(*file);
+  return result;
+}
+
+Pgn_reader Pgn_reader::from_text(std::string_view text)
+{
+  return Pgn_reader{text};
+}
+
+Pgn_reader::Pgn_reader(std::string_view text) : m_games{split_games(text)}
+{
+}
+
+size_t Pgn_reader::get_game_count() const
+{
+  return m_games.size();
+}
+
+std::string_view Pgn_reader::get_game(size_t index) const
+{
+  MY_ASSERT(index < m_games.size(), "No such game");
+  return m_games[index];
+}
+
+Pgn_replay_stats Pgn_reader::replay(size_t thread_count, Pgn_ply_callback const& on_ply) const
+{
+  auto const start = std::chrono::steady_clock::now();
+
+  // Each thread takes the next game that no other thread has started
+  std::atomic<size_t> next_game{0};
+  std::atomic<size_t> failed_games{0};
+  std::atomic<size_t> total_plies{0};
+  auto const replay_games = [&]
+  {
+    std::vector<Pgn_tag> tags;
+    size_t failed{0};
+    size_t plies{0};
+    for (auto i = next_game.fetch_add(1); i < m_games.size(); i = next_game.fetch_add(1))
+    {
+      if (!replay_game_(m_games[i], i, on_ply, tags, plies))
+      {
+        ++failed;
+      }
+    }
+    failed_games += failed;
+    total_plies += plies;
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t thread_index{1}; thread_index < std::min(thread_count, m_games.size()); ++thread_index)
+  {
+    threads.emplace_back(replay_games);
+  }
+  replay_games();
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+  return {m_games.size(), failed_games, total_plies, elapsed.count()};
+}
+
+tl::expected<Board, std::string> Pgn_reader::replay_game(std::string_view game, Pgn_ply_callback const& on_ply)
+{
+  std::vector<Pgn_tag> tags;
+  size_t plies{0};
+  return replay_game_(game, 0, on_ply, tags, plies);
+}
+
+tl::expected<Board, std::string> Pgn_reader::replay_game_(std::string_view game,
+                                                          size_t game_index,
+                                                          Pgn_ply_callback const& on_ply,
+                                                          std::vector<Pgn_tag>& tags,
+                                                          size_t& plies)
+{
+  // Every tag is read before the first ply is reported
+  tags.clear();
+  auto index = game.find_first_not_of(c_whitespace);
+  while (index < game.size() && game[index] == '[')
+  {
+    auto const tag_end = read_tag(game, index, tags);
+    if (!tag_end)
+    {
+      return tl::unexpected("Badly formed tag in game " + std::to_string(game_index + 1));
+    }
+    index = game.find_first_not_of(c_whitespace, *tag_end);
+  }
+
+  Board first_board;
+  auto const fen_tag = std::ranges::find(tags, std::string_view{"FEN"}, &Pgn_tag::name);
+  if (fen_tag != tags.end())
+  {
+    auto const fen_board = Board::parse_fen(fen_tag->value);
+    if (!fen_board)
+    {
+      return tl::unexpected(std::string{get_fen_error_message(fen_board.error())});
+    }
+    first_board = *fen_board;
+  }
+
+  // Each move is made into the other board, then the two swap roles
+  Board second_board{first_board};
+  auto* board = &first_board;
+  auto* next = &second_board;
+  Move_list moves;
+  while (index < game.size())
+  {
+    switch (game[index])
+    {
+      case '{':
+        index = game.find('}', index);
+        index = (index == std::string_view::npos) ? game.size() : index + 1;
+        break;
+      case ';':
+        index = game.find('\n', index);
+        break;
+      case '(':
+        index = skip_variation(game, index);
+        break;
+      case '$': // Numeric annotation glyph
+        index = game.find_first_of(c_whitespace, index);
+        break;
+      default:
+      {
+        auto const token_end = std::min(game.find_first_of(c_token_end, index), game.size());
+        auto token = game.substr(index, token_end - index);
+        index = token_end;
+        if (is_game_result(token))
+        {
+          return *board;
+        }
+
+        // Drop a move number like "12." or "12..." and keep a move after it
+        if (auto const dots = token.find_first_not_of("0123456789");
+            dots != 0 && dots != std::string_view::npos && token[dots] == '.')
+        {
+          token.remove_prefix(std::min(token.find_first_not_of('.', dots), token.size()));
+        }
+        if (token.empty() || token.find_first_not_of('.') == std::string_view::npos)
+        {
+          break;
+        }
+
+        auto const m = find_san_move(*board, token, moves, *next);
+        if (!m)
+        {
+          return tl::unexpected("Illegal move " + std::string{token} + " in game " + std::to_string(game_index + 1));
+        }
+        if (on_ply)
+        {
+          on_ply({*board, *m, tags, game_index});
+        }
+        std::swap(board, next);
+        ++plies;
+        break;
+      }
+    }
+
+    index = game.find_first_not_of(c_whitespace, index);
+  }
+
+  return *board;
+}
+} // namespace Meneldor
@@ -0,0 +1,19 @@
+#include "piece_square_tables.h"
+#include "board.h"
+
+namespace Meneldor
+{
+Piece_square_score::Piece_square_score(Board const& board)
+{
+  for (auto const color : {Color::black, Color::white})
+  {
+    for (auto const piece : Zobrist_hash::piece_types)
+    {
+      for (auto const sq_index : board.get_piece_set(color, piece))
+      {
+        add_piece(color, piece, Coordinates{sq_index});
+      }
+    }
+  }
+}
+} // namespace Meneldor
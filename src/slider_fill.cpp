@@ -0,0 +1,225 @@
+#include "slider_fill.h"
+#include "cpu_features.h"
+#include "move_generator.h"
+
+#ifdef MENELDOR_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace Meneldor
+{
+namespace
+{
+// A ray direction as a shift of the board, positive shifts are to the left.
+// The wrap mask removes squares that a shift moved across the board's edge.
+struct Direction
+{
+  int32_t shift;
+  Bitboard wrap;
+};
+
+constexpr Bitboard c_not_a_file{~Bitboard_constants::a_file};
+constexpr Bitboard c_not_h_file{~Bitboard_constants::h_file};
+
+// North, south, east, west
+constexpr std::array<Direction, 4> c_orthogonal_directions{{
+  {8, Bitboard_constants::all},
+  {-8, Bitboard_constants::all},
+  {1, c_not_a_file},
+  {-1, c_not_h_file},
+}};
+
+// North east, north west, south east, south west
+constexpr std::array<Direction, 4> c_diagonal_directions{{
+  {9, c_not_a_file},
+  {7, c_not_h_file},
+  {-7, c_not_a_file},
+  {-9, c_not_h_file},
+}};
+
+constexpr Bitboard shift(Bitboard bb, int32_t distance)
+{
+  return (distance > 0) ? (bb << distance) : (bb >> -distance);
+}
+
+// Spreads the sliders along the direction until the ray hits a piece. The
+// ray covers 1, then 2, then 4 more squares each step, so 7 squares take 3.
+constexpr Bitboard occluded_fill(Bitboard sliders, Bitboard empty, Direction direction)
+{
+  auto propagators = empty & direction.wrap;
+  sliders |= propagators & shift(sliders, direction.shift);
+  propagators &= shift(propagators, direction.shift);
+  sliders |= propagators & shift(sliders, 2 * direction.shift);
+  propagators &= shift(propagators, 2 * direction.shift);
+  sliders |= propagators & shift(sliders, 4 * direction.shift);
+
+  // The fill includes the sliders but not the blockers, so shift once more
+  return shift(sliders, direction.shift) & direction.wrap;
+}
+
+constexpr Bitboard fill_directions(Bitboard sliders, Bitboard empty, std::array<Direction, 4> const& directions)
+{
+  Bitboard result;
+  for (auto const direction : directions)
+  {
+    result |= occluded_fill(sliders, empty, direction);
+  }
+  return result;
+}
+
+#ifdef MENELDOR_X86_SIMD
+// Each 64 bit lane of an AVX2 register holds one direction, and is shifted by
+// its own count. Counts of 64 or more give zero, so a left and a right shift
+// can be combined into one shift that goes either way.
+struct Lane_directions
+{
+  // Shift counts for the fill steps of 1, 2 and 4 squares
+  alignas(32) std::array<std::array<int64_t, 4>, 3> left;
+  alignas(32) std::array<std::array<int64_t, 4>, 3> right;
+  alignas(32) std::array<uint64_t, 4> wrap;
+};
+
+constexpr Lane_directions make_lane_directions(std::array<Direction, 4> const& directions)
+{
+  Lane_directions result{};
+  for (size_t step{0}; step < 3; ++step)
+  {
+    for (size_t i{0}; i < directions.size(); ++i)
+    {
+      auto const distance = directions[i].shift * (1 << step);
+      result.left[step][i] = (distance > 0) ? distance : 64;
+      result.right[step][i] = (distance > 0) ? 64 : -distance;
+      result.wrap[i] = directions[i].wrap.val;
+    }
+  }
+  return result;
+}
+
+constexpr Lane_directions c_orthogonal_lanes{make_lane_directions(c_orthogonal_directions)};
+constexpr Lane_directions c_diagonal_lanes{make_lane_directions(c_diagonal_directions)};
+
+template <typename T>
+__attribute__((target("avx2"))) __m256i load(T const& values)
+{
+  static_assert(sizeof(T) == sizeof(__m256i));
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  return _mm256_load_si256(reinterpret_cast<__m256i const*>(values.data()));
+}
+
+__attribute__((target("avx2"))) __m256i shift_lanes(__m256i value, Lane_directions const& directions, size_t step)
+{
+  return _mm256_or_si256(_mm256_sllv_epi64(value, load(directions.left[step])),
+                         _mm256_srlv_epi64(value, load(directions.right[step])));
+}
+
+// Same as occluded_fill, for four directions at once
+__attribute__((target("avx2"))) __m256i occluded_fill_avx2(__m256i sliders,
+                                                           __m256i empty,
+                                                           Lane_directions const& directions)
+{
+  auto const wrap = load(directions.wrap);
+  auto propagators = _mm256_and_si256(empty, wrap);
+  sliders = _mm256_or_si256(sliders, _mm256_and_si256(propagators, shift_lanes(sliders, directions, 0)));
+  propagators = _mm256_and_si256(propagators, shift_lanes(propagators, directions, 0));
+  sliders = _mm256_or_si256(sliders, _mm256_and_si256(propagators, shift_lanes(sliders, directions, 1)));
+  propagators = _mm256_and_si256(propagators, shift_lanes(propagators, directions, 1));
+  sliders = _mm256_or_si256(sliders, _mm256_and_si256(propagators, shift_lanes(sliders, directions, 2)));
+  return _mm256_and_si256(shift_lanes(sliders, directions, 0), wrap);
+}
+
+__attribute__((target("avx2"))) Bitboard or_lanes(__m256i value)
+{
+  auto const halves = _mm_or_si128(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+  return Bitboard{static_cast<uint64_t>(_mm_cvtsi128_si64(halves) | _mm_extract_epi64(halves, 1))};
+}
+
+__attribute__((target("avx2"))) __m256i broadcast(Bitboard bb)
+{
+  return _mm256_set1_epi64x(static_cast<int64_t>(bb.val));
+}
+#endif
+} // namespace
+
+Slider_group_attacks Slider_fill::get_group_attacks(Bitboard rooks,
+                                                    Bitboard bishops,
+                                                    Bitboard queens,
+                                                    Bitboard occupied)
+{
+  static bool const use_avx2 = has_avx2();
+  if (use_avx2)
+  {
+    return get_group_attacks_avx2(rooks, bishops, queens, occupied);
+  }
+  return get_group_attacks_scalar(rooks, bishops, queens, occupied);
+}
+
+Bitboard Slider_fill::get_attacks(Bitboard orthogonal_sliders, Bitboard diagonal_sliders, Bitboard occupied)
+{
+  static bool const use_avx2 = has_avx2();
+  if (use_avx2)
+  {
+    return get_attacks_avx2(orthogonal_sliders, diagonal_sliders, occupied);
+  }
+  auto const empty = ~occupied;
+  return fill_directions(orthogonal_sliders, empty, c_orthogonal_directions) |
+         fill_directions(diagonal_sliders, empty, c_diagonal_directions);
+}
+
+Slider_group_attacks Slider_fill::get_group_attacks_scalar(Bitboard rooks,
+                                                           Bitboard bishops,
+                                                           Bitboard queens,
+                                                           Bitboard occupied)
+{
+  auto const empty = ~occupied;
+  return {
+    fill_directions(rooks, empty, c_orthogonal_directions),
+    fill_directions(bishops, empty, c_diagonal_directions),
+    fill_directions(queens, empty, c_orthogonal_directions) | fill_directions(queens, empty, c_diagonal_directions),
+  };
+}
+
+#ifdef MENELDOR_X86_SIMD
+__attribute__((target("avx2"))) Slider_group_attacks Slider_fill::get_group_attacks_avx2(Bitboard rooks,
+                                                                                         Bitboard bishops,
+                                                                                         Bitboard queens,
+                                                                                         Bitboard occupied)
+{
+  auto const empty = broadcast(~occupied);
+  auto const queen_lines = occluded_fill_avx2(broadcast(queens), empty, c_orthogonal_lanes);
+  auto const queen_diagonals = occluded_fill_avx2(broadcast(queens), empty, c_diagonal_lanes);
+  return {
+    or_lanes(occluded_fill_avx2(broadcast(rooks), empty, c_orthogonal_lanes)),
+    or_lanes(occluded_fill_avx2(broadcast(bishops), empty, c_diagonal_lanes)),
+    or_lanes(_mm256_or_si256(queen_lines, queen_diagonals)),
+  };
+}
+
+__attribute__((target("avx2"))) Bitboard Slider_fill::get_attacks_avx2(Bitboard orthogonal_sliders,
+                                                                       Bitboard diagonal_sliders,
+                                                                       Bitboard occupied)
+{
+  auto const empty = broadcast(~occupied);
+  return or_lanes(_mm256_or_si256(occluded_fill_avx2(broadcast(orthogonal_sliders), empty, c_orthogonal_lanes),
+                                  occluded_fill_avx2(broadcast(diagonal_sliders), empty, c_diagonal_lanes)));
+}
+#else
+Bitboard Slider_fill::get_attacks_avx2(Bitboard orthogonal_sliders, Bitboard diagonal_sliders, Bitboard occupied)
+{
+  auto const attacks = get_group_attacks_scalar(orthogonal_sliders, diagonal_sliders, {}, occupied);
+  return attacks.rooks | attacks.bishops;
+}
+
+Slider_group_attacks Slider_fill::get_group_attacks_avx2(Bitboard rooks,
+                                                         Bitboard bishops,
+                                                         Bitboard queens,
+                                                         Bitboard occupied)
+{
+  return get_group_attacks_scalar(rooks, bishops, queens, occupied);
+}
+#endif
+
+bool Slider_fill::has_avx2()
+{
+  return Cpu_features::get().avx2;
+}
+} // namespace Meneldor
@@ -0,0 +1,1371 @@
+#include "syzygy.h"
+#include "board.h"
+#include "memory_mapped_file.h"
+#include "move_generator.h"
+
+// The file layout and the position indexing follow the reference probing code
+// at https://github.com/syzygy1/tb and its port in Stockfish.
+
+namespace rs = std::ranges;
+namespace Meneldor
+{
+namespace
+{
+constexpr size_t c_max_pieces{7};
+
+// Distance to zeroing in plies is stored in 18 bits at most
+constexpr int32_t c_max_dtz{1 << 18};
+
+#ifdef _WIN32
+constexpr char c_path_separator{';'};
+#else
+constexpr char c_path_separator{':'};
+#endif
+
+constexpr std::array<uint8_t, 4> c_wdl_magic{0x71, 0xE8, 0x23, 0x5D};
+constexpr std::array<uint8_t, 4> c_dtz_magic{0xD7, 0x66, 0x0C, 0xA5};
+
+enum class Table_type
+{
+  wdl,
+  dtz,
+};
+
+enum class Probe_state
+{
+  fail,
+  ok,
+
+  // The DTZ table only stores the other side to move
+  change_side_to_move,
+
+  // The best move is a capture or pawn move, so the DTZ table can't be trusted
+  zeroing_best_move,
+};
+
+// Flags stored for each sub-table
+constexpr uint8_t c_flag_side_to_move{1};
+constexpr uint8_t c_flag_mapped{2};
+constexpr uint8_t c_flag_win_plies{4};
+constexpr uint8_t c_flag_loss_plies{8};
+constexpr uint8_t c_flag_wide{16};
+constexpr uint8_t c_flag_single_value{128};
+
+// Syzygy numbers white's pawn to king as 1 to 6, black's pieces have bit 3 set
+constexpr uint8_t c_black_piece_bit{8};
+constexpr int32_t c_flip_ranks{56};
+constexpr int32_t c_flip_files{7};
+
+constexpr uint8_t piece_code(Color color, Piece piece)
+{
+  return static_cast<uint8_t>(static_cast<uint8_t>(piece) - static_cast<uint8_t>(Piece::pawn) + 1 +
+                              ((color == Color::black) ? c_black_piece_bit : 0));
+}
+
+constexpr int32_t file_of(int32_t square)
+{
+  return square & 7;
+}
+
+constexpr int32_t rank_of(int32_t square)
+{
+  return square >> 3;
+}
+
+// Negative below the a1-h8 diagonal, zero on it and positive above
+constexpr int32_t off_diagonal(int32_t square)
+{
+  return rank_of(square) - file_of(square);
+}
+
+constexpr int32_t flip_diagonal(int32_t square)
+{
+  return ((square >> 3) | (square << 3)) & 63;
+}
+
+constexpr Syzygy_wdl operator-(Syzygy_wdl wdl)
+{
+  return static_cast<Syzygy_wdl>(-static_cast<int8_t>(wdl));
+}
+
+template <typename T>
+T read_little_endian(uint8_t const* data)
+{
+  T result;
+  std::memcpy(&result, data, sizeof(T));
+  if constexpr (std::endian::native == std::endian::big)
+  {
+    result = std::byteswap(result);
+  }
+  return result;
+}
+
+template <typename T>
+T read_big_endian(uint8_t const* data)
+{
+  T result;
+  std::memcpy(&result, data, sizeof(T));
+  if constexpr (std::endian::native == std::endian::little)
+  {
+    result = std::byteswap(result);
+  }
+  return result;
+}
+
+// Lookup tables for turning piece squares into a table index
+struct Encoding_tables
+{
+  // a2-h7 to 0-47. The pawn with the highest value leads, which is the one
+  // closest to an edge file and then on the lowest rank.
+  std::array<int32_t, c_board_dimension_squared> map_pawns{};
+
+  // Squares below the a1-h8 diagonal to 0-27
+  std::array<int32_t, c_board_dimension_squared> map_b1h1h7{};
+
+  // The a1-d1-d4 triangle to 0-9, with the diagonal last
+  std::array<int32_t, c_board_dimension_squared> map_a1d1d4{};
+
+  // The 462 ways to place two kings with the first in the a1-d1-d4 triangle
+  std::array<std::array<int32_t, c_board_dimension_squared>, 10> map_kk{};
+
+  // Ways to choose k squares out of n
+  std::array<std::array<int32_t, c_board_dimension_squared>, c_max_pieces - 1> binomial{};
+
+  std::array<std::array<int32_t, c_board_dimension_squared>, c_max_pieces - 1> lead_pawn_index{};
+  std::array<std::array<int32_t, 4>, c_max_pieces - 1> lead_pawns_size{};
+
+  Encoding_tables()
+  {
+    int32_t code{0};
+    for (int32_t square{0}; square < c_board_dimension_squared; ++square)
+    {
+      if (off_diagonal(square) < 0)
+      {
+        map_b1h1h7[static_cast<size_t>(square)] = code++;
+      }
+    }
+
+    code = 0;
+    std::vector<int32_t> diagonal;
+    for (int32_t square{0}; square <= d4.square_index(); ++square)
+    {
+      if (file_of(square) > 3)
+      {
+        continue;
+      }
+      if (off_diagonal(square) < 0)
+      {
+        map_a1d1d4[static_cast<size_t>(square)] = code++;
+      }
+      else if (off_diagonal(square) == 0)
+      {
+        diagonal.push_back(square);
+      }
+    }
+    for (auto const square : diagonal)
+    {
+      map_a1d1d4[static_cast<size_t>(square)] = code++;
+    }
+
+    // If the first king is on the diagonal, the second one can't be above it.
+    // Positions with both kings on the diagonal come last.
+    code = 0;
+    std::vector<std::pair<size_t, size_t>> both_on_diagonal;
+    for (size_t index{0}; index < map_kk.size(); ++index)
+    {
+      for (int32_t first{0}; first <= d4.square_index(); ++first)
+      {
+        auto const first_index = static_cast<size_t>(map_a1d1d4[static_cast<size_t>(first)]);
+        if (first_index != index || (index == 0 && first != b1.square_index()))
+        {
+          continue;
+        }
+        for (int32_t second{0}; second < c_board_dimension_squared; ++second)
+        {
+          bool const touching = std::abs(file_of(first) - file_of(second)) <= 1 &&
+                                std::abs(rank_of(first) - rank_of(second)) <= 1;
+          if (touching || (off_diagonal(first) == 0 && off_diagonal(second) > 0))
+          {
+            continue;
+          }
+          if (off_diagonal(first) == 0 && off_diagonal(second) == 0)
+          {
+            both_on_diagonal.emplace_back(index, static_cast<size_t>(second));
+          }
+          else
+          {
+            map_kk[index][static_cast<size_t>(second)] = code++;
+          }
+        }
+      }
+    }
+    for (auto const& [index, second] : both_on_diagonal)
+    {
+      map_kk[index][second] = code++;
+    }
+
+    binomial[0][0] = 1;
+    for (size_t n{1}; n < c_board_dimension_squared; ++n)
+    {
+      for (size_t k{0}; k < binomial.size() && k <= n; ++k)
+      {
+        binomial[k][n] = ((k > 0) ? binomial[k - 1][n - 1] : 0) + ((k < n) ? binomial[k][n - 1] : 0);
+      }
+    }
+
+    // Every rank the leading pawn advances removes two squares the other
+    // pawns could be on, one on its file and one on the mirrored file
+    int32_t available_squares{47};
+    for (size_t lead_pawns{1}; lead_pawns < lead_pawn_index.size(); ++lead_pawns)
+    {
+      for (int32_t file{0}; file < 4; ++file)
+      {
+        int32_t index{0};
+        for (int32_t rank{1}; rank < c_board_dimension - 1; ++rank)
+        {
+          auto const square = static_cast<size_t>(rank * c_board_dimension + file);
+          if (lead_pawns == 1)
+          {
+            map_pawns[square] = available_squares--;
+            map_pawns[square ^ c_flip_files] = available_squares--;
+          }
+          lead_pawn_index[lead_pawns][square] = index;
+          index += binomial[lead_pawns - 1][static_cast<size_t>(map_pawns[square])];
+        }
+        lead_pawns_size[lead_pawns][static_cast<size_t>(file)] = index;
+      }
+    }
+  }
+};
+
+Encoding_tables const& encoding_tables()
+{
+  static Encoding_tables const tables;
+  return tables;
+}
+
+// Two 12 bit symbols packed into three bytes
+struct Symbol_pair
+{
+  std::array<uint8_t, 3> bytes;
+
+  uint16_t left() const
+  {
+    return static_cast<uint16_t>(((bytes[1] & 0xF) << 8) | bytes[0]);
+  }
+
+  uint16_t right() const
+  {
+    return static_cast<uint16_t>((bytes[2] << 4) | (bytes[1] >> 4));
+  }
+};
+
+static_assert(sizeof(Symbol_pair) == 3);
+
+constexpr uint16_t c_leaf_symbol{0xFFF};
+
+// One compressed sub-table, for one side to move and leading pawn file
+struct Pairs_data
+{
+  uint8_t flags{0};
+  size_t block_size{0};
+
+  // There is a sparse index entry about every span values
+  size_t span{0};
+  uint32_t block_count{0};
+  int32_t max_symbol_length{0};
+  int32_t min_symbol_length{0};
+  uint8_t const* lowest_symbols{nullptr};
+  Symbol_pair const* tree{nullptr};
+  uint8_t const* block_lengths{nullptr};
+  size_t block_lengths_size{0};
+  uint8_t const* sparse_index{nullptr};
+  size_t sparse_index_size{0};
+  uint8_t const* data{nullptr};
+  std::vector<uint64_t> base64;
+
+  // Number of values each symbol expands to, minus one
+  std::vector<uint8_t> symbol_lengths;
+
+  // The order pieces are encoded in, and the size of each group of them
+  std::array<uint8_t, c_max_pieces> pieces{};
+  std::array<uint64_t, c_max_pieces + 1> group_index{};
+  std::array<int32_t, c_max_pieces + 1> group_length{};
+
+  // Where each result's DTZ values start in the table's map
+  std::array<uint16_t, 4> map_index{};
+};
+
+constexpr size_t c_sparse_entry_size{6};
+
+// Decompresses the value at index idx
+int32_t decompress_pairs(Pairs_data const& d, uint64_t idx)
+{
+  // Every position has the same value
+  if (d.flags & c_flag_single_value)
+  {
+    return d.min_symbol_length;
+  }
+
+  // The sparse index points close to the block and offset holding idx
+  auto const k = static_cast<size_t>(idx / d.span);
+  auto block = read_little_endian<uint32_t>(d.sparse_index + k * c_sparse_entry_size);
+  int64_t offset = read_little_endian<uint16_t>(d.sparse_index + k * c_sparse_entry_size + 4);
+  offset += static_cast<int64_t>(idx % d.span) - static_cast<int64_t>(d.span / 2);
+
+  auto block_length = [&](uint32_t index)
+  {
+    return static_cast<int64_t>(read_little_endian<uint16_t>(d.block_lengths + index * sizeof(uint16_t)));
+  };
+  while (offset < 0)
+  {
+    offset += block_length(--block) + 1;
+  }
+  while (offset > block_length(block))
+  {
+    offset -= block_length(block++) + 1;
+  }
+
+  // Blocks are canonical Huffman codes. All codes of the same length are
+  // consecutive, so a code's length is found by comparing against base64.
+  auto const* ptr = d.data + static_cast<uint64_t>(block) * d.block_size;
+  auto buffer = read_big_endian<uint64_t>(ptr);
+  ptr += sizeof(uint64_t);
+  int32_t buffer_size{64};
+  uint16_t symbol{0};
+  while (true)
+  {
+    size_t length{0};
+    while (buffer < d.base64[length])
+    {
+      ++length;
+    }
+    symbol = static_cast<uint16_t>((buffer - d.base64[length]) >>
+                                   (64 - static_cast<int32_t>(length) - d.min_symbol_length));
+    symbol = static_cast<uint16_t>(symbol + read_little_endian<uint16_t>(d.lowest_symbols + length * sizeof(uint16_t)));
+    if (offset < d.symbol_lengths[symbol] + 1)
+    {
+      break;
+    }
+    offset -= d.symbol_lengths[symbol] + 1;
+
+    auto const bits = static_cast<int32_t>(length) + d.min_symbol_length;
+    buffer <<= bits;
+    buffer_size -= bits;
+    if (buffer_size <= 32)
+    {
+      buffer_size += 32;
+      buffer |= static_cast<uint64_t>(read_big_endian<uint32_t>(ptr)) << (64 - buffer_size);
+      ptr += sizeof(uint32_t);
+    }
+  }
+
+  // Symbols expand into pairs of symbols, find the leaf holding the offset
+  while (d.symbol_lengths[symbol] != 0)
+  {
+    auto const left = d.tree[symbol].left();
+    if (offset < d.symbol_lengths[left] + 1)
+    {
+      symbol = left;
+    }
+    else
+    {
+      offset -= d.symbol_lengths[left] + 1;
+      symbol = d.tree[symbol].right();
+    }
+  }
+  return d.tree[symbol].left();
+}
+
+uint8_t set_symbol_length(Pairs_data& d, uint16_t symbol, std::vector<bool>& visited)
+{
+  visited[symbol] = true;
+  auto const right = d.tree[symbol].right();
+  if (right == c_leaf_symbol)
+  {
+    return 0;
+  }
+  auto const left = d.tree[symbol].left();
+  if (!visited[left])
+  {
+    d.symbol_lengths[left] = set_symbol_length(d, left, visited);
+  }
+  if (!visited[right])
+  {
+    d.symbol_lengths[right] = set_symbol_length(d, right, visited);
+  }
+  return static_cast<uint8_t>(d.symbol_lengths[left] + d.symbol_lengths[right] + 1);
+}
+
+uint8_t const* set_sizes(Pairs_data& d, uint8_t const* data)
+{
+  d.flags = *data++;
+  if (d.flags & c_flag_single_value)
+  {
+    d.block_count = 0;
+    d.span = 0;
+    d.sparse_index_size = 0;
+    d.min_symbol_length = *data++; // The single value
+    return data;
+  }
+
+  auto const group_count = static_cast<size_t>(rs::find(d.group_length, 0) - d.group_length.begin());
+  auto const table_size = d.group_index[group_count];
+  d.block_size = size_t{1} << *data++;
+  d.span = size_t{1} << *data++;
+  d.sparse_index_size = static_cast<size_t>((table_size + d.span - 1) / d.span);
+  auto const padding = *data++;
+  d.block_count = read_little_endian<uint32_t>(data);
+  data += sizeof(uint32_t);
+
+  // Padded so the sparse index can't point past the end
+  d.block_lengths_size = d.block_count + padding;
+  d.max_symbol_length = *data++;
+  d.min_symbol_length = *data++;
+  d.lowest_symbols = data;
+
+  // Longer codes have lower values, so base64 is decreasing
+  d.base64.resize(static_cast<size_t>(d.max_symbol_length - d.min_symbol_length + 1));
+  for (auto i = static_cast<int32_t>(d.base64.size()) - 2; i >= 0; --i)
+  {
+    auto const index = static_cast<size_t>(i);
+    d.base64[index] = (d.base64[index + 1] + read_little_endian<uint16_t>(d.lowest_symbols + index * 2) -
+                       read_little_endian<uint16_t>(d.lowest_symbols + (index + 1) * 2)) /
+                      2;
+  }
+  for (size_t i{0}; i < d.base64.size(); ++i)
+  {
+    d.base64[i] <<= 64 - static_cast<int32_t>(i) - d.min_symbol_length;
+  }
+  data += d.base64.size() * sizeof(uint16_t);
+
+  d.symbol_lengths.resize(read_little_endian<uint16_t>(data));
+  data += sizeof(uint16_t);
+  d.tree = reinterpret_cast<Symbol_pair const*>(data);
+
+  std::vector<bool> visited(d.symbol_lengths.size());
+  for (size_t symbol{0}; symbol < d.symbol_lengths.size(); ++symbol)
+  {
+    if (!visited[symbol])
+    {
+      d.symbol_lengths[symbol] = set_symbol_length(d, static_cast<uint16_t>(symbol), visited);
+    }
+  }
+  return data + d.symbol_lengths.size() * sizeof(Symbol_pair) + (d.symbol_lengths.size() & 1);
+}
+
+uint8_t const* align(uint8_t const* data, uintptr_t alignment)
+{
+  auto const address = reinterpret_cast<uintptr_t>(data);
+  return data + (((address + alignment - 1) & ~(alignment - 1)) - address);
+}
+} // namespace
+
+// The same material can be stored with either color as the stronger side, so
+// a table has a key for each
+struct Syzygy_table
+{
+  struct File_data
+  {
+    std::string filename;
+    std::once_flag mapped;
+    std::optional<Memory_mapped_file> file;
+
+    // Start of the DTZ value map
+    uint8_t const* map{nullptr};
+
+    // Indexed by side to move, then leading pawn file
+    std::array<std::array<Pairs_data, 4>, 2> items;
+  };
+
+  std::string name;
+  uint64_t key{0};
+  uint64_t swapped_key{0};
+  int32_t piece_count{0};
+  bool has_pawns{false};
+  bool has_unique_pieces{false};
+
+  // Pawns of the leading color, then of the other color. When both sides have
+  // pawns the side with fewer leads.
+  std::array<int32_t, 2> pawn_count{};
+
+  File_data wdl;
+  File_data dtz;
+
+  File_data& get_file(Table_type type)
+  {
+    return (type == Table_type::wdl) ? wdl : dtz;
+  }
+
+  // DTZ tables only store one side to move
+  Pairs_data& get(Table_type type, int32_t side_to_move, int32_t file)
+  {
+    auto const side = (type == Table_type::wdl) ? static_cast<size_t>(side_to_move) : 0;
+    return get_file(type).items[side][static_cast<size_t>(has_pawns ? file : 0)];
+  }
+
+  void set_groups(Pairs_data& d, std::array<int32_t, 2> order, int32_t file) const
+  {
+    auto const& tables = encoding_tables();
+    size_t n{0};
+    auto first_length = has_pawns ? 0 : has_unique_pieces ? 3 : 2;
+    d.group_length[n] = 1;
+
+    // Groups of identical pieces are encoded together, the leading group
+    // also holds the kings and any unique piece
+    for (size_t i{1}; i < static_cast<size_t>(piece_count); ++i)
+    {
+      if (--first_length > 0 || d.pieces[i] == d.pieces[i - 1])
+      {
+        ++d.group_length[n];
+      }
+      else
+      {
+        d.group_length[++n] = 1;
+      }
+    }
+    d.group_length[++n] = 0;
+
+    // The order groups are encoded in is stored per table. The leading group
+    // is at order[0] and the other side's pawns, if any, at order[1].
+    bool const pawns_on_both_sides = has_pawns && pawn_count[1] != 0;
+    size_t next = pawns_on_both_sides ? 2 : 1;
+    auto free_squares = c_board_dimension_squared - d.group_length[0] - (pawns_on_both_sides ? d.group_length[1] : 0);
+    uint64_t index{1};
+    for (int32_t k{0}; next < n || k == order[0] || k == order[1]; ++k)
+    {
+      if (k == order[0])
+      {
+        d.group_index[0] = index;
+        index *= has_pawns ? static_cast<uint64_t>(tables.lead_pawns_size[static_cast<size_t>(d.group_length[0])]
+                                                                          [static_cast<size_t>(file)]) :
+                 has_unique_pieces ? 31'332 :
+                                     462;
+      }
+      else if (k == order[1])
+      {
+        d.group_index[1] = index;
+        index *= static_cast<uint64_t>(
+          tables.binomial[static_cast<size_t>(d.group_length[1])][static_cast<size_t>(48 - d.group_length[0])]);
+      }
+      else
+      {
+        d.group_index[next] = index;
+        index *= static_cast<uint64_t>(
+          tables.binomial[static_cast<size_t>(d.group_length[next])][static_cast<size_t>(free_squares)]);
+        free_squares -= d.group_length[next++];
+      }
+    }
+    d.group_index[n] = index;
+  }
+
+  uint8_t const* set_dtz_map(uint8_t const* data, int32_t max_file)
+  {
+    dtz.map = data;
+    for (int32_t file{0}; file <= max_file; ++file)
+    {
+      auto& d = get(Table_type::dtz, 0, file);
+      if (!(d.flags & c_flag_mapped))
+      {
+        continue;
+      }
+      if (d.flags & c_flag_wide)
+      {
+        data = align(data, 2);
+        for (auto& index : d.map_index)
+        {
+          index = static_cast<uint16_t>((data - dtz.map) / 2 + 1);
+          data += 2 * read_little_endian<uint16_t>(data) + 2;
+        }
+      }
+      else
+      {
+        for (auto& index : d.map_index)
+        {
+          index = static_cast<uint16_t>(data - dtz.map + 1);
+          data += *data + 1;
+        }
+      }
+    }
+    return align(data, 2);
+  }
+
+  void set(Table_type type, uint8_t const* data)
+  {
+    ++data; // Flags for splitting by side to move and pawns, known from the name
+    auto const sides = (type == Table_type::wdl && key != swapped_key) ? 2 : 1;
+    auto const max_file = has_pawns ? 3 : 0;
+    bool const pawns_on_both_sides = has_pawns && pawn_count[1] != 0;
+
+    for (int32_t file{0}; file <= max_file; ++file)
+    {
+      std::array<std::array<int32_t, 2>, 2> const order{{
+        {*data & 0xF, pawns_on_both_sides ? *(data + 1) & 0xF : 0xF},
+        {*data >> 4, pawns_on_both_sides ? *(data + 1) >> 4 : 0xF},
+      }};
+      data += 1 + (pawns_on_both_sides ? 1 : 0);
+
+      for (size_t k{0}; k < static_cast<size_t>(piece_count); ++k, ++data)
+      {
+        for (int32_t i{0}; i < sides; ++i)
+        {
+          get(type, i, file).pieces[k] = static_cast<uint8_t>(i ? *data >> 4 : *data & 0xF);
+        }
+      }
+      for (int32_t i{0}; i < sides; ++i)
+      {
+        set_groups(get(type, i, file), order[static_cast<size_t>(i)], file);
+      }
+    }
+    data = align(data, 2);
+
+    for (int32_t file{0}; file <= max_file; ++file)
+    {
+      for (int32_t i{0}; i < sides; ++i)
+      {
+        data = set_sizes(get(type, i, file), data);
+      }
+    }
+
+    if (type == Table_type::dtz)
+    {
+      data = set_dtz_map(data, max_file);
+    }
+
+    for (int32_t file{0}; file <= max_file; ++file)
+    {
+      for (int32_t i{0}; i < sides; ++i)
+      {
+        auto& d = get(type, i, file);
+        d.sparse_index = data;
+        data += d.sparse_index_size * c_sparse_entry_size;
+      }
+    }
+    for (int32_t file{0}; file <= max_file; ++file)
+    {
+      for (int32_t i{0}; i < sides; ++i)
+      {
+        auto& d = get(type, i, file);
+        d.block_lengths = data;
+        data += d.block_lengths_size * sizeof(uint16_t);
+      }
+    }
+    for (int32_t file{0}; file <= max_file; ++file)
+    {
+      for (int32_t i{0}; i < sides; ++i)
+      {
+        auto& d = get(type, i, file);
+        data = align(data, 64);
+        d.data = data;
+        data += d.block_count * d.block_size;
+      }
+    }
+  }
+
+  // Maps the file the first time it is needed. Safe to call from several threads.
+  bool map(Table_type type)
+  {
+    auto& file_data = get_file(type);
+    std::call_once(file_data.mapped,
+                   [&]
+                   {
+                     if (file_data.filename.empty())
+                     {
+                       return;
+                     }
+                     auto file = Memory_mapped_file::open(file_data.filename);
+                     if (!file)
+                     {
+                       return;
+                     }
+
+                     // Files are a 16 byte header followed by 64 byte aligned data
+                     auto const bytes = file->get_data();
+                     auto const& magic = (type == Table_type::wdl) ? c_wdl_magic : c_dtz_magic;
+                     if (bytes.size() % 64 != 16 ||
+                         std::memcmp(bytes.data(), magic.data(), magic.size()) != 0)
+                     {
+                       return;
+                     }
+
+                     file_data.file = std::move(*file);
+                     set(type, reinterpret_cast<uint8_t const*>(file_data.file->get_data().data()) + magic.size());
+                   });
+    return file_data.file.has_value();
+  }
+};
+
+namespace
+{
+using Table_map = std::unordered_map<uint64_t, Syzygy_table*>;
+
+int32_t map_score(Syzygy_table& table, Table_type type, int32_t file, int32_t value, Syzygy_wdl wdl)
+{
+  if (type == Table_type::wdl)
+  {
+    return value - 2;
+  }
+
+  constexpr std::array<size_t, 5> c_wdl_map{1, 3, 0, 2, 0};
+  auto const& d = table.get(Table_type::dtz, 0, file);
+  if (d.flags & c_flag_mapped)
+  {
+    auto const index = d.map_index[c_wdl_map[static_cast<size_t>(static_cast<int32_t>(wdl) + 2)]] +
+                       static_cast<size_t>(value);
+    value = (d.flags & c_flag_wide) ? read_little_endian<uint16_t>(table.dtz.map + index * sizeof(uint16_t)) :
+                                      table.dtz.map[index];
+  }
+
+  // Values are stored in moves unless the table says they are in plies
+  if ((wdl == Syzygy_wdl::win && !(d.flags & c_flag_win_plies)) ||
+      (wdl == Syzygy_wdl::loss && !(d.flags & c_flag_loss_plies)) || wdl == Syzygy_wdl::cursed_win ||
+      wdl == Syzygy_wdl::blessed_loss)
+  {
+    value *= 2;
+  }
+  return value + 1;
+}
+
+int32_t probe_table_index(Board const& board, Syzygy_table& table, Table_type type, Syzygy_wdl wdl, Probe_state& state)
+{
+  auto const& tables = encoding_tables();
+  auto const map_pawns_less = [&](int32_t lhs, int32_t rhs)
+  {
+    return tables.map_pawns[static_cast<size_t>(lhs)] < tables.map_pawns[static_cast<size_t>(rhs)];
+  };
+
+  std::array<int32_t, c_max_pieces> squares{};
+  std::array<uint8_t, c_max_pieces> pieces{};
+  size_t size{0};
+  size_t lead_pawn_count{0};
+  Bitboard lead_pawns;
+  int32_t file{0};
+
+  // Symmetric tables are only stored with white to move, and tables are
+  // stored with the stronger side as white. Either case is probed with the
+  // colors swapped and the board mirrored vertically.
+  auto const side_to_move = (board.get_active_color() == Color::white) ? 0 : 1;
+  bool const symmetric_black_to_move = table.key == table.swapped_key && side_to_move == 1;
+  bool const black_stronger = board.get_material_key().get_key() != table.key;
+  bool const swap_colors = symmetric_black_to_move || black_stronger;
+  auto const flip_color = swap_colors ? c_black_piece_bit : 0;
+  auto const flip_squares = swap_colors ? c_flip_ranks : 0;
+  auto const stm = (swap_colors ? 1 : 0) ^ side_to_move;
+
+  // Pawn tables are split by the file of the leading pawn
+  if (table.has_pawns)
+  {
+    auto const lead_code = static_cast<uint8_t>(table.get(type, 0, 0).pieces[0] ^ flip_color);
+    auto const lead_color = (lead_code & c_black_piece_bit) ? Color::black : Color::white;
+    lead_pawns = board.get_piece_set(lead_color, Piece::pawn);
+    for (auto const square : lead_pawns)
+    {
+      squares[size++] = square ^ flip_squares;
+    }
+    lead_pawn_count = size;
+    std::swap(squares[0], *std::max_element(squares.begin(), squares.begin() + static_cast<ptrdiff_t>(size),
+                                            map_pawns_less));
+    file = std::min(file_of(squares[0]), c_board_dimension - 1 - file_of(squares[0]));
+  }
+
+  if (type == Table_type::dtz)
+  {
+    auto const flags = table.get(type, stm, file).flags;
+    if ((flags & c_flag_side_to_move) != stm && !(table.key == table.swapped_key && !table.has_pawns))
+    {
+      state = Probe_state::change_side_to_move;
+      return 0;
+    }
+  }
+
+  for (auto const square : board.get_occupied_squares() & ~lead_pawns)
+  {
+    Coordinates const location{square};
+    squares[size] = square ^ flip_squares;
+    pieces[size++] =
+      static_cast<uint8_t>(piece_code(board.get_piece_color(location), board.get_piece(location)) ^ flip_color);
+  }
+  MY_ASSERT(size >= 2, "Both kings are on the board");
+
+  auto& d = table.get(type, stm, file);
+
+  // Put the pieces in the order the table encodes them in
+  for (auto i = lead_pawn_count; i + 1 < size; ++i)
+  {
+    for (auto j = i + 1; j < size; ++j)
+    {
+      if (d.pieces[i] == pieces[j])
+      {
+        std::swap(pieces[i], pieces[j]);
+        std::swap(squares[i], squares[j]);
+        break;
+      }
+    }
+  }
+
+  // The leading piece goes on the a-d files
+  if (file_of(squares[0]) > 3)
+  {
+    for (size_t i{0}; i < size; ++i)
+    {
+      squares[i] ^= c_flip_files;
+    }
+  }
+
+  uint64_t idx{0};
+  if (table.has_pawns)
+  {
+    idx = static_cast<uint64_t>(tables.lead_pawn_index[lead_pawn_count][static_cast<size_t>(squares[0])]);
+    std::stable_sort(squares.begin() + 1, squares.begin() + static_cast<ptrdiff_t>(lead_pawn_count), map_pawns_less);
+    for (size_t i{1}; i < lead_pawn_count; ++i)
+    {
+      idx += static_cast<uint64_t>(tables.binomial[i][static_cast<size_t>(tables.map_pawns[static_cast<size_t>(squares[i])])]);
+    }
+  }
+  else
+  {
+    // Without pawns the leading piece also goes on ranks 1-4, and below the
+    // a1-h8 diagonal if it can
+    if (rank_of(squares[0]) > 3)
+    {
+      for (size_t i{0}; i < size; ++i)
+      {
+        squares[i] ^= c_flip_ranks;
+      }
+    }
+    for (size_t i{0}; i < static_cast<size_t>(d.group_length[0]); ++i)
+    {
+      if (off_diagonal(squares[i]) == 0)
+      {
+        continue;
+      }
+      if (off_diagonal(squares[i]) > 0)
+      {
+        for (auto j = i; j < size; ++j)
+        {
+          squares[j] = flip_diagonal(squares[j]);
+        }
+      }
+      break;
+    }
+
+    auto const s0 = static_cast<size_t>(squares[0]);
+    auto const s1 = static_cast<size_t>(squares[1]);
+    auto const s2 = static_cast<size_t>(squares[2]);
+    if (table.has_unique_pieces)
+    {
+      // The kings and a unique piece are encoded together
+      auto const adjust1 = (squares[1] > squares[0]) ? 1 : 0;
+      auto const adjust2 = ((squares[2] > squares[0]) ? 1 : 0) + ((squares[2] > squares[1]) ? 1 : 0);
+      int64_t value{0};
+      if (off_diagonal(squares[0]) != 0)
+      {
+        value = (tables.map_a1d1d4[s0] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+      }
+      else if (off_diagonal(squares[1]) != 0)
+      {
+        value = (6 * 63 + rank_of(squares[0]) * 28 + tables.map_b1h1h7[s1]) * 62 + squares[2] - adjust2;
+      }
+      else if (off_diagonal(squares[2]) != 0)
+      {
+        value = 6 * 63 * 62 + 4 * 28 * 62 + rank_of(squares[0]) * 7 * 28 + (rank_of(squares[1]) - adjust1) * 28 +
+                tables.map_b1h1h7[s2];
+      }
+      else
+      {
+        value = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + rank_of(squares[0]) * 7 * 6 +
+                (rank_of(squares[1]) - adjust1) * 6 + (rank_of(squares[2]) - adjust2);
+      }
+      idx = static_cast<uint64_t>(value);
+    }
+    else
+    {
+      idx = static_cast<uint64_t>(tables.map_kk[static_cast<size_t>(tables.map_a1d1d4[s0])][s1]);
+    }
+  }
+
+  idx *= d.group_index[0];
+  auto group_start = static_cast<size_t>(d.group_length[0]);
+
+  // The other pawns, then the pieces, each group with squares in ascending
+  // order and skipping squares taken by earlier groups
+  bool remaining_pawns = table.has_pawns && table.pawn_count[1] != 0;
+  for (size_t next{1}; d.group_length[next] != 0; ++next)
+  {
+    auto const group_end = group_start + static_cast<size_t>(d.group_length[next]);
+    std::stable_sort(squares.begin() + static_cast<ptrdiff_t>(group_start),
+                     squares.begin() + static_cast<ptrdiff_t>(group_end));
+    uint64_t n{0};
+    for (auto i = group_start; i < group_end; ++i)
+    {
+      auto const adjust = std::count_if(squares.begin(), squares.begin() + static_cast<ptrdiff_t>(group_start),
+                                        [&](int32_t square)
+                                        {
+                                          return squares[i] > square;
+                                        });
+      auto const square = squares[i] - static_cast<int32_t>(adjust) - (remaining_pawns ? 8 : 0);
+      n += static_cast<uint64_t>(tables.binomial[i - group_start + 1][static_cast<size_t>(square)]);
+    }
+    remaining_pawns = false;
+    idx += n * d.group_index[next];
+    group_start = group_end;
+  }
+
+  return map_score(table, type, file, decompress_pairs(d, idx), wdl);
+}
+
+constexpr int32_t dtz_before_zeroing(Syzygy_wdl wdl)
+{
+  switch (wdl)
+  {
+    case Syzygy_wdl::win:
+      return 1;
+    case Syzygy_wdl::cursed_win:
+      return 101;
+    case Syzygy_wdl::blessed_loss:
+      return -101;
+    case Syzygy_wdl::loss:
+      return -1;
+    default:
+      return 0;
+  }
+}
+
+constexpr int32_t sign_of(int32_t value)
+{
+  return (value > 0) - (value < 0);
+}
+
+bool is_zeroing(Move move)
+{
+  return move.victim() != Piece::empty || move.type() == Move_type::en_passant || move.piece() == Piece::pawn;
+}
+
+bool is_capture(Move move)
+{
+  return move.victim() != Piece::empty || move.type() == Move_type::en_passant;
+}
+
+bool is_checkmate(Board const& board)
+{
+  return board.is_in_check(board.get_active_color()) && !Move_generator::has_any_legal_moves(board);
+}
+
+// Reads a table directly. The result may be wrong if the position has an en
+// passant square or a capture is the best move.
+int32_t probe_table(Table_map const& tables,
+                    Board const& board,
+                    Table_type type,
+                    Probe_state& state,
+                    Syzygy_wdl wdl = Syzygy_wdl::draw)
+{
+  if (board.get_occupied_squares().occupancy() == 2)
+  {
+    return static_cast<int32_t>(Syzygy_wdl::draw);
+  }
+
+  auto const it = tables.find(board.get_material_key().get_key());
+  if (it == tables.end() || !it->second->map(type))
+  {
+    state = Probe_state::fail;
+    return 0;
+  }
+  return probe_table_index(board, *it->second, type, wdl, state);
+}
+
+// Searches captures until the position is quiet, since tables don't store en
+// passant squares and may store any value when a capture is best. Pawn moves
+// are searched too when check_zeroing_moves is set.
+Syzygy_wdl search_wdl(Table_map const& tables, Board const& board, bool check_zeroing_moves, Probe_state& state)
+{
+  auto best = Syzygy_wdl::loss;
+  auto const moves = Move_generator::generate_legal_moves(board);
+  size_t move_count{0};
+  for (auto const move : moves)
+  {
+    if (!is_capture(move) && (!check_zeroing_moves || move.piece() != Piece::pawn))
+    {
+      continue;
+    }
+
+    ++move_count;
+    Board child{board};
+    child.move_no_verify(move);
+    auto const value = -search_wdl(tables, child, false, state);
+    if (state == Probe_state::fail)
+    {
+      return Syzygy_wdl::draw;
+    }
+    if (value > best)
+    {
+      best = value;
+      if (value >= Syzygy_wdl::win)
+      {
+        state = Probe_state::zeroing_best_move;
+        return value;
+      }
+    }
+  }
+
+  // If every legal move was searched the table isn't needed, which matters
+  // when a capture is the only way out of check
+  bool const no_more_moves = move_count != 0 && move_count == moves.size();
+  auto value = best;
+  if (!no_more_moves)
+  {
+    value = static_cast<Syzygy_wdl>(probe_table(tables, board, Table_type::wdl, state));
+    if (state == Probe_state::fail)
+    {
+      return Syzygy_wdl::draw;
+    }
+  }
+
+  if (best >= value)
+  {
+    state = (best > Syzygy_wdl::draw || no_more_moves) ? Probe_state::zeroing_best_move : Probe_state::ok;
+    return best;
+  }
+  state = Probe_state::ok;
+  return value;
+}
+
+int32_t probe_dtz(Table_map const& tables, Board const& board, Probe_state& state)
+{
+  state = Probe_state::ok;
+  auto const wdl = search_wdl(tables, board, true, state);
+  if (state == Probe_state::fail || wdl == Syzygy_wdl::draw)
+  {
+    return 0;
+  }
+
+  // The table may store anything when a capture or pawn move is best
+  if (state == Probe_state::zeroing_best_move)
+  {
+    return dtz_before_zeroing(wdl);
+  }
+
+  auto const dtz = probe_table(tables, board, Table_type::dtz, state, wdl);
+  if (state == Probe_state::fail)
+  {
+    return 0;
+  }
+  if (state != Probe_state::change_side_to_move)
+  {
+    bool const drawn_by_rule = wdl == Syzygy_wdl::blessed_loss || wdl == Syzygy_wdl::cursed_win;
+    return (dtz + (drawn_by_rule ? 100 : 0)) * sign_of(static_cast<int32_t>(wdl));
+  }
+
+  // The table only stores the other side to move, so look one move ahead
+  // for the move that keeps the result with the smallest distance
+  constexpr int32_t c_no_move{0xFFFF};
+  auto min_dtz = c_no_move;
+  for (auto const move : Move_generator::generate_legal_moves(board))
+  {
+    bool const zeroing = is_zeroing(move);
+    Board child{board};
+    child.move_no_verify(move);
+
+    // A zeroing move resets the distance, so the distance is the one before it
+    auto child_dtz =
+      zeroing ? -dtz_before_zeroing(search_wdl(tables, child, false, state)) : -probe_dtz(tables, child, state);
+    if (child_dtz == 1 && is_checkmate(child))
+    {
+      min_dtz = 1;
+    }
+    if (!zeroing)
+    {
+      child_dtz += sign_of(child_dtz);
+    }
+    if (child_dtz < min_dtz && sign_of(child_dtz) == sign_of(static_cast<int32_t>(wdl)))
+    {
+      min_dtz = child_dtz;
+    }
+    if (state == Probe_state::fail)
+    {
+      return 0;
+    }
+  }
+  return (min_dtz == c_no_move) ? -1 : min_dtz;
+}
+} // namespace
+
+Syzygy_tablebase::Syzygy_tablebase() = default;
+
+Syzygy_tablebase::~Syzygy_tablebase() = default;
+
+tl::expected<size_t, std::string> Syzygy_tablebase::load_paths(std::string const& paths)
+{
+  clear();
+
+  std::string_view remaining{paths};
+  while (!remaining.empty())
+  {
+    auto const separator = remaining.find(c_path_separator);
+    auto const directory = std::string{remaining.substr(0, separator)};
+    remaining = (separator == std::string_view::npos) ? std::string_view{} : remaining.substr(separator + 1);
+    if (directory.empty())
+    {
+      continue;
+    }
+
+    std::error_code error;
+    std::filesystem::directory_iterator files{directory, error};
+    if (error)
+    {
+      return tl::unexpected("Failed to open Syzygy directory " + directory + ": " + error.message());
+    }
+
+    for (auto const& file : files)
+    {
+      if (file.path().extension() != c_wdl_extension)
+      {
+        continue;
+      }
+
+      // Names look like KQPvKR, with the stronger side first
+      auto const name = file.path().stem().string();
+      auto const separator_index = name.find('v');
+      if (name.size() > c_max_pieces + 1 || separator_index == std::string::npos || name.front() != 'K' ||
+          name.size() <= separator_index + 1 || name[separator_index + 1] != 'K')
+      {
+        continue;
+      }
+
+      auto table = std::make_unique<Syzygy_table>();
+      table->name = name;
+      Material_key key;
+      Material_key swapped_key;
+      std::array<int32_t, 2> pawns{};
+      std::map<std::pair<Color, Piece>, int32_t> counts;
+      bool valid{true};
+      for (size_t i{0}; i < name.size(); ++i)
+      {
+        if (i == separator_index)
+        {
+          continue;
+        }
+        auto const color = (i < separator_index) ? Color::white : Color::black;
+        Piece piece{Piece::empty};
+        switch (name[i])
+        {
+          case 'K':
+            piece = Piece::king;
+            break;
+          case 'Q':
+            piece = Piece::queen;
+            break;
+          case 'R':
+            piece = Piece::rook;
+            break;
+          case 'B':
+            piece = Piece::bishop;
+            break;
+          case 'N':
+            piece = Piece::knight;
+            break;
+          case 'P':
+            piece = Piece::pawn;
+            break;
+          default:
+            valid = false;
+            break;
+        }
+        if (!valid)
+        {
+          break;
+        }
+
+        key.add_piece(color, piece);
+        swapped_key.add_piece(opposite_color(color), piece);
+        ++counts[{color, piece}];
+        ++table->piece_count;
+        if (piece == Piece::pawn)
+        {
+          ++pawns[(color == Color::white) ? 0 : 1];
+        }
+      }
+      if (!valid || m_tables_by_key.contains(key.get_key()))
+      {
+        continue;
+      }
+
+      table->key = key.get_key();
+      table->swapped_key = swapped_key.get_key();
+      table->has_pawns = pawns[0] + pawns[1] > 0;
+      table->has_unique_pieces = rs::any_of(counts,
+                                            [](auto const& entry)
+                                            {
+                                              return entry.first.second != Piece::king && entry.second == 1;
+                                            });
+
+      // When both sides have pawns, the side with fewer leads
+      bool const white_leads = pawns[1] == 0 || (pawns[0] != 0 && pawns[1] >= pawns[0]);
+      table->pawn_count = white_leads ? std::array{pawns[0], pawns[1]} : std::array{pawns[1], pawns[0]};
+
+      table->wdl.filename = file.path().string();
+      auto dtz_path = file.path();
+      dtz_path.replace_extension(c_dtz_extension);
+      if (std::filesystem::exists(dtz_path, error))
+      {
+        table->dtz.filename = dtz_path.string();
+      }
+
+      m_max_pieces = std::max(m_max_pieces, static_cast<size_t>(table->piece_count));
+      m_tables_by_key[table->key] = table.get();
+      m_tables_by_key[table->swapped_key] = table.get();
+      m_tables.push_back(std::move(table));
+    }
+  }
+
+  return m_tables.size();
+}
+
+void Syzygy_tablebase::clear()
+{
+  m_tables_by_key.clear();
+  m_tables.clear();
+  m_max_pieces = 0;
+}
+
+size_t Syzygy_tablebase::get_max_pieces() const
+{
+  return m_max_pieces;
+}
+
+bool Syzygy_tablebase::covers_(Board const& board) const
+{
+  return static_cast<size_t>(board.get_occupied_squares().occupancy()) <= m_max_pieces &&
+         board.get_castling_rights() == c_castling_rights_none;
+}
+
+std::optional<Syzygy_wdl> Syzygy_tablebase::probe_wdl(Board const& board) const
+{
+  if (!covers_(board))
+  {
+    return {};
+  }
+
+  auto state = Probe_state::ok;
+  auto const result = search_wdl(m_tables_by_key, board, false, state);
+  if (state == Probe_state::fail)
+  {
+    return {};
+  }
+  return result;
+}
+
+std::optional<int32_t> Syzygy_tablebase::probe_dtz(Board const& board) const
+{
+  if (!covers_(board))
+  {
+    return {};
+  }
+
+  auto state = Probe_state::ok;
+  auto const result = Meneldor::probe_dtz(m_tables_by_key, board, state);
+  if (state == Probe_state::fail)
+  {
+    return {};
+  }
+  return result;
+}
+
+std::optional<Move_list> Syzygy_tablebase::filter_root_moves(Board const& board, std::span<Move const> moves) const
+{
+  if (!covers_(board) || moves.empty())
+  {
+    return {};
+  }
+
+  // Wins that can be reached before the 50 move rule rank equally. Losses
+  // rank equally unless the 50 move rule may save them.
+  auto const halfmove_clock = static_cast<int32_t>(board.get_halfmove_clock());
+  auto rank_by_dtz = [&](Move move) -> std::optional<int32_t>
+  {
+    Board child{board};
+    child.move_no_verify(move);
+
+    auto state = Probe_state::ok;
+    int32_t dtz{0};
+    if (child.get_halfmove_clock() == 0)
+    {
+      dtz = dtz_before_zeroing(-search_wdl(m_tables_by_key, child, false, state));
+    }
+    else
+    {
+      dtz = -Meneldor::probe_dtz(m_tables_by_key, child, state);
+      dtz += sign_of(dtz);
+    }
+    if (state == Probe_state::fail)
+    {
+      return {};
+    }
+    if (dtz == 2 && is_checkmate(child))
+    {
+      dtz = 1;
+    }
+
+    if (dtz > 0)
+    {
+      return (dtz + halfmove_clock <= 99) ? c_max_dtz : c_max_dtz - (dtz + halfmove_clock);
+    }
+    if (dtz < 0)
+    {
+      return (-dtz * 2 + halfmove_clock < 100) ? -c_max_dtz : -c_max_dtz + (-dtz + halfmove_clock);
+    }
+    return 0;
+  };
+
+  // Without DTZ tables moves can only be ranked by their result
+  auto rank_by_wdl = [&](Move move) -> std::optional<int32_t>
+  {
+    constexpr std::array<int32_t, 5> c_wdl_ranks{-c_max_dtz, -c_max_dtz + 101, 0, c_max_dtz - 101, c_max_dtz};
+    Board child{board};
+    child.move_no_verify(move);
+
+    auto state = Probe_state::ok;
+    auto const wdl = -search_wdl(m_tables_by_key, child, false, state);
+    if (state == Probe_state::fail)
+    {
+      return {};
+    }
+    return c_wdl_ranks[static_cast<size_t>(static_cast<int32_t>(wdl) + 2)];
+  };
+
+  auto rank_moves = [&](auto const& rank_move) -> std::optional<std::vector<int32_t>>
+  {
+    std::vector<int32_t> ranks;
+    for (auto const move : moves)
+    {
+      auto const rank = rank_move(move);
+      if (!rank)
+      {
+        return {};
+      }
+      ranks.push_back(*rank);
+    }
+    return ranks;
+  };
+
+  auto ranks = rank_moves(rank_by_dtz);
+  if (!ranks)
+  {
+    ranks = rank_moves(rank_by_wdl);
+  }
+  if (!ranks)
+  {
+    return {};
+  }
+
+  auto const best_rank = rs::max(*ranks);
+  Move_list result;
+  for (size_t i{0}; i < moves.size(); ++i)
+  {
+    if ((*ranks)[i] == best_rank)
+    {
+      result.push_back(moves[i]);
+    }
+  }
+  return result;
+}
+} // namespace Meneldor
@@ -0,0 +1,433 @@
+// Computes the attack tables of the move generator and writes them out as a
+// source file, so they are compiled into the engine instead of being computed
+// at every startup.
+//
+// Usage: table_generator <output file>
+
+#include "move_generator.h"
+#include "slider_magics.h"
+
+namespace Meneldor
+{
+namespace
+{
+constexpr void update_if_in_bounds(Bitboard& bb, int x, int y)
+{
+  if (0 <= x && x < c_board_dimension && 0 <= y && y < c_board_dimension)
+  {
+    bb.set_square(Coordinates{x, y}.square_index());
+  }
+}
+
+int pop_1st_bit(uint64_t* bb)
+{
+  constexpr static std::array<int, 64> BitTable{63, 30, 3,  32, 25, 41, 22, 33, 15, 50, 42, 13, 11, 53, 19, 34,
+                                                61, 29, 2,  51, 21, 43, 45, 10, 18, 47, 1,  54, 9,  57, 0,  35,
+                                                62, 31, 40, 4,  49, 5,  52, 26, 60, 6,  23, 44, 46, 27, 56, 16,
+                                                7,  39, 48, 24, 59, 14, 12, 55, 38, 28, 58, 20, 37, 17, 36, 8};
+
+  uint64_t b = *bb ^ (*bb - 1);
+  auto fold = static_cast<uint32_t>((b & 0xffffffff) ^ (b >> 32));
+  *bb &= (*bb - 1);
+  return BitTable[(fold * 0x783a9b23) >> 26];
+}
+
+// Given a bitboard with n permutations (x one bits -> 2^x permutations),
+// returns the index'th permutation for the bitboard. Must be called n times to
+// generate every permutation.
+uint64_t blocker_permutation_from_index(int index, int bits, uint64_t m)
+{
+  uint64_t result = 0ULL;
+  for (int i = 0; i < bits; i++)
+  {
+    int j = pop_1st_bit(&m);
+    if (index & (1 << i))
+    {
+      result |= (1ULL << j);
+    }
+  }
+  return result;
+}
+
+// Returns the possible blockers mask for a rook on the given square
+// Outer squares are not possible blockers, unless the rook is on an outer
+// square. In that case, other pieces on the same row or column are potential
+// blockers.
+constexpr Bitboard rook_potential_blockers(int sq)
+{
+  Bitboard result{0ULL};
+  int rank = sq / 8;
+  int file = sq % 8;
+  for (int r = rank + 1; r <= 6; r++)
+  {
+    result |= (Bitboard{1ULL} << (file + r * 8));
+  }
+  for (int r = rank - 1; r >= 1; r--)
+  {
+    result |= (Bitboard{1ULL} << (file + r * 8));
+  }
+  for (int f = file + 1; f <= 6; f++)
+  {
+    result |= (Bitboard{1ULL} << (f + rank * 8));
+  }
+  for (int f = file - 1; f >= 1; f--)
+  {
+    result |= (Bitboard{1ULL} << (f + rank * 8));
+  }
+  return result;
+}
+
+// Returns the possible blockers mask for a bishop on the given square
+// Outer squares are not possible blockers for a bishop
+constexpr Bitboard bishop_potential_blockers(int sq)
+{
+  Bitboard result{0ULL};
+  int rank = sq / 8;
+  int file = sq % 8;
+  for (int r = rank + 1, f = file + 1; r <= 6 && f <= 6; r++, f++)
+  {
+    result |= (Bitboard{1ULL} << (f + r * 8));
+  }
+  for (int r = rank + 1, f = file - 1; r <= 6 && f >= 1; r++, f--)
+  {
+    result |= (Bitboard{1ULL} << (f + r * 8));
+  }
+  for (int r = rank - 1, f = file + 1; r >= 1 && f <= 6; r--, f++)
+  {
+    result |= (Bitboard{1ULL} << (f + r * 8));
+  }
+  for (int r = rank - 1, f = file - 1; r >= 1 && f >= 1; r--, f--)
+  {
+    result |= (Bitboard{1ULL} << (f + r * 8));
+  }
+  return result;
+}
+
+constexpr Bitboard rook_attacked_squares(int sq, uint64_t block)
+{
+  Bitboard result{0ULL};
+  int rk = sq / 8, fl = sq % 8;
+  for (int r = rk + 1; r <= 7; r++)
+  {
+    result |= (Bitboard{1ULL} << (fl + r * 8));
+    if (block & (1ULL << (fl + r * 8)))
+    {
+      break;
+    }
+  }
+  for (int r = rk - 1; r >= 0; r--)
+  {
+    result |= (Bitboard{1ULL} << (fl + r * 8));
+    if (block & (1ULL << (fl + r * 8)))
+    {
+      break;
+    }
+  }
+  for (int f = fl + 1; f <= 7; f++)
+  {
+    result |= (Bitboard{1ULL} << (f + rk * 8));
+    if (block & (1ULL << (f + rk * 8)))
+    {
+      break;
+    }
+  }
+  for (int f = fl - 1; f >= 0; f--)
+  {
+    result |= (Bitboard{1ULL} << (f + rk * 8));
+    if (block & (1ULL << (f + rk * 8)))
+    {
+      break;
+    }
+  }
+  return result;
+}
+
+constexpr Bitboard bishop_attacked_squares(int sq, uint64_t block)
+{
+  Bitboard result{0ULL};
+  int rk = sq / 8, fl = sq % 8;
+  for (int r = rk + 1, f = fl + 1; r <= 7 && f <= 7; r++, f++)
+  {
+    result |= (Bitboard{1ULL} << (f + r * 8));
+    if (block & (1ULL << (f + r * 8)))
+    {
+      break;
+    }
+  }
+  for (int r = rk + 1, f = fl - 1; r <= 7 && f >= 0; r++, f--)
+  {
+    result |= (Bitboard{1ULL} << (f + r * 8));
+    if (block & (1ULL << (f + r * 8)))
+    {
+      break;
+    }
+  }
+  for (int r = rk - 1, f = fl + 1; r >= 0 && f <= 7; r--, f++)
+  {
+    result |= (Bitboard{1ULL} << (f + r * 8));
+    if (block & (1ULL << (f + r * 8)))
+    {
+      break;
+    }
+  }
+  for (int r = rk - 1, f = fl - 1; r >= 0 && f >= 0; r--, f--)
+  {
+    result |= (Bitboard{1ULL} << (f + r * 8));
+    if (block & (1ULL << (f + r * 8)))
+    {
+      break;
+    }
+  }
+  return result;
+}
+
+void initialize_lines(Move_generator::Tables& tables)
+{
+  for (int from{0}; from < c_board_dimension_squared; ++from)
+  {
+    for (int to{0}; to < c_board_dimension_squared; ++to)
+    {
+      if (from == to)
+      {
+        continue;
+      }
+
+      auto const from_bb = Bitboard{1ULL} << from;
+      auto const to_bb = Bitboard{1ULL} << to;
+      if (rook_attacked_squares(from, 0).is_set(Coordinates{to}))
+      {
+        tables.squares_between[from][to] =
+          rook_attacked_squares(from, to_bb.val) & rook_attacked_squares(to, from_bb.val);
+        tables.line_through[from][to] =
+          (rook_attacked_squares(from, 0) & rook_attacked_squares(to, 0)) | from_bb | to_bb;
+      }
+      else if (bishop_attacked_squares(from, 0).is_set(Coordinates{to}))
+      {
+        tables.squares_between[from][to] =
+          bishop_attacked_squares(from, to_bb.val) & bishop_attacked_squares(to, from_bb.val);
+        tables.line_through[from][to] =
+          (bishop_attacked_squares(from, 0) & bishop_attacked_squares(to, 0)) | from_bb | to_bb;
+      }
+    }
+  }
+}
+
+void init_bishop_magic_tables(Move_generator::Tables& tables, int index)
+{
+  // Based on code from: https://www.chessprogramming.org/Looking_for_Magics
+  // (The plain implementation)
+
+  Bitboard possible_blockers = bishop_potential_blockers(index);
+  tables.bishop_possible_blockers[index] = possible_blockers;
+
+  // Populate blockers table
+  int n = possible_blockers.occupancy();
+  tables.bishop_blocker_counts[index] = static_cast<uint8_t>(n);
+  auto blocker_permutations = (1 << n);
+
+  for (int i = 0; i < blocker_permutations; ++i)
+  {
+    auto blockers = blocker_permutation_from_index(i, n, possible_blockers.val);
+
+    int shift = 9;
+    auto key = magic_hash_fn(blockers, c_bishop_magics[index], shift);
+    auto attacked_squares = bishop_attacked_squares(index, blockers);
+    tables.bishop_attacks[index][key] = attacked_squares;
+
+    // The permutations are in the order pext extracts the blockers in
+    auto const fancy_key = fancy_magic_hash_fn(blockers, c_bishop_fancy_magics[index], n);
+    tables.bishop_fancy_attacks[tables.bishop_offsets[index] + fancy_key] = attacked_squares;
+    tables.bishop_pext_attacks[tables.bishop_offsets[index] + i] = attacked_squares;
+  }
+
+  if (index + 1 < c_board_dimension_squared)
+  {
+    tables.bishop_offsets[index + 1] = tables.bishop_offsets[index] + blocker_permutations;
+  }
+}
+
+void init_rook_magic_tables(Move_generator::Tables& tables, int index)
+{
+  // Based on code from: https://www.chessprogramming.org/Looking_for_Magics
+  // (The plain implementation)
+
+  Bitboard possible_blockers = rook_potential_blockers(index);
+  tables.rook_possible_blockers[index] = possible_blockers;
+
+  // Populate blockers table
+  int n = possible_blockers.occupancy();
+  tables.rook_blocker_counts[index] = static_cast<uint8_t>(n);
+  auto blocker_permutations = (1 << n);
+
+  for (int i = 0; i < blocker_permutations; ++i)
+  {
+    auto blockers = blocker_permutation_from_index(i, n, possible_blockers.val);
+
+    int shift = 12;
+    auto key = magic_hash_fn(blockers, c_rook_magics[index], shift);
+    auto attacked_squares = rook_attacked_squares(index, blockers);
+    tables.rook_attacks[index][key] = attacked_squares;
+
+    auto const fancy_key = fancy_magic_hash_fn(blockers, c_rook_fancy_magics[index], n);
+    tables.rook_fancy_attacks[tables.rook_offsets[index] + fancy_key] = attacked_squares;
+    tables.rook_pext_attacks[tables.rook_offsets[index] + i] = attacked_squares;
+  }
+
+  if (index + 1 < c_board_dimension_squared)
+  {
+    tables.rook_offsets[index + 1] = tables.rook_offsets[index] + blocker_permutations;
+  }
+}
+
+void initialize_knight_attacks(Move_generator::Tables& tables)
+{
+  for (int8_t x{0}; x < c_board_dimension; ++x)
+  {
+    for (int8_t y{0}; y < c_board_dimension; ++y)
+    {
+      auto square_index = Coordinates{x, y}.square_index();
+      auto& bb = tables.knight_attacks[square_index];
+
+      update_if_in_bounds(bb, x + 1, y + 2);
+      update_if_in_bounds(bb, x - 1, y + 2);
+      update_if_in_bounds(bb, x + 1, y - 2);
+      update_if_in_bounds(bb, x - 1, y - 2);
+      update_if_in_bounds(bb, x + 2, y + 1);
+      update_if_in_bounds(bb, x - 2, y + 1);
+      update_if_in_bounds(bb, x + 2, y - 1);
+      update_if_in_bounds(bb, x - 2, y - 1);
+    }
+  }
+}
+
+void initialize_king_attacks(Move_generator::Tables& tables)
+{
+  for (int8_t x{0}; x < c_board_dimension; ++x)
+  {
+    for (int8_t y{0}; y < c_board_dimension; ++y)
+    {
+      auto square_index = Coordinates{x, y}.square_index();
+      auto& bb = tables.king_attacks[square_index];
+
+      for (int i = -1; i <= 1; ++i)
+      {
+        for (int j = -1; j <= 1; ++j)
+        {
+          if (i != 0 || j != 0)
+          {
+            update_if_in_bounds(bb, x + i, y + j);
+          }
+        }
+      }
+    }
+  }
+}
+
+void fill_tables(Move_generator::Tables& tables)
+{
+  initialize_knight_attacks(tables);
+  initialize_king_attacks(tables);
+  for (int sq{0}; sq < c_board_dimension_squared; ++sq)
+  {
+    init_bishop_magic_tables(tables, sq);
+    init_rook_magic_tables(tables, sq);
+  }
+  initialize_lines(tables);
+}
+
+void write_value(std::ostream& os, Bitboard bb)
+{
+  if (bb.is_empty())
+  {
+    os << "Bitboard{}";
+  }
+  else
+  {
+    os << "Bitboard{0x" << std::hex << bb.val << std::dec << "ULL}";
+  }
+}
+
+template <typename T>
+  requires std::is_integral_v<T>
+void write_value(std::ostream& os, T value)
+{
+  os << static_cast<uint64_t>(value);
+}
+
+// Fully braced, nested std::arrays don't allow the braces to be left out
+template <typename T, size_t size>
+void write_value(std::ostream& os, std::array<T, size> const& values)
+{
+  constexpr size_t c_values_per_line{8};
+  os << "{{";
+  for (size_t i{0}; i < size; ++i)
+  {
+    if (i % c_values_per_line == 0)
+    {
+      os << "\n";
+    }
+    write_value(os, values[i]);
+    os << ",";
+  }
+  os << "}}";
+}
+
+template <typename T>
+void write_member(std::ostream& os, std::string_view name, T const& value)
+{
+  os << "  ." << name << " = ";
+  write_value(os, value);
+  os << ",\n";
+}
+
+void write_tables(std::ostream& os, Move_generator::Tables const& tables)
+{
+  os << "// Generated by table_generator, don't edit\n\n"
+     << "#include \"move_generator.h\"\n\n"
+     << "namespace Meneldor\n{\n"
+     << "constinit Move_generator::Tables const Move_generator::m_tables{\n";
+  write_member(os, "knight_attacks", tables.knight_attacks);
+  write_member(os, "king_attacks", tables.king_attacks);
+  write_member(os, "bishop_possible_blockers", tables.bishop_possible_blockers);
+  write_member(os, "rook_possible_blockers", tables.rook_possible_blockers);
+  write_member(os, "bishop_attacks", tables.bishop_attacks);
+  write_member(os, "rook_attacks", tables.rook_attacks);
+  write_member(os, "bishop_offsets", tables.bishop_offsets);
+  write_member(os, "rook_offsets", tables.rook_offsets);
+  write_member(os, "bishop_blocker_counts", tables.bishop_blocker_counts);
+  write_member(os, "rook_blocker_counts", tables.rook_blocker_counts);
+  write_member(os, "bishop_fancy_attacks", tables.bishop_fancy_attacks);
+  write_member(os, "rook_fancy_attacks", tables.rook_fancy_attacks);
+  write_member(os, "bishop_pext_attacks", tables.bishop_pext_attacks);
+  write_member(os, "rook_pext_attacks", tables.rook_pext_attacks);
+  write_member(os, "squares_between", tables.squares_between);
+  write_member(os, "line_through", tables.line_through);
+  os << "};\n} // namespace Meneldor\n";
+}
+} // namespace
+} // namespace Meneldor
+
+int main(int argc, char* argv[])
+{
+  using namespace Meneldor;
+
+  if (argc != 2)
+  {
+    std::cerr << "Usage: table_generator <output file>\n";
+    return -1;
+  }
+
+  // Too large for the stack
+  auto const tables = std::make_unique<Move_generator::Tables>();
+  fill_tables(*tables);
+
+  std::ofstream file{argv[1]};
+  write_tables(file, *tables);
+  file.close();
+  if (!file)
+  {
+    std::cerr << "Couldn't write " << argv[1] << "\n";
+    return -1;
+  }
+  return 0;
+}
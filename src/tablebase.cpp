@@ -0,0 +1,533 @@
+#include "tablebase.h"
+#include "move_generator.h"
+
+namespace rs = std::ranges;
+namespace Meneldor
+{
+namespace
+{
+// Strongest first. Tables list each side's pieces in this order.
+constexpr std::array c_pieces_by_strength{Piece::queen, Piece::rook, Piece::bishop, Piece::knight, Piece::pawn};
+constexpr std::string_view c_piece_letters{"QRBNP"};
+
+constexpr std::array<char, 8> c_file_magic{'M', 'E', 'N', 'E', 'L', 'T', 'B', '1'};
+
+struct File_header
+{
+  std::array<char, 8> magic{};
+  std::array<char, 16> name{};
+  uint64_t size{0};
+};
+
+// With no pawns the board can be flipped and rotated so the white king is in
+// the a1-d1-d4 triangle. Pawns only move one way, so only mirroring across
+// the middle files is allowed.
+constexpr size_t c_pawnless_king_squares{10};
+constexpr size_t c_pawn_king_squares{32};
+constexpr int32_t c_half_board{c_board_dimension / 2};
+
+constexpr std::array<int8_t, c_board_dimension_squared> make_triangle_indices()
+{
+  std::array<int8_t, c_board_dimension_squared> result{};
+  rs::fill(result, -1);
+  int8_t next_index{0};
+  for (int32_t y{0}; y < c_half_board; ++y)
+  {
+    for (int32_t x{y}; x < c_half_board; ++x)
+    {
+      result[Coordinates{x, y}.square_index()] = next_index++;
+    }
+  }
+  return result;
+}
+
+constexpr std::array<int8_t, c_board_dimension_squared> c_triangle_indices{make_triangle_indices()};
+
+constexpr std::array<uint8_t, c_pawnless_king_squares> make_triangle_squares()
+{
+  std::array<uint8_t, c_pawnless_king_squares> result{};
+  for (size_t square{0}; square < c_triangle_indices.size(); ++square)
+  {
+    if (c_triangle_indices[square] >= 0)
+    {
+      result[static_cast<size_t>(c_triangle_indices[square])] = static_cast<uint8_t>(square);
+    }
+  }
+  return result;
+}
+
+constexpr std::array<uint8_t, c_pawnless_king_squares> c_triangle_squares{make_triangle_squares()};
+
+constexpr Coordinates mirror_vertically(Coordinates location)
+{
+  return {location.x(), c_board_dimension - 1 - location.y()};
+}
+
+int32_t strength_rank(char letter)
+{
+  return static_cast<int32_t>(c_piece_letters.find(letter));
+}
+
+// Compares the pieces of two sides, without their kings
+bool is_stronger_or_equal(std::string_view first, std::string_view second)
+{
+  if (first.size() != second.size())
+  {
+    return first.size() > second.size();
+  }
+  for (size_t i{0}; i < first.size(); ++i)
+  {
+    if (first[i] != second[i])
+    {
+      return strength_rank(first[i]) < strength_rank(second[i]);
+    }
+  }
+  return true;
+}
+
+std::string side_pieces(Material_key key, Color color)
+{
+  std::string result;
+  for (size_t i{0}; i < c_pieces_by_strength.size(); ++i)
+  {
+    result.append(static_cast<size_t>(key.count(color, c_pieces_by_strength[i])), c_piece_letters[i]);
+  }
+  return result;
+}
+
+size_t count_pawns(std::string_view name)
+{
+  return static_cast<size_t>(rs::count(name, 'P'));
+}
+} // namespace
+
+tl::expected<Tablebase_table, std::string> Tablebase_table::from_name_(std::string_view name)
+{
+  auto const separator = name.find('v');
+  if (name.size() < 4 || name.front() != 'K' || separator == std::string_view::npos ||
+      separator + 1 >= name.size() || name[separator + 1] != 'K')
+  {
+    return tl::unexpected("Invalid table name: " + std::string{name});
+  }
+
+  auto const white_pieces = name.substr(1, separator - 1);
+  auto const black_pieces = name.substr(separator + 2);
+  if (white_pieces.size() + black_pieces.size() + 2 > c_max_pieces ||
+      white_pieces.size() + black_pieces.size() == 0)
+  {
+    return tl::unexpected("Tables must have three or four pieces: " + std::string{name});
+  }
+  if (!is_stronger_or_equal(white_pieces, black_pieces))
+  {
+    return tl::unexpected("The stronger side must be white: " + std::string{name});
+  }
+
+  Tablebase_table result;
+  result.m_name = name;
+  for (auto const& [color, pieces] : {std::pair{Color::white, white_pieces}, std::pair{Color::black, black_pieces}})
+  {
+    for (auto const letter : pieces)
+    {
+      auto const rank = strength_rank(letter);
+      if (rank < 0)
+      {
+        return tl::unexpected("Invalid piece in table name: " + std::string{name});
+      }
+      result.m_pieces.emplace_back(color, c_pieces_by_strength[static_cast<size_t>(rank)]);
+    }
+    if (!rs::is_sorted(pieces, {}, strength_rank))
+    {
+      return tl::unexpected("Pieces must be listed strongest first: " + std::string{name});
+    }
+  }
+
+  result.m_has_pawns = count_pawns(name) > 0;
+  result.m_size = 2 * (result.m_has_pawns ? c_pawn_king_squares : c_pawnless_king_squares);
+  for (size_t i{1}; i < result.get_piece_count(); ++i)
+  {
+    result.m_size *= c_board_dimension_squared;
+  }
+  return result;
+}
+
+tl::expected<Tablebase_table, std::string> Tablebase_table::create(std::string_view name)
+{
+  auto result = from_name_(name);
+  if (result)
+  {
+    result->m_owned_values.resize(result->m_size, c_draw);
+    result->m_values = result->m_owned_values;
+  }
+  return result;
+}
+
+tl::expected<Tablebase_table, std::string> Tablebase_table::load(std::string const& filename)
+{
+  auto file = Memory_mapped_file::open(filename);
+  if (!file)
+  {
+    return tl::unexpected(file.error());
+  }
+
+  auto const data = file->get_data();
+  File_header header;
+  if (data.size() < sizeof(header))
+  {
+    return tl::unexpected("Tablebase file is too small: " + filename);
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != c_file_magic)
+  {
+    return tl::unexpected("Not a tablebase file: " + filename);
+  }
+
+  auto const name_length = static_cast<size_t>(rs::find(header.name, '\0') - header.name.begin());
+  auto result = from_name_(std::string_view{header.name.data(), name_length});
+  if (!result)
+  {
+    return result;
+  }
+  if (header.size != result->m_size || data.size() != sizeof(header) + result->m_size)
+  {
+    return tl::unexpected("Tablebase file has the wrong size: " + filename);
+  }
+
+  result->m_values = {reinterpret_cast<uint8_t const*>(data.data() + sizeof(header)), result->m_size};
+  result->m_file = std::move(*file);
+  return result;
+}
+
+tl::expected<void, std::string> Tablebase_table::save(std::string const& filename) const
+{
+  File_header header;
+  header.magic = c_file_magic;
+  rs::copy(m_name, header.name.begin());
+  header.size = m_size;
+
+  std::ofstream out{filename, std::ios::binary};
+  out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  out.write(reinterpret_cast<char const*>(m_values.data()), static_cast<std::streamsize>(m_values.size()));
+  if (!out)
+  {
+    return tl::unexpected("Failed to write " + filename);
+  }
+  return {};
+}
+
+std::string const& Tablebase_table::get_name() const
+{
+  return m_name;
+}
+
+size_t Tablebase_table::get_piece_count() const
+{
+  return m_pieces.size() + 2;
+}
+
+std::span<std::pair<Color, Piece> const> Tablebase_table::get_pieces() const
+{
+  return m_pieces;
+}
+
+bool Tablebase_table::has_pawns() const
+{
+  return m_has_pawns;
+}
+
+size_t Tablebase_table::size() const
+{
+  return m_size;
+}
+
+size_t Tablebase_table::index_of(Tablebase_position position) const
+{
+  auto const piece_count = get_piece_count();
+  auto const white_king = position.squares[0];
+  bool const flip_horizontally = white_king.x() >= c_half_board;
+  bool const flip_vertically = !m_has_pawns && white_king.y() >= c_half_board;
+
+  auto transform = [&](Coordinates location)
+  {
+    auto x = flip_horizontally ? c_board_dimension - 1 - location.x() : location.x();
+    auto y = flip_vertically ? c_board_dimension - 1 - location.y() : location.y();
+    return Coordinates{x, y};
+  };
+  for (size_t i{0}; i < piece_count; ++i)
+  {
+    position.squares[i] = transform(position.squares[i]);
+  }
+
+  size_t king_index{0};
+  if (m_has_pawns)
+  {
+    king_index = static_cast<size_t>(position.squares[0].y() * c_half_board + position.squares[0].x());
+  }
+  else
+  {
+    // Reflect across the a1-h8 diagonal so the king is on or below it
+    if (position.squares[0].y() > position.squares[0].x())
+    {
+      for (size_t i{0}; i < piece_count; ++i)
+      {
+        position.squares[i] = Coordinates{position.squares[i].y(), position.squares[i].x()};
+      }
+    }
+    king_index = static_cast<size_t>(c_triangle_indices[position.squares[0].square_index()]);
+  }
+
+  auto const king_squares = m_has_pawns ? c_pawn_king_squares : c_pawnless_king_squares;
+  auto index = static_cast<size_t>(position.side_to_move) * king_squares + king_index;
+  for (size_t i{1}; i < piece_count; ++i)
+  {
+    index = index * c_board_dimension_squared + static_cast<size_t>(position.squares[i].square_index());
+  }
+  MY_ASSERT(index < m_size, "Index out of range");
+  return index;
+}
+
+Tablebase_position Tablebase_table::position_at(size_t index) const
+{
+  MY_ASSERT(index < m_size, "Index out of range");
+  Tablebase_position result;
+  for (auto i = get_piece_count() - 1; i > 0; --i)
+  {
+    result.squares[i] = Coordinates{static_cast<int32_t>(index % c_board_dimension_squared)};
+    index /= c_board_dimension_squared;
+  }
+
+  auto const king_squares = m_has_pawns ? c_pawn_king_squares : c_pawnless_king_squares;
+  auto const king_index = static_cast<int32_t>(index % king_squares);
+  result.squares[0] = m_has_pawns ? Coordinates{king_index % c_half_board, king_index / c_half_board} :
+                                    Coordinates{c_triangle_squares[static_cast<size_t>(king_index)]};
+  result.side_to_move = static_cast<Color>(index / king_squares);
+  return result;
+}
+
+Tablebase_position Tablebase_table::position_from_board(Board const& board, bool swap_colors) const
+{
+  auto board_color = [&](Color color)
+  {
+    return swap_colors ? opposite_color(color) : color;
+  };
+  auto location = [&](int32_t square_index)
+  {
+    return swap_colors ? mirror_vertically(Coordinates{square_index}) : Coordinates{square_index};
+  };
+
+  Tablebase_position result;
+  result.side_to_move = board_color(board.get_active_color());
+  result.squares[0] = location(board.get_piece_set(board_color(Color::white), Piece::king).bitscan_forward());
+  result.squares[1] = location(board.get_piece_set(board_color(Color::black), Piece::king).bitscan_forward());
+
+  // Pieces of the same type are next to each other, so each one takes the
+  // next square from the same set
+  Bitboard remaining;
+  for (size_t i{0}; i < m_pieces.size(); ++i)
+  {
+    auto const [color, piece] = m_pieces[i];
+    if (i == 0 || m_pieces[i - 1] != m_pieces[i])
+    {
+      remaining = board.get_piece_set(board_color(color), piece);
+    }
+    MY_ASSERT(!remaining.is_empty(), "Board doesn't match the table");
+    result.squares[i + 2] = location(remaining.pop_first_bit());
+  }
+  return result;
+}
+
+uint8_t Tablebase_table::get_value(size_t index) const
+{
+  return m_values[index];
+}
+
+void Tablebase_table::set_value(size_t index, uint8_t value)
+{
+  MY_ASSERT(!m_file, "Loaded tables are read only");
+  m_owned_values[index] = value;
+}
+
+std::vector<std::string> Tablebase::get_all_table_names()
+{
+  std::vector<std::string> result;
+  for (auto const first : c_piece_letters)
+  {
+    result.push_back(std::string{"K"} + first + "vK");
+    for (auto const second : c_piece_letters.substr(c_piece_letters.find(first)))
+    {
+      result.push_back(std::string{"K"} + first + second + "vK");
+      result.push_back(std::string{"K"} + first + "vK" + second);
+    }
+  }
+
+  // Captures lead to tables with fewer pieces, and promotions to tables with fewer pawns
+  rs::stable_sort(result,
+                  [](auto const& lhs, auto const& rhs)
+                  {
+                    return std::pair{lhs.size(), count_pawns(lhs)} < std::pair{rhs.size(), count_pawns(rhs)};
+                  });
+  return result;
+}
+
+std::pair<std::string, bool> Tablebase::table_name(Board const& board)
+{
+  auto const key = board.get_material_key();
+  auto const white = side_pieces(key, Color::white);
+  auto const black = side_pieces(key, Color::black);
+  if (is_stronger_or_equal(white, black))
+  {
+    return {"K" + white + "vK" + black, false};
+  }
+  return {"K" + black + "vK" + white, true};
+}
+
+tl::expected<size_t, std::string> Tablebase::load_directory(std::string const& directory)
+{
+  std::error_code error;
+  std::filesystem::directory_iterator files{directory, error};
+  if (error)
+  {
+    return tl::unexpected("Failed to open tablebase directory " + directory + ": " + error.message());
+  }
+
+  size_t count{0};
+  for (auto const& file : files)
+  {
+    if (file.path().extension() != c_file_extension)
+    {
+      continue;
+    }
+    auto table = Tablebase_table::load(file.path().string());
+    if (!table)
+    {
+      return tl::unexpected(table.error());
+    }
+    add_table(std::move(*table));
+    ++count;
+  }
+  return count;
+}
+
+void Tablebase::add_table(Tablebase_table table)
+{
+  m_max_pieces = std::max(m_max_pieces, table.get_piece_count());
+  auto name = table.get_name();
+  auto const& added = m_tables.insert_or_assign(std::move(name), std::move(table)).first->second;
+
+  Material_key key;
+  Material_key swapped_key;
+  for (auto const& [color, piece] : added.get_pieces())
+  {
+    key.add_piece(color, piece);
+    swapped_key.add_piece(opposite_color(color), piece);
+  }
+
+  // Tables with the same material on both sides are probed without swapping
+  m_tables_by_material.insert_or_assign(key.get_key(), Table_entry{&added, false});
+  if (swapped_key != key)
+  {
+    m_tables_by_material.insert_or_assign(swapped_key.get_key(), Table_entry{&added, true});
+  }
+}
+
+void Tablebase::clear()
+{
+  m_tables.clear();
+  m_tables_by_material.clear();
+  m_max_pieces = 0;
+}
+
+Tablebase_table const* Tablebase::find_table(std::string const& name) const
+{
+  auto const it = m_tables.find(name);
+  return (it == m_tables.end()) ? nullptr : &it->second;
+}
+
+std::optional<Tablebase_result> Tablebase::probe(Board const& board) const
+{
+  return probe_(board, true);
+}
+
+std::optional<Tablebase_result> Tablebase::probe_ignoring_halfmove_clock(Board const& board) const
+{
+  return probe_(board, false);
+}
+
+std::optional<Tablebase_result> Tablebase::probe_(Board const& board, bool use_halfmove_clock) const
+{
+  auto const piece_count = static_cast<size_t>(board.get_occupied_squares().occupancy());
+  if (board.get_castling_rights() != c_castling_rights_none)
+  {
+    return {};
+  }
+
+  // Bare kings don't need a table
+  if (piece_count == 2)
+  {
+    return Tablebase_result{};
+  }
+
+  if (piece_count > m_max_pieces)
+  {
+    return {};
+  }
+
+  if (!board.get_en_passant_square().is_empty())
+  {
+    return probe_en_passant_(board, use_halfmove_clock);
+  }
+
+  auto const entry = m_tables_by_material.find(board.get_material_key().get_key());
+  if (entry == m_tables_by_material.end())
+  {
+    return {};
+  }
+
+  auto const& [table, swap_colors] = entry->second;
+  auto const position = table->position_from_board(board, swap_colors);
+  auto const result = Tablebase_table::decode(table->get_value(table->index_of(position)));
+
+  // The fastest mate may not capture or move a pawn, so it is only certain to
+  // come before the 50 move rule ends the game if it fits in the plies left.
+  // A mate on the last of them still counts.
+  constexpr int32_t c_fifty_move_rule_plies{100};
+  if (use_halfmove_clock && result.wdl != Tablebase_result::Wdl::draw &&
+      board.get_halfmove_clock() + result.distance_to_mate > c_fifty_move_rule_plies)
+  {
+    return {};
+  }
+  return result;
+}
+
+std::optional<Tablebase_result> Tablebase::probe_en_passant_(Board const& board, bool use_halfmove_clock) const
+{
+  auto const moves = Move_generator::generate_legal_moves(board);
+  if (moves.empty())
+  {
+    return board.is_in_check(board.get_active_color()) ?
+             Tablebase_result{Tablebase_result::Wdl::loss, 0} :
+             Tablebase_result{};
+  }
+
+  std::optional<Tablebase_result> best;
+  for (auto const move : moves)
+  {
+    Board child{board};
+    child.move_no_verify(move);
+    auto const result = probe_(child, use_halfmove_clock);
+    if (!result)
+    {
+      return {};
+    }
+    if (!best || result->parent().rank() > best->rank())
+    {
+      best = result->parent();
+    }
+  }
+  return best;
+}
+
+size_t Tablebase::get_max_pieces() const
+{
+  return m_max_pieces;
+}
+} // namespace Meneldor
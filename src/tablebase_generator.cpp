@@ -0,0 +1,528 @@
+#include "tablebase_generator.h"
+#include "move_generator.h"
+
+namespace rs = std::ranges;
+namespace Meneldor
+{
+namespace
+{
+class Bitset
+{
+public:
+  constexpr static size_t c_bits_per_word{std::numeric_limits<uint64_t>::digits};
+
+  explicit Bitset(size_t size) : m_words((size + c_bits_per_word - 1) / c_bits_per_word)
+  {
+  }
+
+  bool test(size_t index) const
+  {
+    return ((m_words[index / c_bits_per_word] >> (index % c_bits_per_word)) & 1) != 0;
+  }
+
+  // Only safe if no other thread is using the same word
+  void set(size_t index)
+  {
+    m_words[index / c_bits_per_word] |= uint64_t{1} << (index % c_bits_per_word);
+  }
+
+  // Safe to call from several threads at once
+  void set_atomic(size_t index)
+  {
+    std::atomic_ref<uint64_t>{m_words[index / c_bits_per_word]}.fetch_or(uint64_t{1} << (index % c_bits_per_word),
+                                                                         std::memory_order_relaxed);
+  }
+
+  void reset()
+  {
+    rs::fill(m_words, uint64_t{0});
+  }
+
+  bool any() const
+  {
+    return rs::any_of(m_words,
+                      [](auto word)
+                      {
+                        return word != 0;
+                      });
+  }
+
+  size_t word_count() const
+  {
+    return m_words.size();
+  }
+
+  Bitboard word(size_t index) const
+  {
+    return Bitboard{m_words[index]};
+  }
+
+  void swap(Bitset& other)
+  {
+    m_words.swap(other.m_words);
+  }
+
+private:
+  std::vector<uint64_t> m_words;
+};
+
+// Reflects the position across the a1-h8 diagonal
+Tablebase_position transpose(Tablebase_position position, size_t piece_count)
+{
+  for (size_t i{0}; i < piece_count; ++i)
+  {
+    position.squares[i] = Coordinates{position.squares[i].y(), position.squares[i].x()};
+  }
+  return position;
+}
+
+// Calls fn(begin, end, thread_index) for thread_count slices of [0, count) in parallel
+template <typename Fn>
+void parallel_for(size_t count, size_t thread_count, Fn const& fn)
+{
+  auto const slice_size = (count + thread_count - 1) / thread_count;
+  std::vector<std::thread> threads;
+  for (size_t thread_index{0}; thread_index < thread_count; ++thread_index)
+  {
+    auto const begin = std::min(count, thread_index * slice_size);
+    auto const end = std::min(count, begin + slice_size);
+    threads.emplace_back(fn, begin, end, thread_index);
+  }
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+}
+
+class Retrograde_analysis
+{
+public:
+  Retrograde_analysis(Tablebase_table& table, Tablebase const& tablebase, size_t thread_count)
+      : m_table{table},
+        m_tablebase{tablebase},
+        m_thread_count{thread_count},
+        m_solved{table.size()},
+        m_dirty{table.size()},
+        m_next_dirty{table.size()}
+  {
+    m_slot_pieces.emplace_back(Color::white, Piece::king);
+    m_slot_pieces.emplace_back(Color::black, Piece::king);
+    rs::copy(table.get_pieces(), std::back_inserter(m_slot_pieces));
+  }
+
+  tl::expected<void, std::string> run(std::ostream* log)
+  {
+    // Pass 0 finds invalid positions, checkmates and stalemates. Every other
+    // position is looked at in the first pass.
+    parallel_for(m_solved.word_count(), m_thread_count,
+                 [&](size_t begin, size_t end, size_t /* thread_index */)
+                 {
+                   initialize_(begin, end);
+                 });
+
+    for (int32_t pass{1}; m_dirty.any() || pass < static_cast<int32_t>(m_scheduled.size()); ++pass)
+    {
+      if (pass > Tablebase_table::c_max_distance_to_mate)
+      {
+        return tl::unexpected("Distance to mate is too long to store in " + m_table.get_name());
+      }
+
+      std::vector<Thread_results> results(m_thread_count);
+      parallel_for(m_dirty.word_count(), m_thread_count,
+                   [&](size_t begin, size_t end, size_t thread_index)
+                   {
+                     for (auto word_index{begin}; word_index < end; ++word_index)
+                     {
+                       for (auto const bit : m_dirty.word(word_index))
+                       {
+                         auto const index = word_index * Bitset::c_bits_per_word + static_cast<size_t>(bit);
+                         if (!m_solved.test(index))
+                         {
+                           evaluate_(index, pass, results[thread_index]);
+                         }
+                       }
+                     }
+                   });
+
+      std::vector<size_t> solved;
+      for (auto& thread_results : results)
+      {
+        if (!thread_results.error.empty())
+        {
+          return tl::unexpected(thread_results.error);
+        }
+        for (auto const& [index, value] : thread_results.solved)
+        {
+          m_table.set_value(index, value);
+          m_solved.set(index);
+          solved.push_back(index);
+        }
+        for (auto const& [scheduled_pass, index] : thread_results.scheduled)
+        {
+          if (static_cast<size_t>(scheduled_pass) >= m_scheduled.size())
+          {
+            m_scheduled.resize(static_cast<size_t>(scheduled_pass) + 1);
+          }
+          m_scheduled[static_cast<size_t>(scheduled_pass)].push_back(index);
+        }
+      }
+
+      if (log)
+      {
+        *log << m_table.get_name() << " pass " << pass << ": " << solved.size() << " positions solved" << std::endl;
+      }
+
+      // Only positions that can reach a newly solved position can change next pass
+      m_next_dirty.reset();
+      parallel_for(solved.size(), m_thread_count,
+                   [&](size_t begin, size_t end, size_t /* thread_index */)
+                   {
+                     for (auto i{begin}; i < end; ++i)
+                     {
+                       mark_predecessors_(solved[i]);
+                     }
+                   });
+      if (static_cast<size_t>(pass + 1) < m_scheduled.size())
+      {
+        for (auto const index : m_scheduled[static_cast<size_t>(pass + 1)])
+        {
+          m_next_dirty.set(index);
+        }
+      }
+      m_dirty.swap(m_next_dirty);
+    }
+
+    // Anything left unsolved can't be forced either way, and is a draw
+    return {};
+  }
+
+private:
+  struct Thread_results
+  {
+    std::vector<std::pair<size_t, uint8_t>> solved;
+
+    // Positions to look at again in a later pass, usually because their
+    // distance to mate is known but longer than the current pass
+    std::vector<std::pair<int32_t, size_t>> scheduled;
+
+    std::string error;
+  };
+
+  std::optional<Board> board_at_(Tablebase_position const& position) const
+  {
+    auto const piece_count = m_table.get_piece_count();
+    std::array<Piece_placement, Tablebase_table::c_max_pieces> placements{};
+    for (size_t i{0}; i < piece_count; ++i)
+    {
+      auto const [color, piece] = m_slot_pieces[i];
+      auto const location = position.squares[i];
+      if (piece == Piece::pawn && (location.y() == 0 || location.y() == c_board_dimension - 1))
+      {
+        return {};
+      }
+      placements[i] = {color, piece, location};
+    }
+
+    auto const white_king = position.squares[0];
+    auto const black_king = position.squares[1];
+    if (std::max(std::abs(white_king.x() - black_king.x()), std::abs(white_king.y() - black_king.y())) <= 1)
+    {
+      return {};
+    }
+
+    auto board = Board::from_pieces(std::span{placements.data(), piece_count}, position.side_to_move);
+    if (!board)
+    {
+      return {};
+    }
+
+    // The side that just moved can't still be in check
+    auto const waiting_color = opposite_color(position.side_to_move);
+    if (Move_generator::is_square_attacked(*board, position.side_to_move,
+                                           board->get_piece_set(waiting_color, Piece::king)))
+    {
+      return {};
+    }
+    return std::move(*board);
+  }
+
+  void initialize_(size_t begin_word, size_t end_word)
+  {
+    auto const end_index = std::min(end_word * Bitset::c_bits_per_word, m_table.size());
+    for (auto index{begin_word * Bitset::c_bits_per_word}; index < end_index; ++index)
+    {
+      auto const board = board_at_(m_table.position_at(index));
+      if (!board)
+      {
+        m_solved.set(index);
+      }
+      else if (!Move_generator::has_any_legal_moves(*board))
+      {
+        if (board->is_in_check(board->get_active_color()))
+        {
+          m_table.set_value(index, Tablebase_table::encode(0));
+        }
+        m_solved.set(index);
+      }
+      else
+      {
+        m_dirty.set(index);
+      }
+    }
+  }
+
+  void evaluate_(size_t index, int32_t pass, Thread_results& results) const
+  {
+    auto const position = m_table.position_at(index);
+    auto const board = board_at_(position);
+    MY_ASSERT(board.has_value(), "Invalid positions are solved during initialization");
+
+    std::optional<int32_t> fastest_win;
+    int32_t slowest_loss{0};
+    bool can_avoid_loss{false};
+    for (auto const move : Move_generator::generate_legal_moves(*board))
+    {
+      std::optional<Tablebase_result> child;
+      if (move.victim() != Piece::empty || move.promotion() != Piece::empty)
+      {
+        // Captures and promotions lead to a different table
+        Board child_board{*board};
+        child_board.move_no_verify(move);
+        child = m_tablebase.probe_ignoring_halfmove_clock(child_board);
+        if (!child)
+        {
+          results.error = "Missing table " + Tablebase::table_name(child_board).first;
+          return;
+        }
+      }
+      else
+      {
+        auto child_position = position;
+        for (size_t i{0}; i < m_table.get_piece_count(); ++i)
+        {
+          if (child_position.squares[i] == move.from())
+          {
+            child_position.squares[i] = move.to();
+            break;
+          }
+        }
+        child_position.side_to_move = opposite_color(position.side_to_move);
+
+        auto const child_index = m_table.index_of(child_position);
+        if (m_solved.test(child_index))
+        {
+          child = Tablebase_table::decode(m_table.get_value(child_index));
+        }
+        if (move.piece() == Piece::pawn && std::abs(move.to().y() - move.from().y()) == 2)
+        {
+          child = add_en_passant_(*board, move, child, index, pass, results);
+        }
+      }
+
+      if (!results.error.empty())
+      {
+        return;
+      }
+
+      // Results are from the point of view of the opponent
+      if (!child || child->wdl == Tablebase_result::Wdl::draw)
+      {
+        can_avoid_loss = true;
+      }
+      else if (child->wdl == Tablebase_result::Wdl::loss)
+      {
+        fastest_win = std::min(fastest_win.value_or(std::numeric_limits<int32_t>::max()), child->distance_to_mate + 1);
+      }
+      else
+      {
+        slowest_loss = std::max(slowest_loss, child->distance_to_mate + 1);
+      }
+    }
+
+    std::optional<int32_t> distance_to_mate;
+    if (fastest_win)
+    {
+      distance_to_mate = fastest_win;
+    }
+    else if (!can_avoid_loss)
+    {
+      distance_to_mate = slowest_loss;
+    }
+
+    if (!distance_to_mate)
+    {
+      return;
+    }
+    if (*distance_to_mate > Tablebase_table::c_max_distance_to_mate)
+    {
+      results.error = "Distance to mate is too long to store in " + m_table.get_name();
+      return;
+    }
+
+    // A mate found through another table may be longer than the current
+    // pass. A shorter one may still show up in this table before then.
+    if (*distance_to_mate <= pass)
+    {
+      results.solved.emplace_back(index, Tablebase_table::encode(*distance_to_mate));
+    }
+    else
+    {
+      results.scheduled.emplace_back(*distance_to_mate, index);
+    }
+  }
+
+  // The table doesn't store en passant squares, so after a double pawn push
+  // the opponent's en passant captures are weighed against the stored result
+  // of the position after the push
+  std::optional<Tablebase_result> add_en_passant_(Board const& board,
+                                                  Move move,
+                                                  std::optional<Tablebase_result> child,
+                                                  size_t index,
+                                                  int32_t pass,
+                                                  Thread_results& results) const
+  {
+    Board child_board{board};
+    child_board.move_no_verify(move);
+
+    std::optional<Tablebase_result> best_capture;
+    for (auto const reply : Move_generator::generate_legal_moves(child_board))
+    {
+      if (reply.type() != Move_type::en_passant)
+      {
+        continue;
+      }
+
+      Board capture_board{child_board};
+      capture_board.move_no_verify(reply);
+      auto const capture = m_tablebase.probe_ignoring_halfmove_clock(capture_board);
+      if (!capture)
+      {
+        results.error = "Missing table " + Tablebase::table_name(capture_board).first;
+        return {};
+      }
+      if (!best_capture || capture->parent().rank() > best_capture->rank())
+      {
+        best_capture = capture->parent();
+      }
+    }
+
+    if (!best_capture)
+    {
+      return child;
+    }
+    if (child)
+    {
+      return (best_capture->rank() > child->rank()) ? *best_capture : *child;
+    }
+
+    // An unsolved position can only turn out to be a win slower than the
+    // current pass, so a faster win by capturing is the final result. A slower
+    // one will be once the passes catch up to it.
+    if (best_capture->wdl == Tablebase_result::Wdl::win)
+    {
+      if (best_capture->distance_to_mate < pass)
+      {
+        return best_capture;
+      }
+      results.scheduled.emplace_back(best_capture->distance_to_mate + 1, index);
+    }
+    return {};
+  }
+
+  // Marks every position in this table that can move to the given one
+  void mark_predecessors_(size_t index)
+  {
+    auto const position = m_table.position_at(index);
+    auto const mover = opposite_color(position.side_to_move);
+
+    Bitboard occupied;
+    for (size_t i{0}; i < m_table.get_piece_count(); ++i)
+    {
+      occupied.set_square(position.squares[i]);
+    }
+
+    for (size_t i{0}; i < m_table.get_piece_count(); ++i)
+    {
+      auto const [color, piece] = m_slot_pieces[i];
+      if (color != mover)
+      {
+        continue;
+      }
+
+      auto const location = position.squares[i];
+      Bitboard origins;
+      if (piece == Piece::pawn)
+      {
+        // Captures and promotions change the material, so only pushes can
+        // lead here from this table
+        auto const backward = (color == Color::white) ? -1 : 1;
+        auto const first_rank = (color == Color::white) ? 0 : c_board_dimension - 1;
+        Coordinates const one_back{location.x(), location.y() + backward};
+        if (one_back.y() != first_rank && !occupied.is_set(one_back))
+        {
+          origins.set_square(one_back);
+          Coordinates const two_back{location.x(), one_back.y() + backward};
+          if (two_back.y() == first_rank - backward && !occupied.is_set(two_back))
+          {
+            origins.set_square(two_back);
+          }
+        }
+      }
+      else
+      {
+        origins = Move_generator::get_piece_attacks(piece, location, occupied) & ~occupied;
+      }
+
+      for (auto const origin : origins)
+      {
+        auto predecessor = position;
+        predecessor.squares[i] = Coordinates{origin};
+        predecessor.side_to_move = mover;
+        m_next_dirty.set_atomic(m_table.index_of(predecessor));
+
+        // Pawnless positions with the white king on the a1-h8 diagonal are
+        // stored twice, once for each side of the diagonal, and both need
+        // another look
+        if (!m_table.has_pawns())
+        {
+          m_next_dirty.set_atomic(m_table.index_of(transpose(predecessor, m_table.get_piece_count())));
+        }
+      }
+    }
+  }
+
+  Tablebase_table& m_table;
+  Tablebase const& m_tablebase;
+  size_t m_thread_count;
+
+  // The piece stored in each square slot of a position
+  std::vector<std::pair<Color, Piece>> m_slot_pieces;
+
+  Bitset m_solved;
+  Bitset m_dirty;
+  Bitset m_next_dirty;
+
+  // Indexed by the pass the positions should be solved in
+  std::vector<std::vector<size_t>> m_scheduled;
+};
+} // namespace
+
+tl::expected<Tablebase_table, std::string> Tablebase_generator::generate(std::string_view name,
+                                                                         Tablebase const& tablebase,
+                                                                         size_t thread_count,
+                                                                         std::ostream* log)
+{
+  auto table = Tablebase_table::create(name);
+  if (!table)
+  {
+    return table;
+  }
+
+  Retrograde_analysis analysis{*table, tablebase, std::max(thread_count, size_t{1})};
+  if (auto const result = analysis.run(log); !result)
+  {
+    return tl::unexpected(result.error());
+  }
+  return table;
+}
+} // namespace Meneldor
@@ -1,98 +1,422 @@
 #include "transposition_table.h"
+#include "numa_topology.h"
 #include "utils.h"
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 namespace rs = std::ranges;
+namespace
+{
+constexpr size_t c_huge_page_size{2UL * 1024UL * 1024UL};
+
+// Rounds the mapping up to whole huge pages when they are used, so no huge
+// page is shared with other allocations
+size_t mapped_size(size_t size_bytes, bool use_huge_pages)
+{
+  if (!use_huge_pages)
+  {
+    return size_bytes;
+  }
+  return (size_bytes + c_huge_page_size - 1) / c_huge_page_size * c_huge_page_size;
+}
+
+// Returns zeroed memory that is only backed by physical pages once touched,
+// or nullptr if it can't be mapped
+void* map_zeroed(size_t size_bytes, bool use_huge_pages)
+{
+#if defined(_WIN32)
+  MY_ASSERT(!use_huge_pages, "Huge pages are not supported on this platform");
+  auto* const data = ::operator new(size_bytes, std::align_val_t{64}, std::nothrow);
+  if (data)
+  {
+    std::memset(data, 0, size_bytes);
+  }
+  return data;
+#else
+  if (!use_huge_pages)
+  {
+    auto* const data = mmap(nullptr, size_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (data == MAP_FAILED) ? nullptr : data;
+  }
+
+  // The kernel only uses huge pages for aligned ranges, so map an extra
+  // huge page and give back the unaligned ends
+  auto const size = mapped_size(size_bytes, true);
+  auto* const raw = mmap(nullptr, size + c_huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED)
+  {
+    return nullptr;
+  }
+
+  auto const raw_address = reinterpret_cast<uintptr_t>(raw);
+  auto const head = (c_huge_page_size - raw_address % c_huge_page_size) % c_huge_page_size;
+  auto* const data = static_cast<std::byte*>(raw) + head;
+  if (head > 0)
+  {
+    munmap(raw, head);
+  }
+  if (head < c_huge_page_size)
+  {
+    munmap(data + size, c_huge_page_size - head);
+  }
+
+  // Only a hint, the table works either way
+  madvise(data, size, MADV_HUGEPAGE);
+  return data;
+#endif
+}
+
+void unmap(void* data, size_t mapping_size)
+{
+#if defined(_WIN32)
+  unused(mapping_size);
+  ::operator delete(data, std::align_val_t{64});
+#else
+  munmap(data, mapping_size);
+#endif
+}
+
+// Maps a whole file with private, writable pages. Writes go to copies of
+// the pages and never reach the file. Returns nullptr if it can't be mapped.
+void* map_file_copy_on_write(std::filesystem::path const& filename, size_t size_bytes)
+{
+#if defined(_WIN32)
+  auto* const data = map_zeroed(size_bytes, false);
+  std::ifstream file{filename, std::ios::binary};
+  if (data && !file.read(static_cast<char*>(data), static_cast<std::streamsize>(size_bytes)))
+  {
+    unmap(data, size_bytes);
+    return nullptr;
+  }
+  return data;
+#else
+  auto const fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return nullptr;
+  }
+
+  // The mapping stays valid after the file is closed
+  auto* const data = mmap(nullptr, size_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  return (data == MAP_FAILED) ? nullptr : data;
+#endif
+}
+
+// Start of a saved table, the buckets follow it. Values are in the byte
+// order of the machine that saved them.
+struct alignas(64) Snapshot_header
+{
+  constexpr static std::array<char, 8> c_magic{'M', 'e', 'n', 'e', 'l', 'T', 'T', '\0'};
+
+  // Increment when the entry layout or the way keys are computed changes.
+  // Version 2 keys the en passant square by its file.
+  constexpr static uint32_t c_version{2};
+
+  std::array<char, 8> magic{c_magic};
+  uint32_t version{c_version};
+  uint32_t bucket_size{0};
+  uint64_t bucket_count{0};
+  uint64_t zobrist_checksum{Meneldor::Zobrist_hash::get_checksum()};
+  uint8_t generation{0};
+
+  // Written out as zeros, so no uninitialized padding reaches the file
+  std::array<uint8_t, 31> reserved{};
+};
+
+static_assert(sizeof(Snapshot_header) == 64, "Buckets after the header must stay cache line aligned");
+static_assert(std::has_unique_object_representations_v<Snapshot_header>, "The header must not have padding");
+} // namespace
+
 namespace Meneldor
 {
-size_t Transposition_table::hash_fn_(zhash_t key) const
+Transposition_table::Transposition_table(size_t table_size_bytes, bool use_huge_pages)
+#if defined(_WIN32)
+    : m_use_huge_pages{false}
+#else
+    : m_use_huge_pages{use_huge_pages}
+#endif
 {
-  // We'd like to store two entries at each position. This
-  // ensures that the indices given are always even numbers, and the odd
-  // number will be the second entry for the two tiered replacement scheme
-  return (key % (m_table_capacity / c_entries_per_key)) * c_entries_per_key;
+  if (!resize(table_size_bytes))
+  {
+    throw std::bad_alloc{};
+  }
 }
 
-Transposition_table::Transposition_table(size_t table_size_bytes) : m_table_capacity(table_size_bytes / sizeof(Entry))
+Transposition_table::~Transposition_table()
 {
-  m_table.resize(m_table_capacity);
+  release_();
+}
+
+tl::expected<void, std::string> Transposition_table::resize(size_t table_size_bytes)
+{
+  auto const bucket_count = std::max(table_size_bytes / sizeof(Bucket), size_t{1});
+  auto const size_bytes = bucket_count * sizeof(Bucket);
+  auto const use_huge_pages = m_use_huge_pages && size_bytes >= c_huge_page_size;
+
+  auto* const data = map_zeroed(size_bytes, use_huge_pages);
+  if (!data)
+  {
+    return tl::unexpected("Failed to allocate " + std::to_string(size_bytes) + " bytes for the transposition table");
+  }
+
+  adopt_(data, mapped_size(size_bytes, use_huge_pages), {static_cast<Bucket*>(data), bucket_count}, use_huge_pages);
+  m_generation = 1;
+
+  // Left alone, the search thread would touch every page first and the whole
+  // table would end up on its node. Spread it across the nodes up front instead.
+  if (Numa_topology::get_system().get_node_count() > 1)
+  {
+    clear();
+  }
+  return {};
 }
 
-void Transposition_table::insert(zhash_t key, Entry entry)
+tl::expected<void, std::string> Transposition_table::save(std::filesystem::path const& filename) const
 {
-  MY_ASSERT(hash_fn_(key) < m_table.size(), "Index out of bounds");
+  Snapshot_header header;
+  header.bucket_size = sizeof(Bucket);
+  header.bucket_count = m_buckets.size();
+  header.generation = m_generation;
+
+  // This table may be mapped from the same file. Truncating a mapped file
+  // makes reading the mapping crash, so write a new file and replace the old one.
+  auto temporary_filename = filename;
+  temporary_filename += ".tmp";
+  {
+    std::ofstream file{temporary_filename, std::ios::binary | std::ios::trunc};
+    file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const*>(m_buckets.data()), static_cast<std::streamsize>(m_buckets.size_bytes()));
+    if (!file)
+    {
+      std::filesystem::remove(temporary_filename);
+      return tl::unexpected("Failed to write " + filename.string());
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporary_filename, filename, error);
+  if (error)
+  {
+    std::filesystem::remove(temporary_filename);
+    return tl::unexpected("Failed to replace " + filename.string() + ": " + error.message());
+  }
+  return {};
+}
+
+tl::expected<void, std::string> Transposition_table::load(std::filesystem::path const& filename)
+{
+  Snapshot_header header;
+  std::ifstream file{filename, std::ios::binary};
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+  {
+    return tl::unexpected("Failed to read " + filename.string());
+  }
+  file.close();
+
+  if (header.magic != Snapshot_header::c_magic || header.version != Snapshot_header::c_version ||
+      header.bucket_size != sizeof(Bucket))
+  {
+    return tl::unexpected(filename.string() + " is not a transposition table saved by this version");
+  }
+  if (header.zobrist_checksum != Zobrist_hash::get_checksum())
+  {
+    return tl::unexpected(filename.string() + " was saved with different hash keys");
+  }
+
+  std::error_code error;
+  auto const file_size = std::filesystem::file_size(filename, error);
+  if (error || header.bucket_count == 0 || file_size != sizeof(header) + header.bucket_count * sizeof(Bucket))
+  {
+    return tl::unexpected(filename.string() + " is truncated");
+  }
+
+  auto* const data = map_file_copy_on_write(filename, file_size);
+  if (!data)
+  {
+    return tl::unexpected("Failed to map " + filename.string());
+  }
+
+  auto* const buckets = reinterpret_cast<Bucket*>(static_cast<std::byte*>(data) + sizeof(header));
+  adopt_(data, file_size, {buckets, header.bucket_count}, false);
+  m_generation = header.generation;
+  return {};
+}
+
+void Transposition_table::adopt_(void* mapping, size_t mapping_size, std::span<Bucket> buckets, bool has_huge_pages)
+{
+  release_();
+  m_mapping = mapping;
+  m_mapping_size = mapping_size;
+  m_buckets = buckets;
+  m_has_huge_pages = has_huge_pages;
+}
+
+void Transposition_table::release_()
+{
+  if (m_mapping)
+  {
+    unmap(m_mapping, m_mapping_size);
+  }
+  m_mapping = nullptr;
+  m_mapping_size = 0;
+  m_buckets = {};
+  m_has_huge_pages = false;
+}
+
+void Transposition_table::insert(zhash_t key, int depth, int evaluation, Move best_move, Eval_type type)
+{
+  auto& bucket = m_buckets[index_(key)];
+  auto const check_bits = check_bits_(key);
 
   /*
-   * Deep + Always replacement scheme
+   * Depth and age replacement scheme
    *
-   * Here we store two entries at every position, the first entry being 'replace
-   * by depth' and the second 'always replace'. So if the new entry had greater
-   * depth, we put it in the first entry. If it had smaller depth we replace the
-   * second entry without looking at it.
-   * The TwoDeep scheme here:
-   * https://pure.uvt.nl/ws/portalfiles/portal/1216990/Replace_ICCA_newsletter_vol_19_no_3.pdf
+   * An entry for the same position is always overwritten. Otherwise the
+   * entry with the lowest depth is replaced, where each generation of age
+   * counts as much as a few plies of depth. Entries from old searches are
+   * mostly for positions that can't be reached anymore, so they go first
+   * even if they were searched deeply.
    */
+  constexpr int c_depth_per_generation{8};
+  auto replacement_value = [&](Packed_entry entry)
+  {
+    if (entry.is_empty())
+    {
+      return std::numeric_limits<int>::min();
+    }
+    return entry.depth() - c_depth_per_generation * age_(entry);
+  };
 
-  // If first entry depth is lower, replace and return
-  auto hash_value = hash_fn_(key);
-  entry.evaluation =
-    std::clamp(entry.evaluation, negative_inf + c_max_supported_depth, positive_inf - c_max_supported_depth);
-  if (m_table[hash_value].depth < entry.depth)
+  auto* replace = &bucket.entries.front();
+  for (auto& entry : bucket.entries)
   {
-    m_table[hash_value] = entry;
+    if (!entry.is_empty() && entry.key == check_bits)
+    {
+      replace = &entry;
+      break;
+    }
+    if (replacement_value(entry) < replacement_value(*replace))
+    {
+      replace = &entry;
+    }
   }
-  else
+
+  // Keep the old best move if this search didn't find one, it's still the
+  // best guess for move ordering
+  auto const compact_move = best_move.compact();
+  if (compact_move != 0 || replace->key != check_bits)
   {
-    m_table[hash_value + 1] = entry;
+    replace->best_move = compact_move;
   }
+  replace->key = check_bits;
+
+  evaluation = std::clamp(evaluation, negative_inf + c_max_supported_depth, positive_inf - c_max_supported_depth);
+  depth = std::clamp(depth, 0, c_max_depth);
+  replace->data = (static_cast<uint32_t>(evaluation) & ((1U << c_evaluation_bits) - 1)) |
+                  (static_cast<uint32_t>(depth) << c_depth_shift) | (static_cast<uint32_t>(type) << c_type_shift) |
+                  (static_cast<uint32_t>(m_generation) << c_generation_shift);
 }
 
-Transposition_table::Entry const* Transposition_table::get(zhash_t key) const
+std::optional<Transposition_table::Entry> Transposition_table::get(zhash_t key) const
 {
-  MY_ASSERT(hash_fn_(key) < m_table.size(), "Index out of bounds");
+  auto const& bucket = m_buckets[index_(key)];
+  auto const check_bits = check_bits_(key);
+  for (auto const& entry : bucket.entries)
+  {
+    if (!entry.is_empty() && entry.key == check_bits)
+    {
+      return Entry{entry.depth(), entry.evaluation(), entry.best_move, entry.type()};
+    }
+  }
+  return {};
+}
 
-  return walk_(key);
+void Transposition_table::new_generation()
+{
+  // Generation zero is never used, so an entry's data is never zero
+  constexpr uint8_t c_generation_count{1 << c_generation_bits};
+  m_generation = (m_generation + 1) % c_generation_count;
+  if (m_generation == 0)
+  {
+    m_generation = 1;
+  }
 }
 
-void Transposition_table::clear()
+uint8_t Transposition_table::age_(Packed_entry entry) const
 {
-  rs::fill(m_table, Transposition_table::Entry{});
+  constexpr uint8_t c_generation_mask{(1 << c_generation_bits) - 1};
+  return (m_generation - entry.generation()) & c_generation_mask;
 }
 
-Transposition_table::Entry const* Transposition_table::walk_(zhash_t key) const
+void Transposition_table::clear()
 {
-  MY_ASSERT(hash_fn_(key) < m_table.size(), "Index out of bounds");
+  // Starting a thread costs more than zeroing a few megabytes. With several
+  // NUMA nodes, each node needs at least one thread so it gets its share.
+  constexpr size_t c_min_bytes_per_thread{16UL * 1024UL * 1024UL};
+  auto const& topology = Numa_topology::get_system();
+  auto const node_count = topology.get_node_count();
+  auto const thread_count =
+    std::max(std::clamp(size_t{std::thread::hardware_concurrency()}, size_t{1},
+                        std::max(m_buckets.size_bytes() / c_min_bytes_per_thread, size_t{1})),
+             (node_count > 1) ? node_count : size_t{1});
 
-  auto const hash_value = hash_fn_(key);
-  auto const& candidate = m_table[hash_value];
-  if (candidate.key == key)
+  // Pages are placed on the node that first touches them, so threads pinned
+  // round robin to the nodes interleave the table across them in slices
+  auto const slice_size = (m_buckets.size() + thread_count - 1) / thread_count;
+  auto clear_slice = [this, slice_size, &topology, node_count](size_t thread_index)
   {
-    return &m_table[hash_value];
+    if (node_count > 1)
+    {
+      topology.bind_current_thread(topology.get_nodes()[thread_index % node_count].id);
+    }
+    auto const begin = std::min(m_buckets.size(), thread_index * slice_size);
+    auto const end = std::min(m_buckets.size(), begin + slice_size);
+    rs::fill(m_buckets.subspan(begin, end - begin), Bucket{});
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t thread_index{(node_count > 1) ? 0UL : 1UL}; thread_index < thread_count; ++thread_index)
+  {
+    threads.emplace_back(clear_slice, thread_index);
+  }
+
+  // Keep the calling thread's affinity as it is
+  if (node_count == 1)
+  {
+    clear_slice(0);
   }
-  if (m_table[hash_value + 1].key == key)
+  for (auto& thread : threads)
   {
-    return &m_table[hash_value + 1];
+    thread.join();
   }
-  return nullptr;
 }
 
-Transposition_table::Entry* Transposition_table::walk_(zhash_t key)
+bool Transposition_table::uses_huge_pages() const
 {
-  // Idiom for sharing implementation between const and non-const versions of a method
-  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
-  return const_cast<Entry*>(std::as_const(*this).walk_(key));
+  return m_has_huge_pages;
 }
 
 size_t Transposition_table::get_capacity() const
 {
-  return m_table_capacity;
+  return m_buckets.size() * c_entries_per_bucket;
 }
 
 size_t Transposition_table::count() const
 {
-  return rs::count_if(m_table,
-                      [](auto const& entry)
-                      {
-                        return entry.best_move.type() != Move_type::null;
-                      });
+  size_t result{0};
+  for (auto const& bucket : m_buckets)
+  {
+    result += rs::count_if(bucket.entries,
+                           [](auto const& entry)
+                           {
+                             return !entry.is_empty();
+                           });
+  }
+  return result;
 }
 } // namespace Meneldor
@@ -31,6 +31,19 @@ Zobrist_hash::Zobrist_hash(Board const& board)
   update_castling_rights(board.get_castling_rights());
 }
 
+Zobrist_hash Zobrist_hash::pawns_only(Board const& board)
+{
+  Zobrist_hash result;
+  for (auto const color : {Color::black, Color::white})
+  {
+    for (auto const sq_index : board.get_piece_set(color, Piece::pawn))
+    {
+      result.update_piece_location(color, Piece::pawn, Coordinates{sq_index});
+    }
+  }
+  return result;
+}
+
 std::ostream& operator<<(std::ostream& os, Zobrist_hash const& self)
 {
   os << std::to_string(self.get_hash());
@@ -0,0 +1,34 @@
+#include "allocation_counter.h"
+
+namespace
+{
+std::atomic<size_t> g_allocation_count{0};
+} // namespace
+
+void* operator new(size_t size)
+{
+  ++g_allocation_count;
+  if (auto* const data = std::malloc(size))
+  {
+    return data;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* data) noexcept
+{
+  std::free(data);
+}
+
+void operator delete(void* data, size_t /* size */) noexcept
+{
+  std::free(data);
+}
+
+namespace Meneldor
+{
+size_t get_allocation_count()
+{
+  return g_allocation_count.load();
+}
+} // namespace Meneldor
@@ -0,0 +1,11 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+namespace Meneldor
+{
+// Number of times the test program has called operator new, so tests can
+// check that hot paths don't allocate
+size_t get_allocation_count();
+} // namespace Meneldor
+
+#endif // ALLOCATION_COUNTER_H
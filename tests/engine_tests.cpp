@@ -1,6 +1,8 @@
 #include <catch2/catch.hpp>
 
+#include "allocation_counter.h"
 #include "meneldor_engine.h"
+#include "nnue.h"
 #include "senjo/UCIAdapter.h"
 #include "utils.h"
 
@@ -60,6 +62,232 @@ TEST_CASE("Evaluate", "[Meneldor_engine]")
   REQUIRE(engine.evaluate(board) > 0);
 }
 
+TEST_CASE("Evaluate with eval cache", "[Meneldor_engine]")
+{
+  auto const board = *Board::from_fen("r1bqk2r/p2p1pbp/1pn3p1/1p1Np2n/4PP2/P2P4/1PP1N1PP/R1B2RK1 b kq f3 0 10");
+  auto const mated = *Board::from_fen("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3");
+
+  Meneldor_engine engine;
+  REQUIRE(engine.setEngineOption("EvalCache", "0"));
+  auto const uncached_eval = engine.evaluate(board);
+  auto const uncached_mate = engine.evaluate(mated);
+
+  REQUIRE(engine.setEngineOption("EvalCache", "1"));
+  for (int i{0}; i < 2; ++i)
+  {
+    REQUIRE(engine.evaluate(board) == uncached_eval);
+    REQUIRE(engine.evaluate(mated) == uncached_mate);
+  }
+
+  REQUIRE(!engine.setEngineOption("EvalCache", "-1"));
+  REQUIRE(!engine.setEngineOption("EvalCache", "abc"));
+}
+
+TEST_CASE("Lazy evaluation", "[Meneldor_engine]")
+{
+  Meneldor_engine engine;
+  REQUIRE(engine.setEngineOption("EvalCache", "0"));
+
+  for (auto const& fen : {std::string{"r1bqk2r/p2p1pbp/1pn3p1/1p1Np2n/4PP2/P2P4/1PP1N1PP/R1B2RK1 b kq f3 0 10"},
+                          std::string{"8/5pk1/6p1/8/2B5/1P3P2/r5PP/4R1K1 w - - 0 35"},
+                          std::string{"rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3"}})
+  {
+    auto const board = *Board::from_fen(fen);
+    auto const full_score = engine.evaluate(board);
+
+    // A lazy score outside the window must still be a valid bound for the full score
+    for (int window_start{-1500}; window_start <= 1500; window_start += 50)
+    {
+      auto const alpha = full_score + window_start;
+      auto const beta = alpha + 20;
+      auto const lazy_score = engine.evaluate(board, alpha, beta);
+      if (lazy_score <= alpha)
+      {
+        REQUIRE(full_score <= alpha);
+      }
+      else if (lazy_score >= beta)
+      {
+        REQUIRE(full_score >= beta);
+      }
+      else
+      {
+        REQUIRE(lazy_score == full_score);
+      }
+    }
+  }
+}
+
+TEST_CASE("Evaluate positions in a row with a network", "[Meneldor_engine]")
+{
+  auto const network_filename = (std::filesystem::temp_directory_path() / "meneldor_in_a_row.nnue").string();
+  REQUIRE(Nnue_network::create_random(42).save(network_filename));
+
+  auto const create_engine = [&]()
+  {
+    auto engine = std::make_unique<Meneldor_engine>();
+    REQUIRE(engine->setEngineOption("EvalCache", "0"));
+    REQUIRE(engine->setEngineOption("EvalFile", network_filename));
+    return engine;
+  };
+
+  std::array const boards{
+    *Board::from_fen(c_start_position_fen),
+    *Board::from_fen("r1bqk2r/p2p1pbp/1pn3p1/1p1Np2n/4PP2/P2P4/1PP1N1PP/R1B2RK1 b kq f3 0 10"),
+    *Board::from_fen("8/5pk1/6p1/8/2B5/1P3P2/r5PP/4R1K1 w - - 0 35"),
+  };
+  std::vector<int> fresh_scores;
+  for (auto const& board : boards)
+  {
+    fresh_scores.push_back(create_engine()->evaluate(board));
+  }
+  REQUIRE(fresh_scores[0] != fresh_scores[1]);
+
+  // Each new position must get its own accumulator, not the previous one's
+  auto const engine = create_engine();
+  for (int i{0}; i < 2; ++i)
+  {
+    for (size_t j{0}; j < boards.size(); ++j)
+    {
+      CAPTURE(i, j);
+      REQUIRE(engine->evaluate(boards[j]) == fresh_scores[j]);
+    }
+  }
+
+  // The network is shared by every engine, so go back to the classic evaluation
+  REQUIRE(engine->setEngineOption("EvalFile", ""));
+  std::filesystem::remove(network_filename);
+}
+
+TEST_CASE("Endgame evaluation", "[Meneldor_engine]")
+{
+  Meneldor_engine engine;
+
+  // Insufficient material is a draw no matter where the pieces are
+  REQUIRE(engine.evaluate(*Board::from_fen("8/8/4k3/8/8/3KN3/8/8 w - - 0 1")) ==
+          engine.evaluate(*Board::from_fen("8/8/4k3/8/8/3KB3/8/8 b - - 0 1")));
+
+  // The rook side should drive the bare king toward the edge
+  auto const king_in_center = engine.evaluate(*Board::from_fen("8/8/8/4k3/8/8/8/R3K3 w - - 0 1"));
+  auto const king_on_edge = engine.evaluate(*Board::from_fen("4k3/8/8/8/8/8/8/R3K3 w - - 0 1"));
+  REQUIRE(king_in_center > 0);
+  REQUIRE(king_on_edge > king_in_center);
+  REQUIRE(engine.evaluate(*Board::from_fen("4k3/8/8/8/8/8/8/R3K3 b - - 0 1")) < 0);
+
+  // A drawn rook pawn ending shouldn't look like a pawn up
+  auto const drawn_kpk = engine.evaluate(*Board::from_fen("k7/8/8/8/8/8/P7/K7 w - - 0 1"));
+  auto const winning_kpk = engine.evaluate(*Board::from_fen("7k/8/8/8/8/8/P7/K7 w - - 0 1"));
+  REQUIRE(std::abs(drawn_kpk) < 20);
+  REQUIRE(winning_kpk > 50);
+}
+
+TEST_CASE("Search doesn't allocate", "[Meneldor_engine]")
+{
+  std::string const fen{"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"};
+  Meneldor_engine engine;
+  engine.initialize();
+  engine.setPosition(fen);
+
+  auto const board = *Board::from_fen(fen);
+  auto legal_moves = Move_generator::generate_legal_moves(board);
+
+  // Feature toggles and other statics are set up by the first search
+  engine.search(3, legal_moves);
+
+  // Anything allocated at the root happens the same number of times at any
+  // depth, so a deeper search only allocates more if the nodes below do
+  auto count_allocations = [&](int depth)
+  {
+    auto const before = get_allocation_count();
+    engine.search(depth, legal_moves);
+    return get_allocation_count() - before;
+  };
+  REQUIRE(count_allocations(5) == count_allocations(3));
+
+  Board perft_board{board};
+  std::atomic_flag is_cancelled{};
+  auto const before_perft = get_allocation_count();
+  auto const perft_nodes = Move_generator::perft(3, perft_board, is_cancelled);
+  REQUIRE(get_allocation_count() == before_perft);
+  REQUIRE(perft_nodes == 97862);
+}
+
+TEST_CASE("Qsearch_nps", "[.Meneldor_engine]")
+{
+  // Positions with lots of captures available, so most of the time is spent in qsearch
+  std::array const fens{
+    std::string{"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"},
+    std::string{"r1bqk2r/p2p1pbp/1pn3p1/1p1Np2n/4PP2/P2P4/1PP1N1PP/R1B2RK1 b kq f3 0 10"},
+    std::string{"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10"},
+  };
+
+  for (auto const& fen : fens)
+  {
+    Meneldor_engine engine;
+    engine.initialize();
+    engine.setPosition(fen);
+    senjo::GoParams params;
+    params.depth = 5;
+    engine.go(params, nullptr);
+
+    auto const stats = engine.getSearchStats();
+    auto const elapsed_seconds = std::max(static_cast<double>(stats.msecs) / 1000.0, 0.001);
+    std::cout << "For position: " << fen << "\n  " << format_with_commas(stats.qnodes) << " qnodes, "
+              << format_with_commas(stats.qnodes / elapsed_seconds) << " qnodes/sec, "
+              << format_with_commas(stats.nodes / elapsed_seconds) << " nodes/sec\n";
+  }
+}
+
+TEST_CASE("Nnue_vs_classic", "[.Nnue_network]")
+{
+  constexpr int c_evals_per_position{20'000};
+  constexpr int c_search_depth{6};
+  std::array const fens{
+    c_start_position_fen,
+    std::string{"r1bqk2r/p2p1pbp/1pn3p1/1p1Np2n/4PP2/P2P4/1PP1N1PP/R1B2RK1 b kq f3 0 10"},
+    std::string{"8/5pk1/6p1/8/2B5/1P3P2/r5PP/4R1K1 w - - 0 35"},
+  };
+
+  auto const network_filename = (std::filesystem::temp_directory_path() / "meneldor_benchmark.nnue").string();
+  REQUIRE(Nnue_network::create_random(42).save(network_filename));
+
+  for (auto const* eval_file : {"", network_filename.c_str()})
+  {
+    Meneldor_engine engine;
+    REQUIRE(engine.setEngineOption("EvalCache", "0"));
+    REQUIRE(engine.setEngineOption("EvalFile", eval_file));
+    std::string const name = (std::string{eval_file}.empty()) ? "classic" : "nnue";
+
+    int64_t checksum{0};
+    auto const start = std::chrono::system_clock::now();
+    for (auto const& fen : fens)
+    {
+      auto const board = *Board::from_fen(fen);
+      for (int i{0}; i < c_evals_per_position; ++i)
+      {
+        checksum += engine.evaluate(board);
+      }
+    }
+    std::chrono::duration<double> const elapsed = std::chrono::system_clock::now() - start;
+    std::cout << name << ": " << format_with_commas((c_evals_per_position * fens.size()) / elapsed.count())
+              << " evals/sec (checksum " << checksum << ")\n";
+
+    for (auto const& fen : fens)
+    {
+      engine.initialize();
+      engine.setPosition(fen);
+      senjo::GoParams params;
+      params.depth = c_search_depth;
+      engine.go(params, nullptr);
+      auto const stats = engine.getSearchStats();
+      std::cout << name << ": " << format_with_commas(1000.0 * stats.nodes / std::max(stats.msecs, uint64_t{1}))
+                << " nodes/sec for " << fen << "\n";
+    }
+  }
+
+  std::filesystem::remove(network_filename);
+  REQUIRE(true);
+}
+
 TEST_CASE("Search_opening", "[.Meneldor_engine]")
 {
   engine_stats_from_position(c_start_position_fen);
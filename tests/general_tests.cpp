@@ -1,10 +1,23 @@
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch.hpp>
 
+#include "allocation_counter.h"
 #include "bitboard.h"
 #include "board.h"
+#include "eval_cache.h"
+#include "material_table.h"
 #include "meneldor_engine.h"
 #include "move_generator.h"
+#include "nnue.h"
+#include "numa_topology.h"
+#include "pgn_reader.h"
+#include "pawn_hash_table.h"
+#include "slider_fill.h"
+#include "syzygy.h"
+#include "syzygy_writer.h"
+#include "tablebase.h"
+#include "tablebase_generator.h"
+#include "test_positions.h"
 #include "transposition_table.h"
 #include "utils.h"
 #include "zobrist_hash.h"
@@ -142,6 +155,209 @@ TEST_CASE("A pgn file from chess.com", "[board]")
                     c_sigrist_result | rs::views::filter(std::not_fn(isspace))));
 }
 
+TEST_CASE("Pgn reader", "[Pgn_reader]")
+{
+  auto const fischer_spassky = read_file_contents("./data/fischer_spassky.pgn");
+  auto const sigrist = read_file_contents("./data/sigrist.pgn");
+  REQUIRE(fischer_spassky);
+  REQUIRE(sigrist);
+
+  // Comments can hold brackets, and variations, glyphs and a starting fen
+  // should be handled
+  std::string const text = *fischer_spassky + "\n\n" + *sigrist + R"(
+
+[Event "Promotion"]
+[FEN "8/P7/8/8/8/8/8/k6K w - - 0 1"]
+[SetUp "1"]
+
+1. a8=Q+ {[%clk 0:01:00]} (1. a8N) 1... Kb2 $1 2.Qb7+ Kc3 *
+
+[Event "Illegal"]
+
+1. e4 e5 2. Ke3 *
+)";
+
+  auto const reader = Pgn_reader::from_text(text);
+  REQUIRE(reader.get_game_count() == 4);
+  REQUIRE(reader.get_game(2).starts_with("[Event \"Promotion\"]"));
+
+  // Catch can't check from other threads, so the callback only records
+  std::mutex mutex;
+  std::array<size_t, 4> plies{};
+  std::vector<Pgn_tag> promotion_tags;
+  std::string last_promotion_fen;
+  auto const stats = reader.replay(2,
+                                   [&](Pgn_ply const& ply)
+                                   {
+                                     std::lock_guard const lock{mutex};
+                                     ++plies[ply.game_index];
+                                     if (ply.game_index == 2)
+                                     {
+                                       promotion_tags.assign(ply.tags.begin(), ply.tags.end());
+                                       last_promotion_fen = ply.board.to_fen();
+                                     }
+                                   });
+
+  REQUIRE(stats.games == 4);
+  REQUIRE(stats.failed_games == 1);
+  REQUIRE(stats.plies == 85 + 47 + 4 + 2);
+  REQUIRE(plies == std::array<size_t, 4>{85, 47, 4, 2});
+  REQUIRE(promotion_tags.size() == 3);
+  REQUIRE(promotion_tags[1].name == "FEN");
+  REQUIRE(promotion_tags[1].value == "8/P7/8/8/8/8/8/k6K w - - 0 1");
+  REQUIRE(last_promotion_fen == "8/1Q6/8/8/8/8/1k6/7K b - - 2 2");
+
+  auto const final_position = Pgn_reader::replay_game(reader.get_game(2));
+  REQUIRE(final_position);
+  REQUIRE(final_position->to_fen() == "8/1Q6/8/8/8/2k5/8/7K w - - 3 3");
+  REQUIRE(!Pgn_reader::replay_game(reader.get_game(3)));
+
+  // Pawns can't promote to a king or a pawn
+  REQUIRE(!Pgn_reader::replay_game("[FEN \"8/4P3/8/8/8/8/8/k6K w - - 0 1\"]\n\n1. e8=K *"));
+  REQUIRE(!Pgn_reader::replay_game("[FEN \"8/4P3/8/8/8/8/8/k6K w - - 0 1\"]\n\n1. e8=P *"));
+  REQUIRE(!Board::from_pgn("[FEN \"8/4P3/8/8/8/8/8/k6K w - - 0 1\"]\n\n1. e8K *"));
+  REQUIRE(Board::from_pgn("[FEN \"8/4P3/8/8/8/8/8/k6K w - - 0 1\"]\n\n1. e8=N *"));
+
+  auto const file_reader = Pgn_reader::open("./data/sigrist.pgn");
+  REQUIRE(file_reader);
+  REQUIRE(file_reader->get_game_count() == 1);
+  REQUIRE(file_reader->replay(1, {}).plies == 47);
+  REQUIRE(!Pgn_reader::open("./data/no_such_file.pgn"));
+}
+
+// Writes random games in standard algebraic notation and checks that reading
+// them back reaches the same positions, covering disambiguation, promotions,
+// en passant and castling
+TEST_CASE("Pgn reader matches the move generator", "[Pgn_reader]")
+{
+  constexpr std::string_view c_piece_letters{"  PNBRQK"};
+  auto const to_san = [&](Board const& board, Move m, Move_list const& legal_moves)
+  {
+    if (m.type() == Move_type::castle)
+    {
+      return std::string{(m.to().x() == 6) ? "O-O" : "O-O-O"};
+    }
+
+    std::stringstream ss;
+    auto const is_capture = m.victim() != Piece::empty;
+    if (m.piece() == Piece::pawn)
+    {
+      if (is_capture)
+      {
+        ss << static_cast<char>('a' + m.from().x());
+      }
+    }
+    else
+    {
+      ss << c_piece_letters[static_cast<size_t>(m.piece())];
+      auto const same_target = rs::count_if(legal_moves,
+                                            [&](Move other)
+                                            {
+                                              return other.piece() == m.piece() && other.to() == m.to();
+                                            });
+      auto const same_file = rs::count_if(legal_moves,
+                                          [&](Move other)
+                                          {
+                                            return other.piece() == m.piece() && other.to() == m.to() &&
+                                                   other.from().x() == m.from().x();
+                                          });
+      if (same_target > 1)
+      {
+        ss << static_cast<char>('a' + m.from().x());
+      }
+      if (same_file > 1)
+      {
+        ss << static_cast<char>('1' + m.from().y());
+      }
+    }
+    if (is_capture)
+    {
+      ss << 'x';
+    }
+    ss << m.to();
+    if (m.promotion() != Piece::empty)
+    {
+      ss << '=' << c_piece_letters[static_cast<size_t>(m.promotion())];
+    }
+    return ss.str();
+  };
+
+  std::mt19937_64 random{7};
+  std::string text;
+  std::vector<std::string> expected_fens;
+  for (auto const* fen : {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+                          "n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"})
+  {
+    for (int game{0}; game < 20; ++game)
+    {
+      auto board = *Board::from_fen(fen);
+      text += std::string{"[FEN \""} + fen + "\"]\n\n";
+      for (int ply{0}; ply < 60; ++ply)
+      {
+        auto const moves = Move_generator::generate_legal_moves(board);
+        if (moves.empty())
+        {
+          break;
+        }
+        auto const m = moves[random() % moves.size()];
+        text += to_san(board, m, moves) + " ";
+        board.move_no_verify(m);
+      }
+      text += "*\n\n";
+      expected_fens.push_back(board.to_fen());
+    }
+  }
+
+  auto const reader = Pgn_reader::from_text(text);
+  REQUIRE(reader.get_game_count() == expected_fens.size());
+  for (size_t i{0}; i < expected_fens.size(); ++i)
+  {
+    auto const board = Pgn_reader::replay_game(reader.get_game(i));
+    REQUIRE(board);
+    REQUIRE(board->to_fen() == expected_fens[i]);
+  }
+}
+
+// Replays a file of twenty thousand games
+TEST_CASE("Pgn_replay_speed", "[.Pgn_reader]")
+{
+  auto const fischer_spassky = read_file_contents("./data/fischer_spassky.pgn");
+  auto const sigrist = read_file_contents("./data/sigrist.pgn");
+  REQUIRE(fischer_spassky);
+  REQUIRE(sigrist);
+
+  auto const filename = (std::filesystem::temp_directory_path() / "pgn_replay_speed.pgn").string();
+  {
+    std::ofstream file{filename};
+    for (int i{0}; i < 10'000; ++i)
+    {
+      file << *fischer_spassky << "\n\n" << *sigrist << "\n\n";
+    }
+  }
+
+  auto const split_start = std::chrono::steady_clock::now();
+  auto const reader = Pgn_reader::open(filename);
+  std::chrono::duration<double> const split_elapsed = std::chrono::steady_clock::now() - split_start;
+  REQUIRE(reader);
+  REQUIRE(reader->get_game_count() == 20'000);
+  std::cout << "Opening and splitting: " << split_elapsed.count() << " seconds\n";
+
+  for (auto const thread_count : {size_t{1}, size_t{std::max(std::thread::hardware_concurrency(), 1u)}})
+  {
+    std::atomic<uint64_t> checksum{0};
+    auto const stats = reader->replay(thread_count,
+                                      [&](Pgn_ply const& ply)
+                                      {
+                                        checksum.fetch_add(ply.board.get_hash_key(), std::memory_order_relaxed);
+                                      });
+    REQUIRE(stats.failed_games == 0);
+    std::cout << "replay with " << thread_count << " threads: " << format_with_commas(stats.games_per_second())
+              << " games/s, " << format_with_commas(static_cast<double>(stats.plies) / stats.elapsed_seconds)
+              << " plies/s (" << checksum << ")\n";
+  }
+  std::filesystem::remove(filename);
+}
+
 TEST_CASE("A board should be initially setup", "[board]")
 {
   Board board;
@@ -212,6 +428,153 @@ TEST_CASE("Fen castling rights and en passant"
   REQUIRE(generated_fen == fen);
 }
 
+TEST_CASE("Fen parsing and writing without allocating", "[board]")
+{
+  std::string_view const fen{"r3k2r/qppb1pp1/2nbpn2/1B1N4/pP1PP1qP/P1P3N1/3BQP2/R3K2R b Qk b3 12 140"};
+  auto const allocations_before_parse = get_allocation_count();
+  auto const board = Board::parse_fen(fen);
+  REQUIRE(get_allocation_count() == allocations_before_parse);
+  REQUIRE(board);
+  REQUIRE(board->get_halfmove_clock() == 12);
+  REQUIRE(board->get_move_count() == 140);
+  REQUIRE(board->get_hash_key() == Board::from_fen(fen)->get_hash_key());
+
+  std::array<char, Board::c_max_fen_length> buffer{};
+  auto const allocations_before_write = get_allocation_count();
+  auto const [end, error] = board->to_fen(buffer.data(), buffer.data() + buffer.size());
+  REQUIRE(get_allocation_count() == allocations_before_write);
+  REQUIRE(error == std::errc{});
+  REQUIRE(std::string_view{buffer.data(), end} == fen);
+  REQUIRE(board->to_fen(buffer.data(), buffer.data() + fen.size() - 1).ec == std::errc::value_too_large);
+
+  // Move counts are optional, and epd operations or uci moves can follow
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K6k w - -")->get_move_count() == 1);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K6k w - - ;D1 3"));
+  REQUIRE(Board::parse_fen("  8/8/8/8/8/8/8/K6k w - - 0 1 moves a1a2")->to_fen() == "8/8/8/8/8/8/8/K6k w - - 0 1");
+
+  REQUIRE(Board::parse_fen("").error() == Fen_error::missing_field);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K6k w -").error() == Fen_error::missing_field);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K6x w - -").error() == Fen_error::invalid_piece);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K6\xeb w - -").error() == Fen_error::invalid_piece);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K6\xd0 w - -").error() == Fen_error::invalid_piece);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K7k w - -").error() == Fen_error::bad_rank_length);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/7/K6k w - -").error() == Fen_error::bad_rank_length);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/K6k w - -").error() == Fen_error::bad_rank_count);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/8/K6k w - -").error() == Fen_error::bad_rank_count);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K6k x - -").error() == Fen_error::invalid_active_color);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K6k w KX -").error() == Fen_error::invalid_castling_rights);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K6k w - e9").error() == Fen_error::invalid_en_passant_square);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K6k w - - 0").error() == Fen_error::invalid_move_count);
+  REQUIRE(Board::parse_fen("8/8/8/8/8/8/8/K6k w - - 0 x").error() == Fen_error::invalid_move_count);
+  REQUIRE(Board::from_fen("8/8/8/8/8/8/8/K6x w - -").error() ==
+          get_fen_error_message(Fen_error::invalid_piece));
+}
+
+// Parses and writes an epd file of a few hundred thousand positions, the way
+// training data and test suites are read in. The file repeats every position
+// of the games in data/, the perft suite with its operations, and positions
+// from random games, which have more promotions, castling and en passant.
+TEST_CASE("Fen_speed", "[.board]")
+{
+  std::vector<std::string> lines;
+  for (auto const* pgn_filename : {"./data/fischer_spassky.pgn", "./data/sigrist.pgn"})
+  {
+    auto const pgn = read_file_contents(pgn_filename);
+    REQUIRE(pgn);
+    auto const stats = Pgn_reader::from_text(*pgn).replay(1,
+                                                          [&](Pgn_ply const& ply)
+                                                          {
+                                                            lines.push_back(ply.board.to_fen());
+                                                          });
+    REQUIRE(stats.failed_games == 0);
+  }
+
+  std::ifstream suite{"./data/perftsuite.epd"};
+  REQUIRE(suite);
+  for (std::string line; std::getline(suite, line);)
+  {
+    if (!line.empty() && line.front() != '#')
+    {
+      lines.push_back(line);
+    }
+  }
+
+  for (auto const& board : random_game_positions(1'000))
+  {
+    lines.push_back(board.to_fen());
+  }
+
+  constexpr size_t c_position_count{200'000};
+  auto const filename = std::filesystem::temp_directory_path() / "fen_speed.epd";
+  {
+    std::ofstream file{filename};
+    for (size_t i{0}; i < c_position_count; ++i)
+    {
+      file << lines[i % lines.size()] << "\n";
+    }
+  }
+
+  auto const contents = read_file_contents(filename.string());
+  std::filesystem::remove(filename);
+  REQUIRE(contents);
+
+  std::vector<Board> boards;
+  boards.reserve(c_position_count);
+  for (auto const line : *contents | rs::views::split('\n'))
+  {
+    if (!line.empty())
+    {
+      if (auto const board = Board::parse_fen(std::string_view{line.begin(), line.end()}))
+      {
+        boards.push_back(*board);
+      }
+    }
+  }
+  REQUIRE(boards.size() == c_position_count);
+
+  auto const time = [&](std::string_view name, auto operation)
+  {
+    uint64_t checksum{0};
+    auto const start = std::chrono::steady_clock::now();
+    for (auto const line : *contents | rs::views::split('\n'))
+    {
+      if (!line.empty())
+      {
+        checksum += operation(std::string_view{line.begin(), line.end()});
+      }
+    }
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << name << ": " << format_with_commas(static_cast<double>(boards.size()) / elapsed.count())
+              << " positions/s (" << checksum << ")\n";
+  };
+
+  time("from_fen",
+       [](std::string_view fen)
+       {
+         return Board::from_fen(fen)->get_hash_key();
+       });
+  time("parse_fen",
+       [](std::string_view fen)
+       {
+         return Board::parse_fen(fen)->get_hash_key();
+       });
+
+  size_t board_index{0};
+  time("to_fen string",
+       [&](std::string_view)
+       {
+         return boards[board_index++].to_fen().size();
+       });
+  board_index = 0;
+  std::array<char, Board::c_max_fen_length> buffer{};
+  time("to_fen buffer",
+       [&](std::string_view)
+       {
+         auto const& board = boards[board_index++];
+         return static_cast<size_t>(board.to_fen(buffer.data(), buffer.data() + buffer.size()).ptr - buffer.data());
+       });
+}
+
 TEST_CASE("A board should prevent illegal moves", "[board]")
 {
   Board board;
@@ -312,6 +675,23 @@ TEST_CASE("En passant move type", "[board]")
   REQUIRE(m->type() == Move_type::normal);
 }
 
+TEST_CASE("Move types", "[board]")
+{
+  auto board = *Board::from_fen("r3k2r/1P6/8/8/8/8/4P3/R3K2R w KQkq - 0 1");
+  REQUIRE(board.move_from_uci("e2e4")->type() == Move_type::double_push);
+  REQUIRE(board.move_from_uci("e2e3")->type() == Move_type::normal);
+  REQUIRE(board.move_from_uci("e1g1")->type() == Move_type::castle);
+  REQUIRE(board.move_from_algebraic("O-O-O", Color::white)->type() == Move_type::castle);
+  REQUIRE(board.move_from_uci("b7b8q")->type() == Move_type::promotion);
+  REQUIRE(board.move_from_uci("b7a8n")->type() == Move_type::promotion);
+
+  // The generator must agree with the move parser on every move
+  for (auto const move : Move_generator::generate_legal_moves(board))
+  {
+    REQUIRE(*board.move_from_uci(move_to_string(move)) == move);
+  }
+}
+
 TEST_CASE("A board can make moves in uci format", "[board]")
 {
   Board board;
@@ -429,7 +809,7 @@ TEST_CASE("Undo move 2", "[board]")
   auto halfmove_clock = board->get_halfmove_clock();
 
   auto m = board->move_from_uci("e1c1");
-  REQUIRE(m->type() == Move_type::normal);
+  REQUIRE(m->type() == Move_type::castle);
   REQUIRE(board->move_no_verify(*m));
 
   board->undo_move(*m, en_passant_square, castling_rights, halfmove_clock);
@@ -466,6 +846,125 @@ TEST_CASE("Test is_square_attacked", "[Move_generator]")
   REQUIRE(!Move_generator::is_square_attacked(board, Color::white, bb));
 }
 
+TEST_CASE("Slider fill", "[Move_generator]")
+{
+  // Compares the set-wise fills with one magic lookup per piece
+  auto const lookup_attacks = [](Piece piece, Bitboard pieces, Bitboard occupied)
+  {
+    Bitboard result;
+    for (auto const location : pieces)
+    {
+      result |= Move_generator::get_piece_attacks(piece, Coordinates{location}, occupied);
+    }
+    return result;
+  };
+
+  std::mt19937_64 random{42};
+  for (int i{0}; i < 1000; ++i)
+  {
+    Bitboard const occupied{random() & random()};
+    Bitboard const rooks{random() & random() & random() & occupied.val};
+    Bitboard const bishops{random() & random() & random() & occupied.val};
+    Bitboard const queens{random() & random() & random() & occupied.val};
+    CAPTURE(occupied.val, rooks.val, bishops.val, queens.val);
+
+    auto const scalar = Slider_fill::get_group_attacks_scalar(rooks, bishops, queens, occupied);
+    REQUIRE(scalar.rooks == lookup_attacks(Piece::rook, rooks, occupied));
+    REQUIRE(scalar.bishops == lookup_attacks(Piece::bishop, bishops, occupied));
+    REQUIRE(scalar.queens == lookup_attacks(Piece::queen, queens, occupied));
+    REQUIRE(Slider_fill::get_attacks(rooks | queens, bishops | queens, occupied) ==
+            (scalar.rooks | scalar.bishops | scalar.queens));
+
+    if (Slider_fill::has_avx2())
+    {
+      auto const avx2 = Slider_fill::get_group_attacks_avx2(rooks, bishops, queens, occupied);
+      REQUIRE(avx2.rooks == scalar.rooks);
+      REQUIRE(avx2.bishops == scalar.bishops);
+      REQUIRE(avx2.queens == scalar.queens);
+    }
+  }
+}
+
+TEST_CASE("Attack info", "[Move_generator]")
+{
+  SECTION("Checkers and pins")
+  {
+    // The e4 knight is pinned by the e8 rook, the d2 pawn is pinned by the a5 bishop,
+    // and the h4 bishop is giving check
+    auto const board = *Board::from_fen("4r1k1/8/8/b7/4N2b/8/3P4/4K3 w - - 0 1");
+    auto const info = Move_generator::get_attack_info(board);
+
+    REQUIRE(info.is_in_check());
+    REQUIRE(info.checkers.occupancy() == 1);
+    REQUIRE(info.checkers.is_set(h4));
+    REQUIRE(info.pinned.occupancy() == 2);
+    REQUIRE(info.pinned.is_set(e4));
+    REQUIRE(info.pinned.is_set(d2));
+
+    // The king can't step back along the bishop's diagonal
+    REQUIRE(info.king_danger.is_set(f2));
+    REQUIRE(!info.get_attacks(Color::black).is_set(d1));
+    REQUIRE(info.get_attacks(Color::black, Piece::rook).is_set(e4));
+    REQUIRE(info.get_attacks(Color::white, Piece::knight).is_set(f6));
+    REQUIRE(info.get_attacks(Color::white) == Move_generator::get_all_attacked_squares(board, Color::white));
+  }
+
+  SECTION("is_legal matches making the move")
+  {
+    std::array<std::string_view, 9> const fens{
+      c_start_position_fen,
+      "4r1k1/8/8/b7/4N2b/8/3P4/4K3 w - - 0 1",
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      "8/8/8/K2pP2r/8/8/8/7k w - d6 0 1",                     // En passant would expose the king
+      "4k3/8/8/8/1b6/8/3r4/4K3 w - - 0 1",                     // Can only move the king
+      "4k3/8/8/2Pp4/8/8/8/7K w - d6 0 1",                      // Checked by a pawn that can be captured en passant
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    };
+
+    for (auto const fen : fens)
+    {
+      CAPTURE(fen);
+      auto const board = *Board::from_fen(fen);
+      auto const info = Move_generator::get_attack_info(board);
+      REQUIRE(info.is_in_check() == board.is_in_check(board.get_active_color()));
+
+      for (auto const move : Move_generator::generate_pseudo_legal_moves(board, info))
+      {
+        CAPTURE(move);
+        Board tmp_board{board};
+        REQUIRE(Move_generator::is_legal(board, info, move) == !tmp_board.move_results_in_check_destructive(move));
+      }
+
+      // The legal generator should produce exactly the pseudo legal moves that pass the check
+      Move_list expected;
+      for (auto const move : Move_generator::generate_pseudo_legal_moves(board, info))
+      {
+        Board tmp_board{board};
+        if (!tmp_board.move_results_in_check_destructive(move))
+        {
+          expected.push_back(move);
+        }
+      }
+      auto legal = Move_generator::generate_legal_moves(board);
+      rs::sort(expected);
+      rs::sort(legal);
+      REQUIRE(rs::equal(legal, expected));
+
+      Move_list expected_attacks;
+      rs::copy_if(expected, std::back_inserter(expected_attacks),
+                  [](auto move)
+                  {
+                    return move.victim() != Piece::empty && move.type() != Move_type::en_passant;
+                  });
+      auto legal_attacks = Move_generator::generate_legal_attack_moves(board);
+      rs::sort(legal_attacks);
+      REQUIRE(rs::equal(legal_attacks, expected_attacks));
+    }
+  }
+}
+
 TEST_CASE("Move counts", "[board]")
 {
   Board board;
@@ -530,6 +1029,15 @@ TEST_CASE("Zobrist hashing", "[Zobrist_hash]")
     REQUIRE(hash1 != hash2);
   }
 
+  SECTION("En passant squares on different files should change hash")
+  {
+    // Both squares are on the same rank, so the key must come from the file
+    auto const board_d6 = *Board::from_fen("4k3/8/8/2PppP2/8/8/8/4K3 w - d6 0 1");
+    auto const board_e6 = *Board::from_fen("4k3/8/8/2PppP2/8/8/8/4K3 w - e6 0 1");
+    REQUIRE(Zobrist_hash(board_d6) != Zobrist_hash(board_e6));
+    REQUIRE(board_d6.get_hash_key() != board_e6.get_hash_key());
+  }
+
   SECTION("Different castling rights should change hash")
   {
     static std::string const fen_string2{"r1bqk2r/p2p1pbp/1pn3p1/1p1Np2n/4PP2/"
@@ -588,9 +1096,299 @@ TEST_CASE("Zobrist hash from fen should match hash from playing moves", "[Zobris
   REQUIRE(board.get_hash_key() == board2.get_hash_key());
 }
 
+TEST_CASE("Piece square score", "[Piece_square_score]")
+{
+  SECTION("Starting position is balanced")
+  {
+    Board board;
+    auto const score = board.get_piece_square_score();
+    REQUIRE(score.phase() == Piece_square_score::c_max_phase);
+    REQUIRE(score.middlegame() == 0);
+    REQUIRE(score.endgame() == 0);
+  }
+
+  SECTION("Mirrored positions have opposite scores")
+  {
+    auto board = *Board::from_fen("r1bqk2r/p2p1pbp/1pn3p1/1p1Np2n/4PP2/P2P4/1PP1N1PP/R1B2RK1 b kq f3 0 10");
+    auto mirrored = *Board::from_fen("r1b2rk1/1pp1n1pp/p2p4/4pp2/1P1nP2N/1PN3P1/P2P1PBP/R1BQK2R w KQ f6 0 10");
+    REQUIRE(board.get_piece_square_score().tapered(Color::black) ==
+            mirrored.get_piece_square_score().tapered(Color::white));
+  }
+
+  SECTION("Incremental updates match a full recomputation")
+  {
+    // Covers castling, en passant, captures and promotion
+    auto board = *Board::from_fen("r3k2r/1P3ppp/8/3pP3/8/8/5PPP/R3K2R w KQkq d6 0 1");
+    for (auto const move_str : {"e5d6", "e8g8", "b7b8q", "a8b8", "e1g1"})
+    {
+      REQUIRE(board.try_move_uci(move_str));
+      REQUIRE(board.get_piece_square_score() == Piece_square_score{board});
+    }
+  }
+}
+
+TEST_CASE("Material table", "[Material_table]")
+{
+  SECTION("Material key counts pieces incrementally")
+  {
+    auto board = *Board::from_fen("r3k2r/1P3ppp/8/3pP3/8/8/5PPP/R3K2R w KQkq d6 0 1");
+    REQUIRE(board.get_material_key().count(Color::white, Piece::pawn) == 5);
+    for (auto const move_str : {"e5d6", "e8g8", "b7b8q", "a8b8", "e1g1"})
+    {
+      REQUIRE(board.try_move_uci(move_str));
+      REQUIRE(board.get_material_key() == Material_key{board});
+    }
+    REQUIRE(board.get_material_key().count(Color::white, Piece::pawn) == 4);
+    REQUIRE(board.get_material_key().count(Color::white, Piece::queen) == 0);
+    REQUIRE(board.get_material_key().count(Color::black, Piece::pawn) == 3);
+    REQUIRE(board.get_material_key().count(Color::black, Piece::rook) == 2);
+  }
+
+  SECTION("Starting position")
+  {
+    Board board;
+    auto const entry = Material_table::evaluate(board.get_material_key());
+    REQUIRE(entry.material == 0);
+    REQUIRE(entry.imbalance == 0);
+    REQUIRE(entry.phase == Piece_square_score::c_max_phase);
+    REQUIRE(!entry.is_special());
+  }
+
+  SECTION("Known draws")
+  {
+    for (auto const* fen :
+         {"8/8/4k3/8/8/3K4/8/8 w - - 0 1", "8/8/4k3/8/8/3KN3/8/8 w - - 0 1", "8/8/4kb2/8/8/3KB3/8/8 w - - 0 1",
+          "8/8/4kn2/8/8/3KB3/8/8 b - - 0 1", "8/8/4k3/8/8/3KNN2/8/8 w - - 0 1"})
+    {
+      CAPTURE(fen);
+      REQUIRE(Material_table::evaluate(Board::from_fen(fen)->get_material_key()).is_draw);
+    }
+
+    for (auto const* fen : {"8/8/4k3/8/8/3KR3/8/8 w - - 0 1", "8/8/4k3/8/8/3KBB2/8/8 w - - 0 1",
+                            "8/8/4k3/8/8/3KNN2/4P3/8 w - - 0 1", "8/8/4kn2/8/8/3KNN2/8/8 w - - 0 1"})
+    {
+      CAPTURE(fen);
+      REQUIRE(!Material_table::evaluate(Board::from_fen(fen)->get_material_key()).is_draw);
+    }
+  }
+
+  SECTION("Specialized endgames")
+  {
+    auto const krk = Material_table::evaluate(Board::from_fen("8/8/4k3/8/8/3K4/8/6r1 w - - 0 1")->get_material_key());
+    REQUIRE(krk.endgame_function);
+    REQUIRE(krk.strong_color == Color::black);
+
+    auto const kbnk = Material_table::evaluate(Board::from_fen("8/8/4k3/8/8/3KBN2/8/8 w - - 0 1")->get_material_key());
+    REQUIRE(kbnk.endgame_function);
+    REQUIRE(kbnk.strong_color == Color::white);
+
+    // Rook pawn with the defending king in the corner is a draw
+    auto const kpk_draw = *Board::from_fen("7k/8/8/8/8/8/P7/K7 w - - 0 1");
+    auto const kpk_draw_corner = *Board::from_fen("k7/8/8/8/8/8/P7/K7 w - - 0 1");
+    auto const kpk = Material_table::evaluate(kpk_draw.get_material_key());
+    REQUIRE(kpk.scale_function);
+    REQUIRE(kpk.scale_factor(kpk_draw) == Material_table::c_scale_normal);
+    REQUIRE(kpk.scale_factor(kpk_draw_corner) == 0);
+
+    auto const same_bishops = *Board::from_fen("8/4kbp1/8/8/8/8/3KB1P1/8 w - - 0 1");
+    auto const opposite_bishops = *Board::from_fen("8/4k1p1/5b2/8/8/8/3KB1P1/8 w - - 0 1");
+    auto const bishops = Material_table::evaluate(same_bishops.get_material_key());
+    REQUIRE(bishops.scale_function);
+    REQUIRE(bishops.scale_factor(same_bishops) == Material_table::c_scale_normal);
+    REQUIRE(bishops.scale_factor(opposite_bishops) < Material_table::c_scale_normal);
+  }
+
+  SECTION("Probing")
+  {
+    Material_table table{1024};
+    Board board;
+    REQUIRE(table.probe(board).key == board.get_material_key().get_key());
+    REQUIRE(table.probe(board).phase == Piece_square_score::c_max_phase);
+    REQUIRE(table.get_hits() == 1);
+    REQUIRE(table.get_misses() == 1);
+
+    table.clear();
+    REQUIRE(table.get_hits() == 0);
+    REQUIRE(table.get_misses() == 0);
+  }
+}
+
+TEST_CASE("Pawn hash table", "[Pawn_hash_table]")
+{
+  SECTION("Pawn key only changes when pawns move")
+  {
+    Board board;
+    auto const start_key = board.get_pawn_hash_key();
+    REQUIRE(start_key == Zobrist_hash::pawns_only(board));
+
+    REQUIRE(board.try_move_algebraic("Nf3"));
+    REQUIRE(board.get_pawn_hash_key() == start_key);
+
+    REQUIRE(board.try_move_algebraic("e5"));
+    REQUIRE(board.get_pawn_hash_key() != start_key);
+    REQUIRE(board.get_pawn_hash_key() == Zobrist_hash::pawns_only(board));
+  }
+
+  SECTION("Pawn structure evaluation")
+  {
+    // c2 is doubled so only the front c pawn is passed
+    auto const board = *Board::from_fen("4k3/8/8/3P4/8/2P1P3/2P5/4K3 w - - 0 1");
+    auto const entry = Pawn_hash_table::evaluate(board);
+
+    Bitboard expected_passed;
+    expected_passed.set_square(c3);
+    expected_passed.set_square(d5);
+    expected_passed.set_square(e3);
+    REQUIRE(entry.passed_pawns[static_cast<uint8_t>(Color::white)] == expected_passed);
+    REQUIRE(entry.passed_pawns[static_cast<uint8_t>(Color::black)].is_empty());
+
+    auto const mirrored = *Board::from_fen("4k3/2p5/2p1p3/8/3p4/8/8/4K3 b - - 0 1");
+    auto const mirrored_entry = Pawn_hash_table::evaluate(mirrored);
+    REQUIRE(mirrored_entry.middlegame == -entry.middlegame);
+    REQUIRE(mirrored_entry.endgame == -entry.endgame);
+  }
+
+  SECTION("Probes hit once the pawn structure is cached")
+  {
+    Pawn_hash_table table{1024 * sizeof(Pawn_hash_table::Entry)};
+    Board board;
+    auto const first = table.probe(board);
+    REQUIRE(table.get_misses() == 1);
+
+    REQUIRE(board.try_move_algebraic("Nf3"));
+    auto const second = table.probe(board);
+    REQUIRE(table.get_hits() == 1);
+    REQUIRE(first.score(Color::white, 24) == second.score(Color::white, 24));
+
+    REQUIRE(board.try_move_algebraic("d5"));
+    table.probe(board);
+    REQUIRE(table.get_misses() == 2);
+  }
+}
+
+TEST_CASE("Eval cache", "[Eval_cache]")
+{
+  Eval_cache cache{1024 * sizeof(uint32_t)};
+  REQUIRE(cache.get_capacity() == 1024);
+
+  Board board;
+  auto const key = board.get_hash_key().get_hash();
+  REQUIRE(!cache.get(key));
+
+  cache.insert(key, -123);
+  REQUIRE(cache.get(key) == -123);
+
+  // Same index, but the check bits don't match
+  auto const colliding_key = key ^ (zhash_t{1} << 60);
+  REQUIRE(!cache.get(colliding_key));
+  cache.insert(colliding_key, Eval_cache::c_checkmate_score);
+  REQUIRE(cache.get(colliding_key) == Eval_cache::c_checkmate_score);
+  REQUIRE(!cache.get(key));
+
+  // Keys that differ only in the lowest check bit are told apart
+  auto const low_bit_key = key ^ (zhash_t{1} << 48);
+  cache.insert(low_bit_key, 77);
+  REQUIRE(cache.get(low_bit_key) == 77);
+  REQUIRE(!cache.get(colliding_key));
+  REQUIRE(!cache.get(key));
+
+  // Check bits of zero mark empty entries, so those keys aren't cached
+  auto const empty_check_key = key & ((zhash_t{1} << 48) - 1);
+  REQUIRE(!cache.get(empty_check_key));
+  cache.insert(empty_check_key, 0);
+  REQUIRE(!cache.get(empty_check_key));
+
+  cache.clear();
+  REQUIRE(!cache.get(colliding_key));
+
+  cache.resize(0);
+  cache.insert(key, 5);
+  REQUIRE(!cache.get(key));
+}
+
+TEST_CASE("Nnue", "[Nnue_network]")
+{
+  auto const network = Nnue_network::create_random(42);
+  auto const board = *Board::from_fen("r1bqk2r/p2p1pbp/1pn3p1/1p1Np2n/4PP2/P2P4/1PP1N1PP/R1B2RK1 b kq f3 0 10");
+
+  SECTION("Save and load")
+  {
+    auto const filename = (std::filesystem::temp_directory_path() / "meneldor_test_network.nnue").string();
+    REQUIRE(network.save(filename));
+    auto const loaded = Nnue_network::load(filename);
+    std::filesystem::remove(filename);
+    REQUIRE(loaded);
+
+    Nnue_accumulator original_accumulator;
+    original_accumulator.refresh(network, board);
+    Nnue_accumulator loaded_accumulator;
+    loaded_accumulator.refresh(*loaded, board);
+    REQUIRE(network.evaluate(original_accumulator, Color::black) ==
+            loaded->evaluate(loaded_accumulator, Color::black));
+
+    REQUIRE(!Nnue_network::load(filename));
+  }
+
+  SECTION("SIMD matches scalar")
+  {
+    Nnue_accumulator accumulator;
+    accumulator.refresh(network, board);
+    auto const expected = network.evaluate(accumulator, Color::black, Simd_level::scalar);
+    for (auto const level : {Simd_level::sse41, Simd_level::avx2})
+    {
+      if (level <= Nnue_network::get_best_simd_level())
+      {
+        REQUIRE(network.evaluate(accumulator, Color::black, level) == expected);
+      }
+    }
+  }
+
+  SECTION("Incremental updates match a refresh")
+  {
+    auto const matches_refresh = [&](Nnue_accumulator const& accumulator, Board const& position)
+    {
+      Nnue_accumulator expected;
+      expected.refresh(network, position);
+      return rs::equal(accumulator.get_values(Color::black), expected.get_values(Color::black)) &&
+             rs::equal(accumulator.get_values(Color::white), expected.get_values(Color::white));
+    };
+
+    // Includes castling, en passant, a capturing promotion and king moves into
+    // different buckets, which need a refresh
+    constexpr std::array c_moves{"e5d6", "e8g8", "b7b8q", "a8b8", "e1d1", "g8h8", "d1c2", "h8g8", "c2d3"};
+    std::array<Board, c_moves.size() + 1> path;
+    path[0] = *Board::from_fen("r3k2r/1P3ppp/8/3pP3/8/8/5PPP/R3K2R w KQkq d6 0 1");
+
+    Nnue_stack stack;
+    stack.reset(path[0]);
+    REQUIRE(matches_refresh(stack.get(network, path[0]), path[0]));
+    for (size_t i{0}; i < c_moves.size(); ++i)
+    {
+      path[i + 1] = path[i];
+      REQUIRE(path[i + 1].try_move_uci(c_moves[i]));
+      stack.push(path[i + 1]);
+
+      // Only evaluate every other position, so some updates span several moves
+      if (i % 2 == 1)
+      {
+        REQUIRE(matches_refresh(stack.get(network, path[i + 1]), path[i + 1]));
+      }
+    }
+    REQUIRE(matches_refresh(stack.get(network, path.back()), path.back()));
+
+    // A sibling of a position is updated from their common parent
+    stack.pop();
+    auto sibling = path[path.size() - 2];
+    REQUIRE(sibling.try_move_uci("c2d2"));
+    stack.push(sibling);
+    REQUIRE(matches_refresh(stack.get(network, sibling), sibling));
+  }
+}
+
 TEST_CASE("Transposition table", "[Transposition_table]")
 {
-  Transposition_table tt{1024 * sizeof(Transposition_table::Entry)};
+  Transposition_table tt{1024 * 64};
+  REQUIRE(tt.get_capacity() == 1024 * 8);
 
   Board board;
   board.try_move_algebraic("e4");
@@ -601,9 +1399,7 @@ TEST_CASE("Transposition table", "[Transposition_table]")
   board.try_move_algebraic("d6");
 
   auto m = board.move_from_uci("a2 a3");
-  Transposition_table::Entry e{board.get_hash_key(), 2, 1, *m, Transposition_table::Eval_type::alpha};
-
-  tt.insert(board.get_hash_key(), e);
+  tt.insert(board.get_hash_key(), 2, 1, *m, Transposition_table::Eval_type::alpha);
 
   Board board2;
 
@@ -618,8 +1414,415 @@ TEST_CASE("Transposition table", "[Transposition_table]")
 
   REQUIRE(board.get_hash_key() == board2.get_hash_key());
   auto e2 = tt.get(board2.get_hash_key());
-  REQUIRE(e2 != nullptr);
+  REQUIRE(e2);
   REQUIRE(e2->evaluation == 1);
+  REQUIRE(e2->depth == 2);
+  REQUIRE(e2->best_move == m->compact());
+  REQUIRE(e2->type == Transposition_table::Eval_type::alpha);
+  REQUIRE(tt.count() == 1);
+
+  // Negative and mate scores survive packing, and searching the same
+  // position again keeps the old move if the new search didn't find one
+  tt.insert(board.get_hash_key(), 3, negative_inf + 5, Move{}, Transposition_table::Eval_type::exact);
+  e2 = tt.get(board.get_hash_key());
+  REQUIRE(e2);
+  REQUIRE(e2->evaluation == negative_inf + c_max_supported_depth);
+  REQUIRE(e2->best_move == m->compact());
+  REQUIRE(e2->type == Transposition_table::Eval_type::exact);
+  REQUIRE(tt.count() == 1);
+
+  // Fill a single bucket. Keys differing only in their top bits land in the
+  // same bucket with the same check bits, so use the low bits to tell them apart.
+  Transposition_table small_tt{64};
+  for (zhash_t i{1}; i <= 8; ++i)
+  {
+    small_tt.insert(i, static_cast<int>(i) + 10, -static_cast<int>(i), Move{}, Transposition_table::Eval_type::beta);
+  }
+  REQUIRE(small_tt.count() == 8);
+  REQUIRE(small_tt.get(1)->evaluation == -1);
+
+  // The shallowest entry is replaced first
+  small_tt.insert(9, 1, 0, Move{}, Transposition_table::Eval_type::beta);
+  REQUIRE_FALSE(small_tt.get(1));
+  REQUIRE(small_tt.get(9));
+
+  // Entries from older generations are replaced before deeper entries
+  small_tt.new_generation();
+  small_tt.new_generation();
+  small_tt.insert(10, 1, 0, Move{}, Transposition_table::Eval_type::beta);
+  small_tt.insert(11, 1, 0, Move{}, Transposition_table::Eval_type::beta);
+  REQUIRE(small_tt.get(10));
+  REQUIRE(small_tt.get(11));
+  REQUIRE_FALSE(small_tt.get(2));
+  REQUIRE(small_tt.get(8));
+  REQUIRE(small_tt.count() == 8);
+
+  small_tt.clear();
+  REQUIRE(small_tt.count() == 0);
+  REQUIRE_FALSE(small_tt.uses_huge_pages());
+
+  // Resizing discards the old entries
+  REQUIRE(tt.resize(8 * 1024 * 1024));
+  REQUIRE(tt.get_capacity() == 1024 * 1024);
+  REQUIRE(tt.count() == 0);
+#if !defined(_WIN32)
+  REQUIRE(tt.uses_huge_pages());
+#endif
+  tt.insert(board.get_hash_key(), 2, 1, *m, Transposition_table::Eval_type::alpha);
+  REQUIRE(tt.get(board.get_hash_key()));
+  tt.clear();
+  REQUIRE_FALSE(tt.get(board.get_hash_key()));
+
+  Transposition_table no_huge_pages_tt{8 * 1024 * 1024, false};
+  REQUIRE_FALSE(no_huge_pages_tt.uses_huge_pages());
+
+  // Saving and loading
+  auto const filename = std::filesystem::temp_directory_path() / "meneldor_test.hash";
+  tt.insert(board.get_hash_key(), 4, -20, *m, Transposition_table::Eval_type::beta);
+  REQUIRE(tt.save(filename));
+
+  // The end of the header, after the generation, is written as zeros
+  {
+    std::array<char, 64> header{};
+    std::ifstream{filename, std::ios::binary}.read(header.data(), header.size());
+    REQUIRE(std::all_of(header.begin() + 33, header.end(),
+                        [](char c)
+                        {
+                          return c == 0;
+                        }));
+  }
+
+  Transposition_table loaded_tt{64};
+  REQUIRE(loaded_tt.load(filename));
+  REQUIRE(loaded_tt.get_capacity() == tt.get_capacity());
+  REQUIRE(loaded_tt.count() == 1);
+  auto const loaded = loaded_tt.get(board.get_hash_key());
+  REQUIRE(loaded);
+  REQUIRE(loaded->depth == 4);
+  REQUIRE(loaded->evaluation == -20);
+  REQUIRE(loaded->best_move == m->compact());
+
+  // Changes to a loaded table don't reach the file
+  loaded_tt.clear();
+  REQUIRE(loaded_tt.count() == 0);
+  REQUIRE(loaded_tt.load(filename));
+  REQUIRE(loaded_tt.count() == 1);
+
+  // Saving over the file the table is mapped from
+  loaded_tt.insert(board2.get_hash_key() ^ 1, 1, 0, Move{}, Transposition_table::Eval_type::exact);
+  REQUIRE(loaded_tt.save(filename));
+  REQUIRE(loaded_tt.count() == 2);
+  REQUIRE(loaded_tt.load(filename));
+  REQUIRE(loaded_tt.count() == 2);
+
+  // Truncated files and files that aren't tables are rejected, keeping the current table
+  auto const bad_filename = std::filesystem::temp_directory_path() / "meneldor_test_bad.hash";
+  std::filesystem::copy_file(filename, bad_filename, std::filesystem::copy_options::overwrite_existing);
+  std::filesystem::resize_file(bad_filename, std::filesystem::file_size(bad_filename) - 64);
+  REQUIRE_FALSE(loaded_tt.load(bad_filename));
+  REQUIRE(loaded_tt.count() == 2);
+  std::ofstream{bad_filename} << "Not a transposition table, but long enough to have a header that can be read";
+  REQUIRE_FALSE(loaded_tt.load(bad_filename));
+  std::filesystem::remove(bad_filename);
+  REQUIRE_FALSE(loaded_tt.load(bad_filename));
+  REQUIRE(loaded_tt.count() == 2);
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("Numa topology", "[Numa_topology]")
+{
+  REQUIRE(Numa_topology::parse_cpu_list("0-3,8-9,5\n") == std::vector{0, 1, 2, 3, 5, 8, 9});
+  REQUIRE(Numa_topology::parse_cpu_list("")->empty());
+  REQUIRE_FALSE(Numa_topology::parse_cpu_list("3-1"));
+  REQUIRE_FALSE(Numa_topology::parse_cpu_list("0,a"));
+
+  auto const root = std::filesystem::temp_directory_path() / "meneldor_test_numa";
+  std::filesystem::remove_all(root);
+  auto write_cpu_list = [&](std::string const& node, std::string const& cpus)
+  {
+    std::filesystem::create_directories(root / node);
+    std::ofstream{root / node / "cpulist"} << cpus << "\n";
+  };
+  write_cpu_list("node0", "0-3,8-11");
+  write_cpu_list("node2", "4-7,12-15");
+
+  // Memory only node
+  write_cpu_list("node1", "");
+  std::filesystem::create_directories(root / "power");
+
+  // Nodes keep their ids from sysfs
+  auto const topology = Numa_topology::detect(root);
+  REQUIRE(topology.get_node_count() == 2);
+  REQUIRE(topology.get_nodes()[1].id == 2);
+  REQUIRE(topology.has_node(2));
+  REQUIRE_FALSE(topology.has_node(1));
+  REQUIRE(rs::equal(topology.get_cpus(2), std::vector{4, 5, 6, 7, 12, 13, 14, 15}));
+  REQUIRE(topology.get_cpus(1).empty());
+  REQUIRE_FALSE(topology.bind_current_thread(1));
+  std::filesystem::remove_all(root);
+
+  // Without any nodes, every cpu is on one node
+  auto const single_node = Numa_topology::detect(root);
+  REQUIRE(single_node.get_node_count() == 1);
+  REQUIRE_FALSE(single_node.get_cpus(0).empty());
+
+  auto const& system = Numa_topology::get_system();
+  REQUIRE(system.get_node_count() >= 1);
+#if !defined(_WIN32)
+  // A thread bound to a node can run on every cpu again
+  REQUIRE(system.bind_current_thread(system.get_nodes().front().id));
+  REQUIRE(system.unbind_current_thread());
+#endif
+}
+
+TEST_CASE("Tablebase", "[Tablebase]")
+{
+  auto const names = Tablebase::get_all_table_names();
+  auto position_of = [&](std::string_view name)
+  {
+    return rs::find(names, name) - names.begin();
+  };
+  REQUIRE(position_of("KQvK") < position_of("KQvKR"));
+  REQUIRE(position_of("KQQvK") < position_of("KQPvK"));
+  REQUIRE(position_of("KPvKP") < static_cast<ptrdiff_t>(names.size()));
+
+  Tablebase tablebase;
+  auto generated = Tablebase_generator::generate("KQvK", tablebase, 2);
+  REQUIRE(generated);
+  auto const& table = *generated;
+  REQUIRE(table.get_piece_count() == 3);
+
+  SECTION("Index round trip")
+  {
+    for (size_t i{0}; i < table.size(); i += 7)
+    {
+      REQUIRE(table.index_of(table.position_at(i)) == i);
+    }
+  }
+
+  auto const filename = (std::filesystem::temp_directory_path() / "meneldor_test_KQvK.mtb").string();
+  REQUIRE(table.save(filename));
+  auto loaded = Tablebase_table::load(filename);
+  REQUIRE(loaded);
+  std::filesystem::remove(filename);
+  REQUIRE(loaded->get_name() == "KQvK");
+  REQUIRE(loaded->size() == table.size());
+  for (size_t i{0}; i < table.size(); ++i)
+  {
+    REQUIRE(loaded->get_value(i) == table.get_value(i));
+  }
+  tablebase.add_table(std::move(*loaded));
+  REQUIRE(tablebase.get_max_pieces() == 3);
+
+  auto probe = [&](std::string_view fen)
+  {
+    auto const result = tablebase.probe(*Board::from_fen(fen));
+    REQUIRE(result);
+    return std::pair{result->wdl, result->distance_to_mate};
+  };
+
+  using enum Tablebase_result::Wdl;
+  REQUIRE(probe("k7/8/1K6/8/8/8/8/6Q1 w - - 0 1") == std::pair{win, 1});
+  REQUIRE(probe("k6Q/8/1K6/8/8/8/8/8 b - - 0 1") == std::pair{loss, 0});
+  REQUIRE(probe("k7/8/1Q6/8/8/8/8/K7 b - - 0 1") == std::pair{draw, 0});
+  REQUIRE(probe("k7/8/8/8/8/8/8/Kq6 w - - 0 1") == std::pair{draw, 0});
+
+  // Black is the stronger side
+  REQUIRE(probe("6q1/8/8/8/8/1k6/8/K7 b - - 0 1") == std::pair{win, 1});
+
+  // No position takes longer than ten moves to mate
+  REQUIRE(probe("8/8/8/4k3/8/8/8/KQ6 w - - 0 1").first == win);
+  for (size_t i{0}; i < table.size(); ++i)
+  {
+    REQUIRE(Tablebase_table::decode(table.get_value(i)).distance_to_mate <= 20);
+  }
+
+  // Every result agrees with the best result after each move
+  Board const board = *Board::from_fen("8/8/3k4/8/8/2Q5/8/4K3 w - - 0 1");
+  auto const result = tablebase.probe(board);
+  REQUIRE(result);
+  std::optional<Tablebase_result> best;
+  for (auto const move : Move_generator::generate_legal_moves(board))
+  {
+    Board child{board};
+    child.move_no_verify(move);
+    auto const child_result = tablebase.probe(child);
+    REQUIRE(child_result);
+    if (!best || child_result->parent().rank() > best->rank())
+    {
+      best = child_result->parent();
+    }
+  }
+  REQUIRE(best->wdl == result->wdl);
+  REQUIRE(best->distance_to_mate == result->distance_to_mate);
+
+  // Only KQvK is loaded
+  REQUIRE_FALSE(tablebase.probe(*Board::from_fen("4k3/8/8/8/8/8/8/R3K3 w - - 0 1")));
+
+  // A win is only reported if mate comes before the 50 move rule ends the game
+  auto const distance_to_mate = probe("8/8/8/4k3/8/8/8/KQ6 w - - 0 1").second;
+  auto const with_halfmove_clock = [&](int32_t halfmove_clock)
+  {
+    return *Board::from_fen("8/8/8/4k3/8/8/8/KQ6 w - - " + std::to_string(halfmove_clock) + " 60");
+  };
+  REQUIRE(tablebase.probe(with_halfmove_clock(100 - distance_to_mate))->wdl == win);
+  REQUIRE_FALSE(tablebase.probe(with_halfmove_clock(101 - distance_to_mate)));
+  REQUIRE(tablebase.probe_ignoring_halfmove_clock(with_halfmove_clock(101 - distance_to_mate))->distance_to_mate ==
+          distance_to_mate);
+  REQUIRE(probe("k7/8/1Q6/8/8/8/8/K7 b - - 99 80") == std::pair{draw, 0});
+
+  tablebase.clear();
+  REQUIRE_FALSE(tablebase.probe(*Board::from_fen("k7/8/1K6/8/8/8/8/6Q1 w - - 0 1")));
+}
+
+TEST_CASE("Syzygy", "[Syzygy]")
+{
+  Syzygy_tablebase tablebase;
+  REQUIRE_FALSE(tablebase.load_paths("/this/directory/does/not/exist"));
+
+  auto const directory = std::filesystem::temp_directory_path() / "meneldor_test_syzygy";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  REQUIRE(tablebase.load_paths(directory.string()) == 0);
+  REQUIRE_FALSE(tablebase.probe_wdl(*Board::from_fen("k7/8/1K6/8/8/8/8/6Q1 w - - 0 1")));
+
+  // A KQvK table where every position with white to move is a win, and every
+  // position with black to move is a loss. Real tables compress their values,
+  // this one stores a single value for each side to move.
+  std::array<uint8_t, 80> file{
+    0x71, 0xE8, 0x23, 0x5D, // Magic
+    0x01,                   // Split by side to move, no pawns
+    0x00,                   // Encoding order
+    0x55, 0x66, 0xEE,       // White queen, white king and black king for both sides to move
+    0x00,                   // Padding
+    0x80, 0x04,             // White to move: a single value, win
+    0x80, 0x00,             // Black to move: a single value, loss
+  };
+  {
+    std::ofstream out{directory / "KQvK.rtbw", std::ios::binary};
+    out.write(reinterpret_cast<char const*>(file.data()), file.size());
+  }
+  REQUIRE(tablebase.load_paths(directory.string()) == 1);
+  REQUIRE(tablebase.get_max_pieces() == 3);
+
+  REQUIRE(tablebase.probe_wdl(*Board::from_fen("8/8/8/8/8/2k5/8/KQ6 w - - 0 1")) == Syzygy_wdl::win);
+  REQUIRE(tablebase.probe_wdl(*Board::from_fen("8/8/8/8/8/2k5/8/KQ6 b - - 0 1")) == Syzygy_wdl::loss);
+
+  // Black is the stronger side
+  REQUIRE(tablebase.probe_wdl(*Board::from_fen("kq6/8/2K5/8/8/8/8/8 w - - 0 1")) == Syzygy_wdl::loss);
+
+  // Captures are searched, since the table doesn't know about them
+  REQUIRE(tablebase.probe_wdl(*Board::from_fen("8/8/8/8/8/2k5/2Q5/K7 b - - 0 1")) == Syzygy_wdl::draw);
+
+  // Not covered by any table
+  REQUIRE_FALSE(tablebase.probe_wdl(*Board::from_fen("8/8/8/8/8/2k5/8/KR6 w - - 0 1")));
+
+  // There is no DTZ table, so root moves are only filtered by their result.
+  // Moving the queen next to the black king loses it.
+  auto const board = *Board::from_fen("8/8/8/8/8/2k5/8/KQ6 w - - 0 1");
+  auto const legal_moves = Move_generator::generate_legal_moves(board);
+  auto const root_moves = tablebase.filter_root_moves(board, legal_moves);
+  REQUIRE(root_moves);
+  REQUIRE(root_moves->size() < legal_moves.size());
+  REQUIRE(rs::none_of(*root_moves,
+                      [](Move move)
+                      {
+                        return move.to() == c2;
+                      }));
+  REQUIRE_FALSE(tablebase.probe_dtz(board));
+
+  // Files with the wrong magic aren't used
+  file[0] = 0;
+  {
+    std::ofstream out{directory / "KRvK.rtbw", std::ios::binary};
+    out.write(reinterpret_cast<char const*>(file.data()), file.size());
+  }
+  REQUIRE(tablebase.load_paths(directory.string()) == 2);
+  REQUIRE_FALSE(tablebase.probe_wdl(*Board::from_fen("8/8/8/8/8/2k5/8/KR6 w - - 0 1")));
+
+  tablebase.clear();
+  REQUIRE(tablebase.get_max_pieces() == 0);
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Syzygy agrees with the tablebase everywhere", "[Syzygy]")
+{
+  Tablebase tablebase;
+  for (auto const* name : {"KQvK", "KRvK", "KBvK", "KNvK", "KPvK"})
+  {
+    auto table = Tablebase_generator::generate(name, tablebase, 1);
+    REQUIRE(table);
+    tablebase.add_table(std::move(*table));
+  }
+
+  // The tables are written in the Syzygy format from the generated tables.
+  // The DTZ tables store different sides to move, so both the direct lookup
+  // and the search one move ahead are checked.
+  auto const directory = std::filesystem::temp_directory_path() / "meneldor_test_syzygy_tables";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  REQUIRE(write_syzygy_table(*tablebase.find_table("KQvK"), directory, Color::white));
+  REQUIRE(write_syzygy_table(*tablebase.find_table("KRvK"), directory, Color::black));
+  REQUIRE(write_syzygy_table(*tablebase.find_table("KPvK"), directory, std::nullopt));
+  REQUIRE_FALSE(write_syzygy_table(*tablebase.find_table("KPvK"), directory, Color::white));
+
+  Syzygy_tablebase syzygy;
+  REQUIRE(syzygy.load_paths(directory.string()) == 3);
+
+  // The same position with the colors swapped and the board mirrored
+  auto swap_colors = [](Board const& board)
+  {
+    std::vector<Piece_placement> placements;
+    for (auto const square : board.get_occupied_squares())
+    {
+      Coordinates const location{square};
+      placements.push_back({opposite_color(board.get_piece_color(location)), board.get_piece(location),
+                            {location.x(), c_board_dimension - 1 - location.y()}});
+    }
+    return *Board::from_pieces(placements, opposite_color(board.get_active_color()));
+  };
+
+  // Known values: the longest wins take 10 moves to mate with a queen and
+  // 16 moves with a rook
+  for (auto const& [name, longest_win] : {std::pair{"KQvK", 19}, std::pair{"KRvK", 31}, std::pair{"KPvK", 0}})
+  {
+    auto const& table = *tablebase.find_table(name);
+    size_t position_count{0};
+    int32_t max_dtz{0};
+    for (size_t i{0}; i < table.size(); ++i)
+    {
+      auto const board = board_from_position(table, table.position_at(i));
+      if (!board)
+      {
+        continue;
+      }
+      ++position_count;
+
+      using enum Tablebase_result::Wdl;
+      auto const expected = Tablebase_table::decode(table.get_value(i));
+      auto const wdl = (expected.wdl == win) ? Syzygy_wdl::win : (expected.wdl == loss) ? Syzygy_wdl::loss :
+                                                                                         Syzygy_wdl::draw;
+      INFO(board->to_fen());
+      REQUIRE(syzygy.probe_wdl(*board) == wdl);
+      REQUIRE(syzygy.probe_wdl(swap_colors(*board)) == wdl);
+
+      // A capture by the weaker side draws and the stronger side has nothing
+      // to capture, so DTZ is the distance to mate. Being checkmated counts
+      // as one ply.
+      if (!table.has_pawns())
+      {
+        auto const dtz = (expected.wdl == win)  ? expected.distance_to_mate :
+                         (expected.wdl == loss) ? -std::max(expected.distance_to_mate, 1) :
+                                                  0;
+        REQUIRE(syzygy.probe_dtz(*board) == dtz);
+        max_dtz = std::max(max_dtz, dtz);
+      }
+    }
+    REQUIRE(position_count > table.size() / 2);
+    REQUIRE(max_dtz == longest_win);
+  }
+
+  std::filesystem::remove_all(directory);
 }
 
 TEST_CASE("Coordinate constants are correct", "[Coordinates]")
@@ -1,8 +1,15 @@
 #include <catch2/catch.hpp>
 
 #include "board.h"
+#include "move_counter.h"
 #include "move_generator.h"
+#include "perft.h"
+#include "perft_checker.h"
+#include "slider_fill.h"
+#include "test_positions.h"
+#include "utils.h"
 
+namespace rs = std::ranges;
 namespace Meneldor
 {
 
@@ -79,4 +86,551 @@ TEST_CASE("Perft position 7", "[.Move_generator]")
   uint64_t expected{865305};
   test_perft(fen_str, depth, expected);
 }
+
+// Compares filtering pseudo legal moves by making each one, filtering them with the attack info and
+// generating only legal moves
+TEST_CASE("Legality_check_speed", "[.Move_generator]")
+{
+  constexpr int c_iterations{20'000};
+  std::array<std::string_view, 4> const fens{
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+  };
+  std::vector<Board> boards;
+  rs::transform(fens, std::back_inserter(boards),
+                [](auto fen)
+                {
+                  return *Board::from_fen(fen);
+                });
+
+  size_t make_move_count{0};
+  auto start = std::chrono::steady_clock::now();
+  for (int i{0}; i < c_iterations; ++i)
+  {
+    for (auto const& board : boards)
+    {
+      for (auto const move : Move_generator::generate_pseudo_legal_moves(board))
+      {
+        Board tmp_board{board};
+        make_move_count += !tmp_board.move_results_in_check_destructive(move);
+      }
+    }
+  }
+  std::chrono::duration<double> const make_move_elapsed = std::chrono::steady_clock::now() - start;
+
+  size_t attack_info_count{0};
+  start = std::chrono::steady_clock::now();
+  for (int i{0}; i < c_iterations; ++i)
+  {
+    for (auto const& board : boards)
+    {
+      auto const info = Move_generator::get_attack_info(board);
+      for (auto const move : Move_generator::generate_pseudo_legal_moves(board, info))
+      {
+        attack_info_count += Move_generator::is_legal(board, info, move);
+      }
+    }
+  }
+  std::chrono::duration<double> const attack_info_elapsed = std::chrono::steady_clock::now() - start;
+
+  size_t legal_count{0};
+  start = std::chrono::steady_clock::now();
+  for (int i{0}; i < c_iterations; ++i)
+  {
+    for (auto const& board : boards)
+    {
+      legal_count += Move_generator::generate_legal_moves(board).size();
+    }
+  }
+  std::chrono::duration<double> const legal_elapsed = std::chrono::steady_clock::now() - start;
+
+  auto const positions = static_cast<double>(c_iterations * fens.size());
+  std::cout << "Make move: " << 1e9 * make_move_elapsed.count() / positions << " ns/position\n";
+  std::cout << "Attack info: " << 1e9 * attack_info_elapsed.count() / positions << " ns/position\n";
+  std::cout << "Legal generator: " << 1e9 * legal_elapsed.count() / positions << " ns/position\n";
+  REQUIRE(make_move_count == attack_info_count);
+  REQUIRE(make_move_count == legal_count);
+}
+
+TEST_CASE("Slider backends", "[Move_generator]")
+{
+  auto const original_backend = Move_generator::get_slider_backend();
+
+  auto const& tables = Move_generator::m_tables;
+
+  for (auto const backend : {Slider_backend::plain_magic, Slider_backend::fancy_magic, Slider_backend::pext})
+  {
+    CAPTURE(backend);
+    if (!Move_generator::set_slider_backend(backend))
+    {
+      REQUIRE(!Move_generator::is_supported(backend));
+      continue;
+    }
+
+    for (int square{0}; square < c_board_dimension_squared; ++square)
+    {
+      CAPTURE(square);
+      Bitboard const slider{1ULL << square};
+      for (auto const piece : {Piece::bishop, Piece::rook})
+      {
+        CAPTURE(piece);
+        auto const mask = (piece == Piece::rook) ? tables.rook_possible_blockers[square].val
+                                                 : tables.bishop_possible_blockers[square].val;
+
+        // Every subset of the possible blockers, walked with the carry-rippler
+        // trick, checked against the fills, which don't use any tables
+        uint64_t blockers{0};
+        do
+        {
+          Bitboard const occupied{blockers};
+          auto const fill = Slider_fill::get_group_attacks_scalar(
+            (piece == Piece::rook) ? slider : Bitboard{}, (piece == Piece::bishop) ? slider : Bitboard{}, {}, occupied);
+          auto const expected = (piece == Piece::rook) ? fill.rooks : fill.bishops;
+          auto const attacks = Move_generator::get_piece_attacks(piece, Coordinates{square}, occupied);
+          if (attacks != expected)
+          {
+            CAPTURE(blockers);
+            REQUIRE(attacks == expected);
+          }
+          blockers = (blockers - mask) & mask;
+        } while (blockers != 0);
+      }
+    }
+
+    test_perft("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3, 97'862);
+  }
+
+  Move_generator::set_slider_backend(original_backend);
+}
+
+TEST_CASE("Perft with threads and a table", "[Move_generator]")
+{
+  auto const board = *Board::from_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  std::atomic_flag is_cancelled{};
+
+  Perft single_thread;
+  REQUIRE(single_thread.count(0, board, is_cancelled) == 1);
+  REQUIRE(single_thread.count(1, board, is_cancelled) == 48);
+  REQUIRE(single_thread.count(3, board, is_cancelled) == 97'862);
+
+  // Run twice so the second count comes from the table
+  Perft hashed{4, 1024 * 1024};
+  REQUIRE(hashed.count(3, board, is_cancelled) == 97'862);
+  REQUIRE(hashed.count(3, board, is_cancelled) == 97'862);
+  REQUIRE(hashed.count(4, board, is_cancelled) == 4'085'603);
+
+  auto const entries = hashed.divide(3, board, is_cancelled);
+  REQUIRE(entries.size() == 48);
+  uint64_t total{0};
+  for (auto const& entry : entries)
+  {
+    total += entry.nodes;
+  }
+  REQUIRE(total == 97'862);
+}
+
+TEST_CASE("Perft suite", "[Move_generator]")
+{
+  auto const positions = Perft::load_suite("./data/perftsuite.epd");
+  REQUIRE(positions);
+  REQUIRE(positions->size() > 30);
+
+  Perft perft{2, 1024 * 1024};
+  std::atomic_flag is_cancelled{};
+  for (auto const& position : *positions)
+  {
+    auto const board = Board::from_fen(position.fen);
+    REQUIRE(board);
+    for (size_t depth{1}; depth <= position.expected_nodes.size() && position.expected_nodes[depth - 1] < 100'000;
+         ++depth)
+    {
+      REQUIRE(perft.count(static_cast<int>(depth), *board, is_cancelled) == position.expected_nodes[depth - 1]);
+    }
+  }
+
+  REQUIRE(!Perft::load_suite("./data/no_such_file.epd"));
+}
+
+TEST_CASE("Perft checker", "[Move_generator]")
+{
+  std::string_view const kiwipete{"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"};
+  REQUIRE(Perft_checker::reference_perft(c_start_position_fen, 4) == 197'281);
+  REQUIRE(Perft_checker::reference_perft(kiwipete, 3) == 97'862);
+  REQUIRE(Perft_checker::reference_perft("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4) == 43'238);
+
+  auto const result = Perft_checker::check(kiwipete, 3, 2);
+  REQUIRE(result);
+  REQUIRE(!result->mismatch);
+  REQUIRE(result->nodes == 97'862);
+
+  auto const promotions = Perft_checker::check("n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1", 3, 1);
+  REQUIRE(promotions);
+  REQUIRE(!promotions->mismatch);
+  REQUIRE(promotions->nodes == 9'483);
+
+  REQUIRE(!Perft_checker::check("not a fen", 2, 1));
+}
+
+TEST_CASE("Perft checker reports mismatches", "[Move_generator]")
+{
+  std::string_view const kiwipete{"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"};
+  auto target = *Board::from_fen(kiwipete);
+  REQUIRE(target.try_move_uci("a2a3"));
+  REQUIRE(target.try_move_uci("b4b3"));
+  auto const target_key = target.get_hash_key();
+
+  SECTION("A missing move")
+  {
+    auto const result = Perft_checker::check(kiwipete, 3, 2,
+                                             [&](Board const& board, Move_list& moves)
+                                             {
+                                               if (board.get_hash_key() != target_key)
+                                               {
+                                                 return;
+                                               }
+                                               Move_list kept;
+                                               for (auto const m : moves)
+                                               {
+                                                 if (move_to_string(m) != "e1g1")
+                                                 {
+                                                   kept.push_back(m);
+                                                 }
+                                               }
+                                               moves = kept;
+                                             });
+    REQUIRE(result);
+    REQUIRE(result->mismatch);
+    REQUIRE(result->mismatch->fen == target.to_fen());
+    REQUIRE(result->mismatch->path == std::vector<std::string>{"a2a3", "b4b3"});
+    REQUIRE(result->mismatch->missing_moves == std::vector<std::string>{"e1g1"});
+    REQUIRE(result->mismatch->extra_moves.empty());
+  }
+
+  SECTION("A move generated twice")
+  {
+    auto const result = Perft_checker::check(kiwipete, 3, 1,
+                                             [&](Board const& board, Move_list& moves)
+                                             {
+                                               if (board.get_hash_key() == target_key)
+                                               {
+                                                 moves.push_back(moves.front());
+                                               }
+                                             });
+    REQUIRE(result);
+    REQUIRE(result->mismatch);
+    REQUIRE(result->mismatch->path == std::vector<std::string>{"a2a3", "b4b3"});
+    REQUIRE(result->mismatch->missing_moves.empty());
+    REQUIRE(result->mismatch->extra_moves.size() == 1);
+  }
+}
+
+// Compares perft speed with each way of looking up slider attacks. The
+// backends take turns so noise from other processes affects them equally.
+TEST_CASE("Slider_backend_speed", "[.Move_generator]")
+{
+  constexpr int c_rounds{5};
+  constexpr std::array backends{Slider_backend::plain_magic, Slider_backend::fancy_magic, Slider_backend::pext};
+  auto const original_backend = Move_generator::get_slider_backend();
+  std::cout << "Best backend: " << Move_generator::get_best_slider_backend() << "\n";
+
+  std::array<double, backends.size()> best_nodes_per_second{};
+  for (int round{0}; round < c_rounds; ++round)
+  {
+    for (size_t i{0}; i < backends.size(); ++i)
+    {
+      if (!Move_generator::set_slider_backend(backends[i]))
+      {
+        continue;
+      }
+
+      auto board = *Board::from_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+      std::atomic_flag is_cancelled{};
+      auto const start = std::chrono::steady_clock::now();
+      auto const nodes = Move_generator::perft(4, board, is_cancelled);
+      std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+      best_nodes_per_second[i] = std::max(best_nodes_per_second[i], static_cast<double>(nodes) / elapsed.count());
+      REQUIRE(nodes == 4'085'603);
+    }
+  }
+
+  for (size_t i{0}; i < backends.size(); ++i)
+  {
+    if (Move_generator::is_supported(backends[i]))
+    {
+      std::cout << backends[i] << ": " << best_nodes_per_second[i] / 1e6 << "M nodes/s\n";
+    }
+    else
+    {
+      std::cout << backends[i] << ": not supported\n";
+    }
+  }
+
+  Move_generator::set_slider_backend(original_backend);
+}
+
+// Compares computing every slider attack of both sides, like evaluation does,
+// with one magic lookup per piece against the set-wise fills
+TEST_CASE("Slider_fill_speed", "[.Move_generator]")
+{
+  constexpr int c_iterations{200'000};
+  std::array<std::string_view, 4> const fens{
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N2N2/PP2BPPP/R2QKB1R w KQ - 0 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+  };
+  std::vector<Board> boards;
+  rs::transform(fens, std::back_inserter(boards),
+                [](auto fen)
+                {
+                  return *Board::from_fen(fen);
+                });
+
+  auto const time = [&](std::string_view name, auto get_attacks)
+  {
+    uint64_t checksum{0};
+    auto const start = std::chrono::steady_clock::now();
+    for (int i{0}; i < c_iterations; ++i)
+    {
+      for (auto const& board : boards)
+      {
+        for (auto const color : {Color::black, Color::white})
+        {
+          auto const attacks = get_attacks(board, color);
+          checksum += (attacks.rooks | attacks.bishops | attacks.queens).val;
+        }
+      }
+    }
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+    auto const positions = static_cast<double>(c_iterations * fens.size());
+    std::cout << name << ": " << 1e9 * elapsed.count() / positions << " ns/position\n";
+    return checksum;
+  };
+
+  auto const magics = time("Magic lookups",
+                           [](Board const& board, Color color)
+                           {
+                             auto const occupied = board.get_occupied_squares();
+                             Slider_group_attacks result;
+                             for (auto const [piece, attacks] :
+                                  {std::pair{Piece::rook, &result.rooks}, std::pair{Piece::bishop, &result.bishops},
+                                   std::pair{Piece::queen, &result.queens}})
+                             {
+                               for (auto const location : board.get_piece_set(color, piece))
+                               {
+                                 *attacks |= Move_generator::get_piece_attacks(piece, Coordinates{location}, occupied);
+                               }
+                             }
+                             return result;
+                           });
+
+  auto const group_attacks = [](auto fill)
+  {
+    return [fill](Board const& board, Color color)
+    {
+      return fill(board.get_piece_set(color, Piece::rook), board.get_piece_set(color, Piece::bishop),
+                  board.get_piece_set(color, Piece::queen), board.get_occupied_squares());
+    };
+  };
+  auto const scalar = time("Kogge-Stone scalar", group_attacks(&Slider_fill::get_group_attacks_scalar));
+  REQUIRE(scalar == magics);
+
+  if (Slider_fill::has_avx2())
+  {
+    auto const avx2 = time("Kogge-Stone avx2", group_attacks(&Slider_fill::get_group_attacks_avx2));
+    REQUIRE(avx2 == magics);
+  }
+}
+
+TEST_CASE("Bulk counting", "[Move_generator]")
+{
+  auto const boards = random_game_positions(2'000);
+  std::vector<uint32_t> expected;
+  rs::transform(boards, std::back_inserter(expected),
+                [](Board const& board)
+                {
+                  return static_cast<uint32_t>(Move_generator::generate_legal_moves(board).size());
+                });
+
+  // An odd number of boards leaves some lanes of the last batch empty
+  auto const check = [&](auto count_legal_moves)
+  {
+    std::vector<uint32_t> counts(boards.size() - 3);
+    count_legal_moves(std::span{boards}.first(counts.size()), counts);
+    for (size_t i{0}; i < counts.size(); ++i)
+    {
+      CAPTURE(boards[i].to_fen());
+      REQUIRE(counts[i] == expected[i]);
+    }
+  };
+
+  check(&Move_counter::count_legal_moves_scalar);
+  if (Move_counter::has_avx2())
+  {
+    check(&Move_counter::count_legal_moves_avx2);
+  }
+  if (Move_counter::has_avx512())
+  {
+    check(&Move_counter::count_legal_moves_avx512);
+  }
+  check([](std::span<Board const> batch, std::span<uint32_t> counts)
+        {
+          Move_counter::count_legal_moves(batch, counts);
+        });
+
+  auto board = *Board::from_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  std::atomic_flag is_cancelled{};
+  REQUIRE(Move_counter::perft(1, board, is_cancelled) == 48);
+  REQUIRE(Move_counter::perft(3, board, is_cancelled) == 97'862);
+}
+
+// Leaf nodes per second of perft making every move against counting the last
+// ply in batches, and the time to count one position with each batch width
+TEST_CASE("Bulk_counting_speed", "[.Move_generator]")
+{
+  constexpr int c_rounds{3};
+  auto board = *Board::from_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  std::cout << "Batch size: " << Move_counter::get_batch_size() << "\n";
+
+  auto const nodes_per_second = [&](auto perft)
+  {
+    double best{0};
+    for (int round{0}; round < c_rounds; ++round)
+    {
+      std::atomic_flag is_cancelled{};
+      auto const start = std::chrono::steady_clock::now();
+      auto const nodes = perft(4, board, is_cancelled);
+      std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+      best = std::max(best, static_cast<double>(nodes) / elapsed.count());
+      REQUIRE(nodes == 4'085'603);
+    }
+    return best;
+  };
+  std::cout << "Move_generator::perft: " << nodes_per_second(&Move_generator::perft) / 1e6 << "M nodes/s\n";
+  std::cout << "Move_counter::perft: " << nodes_per_second(&Move_counter::perft) / 1e6 << "M nodes/s\n";
+
+  auto const boards = random_game_positions(4'096);
+  std::vector<uint32_t> counts(boards.size());
+  auto const time = [&](std::string_view name, auto count_legal_moves)
+  {
+    constexpr int c_iterations{100};
+    auto const start = std::chrono::steady_clock::now();
+    for (int i{0}; i < c_iterations; ++i)
+    {
+      count_legal_moves(boards, counts);
+    }
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+    auto const positions = static_cast<double>(c_iterations * boards.size());
+    std::cout << name << ": " << 1e9 * elapsed.count() / positions << " ns/position\n";
+  };
+
+  time("Move generation",
+       [](std::span<Board const> batch, std::span<uint32_t> result)
+       {
+         Move_list moves;
+         for (size_t i{0}; i < batch.size(); ++i)
+         {
+           moves.clear();
+           Move_generator::generate_legal_moves(batch[i], moves);
+           result[i] = static_cast<uint32_t>(moves.size());
+         }
+       });
+  time("Counting scalar", &Move_counter::count_legal_moves_scalar);
+  if (Move_counter::has_avx2())
+  {
+    time("Counting avx2", &Move_counter::count_legal_moves_avx2);
+  }
+  if (Move_counter::has_avx512())
+  {
+    time("Counting avx512", &Move_counter::count_legal_moves_avx512);
+  }
+}
+
+// Size of a board against the cost of looking up what stands on a square,
+// which perft pays for every capture, and of copying a board, which search
+// pays for every node
+TEST_CASE("Piece_lookup_speed", "[.Move_generator]")
+{
+  constexpr int c_iterations{100};
+  auto const boards = random_game_positions(4'096);
+  std::cout << "sizeof(Board): " << sizeof(Board) << " bytes\n";
+
+  auto const time = [&](std::string_view name, auto operation)
+  {
+    uint64_t checksum{0};
+    auto const start = std::chrono::steady_clock::now();
+    for (int i{0}; i < c_iterations; ++i)
+    {
+      for (auto const& board : boards)
+      {
+        checksum += operation(board);
+      }
+    }
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+    auto const positions = static_cast<double>(c_iterations * boards.size());
+    std::cout << name << ": " << 1e9 * elapsed.count() / positions << " ns/position (" << checksum << ")\n";
+  };
+
+  time("get_piece on 64 squares",
+       [](Board const& board)
+       {
+         uint64_t sum{0};
+         for (int32_t square{0}; square < c_board_dimension_squared; ++square)
+         {
+           sum += static_cast<uint8_t>(board.get_piece(Coordinates{square}));
+         }
+         return sum;
+       });
+  std::vector<Board> copies(boards.size(), Board{});
+  size_t copy_index{0};
+  time("Board copy",
+       [&](Board const& board)
+       {
+         auto& copy = copies[copy_index++ % copies.size()];
+         copy = board;
+         return copy.get_move_count();
+       });
+
+  auto board = *Board::from_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  std::atomic_flag is_cancelled{};
+  auto const start = std::chrono::steady_clock::now();
+  REQUIRE(Move_generator::perft(4, board, is_cancelled) == 4'085'603);
+  std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Move_generator::perft: " << 4'085'603 / elapsed.count() / 1e6 << "M nodes/s\n";
+}
+
+// Time to make every legal move of a set of positions, without generating
+// them again or counting anything, to isolate the board update
+TEST_CASE("Make_move_speed", "[.Move_generator]")
+{
+  constexpr int c_iterations{20};
+  auto const boards = random_game_positions(4'096);
+  std::vector<Move_list> moves(boards.size());
+  size_t move_count{0};
+  for (size_t i{0}; i < boards.size(); ++i)
+  {
+    Move_generator::generate_legal_moves(boards[i], moves[i]);
+    move_count += moves[i].size();
+  }
+
+  uint64_t checksum{0};
+  auto const start = std::chrono::steady_clock::now();
+  for (int iteration{0}; iteration < c_iterations; ++iteration)
+  {
+    for (size_t i{0}; i < boards.size(); ++i)
+    {
+      for (auto const m : moves[i])
+      {
+        auto board = boards[i];
+        board.move_no_verify(m);
+        checksum += board.get_hash_key();
+      }
+    }
+  }
+  std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Make move: " << 1e9 * elapsed.count() / static_cast<double>(c_iterations * move_count)
+            << " ns/move (" << checksum << ")\n";
+}
 } // namespace Meneldor
@@ -0,0 +1,812 @@
+#include "syzygy_writer.h"
+#include "move_generator.h"
+
+// Writes the layout read by syzygy.cpp, which follows the reference code at
+// https://github.com/syzygy1/tb
+
+namespace rs = std::ranges;
+namespace Meneldor
+{
+namespace
+{
+constexpr std::array<uint8_t, 4> c_wdl_magic{0x71, 0xE8, 0x23, 0x5D};
+constexpr std::array<uint8_t, 4> c_dtz_magic{0xD7, 0x66, 0x0C, 0xA5};
+
+// Flags for the whole file
+constexpr uint8_t c_flag_split{1};
+constexpr uint8_t c_flag_has_pawns{2};
+
+// Flags for each sub-table
+constexpr uint8_t c_flag_side_to_move{1};
+constexpr uint8_t c_flag_mapped{2};
+constexpr uint8_t c_flag_win_plies{4};
+constexpr uint8_t c_flag_loss_plies{8};
+constexpr uint8_t c_flag_single_value{128};
+
+constexpr uint8_t c_black_piece_bit{8};
+constexpr uint16_t c_leaf_symbol{0xFFF};
+
+// Small blocks and a short span, so even three piece tables need many blocks
+// and sparse index entries
+constexpr uint8_t c_block_size_bits{6};
+constexpr uint8_t c_span_bits{6};
+constexpr size_t c_block_size{size_t{1} << c_block_size_bits};
+constexpr size_t c_span{size_t{1} << c_span_bits};
+
+constexpr size_t c_max_pair_rounds{32};
+constexpr size_t c_min_pair_count{8};
+constexpr size_t c_max_symbol_values{256};
+constexpr size_t c_max_block_values{size_t{1} << 16};
+constexpr int32_t c_max_code_length{32};
+
+// Table slots that no position maps to can hold any value
+constexpr int32_t c_unused{std::numeric_limits<int32_t>::min()};
+
+// Two kings and a piece that isn't doubled, with the piece in the a1-d1-d4 triangle
+constexpr uint64_t c_unique_pieces_size{31'332};
+
+// Ranks 2 to 7 for a single leading pawn
+constexpr uint64_t c_lead_pawn_size{6};
+
+constexpr int32_t file_of(int32_t square)
+{
+  return square & 7;
+}
+
+constexpr int32_t rank_of(int32_t square)
+{
+  return square >> 3;
+}
+
+constexpr int32_t off_diagonal(int32_t square)
+{
+  return rank_of(square) - file_of(square);
+}
+
+constexpr uint8_t piece_code(Color color, Piece piece)
+{
+  return static_cast<uint8_t>(static_cast<uint8_t>(piece) - static_cast<uint8_t>(Piece::pawn) + 1 +
+                              ((color == Color::black) ? c_black_piece_bit : 0));
+}
+
+uint64_t binomial(int32_t n, int32_t k)
+{
+  if (k < 0 || n < k)
+  {
+    return 0;
+  }
+  uint64_t result{1};
+  for (int32_t i{1}; i <= k; ++i)
+  {
+    result = result * static_cast<uint64_t>(n - k + i) / static_cast<uint64_t>(i);
+  }
+  return result;
+}
+
+// The a1-d1-d4 triangle below the diagonal comes first, then the diagonal
+int32_t map_a1d1d4(int32_t square)
+{
+  int32_t index{0};
+  for (bool const diagonal : {false, true})
+  {
+    for (int32_t other{0}; other <= d4.square_index(); ++other)
+    {
+      if (file_of(other) > 3 || off_diagonal(other) > 0 || (off_diagonal(other) == 0) != diagonal)
+      {
+        continue;
+      }
+      if (other == square)
+      {
+        return index;
+      }
+      ++index;
+    }
+  }
+  return -1;
+}
+
+// Squares below the a1-h8 diagonal, in order
+int32_t map_b1h1h7(int32_t square)
+{
+  int32_t index{0};
+  for (int32_t other{0}; other < square; ++other)
+  {
+    index += (off_diagonal(other) < 0) ? 1 : 0;
+  }
+  return index;
+}
+
+// The order pieces are encoded in and how they are grouped. The first group
+// is the leading pawn, or a piece that isn't doubled along with both kings.
+struct Layout
+{
+  bool has_pawns{false};
+  std::vector<uint8_t> pieces;
+  std::vector<size_t> group_lengths;
+
+  // Where each piece is in a Tablebase_position
+  std::vector<size_t> slots;
+};
+
+tl::expected<Layout, std::string> make_layout(Tablebase_table const& table)
+{
+  Layout layout;
+  layout.has_pawns = table.has_pawns();
+  auto const pieces = table.get_pieces();
+
+  std::optional<size_t> leader;
+  for (size_t i{0}; i < pieces.size() && !leader; ++i)
+  {
+    auto const count = rs::count(pieces, pieces[i]);
+    if (layout.has_pawns ? pieces[i].second == Piece::pawn : count == 1)
+    {
+      leader = i;
+    }
+  }
+  auto const pawn_count = rs::count_if(pieces,
+                                       [](auto const& piece)
+                                       {
+                                         return piece.second == Piece::pawn;
+                                       });
+  if (!leader || pawn_count > 1)
+  {
+    return tl::unexpected("Can't write " + table.get_name() + " as a Syzygy table");
+  }
+
+  auto add_piece = [&](Color color, Piece piece, size_t slot)
+  {
+    layout.pieces.push_back(piece_code(color, piece));
+    layout.slots.push_back(slot);
+  };
+  add_piece(pieces[*leader].first, pieces[*leader].second, *leader + 2);
+  add_piece(Color::white, Piece::king, 0);
+  add_piece(Color::black, Piece::king, 1);
+  for (size_t i{0}; i < pieces.size(); ++i)
+  {
+    if (i != *leader)
+    {
+      add_piece(pieces[i].first, pieces[i].second, i + 2);
+    }
+  }
+
+  layout.group_lengths.push_back(layout.has_pawns ? 1 : 3);
+  for (auto i = layout.group_lengths.front(); i < layout.pieces.size(); ++i)
+  {
+    if (i > layout.group_lengths.front() && layout.pieces[i] == layout.pieces[i - 1])
+    {
+      ++layout.group_lengths.back();
+    }
+    else
+    {
+      layout.group_lengths.push_back(1);
+    }
+  }
+  return layout;
+}
+
+// The leading piece in the a1-d1-d4 triangle, and the first of the leading
+// group off the a1-h8 diagonal below it
+bool is_canonical(std::span<int32_t const> squares)
+{
+  if (file_of(squares[0]) > 3 || rank_of(squares[0]) > 3 || off_diagonal(squares[0]) > 0)
+  {
+    return false;
+  }
+  for (size_t i{0}; i < 3; ++i)
+  {
+    if (off_diagonal(squares[i]) != 0)
+    {
+      return off_diagonal(squares[i]) < 0;
+    }
+  }
+  return true;
+}
+
+uint64_t unique_pieces_index(int32_t s0, int32_t s1, int32_t s2)
+{
+  auto const adjust1 = (s1 > s0) ? 1 : 0;
+  auto const adjust2 = ((s2 > s0) ? 1 : 0) + ((s2 > s1) ? 1 : 0);
+  int64_t index{0};
+  if (off_diagonal(s0) != 0)
+  {
+    index = (map_a1d1d4(s0) * 63 + s1 - adjust1) * 62 + s2 - adjust2;
+  }
+  else if (off_diagonal(s1) != 0)
+  {
+    index = (6 * 63 + rank_of(s0) * 28 + map_b1h1h7(s1)) * 62 + s2 - adjust2;
+  }
+  else if (off_diagonal(s2) != 0)
+  {
+    index = 6 * 63 * 62 + 4 * 28 * 62 + rank_of(s0) * 7 * 28 + (rank_of(s1) - adjust1) * 28 + map_b1h1h7(s2);
+  }
+  else
+  {
+    index = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + rank_of(s0) * 7 * 6 + (rank_of(s1) - adjust1) * 6 +
+            rank_of(s2) - adjust2;
+  }
+  return static_cast<uint64_t>(index);
+}
+
+// Sizes of each group, in layout order
+std::vector<uint64_t> group_sizes(Layout const& layout)
+{
+  std::vector<uint64_t> result{layout.has_pawns ? c_lead_pawn_size : c_unique_pieces_size};
+  auto free_squares = c_board_dimension_squared - static_cast<int32_t>(layout.group_lengths.front());
+  for (size_t group{1}; group < layout.group_lengths.size(); ++group)
+  {
+    auto const length = static_cast<int32_t>(layout.group_lengths[group]);
+    result.push_back(binomial(free_squares, length));
+    free_squares -= length;
+  }
+  return result;
+}
+
+// Groups are multiplied in layout order, except that the leading group is
+// moved to position order
+uint64_t combine_groups(std::span<uint64_t const> indices, std::span<uint64_t const> sizes, size_t order)
+{
+  uint64_t result{0};
+  uint64_t factor{1};
+  size_t next{1};
+  for (size_t k{0}; k < sizes.size(); ++k)
+  {
+    auto const group = (k == order) ? 0 : next++;
+    result += indices[group] * factor;
+    factor *= sizes[group];
+  }
+  return result;
+}
+
+uint64_t table_size(Layout const& layout)
+{
+  auto const sizes = group_sizes(layout);
+  return std::accumulate(sizes.begin(), sizes.end(), uint64_t{1}, std::multiplies{});
+}
+
+// The sub-table, which is the leading pawn's file, and the index of a position
+std::pair<size_t, uint64_t> encode_position(Layout const& layout, std::vector<int32_t> squares, size_t order)
+{
+  size_t file{0};
+  std::vector<uint64_t> indices;
+  if (layout.has_pawns)
+  {
+    if (file_of(squares[0]) > 3)
+    {
+      for (auto& square : squares)
+      {
+        square ^= 7;
+      }
+    }
+    file = static_cast<size_t>(file_of(squares[0]));
+    indices.push_back(static_cast<uint64_t>(rank_of(squares[0]) - 1));
+  }
+  else
+  {
+    for (int32_t symmetry{0}; symmetry < 8; ++symmetry)
+    {
+      auto transformed = squares;
+      for (auto& square : transformed)
+      {
+        square = (symmetry & 4) ? ((square >> 3) | (square << 3)) & 63 : square;
+        square ^= ((symmetry & 1) ? 7 : 0) | ((symmetry & 2) ? 56 : 0);
+      }
+      if (is_canonical(transformed))
+      {
+        squares = transformed;
+        break;
+      }
+    }
+    indices.push_back(unique_pieces_index(squares[0], squares[1], squares[2]));
+  }
+
+  // Each group's squares are a combination of the squares earlier groups left free
+  auto start = layout.group_lengths.front();
+  for (size_t group{1}; group < layout.group_lengths.size(); ++group)
+  {
+    auto const end = start + layout.group_lengths[group];
+    std::sort(squares.begin() + static_cast<ptrdiff_t>(start), squares.begin() + static_cast<ptrdiff_t>(end));
+    uint64_t index{0};
+    for (auto i = start; i < end; ++i)
+    {
+      auto const taken = std::count_if(squares.begin(), squares.begin() + static_cast<ptrdiff_t>(start),
+                                       [&](int32_t square)
+                                       {
+                                         return square < squares[i];
+                                       });
+      index += binomial(squares[i] - static_cast<int32_t>(taken), static_cast<int32_t>(i - start + 1));
+    }
+    indices.push_back(index);
+    start = end;
+  }
+  return {file, combine_groups(indices, group_sizes(layout), order)};
+}
+
+void append_u16(std::vector<uint8_t>& out, size_t value)
+{
+  out.push_back(static_cast<uint8_t>(value));
+  out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void append_u32(std::vector<uint8_t>& out, size_t value)
+{
+  append_u16(out, value & 0xFFFF);
+  append_u16(out, value >> 16);
+}
+
+void align(std::vector<uint8_t>& out, size_t alignment)
+{
+  out.resize((out.size() + alignment - 1) / alignment * alignment);
+}
+
+// The parts of one sub-table, which are stored apart in the file
+struct Compressed_table
+{
+  std::vector<uint8_t> header;
+  std::vector<uint8_t> sparse_index;
+  std::vector<uint8_t> block_lengths;
+  std::vector<uint8_t> data;
+};
+
+struct Symbol
+{
+  uint16_t left{0};
+  uint16_t right{c_leaf_symbol};
+  size_t value_count{1};
+};
+
+// Replaces the most common neighboring symbols with a new symbol, a few
+// dozen times, then writes the symbols with canonical Huffman codes
+tl::expected<Compressed_table, std::string> compress(std::span<uint8_t const> values, uint8_t flags)
+{
+  Compressed_table result;
+  std::vector<Symbol> symbols;
+  std::array<int32_t, 256> leaf_symbols;
+  rs::fill(leaf_symbols, -1);
+  std::vector<uint16_t> text;
+  for (auto const value : values)
+  {
+    if (leaf_symbols[value] < 0)
+    {
+      leaf_symbols[value] = static_cast<int32_t>(symbols.size());
+      symbols.push_back({.left = value});
+    }
+    text.push_back(static_cast<uint16_t>(leaf_symbols[value]));
+  }
+
+  if (symbols.size() == 1)
+  {
+    result.header = {static_cast<uint8_t>(flags | c_flag_single_value), values.front()};
+    return result;
+  }
+
+  for (size_t round{0}; round < c_max_pair_rounds; ++round)
+  {
+    std::unordered_map<uint32_t, size_t> counts;
+    for (size_t i{0}; i + 1 < text.size(); ++i)
+    {
+      if (symbols[text[i]].value_count + symbols[text[i + 1]].value_count <= c_max_symbol_values)
+      {
+        ++counts[(static_cast<uint32_t>(text[i]) << 16) | text[i + 1]];
+      }
+    }
+    auto const best = rs::max_element(counts,
+                                      [](auto const& lhs, auto const& rhs)
+                                      {
+                                        return lhs.second < rhs.second || (lhs.second == rhs.second && lhs.first > rhs.first);
+                                      });
+    if (best == counts.end() || best->second < c_min_pair_count)
+    {
+      break;
+    }
+
+    auto const left = static_cast<uint16_t>(best->first >> 16);
+    auto const right = static_cast<uint16_t>(best->first & 0xFFFF);
+    auto const pair = static_cast<uint16_t>(symbols.size());
+    symbols.push_back({left, right, symbols[left].value_count + symbols[right].value_count});
+    std::vector<uint16_t> next;
+    for (size_t i{0}; i < text.size();)
+    {
+      if (i + 1 < text.size() && text[i] == left && text[i + 1] == right)
+      {
+        next.push_back(pair);
+        i += 2;
+      }
+      else
+      {
+        next.push_back(text[i++]);
+      }
+    }
+    text.swap(next);
+  }
+
+  // Huffman code lengths. Merging two nodes makes every code under them one
+  // bit longer.
+  std::vector<size_t> frequencies(symbols.size());
+  for (auto const symbol : text)
+  {
+    ++frequencies[symbol];
+  }
+  std::vector<int32_t> lengths(symbols.size());
+  std::multimap<size_t, std::vector<uint16_t>> nodes;
+  for (size_t symbol{0}; symbol < symbols.size(); ++symbol)
+  {
+    if (frequencies[symbol] > 0)
+    {
+      nodes.emplace(frequencies[symbol], std::vector{static_cast<uint16_t>(symbol)});
+    }
+  }
+  if (nodes.size() == 1)
+  {
+    lengths[nodes.begin()->second.front()] = 1;
+  }
+  while (nodes.size() > 1)
+  {
+    auto first = nodes.extract(nodes.begin());
+    auto second = nodes.extract(nodes.begin());
+    auto merged = std::move(first.mapped());
+    merged.insert(merged.end(), second.mapped().begin(), second.mapped().end());
+    for (auto const symbol : merged)
+    {
+      ++lengths[symbol];
+    }
+    nodes.emplace(first.key() + second.key(), std::move(merged));
+  }
+
+  // Codes of the same length have consecutive symbols, longest codes first,
+  // and symbols that only appear inside pairs go last
+  std::vector<uint16_t> order(symbols.size());
+  std::iota(order.begin(), order.end(), uint16_t{0});
+  rs::stable_sort(order,
+                  [&](uint16_t lhs, uint16_t rhs)
+                  {
+                    return lengths[lhs] > lengths[rhs];
+                  });
+  std::vector<uint16_t> renumbered(symbols.size());
+  for (size_t i{0}; i < order.size(); ++i)
+  {
+    renumbered[order[i]] = static_cast<uint16_t>(i);
+  }
+
+  auto const max_length = rs::max(lengths);
+  auto const min_length = rs::min(lengths | std::views::filter(
+                                             [](int32_t length)
+                                             {
+                                               return length > 0;
+                                             }));
+  if (max_length > c_max_code_length || symbols.size() >= c_leaf_symbol)
+  {
+    return tl::unexpected(std::string{"Too many symbols to compress"});
+  }
+
+  // Indexed by length. The longest codes start at zero, and each shorter
+  // length starts at half of where the longer codes end.
+  std::vector<size_t> counts(static_cast<size_t>(max_length) + 2);
+  for (auto const length : lengths)
+  {
+    ++counts[static_cast<size_t>(length)];
+  }
+  std::vector<size_t> lowest_symbols(counts.size());
+  std::vector<uint64_t> first_codes(counts.size());
+  for (auto length = max_length - 1; length >= min_length; --length)
+  {
+    auto const index = static_cast<size_t>(length);
+    lowest_symbols[index] = lowest_symbols[index + 1] + counts[index + 1];
+    first_codes[index] = (first_codes[index + 1] + counts[index + 1]) / 2;
+  }
+
+  // Symbols never span blocks, and unused bits at the end of a block are zero
+  std::vector<size_t> block_starts{0};
+  size_t block_values{0};
+  size_t bit{0};
+  result.data.resize(c_block_size);
+  for (auto const symbol : text)
+  {
+    auto const length = static_cast<size_t>(lengths[symbol]);
+    auto const value_count = symbols[symbol].value_count;
+    if (bit + length > c_block_size * 8 || block_values + value_count > c_max_block_values)
+    {
+      append_u16(result.block_lengths, block_values - 1);
+      block_starts.push_back(block_starts.back() + block_values);
+      result.data.resize(result.data.size() + c_block_size);
+      block_values = 0;
+      bit = 0;
+    }
+
+    auto const code = first_codes[length] + renumbered[symbol] - lowest_symbols[length];
+    auto* block = result.data.data() + result.data.size() - c_block_size;
+    for (auto i = length; i-- > 0; ++bit)
+    {
+      if ((code >> i) & 1)
+      {
+        block[bit / 8] = static_cast<uint8_t>(block[bit / 8] | (0x80 >> (bit % 8)));
+      }
+    }
+    block_values += value_count;
+  }
+  append_u16(result.block_lengths, block_values - 1);
+
+  // Each entry points at the value in the middle of its span
+  for (size_t k{0}; k * c_span < values.size(); ++k)
+  {
+    auto const value = k * c_span + c_span / 2;
+    auto const block = static_cast<size_t>(rs::upper_bound(block_starts, value) - block_starts.begin()) - 1;
+    auto const offset = value - block_starts[block];
+    if (offset > std::numeric_limits<uint16_t>::max())
+    {
+      return tl::unexpected(std::string{"Sparse index offset is too large"});
+    }
+    append_u32(result.sparse_index, block);
+    append_u16(result.sparse_index, offset);
+  }
+
+  auto& header = result.header;
+  header = {flags, c_block_size_bits, c_span_bits, 0};
+  append_u32(header, block_starts.size());
+  header.push_back(static_cast<uint8_t>(max_length));
+  header.push_back(static_cast<uint8_t>(min_length));
+  for (auto length = min_length; length <= max_length; ++length)
+  {
+    append_u16(header, lowest_symbols[static_cast<size_t>(length)]);
+  }
+  append_u16(header, symbols.size());
+  for (auto const old_symbol : order)
+  {
+    auto const& symbol = symbols[old_symbol];
+    auto const left = (symbol.right == c_leaf_symbol) ? symbol.left : renumbered[symbol.left];
+    auto const right = (symbol.right == c_leaf_symbol) ? c_leaf_symbol : renumbered[symbol.right];
+    header.push_back(static_cast<uint8_t>(left));
+    header.push_back(static_cast<uint8_t>(((left >> 8) & 0xF) | ((right & 0xF) << 4)));
+    header.push_back(static_cast<uint8_t>(right >> 4));
+  }
+  if (symbols.size() & 1)
+  {
+    header.push_back(0);
+  }
+  return result;
+}
+
+// Slots no position maps to repeat the value before them, which compresses well
+std::vector<uint8_t> fill_unused(std::span<int32_t const> values)
+{
+  auto const first = rs::find_if(values,
+                                 [](int32_t value)
+                                 {
+                                   return value != c_unused;
+                                 });
+  auto previous = static_cast<uint8_t>((first == values.end()) ? 0 : *first);
+  std::vector<uint8_t> result;
+  for (auto const value : values)
+  {
+    previous = (value == c_unused) ? previous : static_cast<uint8_t>(value);
+    result.push_back(previous);
+  }
+  return result;
+}
+
+tl::expected<void, std::string> write_file(std::filesystem::path const& filename,
+                                           std::array<uint8_t, 4> const& magic,
+                                           Layout const& layout,
+                                           std::span<size_t const> orders,
+                                           std::span<Compressed_table const> tables,
+                                           std::vector<uint8_t> const& dtz_map)
+{
+  auto const sides = orders.size();
+  std::vector<uint8_t> out{magic.begin(), magic.end()};
+  out.push_back(static_cast<uint8_t>(((sides == 2) ? c_flag_split : 0) | (layout.has_pawns ? c_flag_has_pawns : 0)));
+  for (size_t file{0}; file < tables.size() / sides; ++file)
+  {
+    out.push_back(static_cast<uint8_t>(orders.front() | (orders.back() << 4)));
+    for (auto const code : layout.pieces)
+    {
+      out.push_back(static_cast<uint8_t>(code | (code << 4)));
+    }
+  }
+  align(out, 2);
+
+  for (auto const& table : tables)
+  {
+    out.insert(out.end(), table.header.begin(), table.header.end());
+  }
+  if (!dtz_map.empty())
+  {
+    out.insert(out.end(), dtz_map.begin(), dtz_map.end());
+    align(out, 2);
+  }
+  for (auto const& table : tables)
+  {
+    out.insert(out.end(), table.sparse_index.begin(), table.sparse_index.end());
+  }
+  for (auto const& table : tables)
+  {
+    out.insert(out.end(), table.block_lengths.begin(), table.block_lengths.end());
+  }
+  for (auto const& table : tables)
+  {
+    align(out, 64);
+    out.insert(out.end(), table.data.begin(), table.data.end());
+  }
+
+  // Decoding reads a little past the end of a block
+  out.resize(out.size() + 64);
+  align(out, 64);
+  out.resize(out.size() + 16);
+
+  std::ofstream file{filename, std::ios::binary};
+  file.write(reinterpret_cast<char const*>(out.data()), static_cast<std::streamsize>(out.size()));
+  if (!file)
+  {
+    return tl::unexpected("Failed to write " + filename.string());
+  }
+  return {};
+}
+} // namespace
+
+std::optional<Board> board_from_position(Tablebase_table const& table, Tablebase_position const& position)
+{
+  std::array<Piece_placement, Tablebase_table::c_max_pieces> placements{};
+  placements[0] = {Color::white, Piece::king, position.squares[0]};
+  placements[1] = {Color::black, Piece::king, position.squares[1]};
+  for (size_t i{2}; i < table.get_piece_count(); ++i)
+  {
+    auto const [color, piece] = table.get_pieces()[i - 2];
+    auto const location = position.squares[i];
+    if (piece == Piece::pawn && (location.y() == 0 || location.y() == c_board_dimension - 1))
+    {
+      return {};
+    }
+    placements[i] = {color, piece, location};
+  }
+
+  auto board = Board::from_pieces(std::span{placements.data(), table.get_piece_count()}, position.side_to_move);
+  if (!board)
+  {
+    return {};
+  }
+
+  // The side that just moved can't be in check, which includes the kings touching
+  auto const waiting_color = opposite_color(position.side_to_move);
+  if (Move_generator::is_square_attacked(*board, position.side_to_move,
+                                         board->get_piece_set(waiting_color, Piece::king)))
+  {
+    return {};
+  }
+  return std::move(*board);
+}
+
+tl::expected<void, std::string> write_syzygy_table(Tablebase_table const& table,
+                                                   std::filesystem::path const& directory,
+                                                   std::optional<Color> dtz_side_to_move)
+{
+  auto const layout = make_layout(table);
+  if (!layout)
+  {
+    return tl::unexpected(layout.error());
+  }
+  if (dtz_side_to_move && (layout->has_pawns || table.get_piece_count() != 3))
+  {
+    return tl::unexpected("DTZ isn't the distance to mate in " + table.get_name());
+  }
+
+  // Each side to move has its own order, so both are checked
+  auto const group_count = layout->group_lengths.size();
+  std::array<size_t, 2> const orders{0, std::min<size_t>(1, group_count - 1)};
+  auto const file_count = layout->has_pawns ? size_t{4} : size_t{1};
+  auto const size = table_size(*layout);
+
+  // Indexed by side to move and file. WDL values are stored as 0 for a loss to
+  // 4 for a win. DTZ values are stored as plies, negative for a loss.
+  std::array<std::vector<std::vector<int32_t>>, 2> wdl_values;
+  for (auto& side : wdl_values)
+  {
+    side.assign(file_count, std::vector<int32_t>(size, c_unused));
+  }
+  std::vector<int32_t> dtz_values(size, c_unused);
+
+  auto store = [&](int32_t& slot, int32_t value) -> tl::expected<void, std::string>
+  {
+    if (slot != c_unused && slot != value)
+    {
+      return tl::unexpected("Positions with different values share an index in " + table.get_name());
+    }
+    slot = value;
+    return {};
+  };
+
+  for (size_t i{0}; i < table.size(); ++i)
+  {
+    auto const position = table.position_at(i);
+    if (!board_from_position(table, position))
+    {
+      continue;
+    }
+
+    std::vector<int32_t> squares;
+    for (auto const slot : layout->slots)
+    {
+      squares.push_back(position.squares[slot].square_index());
+    }
+    auto const side = (position.side_to_move == Color::white) ? size_t{0} : size_t{1};
+    auto const [file, index] = encode_position(*layout, squares, orders[side]);
+
+    using enum Tablebase_result::Wdl;
+    auto const result = Tablebase_table::decode(table.get_value(i));
+    auto const wdl = (result.wdl == win) ? 4 : (result.wdl == loss) ? 0 : 2;
+    if (auto const stored = store(wdl_values[side][file][index], wdl); !stored)
+    {
+      return stored;
+    }
+
+    // Being checkmated is one ply from zeroing, like mating is
+    if (position.side_to_move == dtz_side_to_move && result.wdl != draw)
+    {
+      auto const dtz = (result.wdl == win) ? result.distance_to_mate : -std::max(result.distance_to_mate, 1);
+      if (auto const stored = store(dtz_values[index], dtz); !stored)
+      {
+        return stored;
+      }
+    }
+  }
+
+  std::vector<Compressed_table> wdl_tables;
+  for (size_t file{0}; file < file_count; ++file)
+  {
+    for (auto const& side : wdl_values)
+    {
+      auto compressed = compress(fill_unused(side[file]), 0);
+      if (!compressed)
+      {
+        return tl::unexpected(compressed.error());
+      }
+      wdl_tables.push_back(std::move(*compressed));
+    }
+  }
+  auto const wdl_written = write_file(directory / (table.get_name() + ".rtbw"), c_wdl_magic, *layout, orders,
+                                      wdl_tables, {});
+  if (!wdl_written || !dtz_side_to_move)
+  {
+    return wdl_written;
+  }
+
+  // The map lists the plies before zeroing for wins, then losses, then the
+  // empty lists for results drawn by the 50 move rule. Values in the table
+  // are positions in the list for their result.
+  std::array<std::vector<int32_t>, 2> distances;
+  for (auto const dtz : dtz_values)
+  {
+    if (dtz != c_unused)
+    {
+      distances[(dtz > 0) ? 0 : 1].push_back(std::abs(dtz) - 1);
+    }
+  }
+  std::vector<uint8_t> dtz_map;
+  for (auto& list : distances)
+  {
+    rs::sort(list);
+    list.erase(std::unique(list.begin(), list.end()), list.end());
+    dtz_map.push_back(static_cast<uint8_t>(list.size()));
+    dtz_map.insert(dtz_map.end(), list.begin(), list.end());
+  }
+  dtz_map.insert(dtz_map.end(), {0, 0});
+
+  std::vector<int32_t> mapped_values;
+  for (auto const dtz : dtz_values)
+  {
+    auto const& list = distances[(dtz > 0) ? 0 : 1];
+    mapped_values.push_back((dtz == c_unused) ? c_unused :
+                                                static_cast<int32_t>(rs::lower_bound(list, std::abs(dtz) - 1) -
+                                                                     list.begin()));
+  }
+
+  auto const side_flag = (*dtz_side_to_move == Color::black) ? c_flag_side_to_move : 0;
+  auto dtz_table =
+    compress(fill_unused(mapped_values), static_cast<uint8_t>(side_flag | c_flag_mapped | c_flag_win_plies |
+                                                              c_flag_loss_plies));
+  if (!dtz_table)
+  {
+    return tl::unexpected(dtz_table.error());
+  }
+  auto const dtz_side = (*dtz_side_to_move == Color::white) ? size_t{0} : size_t{1};
+  return write_file(directory / (table.get_name() + ".rtbz"), c_dtz_magic, *layout,
+                    std::span{orders}.subspan(dtz_side, 1), std::span{&*dtz_table, 1}, dtz_map);
+}
+} // namespace Meneldor
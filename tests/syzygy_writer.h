@@ -0,0 +1,27 @@
+#ifndef SYZYGY_WRITER_H
+#define SYZYGY_WRITER_H
+
+#include "tablebase.h"
+
+namespace Meneldor
+{
+// The board for a position of a tablebase table, or nothing if the position
+// can't happen
+std::optional<Board> board_from_position(Tablebase_table const& table, Tablebase_position const& position);
+
+// Writes a table from the tablebase generator as Syzygy .rtbw and .rtbz files,
+// so the Syzygy prober can be checked against every position without the real
+// files. The files use the whole format: values are compressed into symbol
+// pairs and canonical Huffman codes, split into small blocks found through a
+// sparse index, and DTZ values go through a value map.
+//
+// Tables without pawns need a piece that isn't doubled, and tables with pawns
+// need a single pawn. The .rtbz file stores dtz_side_to_move and is only
+// written for three pieces without pawns, where nothing can be captured or
+// promoted before mate so DTZ is the distance to mate.
+tl::expected<void, std::string> write_syzygy_table(Tablebase_table const& table,
+                                                   std::filesystem::path const& directory,
+                                                   std::optional<Color> dtz_side_to_move);
+} // namespace Meneldor
+
+#endif // SYZYGY_WRITER_H
@@ -0,0 +1,34 @@
+#include "test_positions.h"
+#include "move_generator.h"
+
+namespace Meneldor
+{
+std::vector<Board> random_game_positions(size_t count)
+{
+  std::array<std::string_view, 5> const fens{
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+  };
+
+  std::mt19937_64 random{42};
+  std::vector<Board> result;
+  while (result.size() < count)
+  {
+    auto board = *Board::from_fen(fens[result.size() % fens.size()]);
+    for (int ply{0}; ply < 40 && result.size() < count; ++ply)
+    {
+      result.push_back(board);
+      auto const moves = Move_generator::generate_legal_moves(board);
+      if (moves.empty())
+      {
+        break;
+      }
+      board.move_no_verify(moves[random() % moves.size()]);
+    }
+  }
+  return result;
+}
+} // namespace Meneldor
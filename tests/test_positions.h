@@ -0,0 +1,14 @@
+#ifndef TEST_POSITIONS_H
+#define TEST_POSITIONS_H
+
+#include "board.h"
+
+namespace Meneldor
+{
+// Positions reached by random games from the perft positions, with plenty of
+// checks, pins, promotions, castling and en passant. The same count always
+// gives the same positions.
+std::vector<Board> random_game_positions(size_t count);
+} // namespace Meneldor
+
+#endif // TEST_POSITIONS_H